@@ -1,6 +1,9 @@
 /* Define if libgpgme is available */
 #cmakedefine HAVE_LIBGPGME
 
+/* Define if QCA2 is available */
+#cmakedefine HAVE_QCA2
+
 /* Define if Nepomuk is available */
 #cmakedefine HAVE_NEPOMUK
 
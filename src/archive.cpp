@@ -25,6 +25,7 @@
 #include <QtCore/QList>
 #include <QtCore/QMap>
 #include <QtCore/QDir>
+#include <QtCore/QBuffer>
 #include <QtCore/QTextStream>
 #include <QtGui/QPixmap>
 #include <QtGui/QPainter>
@@ -41,6 +42,7 @@
 #include <KDE/KProgressDialog>
 #include <KDE/KMessageBox>
 #include <KDE/KTar>
+#include <KDE/KSaveFile>
 
 #include "global.h"
 #include "bnpview.h"
@@ -52,10 +54,19 @@
 #include "tools.h"
 #include "backgroundmanager.h"
 #include "formatimporter.h"
+#include "backup.h"
+#include "parallelgzipdevice.h"
+#include "archivebrowser.h"
 
 void Archive::save(BasketScene *basket, bool withSubBaskets, const QString &destination)
 {
-    QDir dir;
+    // The archive is streamed straight to its destination: no temporary file is created, and nothing is copied twice:
+    KSaveFile file(destination);
+    if (!file.open(QIODevice::WriteOnly)) {
+        KMessageBox::error(0, i18n("Unable to write the basket archive %1.", destination), i18n("Basket Archive Error"));
+        return;
+    }
+
     KProgressDialog dialog(0, i18n("Save as Basket Archive"), i18n("Saving as basket archive. Please wait..."));
     dialog.showCancelButton(false);
     dialog.setAutoClose(true);
@@ -65,13 +76,25 @@ void Archive::save(BasketScene *basket, bool withSubBaskets, const QString &dest
     progress->setRange(0,/*Preparation:*/1 + /*Finishing:*/1 + /*Basket:*/1 + /*SubBaskets:*/(withSubBaskets ? Global::bnpView->basketCount(Global::bnpView->listViewItemForBasket(basket)) : 0));
     progress->setValue(0);
 
-    // Create the temporary folder:
-    QString tempFolder = Global::savesFolder() + "temp-archive/";
-    dir.mkdir(tempFolder);
-
-    // Create the temporary archive file:
-    QString tempDestination = tempFolder + "temp-archive.tar.gz";
-    KTar tar(tempDestination, "application/x-gzip");
+    // Write the header and the file preview:
+    QByteArray preview = previewData(basket);
+    file.write("BasKetNP:archive\n"
+               "version:0.6.1\n");
+//             "read-compatible:0.6.1\n"
+//             "write-compatible:0.6.1\n"
+    file.write("preview*:" + QByteArray::number(preview.size()) + "\n");
+    file.write(preview);
+
+    // The size of the archive is only known once it is written: reserve a fixed-width field for it, to patch it at the end
+    // (the zero-padded number is read fine by Archive::open(), even by older versions):
+    file.write("archive*:");
+    qint64 sizePosition = file.pos();
+    file.write(QByteArray(ARCHIVE_SIZE_WIDTH, '0') + "\n");
+    qint64 archiveStart = file.pos();
+
+    // Compress the tar archive on the fly, after the header:
+    ParallelGzipDevice compressor(&file, Backup::compressionLevel(), Backup::compressionThreads());
+    KTar tar(&compressor);
     tar.open(QIODevice::WriteOnly);
     tar.writeDir("baskets", "", "");
 
@@ -79,50 +102,63 @@ void Archive::save(BasketScene *basket, bool withSubBaskets, const QString &dest
 
     kDebug() << "Preparation finished out of " << progress->maximum();
 
-    // Copy the baskets data into the archive:
+    // Copy the baskets data into the archive, every basket in its own part (see IndexedArchive):
     QStringList backgrounds;
-    Archive::saveBasketToArchive(basket, withSubBaskets, &tar, backgrounds, tempFolder, progress);
+    IndexedArchive::PartList parts;
+    Archive::saveBasketToArchive(basket, withSubBaskets, &tar, &compressor, parts, backgrounds, progress);
 
     // Create a Small baskets.xml Document:
+    startPart(&compressor, parts, "metadata");
     QDomDocument document("basketTree");
     QDomElement root = document.createElement("basketTree");
     document.appendChild(root);
     Global::bnpView->saveSubHierarchy(Global::bnpView->listViewItemForBasket(basket), document, root, withSubBaskets);
-    BasketScene::safelySaveToFile(tempFolder + "baskets.xml", "<?xml version=\"1.0\" encoding=\"UTF-8\" ?>\n" + document.toString());
-    tar.addLocalFile(tempFolder + "baskets.xml", "baskets/baskets.xml");
-    dir.remove(tempFolder + "baskets.xml");
+    QByteArray basketsXml = QString("<?xml version=\"1.0\" encoding=\"UTF-8\" ?>\n" + document.toString()).toUtf8();
+    tar.writeFile("baskets/baskets.xml", "", "", basketsXml.constData(), basketsXml.size());
 
     // Save a Small tags.xml Document:
     QList<Tag*> tags;
     listUsedTags(basket, withSubBaskets, tags);
-    Tag::saveTagsTo(tags, tempFolder + "tags.xml");
-    tar.addLocalFile(tempFolder + "tags.xml", "tags.xml");
-    dir.remove(tempFolder + "tags.xml");
+    QByteArray tagsXml = Tag::tagsToXml(tags).toUtf8();
+    tar.writeFile("tags.xml", "", "", tagsXml.constData(), tagsXml.size());
 
     // Save Tag Emblems (in case they are loaded on a computer that do not have those icons):
-    QString tempIconFile = tempFolder + "icon.png";
     for (Tag::List::iterator it = tags.begin(); it != tags.end(); ++it) {
         State::List states = (*it)->states();
         for (State::List::iterator it2 = states.begin(); it2 != states.end(); ++it2) {
             State *state = (*it2);
-            QPixmap icon = KIconLoader::global()->loadIcon(
-                               state->emblem(), KIconLoader::Small, 16, KIconLoader::DefaultState,
-                               QStringList(), 0L, true
-                           );
-            if (!icon.isNull()) {
-                icon.save(tempIconFile, "PNG");
+            QByteArray icon = iconData(state->emblem());
+            if (!icon.isEmpty()) {
                 QString iconFileName = state->emblem().replace('/', '_');
-                tar.addLocalFile(tempIconFile, "tag-emblems/" + iconFileName);
+                tar.writeFile("tag-emblems/" + iconFileName, "", "", icon.constData(), icon.size());
             }
         }
     }
-    dir.remove(tempIconFile);
 
-    // Finish Tar.Gz Exportation:
+    // Finish Tar.Gz Exportation, write the index of its parts, and patch its size in the header:
     tar.close();
+    qint64 archiveSize = file.pos() - archiveStart;
+    QByteArray index = IndexedArchive::createIndex(parts, compressor.restartPoints());
+    file.write("index*:" + QByteArray::number(index.size()) + "\n");
+    file.write(index);
+    file.seek(sizePosition);
+    file.write(QByteArray::number(archiveSize).rightJustified(ARCHIVE_SIZE_WIDTH, '0'));
+
+    // Only replace the destination if everything went well (a compression failure leaves a truncated archive):
+    if (compressor.hasFailed() || file.error() != QFile::NoError || !file.finalize()) {
+        file.abort();
+        KMessageBox::error(0, i18n("Unable to write the basket archive %1.", destination), i18n("Basket Archive Error"));
+    }
 
-    // Computing the File Preview:
+    progress->setValue(progress->value() + 1); // Finishing finished
+    kDebug() << "Finishing finished";
+}
+
+QByteArray Archive::previewData(BasketScene *basket)
+{
     BasketScene *previewBasket = basket; // FIXME: Use the first non-empty basket!
+    if (!previewBasket->isLoaded())
+        previewBasket->load();
     //QPixmap previewPixmap(previewBasket->visibleWidth(), previewBasket->visibleHeight());
     QPixmap previewPixmap(previewBasket->width(), previewBasket->height());
     QPainter painter(&previewPixmap);
@@ -143,56 +179,40 @@ void Archive::save(BasketScene *basket, bool withSubBaskets, const QString &dest
     QImage previewImage = previewPixmap.toImage();
     const int PREVIEW_SIZE = 256;
     previewImage = previewImage.scaled(PREVIEW_SIZE, PREVIEW_SIZE, Qt::KeepAspectRatio);
-    previewImage.save(tempFolder + "preview.png", "PNG");
 
-    // Finaly Save to the Real Destination file:
-    QFile file(destination);
-    if (file.open(QIODevice::WriteOnly)) {
-        ulong previewSize = QFile(tempFolder + "preview.png").size();
-        ulong archiveSize = QFile(tempDestination).size();
-        QTextStream stream(&file);
-        stream.setCodec("ISO-8859-1");
-        stream << "BasKetNP:archive\n"
-        << "version:0.6.1\n"
-//             << "read-compatible:0.6.1\n"
-//             << "write-compatible:0.6.1\n"
-        << "preview*:" << previewSize << "\n";
-
-        stream.flush();
-        // Copy the Preview File:
-        const unsigned long BUFFER_SIZE = 1024;
-        char *buffer = new char[BUFFER_SIZE];
-        long sizeRead;
-        QFile previewFile(tempFolder + "preview.png");
-        if (previewFile.open(QIODevice::ReadOnly)) {
-            while ((sizeRead = previewFile.read(buffer, BUFFER_SIZE)) > 0)
-                file.write(buffer, sizeRead);
-        }
-        stream << "archive*:" << archiveSize << "\n";
-        stream.flush();
-
-        // Copy the Archive File:
-        QFile archiveFile(tempDestination);
-        if (archiveFile.open(QIODevice::ReadOnly)) {
-            while ((sizeRead = archiveFile.read(buffer, BUFFER_SIZE)) > 0)
-                file.write(buffer, sizeRead);
-        }
-        // Clean Up:
-        delete[] buffer;
-        buffer = 0;
-        file.close();
-    }
+    QByteArray data;
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::WriteOnly);
+    previewImage.save(&buffer, "PNG");
+    return data;
+}
 
-    progress->setValue(progress->value() + 1); // Finishing finished
-    kDebug() << "Finishing finished";
+QByteArray Archive::iconData(const QString &iconName)
+{
+    QByteArray data;
+    QPixmap icon = KIconLoader::global()->loadIcon(iconName, KIconLoader::Small, 16, KIconLoader::DefaultState,
+                   QStringList(), /*path_store=*/0L, /*canReturnNull=*/true);
+    if (!icon.isNull()) {
+        QBuffer buffer(&data);
+        buffer.open(QIODevice::WriteOnly);
+        icon.save(&buffer, "PNG");
+    }
+    return data;
+}
 
-    // Clean Up Everything:
-    dir.remove(tempFolder + "preview.png");
-    dir.remove(tempDestination);
-    dir.rmdir(tempFolder);
+/** Let IndexedArchive read what is written from now on without inflating what was written before.
+  */
+void Archive::startPart(ParallelGzipDevice *compressor, IndexedArchive::PartList &parts, const QString &name)
+{
+    compressor->addRestartPoint();
+    IndexedArchive::Part part;
+    part.name   = name;
+    part.offset = compressor->pos();
+    parts.append(part);
 }
 
-void Archive::saveBasketToArchive(BasketScene *basket, bool recursive, KTar *tar, QStringList &backgrounds, const QString &tempFolder, QProgressBar *progress)
+void Archive::saveBasketToArchive(BasketScene *basket, bool recursive, KTar *tar, ParallelGzipDevice *compressor, IndexedArchive::PartList &parts,
+                                  QStringList &backgrounds, QProgressBar *progress)
 {
     // Basket need to be loaded for tags exportation.
     // We load it NOW so that the progress bar really reflect the state of the exportation:
@@ -200,19 +220,19 @@ void Archive::saveBasketToArchive(BasketScene *basket, bool recursive, KTar *tar
         basket->load();
     }
 
+    startPart(compressor, parts, basket->folderName());
     QDir dir;
     // Save basket data:
     tar->addLocalDirectory(basket->fullPath(), "baskets/" + basket->folderName());
     tar->addLocalFile(basket->fullPath() + ".basket", "baskets/" + basket->folderName() + ".basket"); // The hidden files were not added
+    if (QFile::exists(basket->fullPath() + ".basketkey"))
+        tar->addLocalFile(basket->fullPath() + ".basketkey", "baskets/" + basket->folderName() + ".basketkey"); // The data key of protected baskets
     // Save basket icon:
-    QString tempIconFile = tempFolder + "icon.png";
     if (!basket->icon().isEmpty() && basket->icon() != "basket") {
-        QPixmap icon = KIconLoader::global()->loadIcon(basket->icon(), KIconLoader::Small, 16, KIconLoader::DefaultState,
-                       QStringList(), /*path_store=*/0L, /*canReturnNull=*/true);
-        if (!icon.isNull()) {
-            icon.save(tempIconFile, "PNG");
+        QByteArray icon = iconData(basket->icon());
+        if (!icon.isEmpty()) {
             QString iconFileName = basket->icon().replace('/', '_');
-            tar->addLocalFile(tempIconFile, "basket-icons/" + iconFileName);
+            tar->writeFile("basket-icons/" + iconFileName, "", "", icon.constData(), icon.size());
         }
     }
     // Save basket backgorund image:
@@ -220,7 +240,8 @@ void Archive::saveBasketToArchive(BasketScene *basket, bool recursive, KTar *tar
     if (!basket->backgroundImageName().isEmpty() && !backgrounds.contains(imageName)) {
         QString backgroundPath = Global::backgroundManager->pathForImageName(imageName);
         if (!backgroundPath.isEmpty()) {
-            // Save the background image:
+            // Save the background image (in its own part, as it is shared by every basket using it):
+            startPart(compressor, parts, "backgrounds/" + imageName);
             tar->addLocalFile(backgroundPath, "backgrounds/" + imageName);
             // Save the preview image:
             QString previewPath = Global::backgroundManager->previewPathForImageName(imageName);
@@ -241,7 +262,7 @@ void Archive::saveBasketToArchive(BasketScene *basket, bool recursive, KTar *tar
     BasketListViewItem *item = Global::bnpView->listViewItemForBasket(basket);
     if (recursive) {
         for (int i = 0; i < item->childCount(); i++) {
-            saveBasketToArchive(((BasketListViewItem *)item->child(i))->basket(), recursive, tar, backgrounds, tempFolder, progress);
+            saveBasketToArchive(((BasketListViewItem *)item->child(i))->basket(), recursive, tar, compressor, parts, backgrounds, progress);
         }
     }
 }
@@ -372,19 +393,7 @@ void Archive::open(const QString &path)
                     tar.directory()->copyTo(extractionFolder);
                     tar.close();
 
-                    // Import the Tags:
-                    importTagEmblems(extractionFolder); // Import and rename tag emblems BEFORE loading them!
-                    QMap<QString, QString> mergedStates = Tag::loadTags(extractionFolder + "tags.xml");
-                    QMap<QString, QString>::Iterator it;
-                    if (mergedStates.count() > 0) {
-                        Tag::saveTags();
-                    }
-
-                    // Import the Background Images:
-                    importArchivedBackgroundImages(extractionFolder);
-
-                    // Import the Baskets:
-                    renameBasketFolders(extractionFolder, mergedStates);
+                    importExtractedArchive(extractionFolder);
                     stream.seek(file.pos());
 
                 }
@@ -415,6 +424,93 @@ void Archive::open(const QString &path)
     Tools::deleteRecursively(tempFolder);
 }
 
+void Archive::browse(const QString &path)
+{
+    // Archives created by older versions have no index: they can only be imported in full:
+    IndexedArchive archive(path);
+    if (!archive.open() || !archive.hasIndex()) {
+        open(path);
+        return;
+    }
+
+    ArchiveBrowser browser(&archive, Global::mainWindow());
+    if (browser.exec() == QDialog::Accepted && !browser.selectedBaskets().isEmpty())
+        importBaskets(archive, browser.selectedBaskets());
+}
+
+/** Import only the @p folders baskets of @p archive, without extracting the other ones.
+  */
+void Archive::importBaskets(IndexedArchive &archive, const QStringList &folders)
+{
+    QString tempFolder = Global::savesFolder() + "temp-archive/";
+    QString extractionFolder = tempFolder + "extraction/";
+    QDir dir;
+    dir.mkpath(extractionFolder);
+
+    bool success = archive.extractPart("metadata", extractionFolder);
+    for (QStringList::const_iterator it = folders.begin(); it != folders.end() && success; ++it)
+        success = archive.extractPart(*it, extractionFolder);
+    // The backgrounds are stored once, with the first basket using them, so they are all needed:
+    QStringList parts = archive.parts();
+    for (QStringList::iterator it = parts.begin(); it != parts.end() && success; ++it)
+        if ((*it).startsWith("backgrounds/"))
+            success = archive.extractPart(*it, extractionFolder);
+    if (!success) {
+        KMessageBox::error(0, i18n("This file is corrupted. It can not be opened."), i18n("Basket Archive Error"));
+        Tools::deleteRecursively(tempFolder);
+        return;
+    }
+
+    // Only keep the chosen baskets in the tree to load:
+    QDomDocument *document = XMLWork::openFile("basketTree", extractionFolder + "baskets/baskets.xml");
+    if (document) {
+        keepBaskets(document->documentElement(), folders);
+        BasketScene::safelySaveToFile(extractionFolder + "baskets/baskets.xml", document->toString());
+        delete document;
+    }
+
+    importExtractedArchive(extractionFolder);
+    Tools::deleteRecursively(tempFolder);
+}
+
+/** Remove the baskets that are not in @p folders from the tree of @p parent.
+  * The kept children of a removed basket take its place.
+  */
+void Archive::keepBaskets(QDomElement parent, const QStringList &folders)
+{
+    QDomElement element = parent.firstChildElement("basket");
+    while (!element.isNull()) {
+        QDomElement next = element.nextSiblingElement("basket");
+        keepBaskets(element, folders);
+        if (!folders.contains(element.attribute("folderName"))) {
+            QDomElement child = element.firstChildElement("basket");
+            while (!child.isNull()) {
+                QDomElement nextChild = child.nextSiblingElement("basket");
+                parent.insertBefore(child, element);
+                child = nextChild;
+            }
+            parent.removeChild(element);
+        }
+        element = next;
+    }
+}
+
+void Archive::importExtractedArchive(const QString &extractionFolder)
+{
+    // Import the Tags:
+    importTagEmblems(extractionFolder); // Import and rename tag emblems BEFORE loading them!
+    QMap<QString, QString> mergedStates = Tag::loadTags(extractionFolder + "tags.xml");
+    if (mergedStates.count() > 0) {
+        Tag::saveTags();
+    }
+
+    // Import the Background Images:
+    importArchivedBackgroundImages(extractionFolder);
+
+    // Import the Baskets:
+    renameBasketFolders(extractionFolder, mergedStates);
+}
+
 /**
  * When opening a basket archive that come from another computer,
  * it can contains tags that use icons (emblems) that are not present on that computer.
@@ -21,9 +21,12 @@
 #ifndef ARCHIVE_H
 #define ARCHIVE_H
 
+#include <QtCore/QByteArray>
 #include <QtCore/QList>
 #include <QtCore/QMap>
 
+#include "indexedarchive.h"
+
 class BasketScene;
 class Tag;
 
@@ -36,6 +39,8 @@ class QDomElement;
 class KTar;
 class KProgress;
 
+class ParallelGzipDevice;
+
 /**
  * @author Sébastien Laoût <slaout@linux62.org>
  */
@@ -44,11 +49,20 @@ class Archive
 public:
     static void save(BasketScene *basket, bool withSubBaskets, const QString &destination);
     static void open(const QString &path);
+    static void browse(const QString &path); /// << Let the user choose the baskets to import, or import everything if the archive has no index
 private:
     // Convenient Methods for Saving:
-    static void saveBasketToArchive(BasketScene *basket, bool recursive, KTar *tar, QStringList &backgrounds, const QString &tempFolder, QProgressBar *progress);
+    static void saveBasketToArchive(BasketScene *basket, bool recursive, KTar *tar, ParallelGzipDevice *compressor, IndexedArchive::PartList &parts,
+                                    QStringList &backgrounds, QProgressBar *progress);
+    static void startPart(ParallelGzipDevice *compressor, IndexedArchive::PartList &parts, const QString &name);
+    static QByteArray previewData(BasketScene *basket);   /// << @Return the PNG screenshot shown as the preview of the archive
+    static QByteArray iconData(const QString &iconName);  /// << @Return the icon as a PNG image, or an empty array if it does not exist
+    static const int ARCHIVE_SIZE_WIDTH = 20; /// << Digits reserved in the header for the size of the archive, that is written last
     static void listUsedTags(BasketScene *basket, bool recursive, QList<Tag*> &list);
     // Convenient Methods for Loading:
+    static void importBaskets(IndexedArchive &archive, const QStringList &folders);
+    static void keepBaskets(QDomElement parent, const QStringList &folders);
+    static void importExtractedArchive(const QString &extractionFolder);
     static void renameBasketFolders(const QString &extractionFolder, QMap<QString, QString> &mergedStates);
     static void renameBasketFolder(const QString &extractionFolder, QDomNode &basketNode, QMap<QString, QString> &folderMap, QMap<QString, QString> &mergedStates);
     static void renameMergedStatesAndBasketIcon(const QString &fullPath, QMap<QString, QString> &mergedStates, const QString &extractionFolder);
@@ -0,0 +1,161 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by BasKet Note Pads developers                     *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+
+#include "archivebrowser.h"
+
+#include <QtGui/QHeaderView>
+#include <QtGui/QLabel>
+#include <QtGui/QSplitter>
+#include <QtGui/QTextBrowser>
+#include <QtGui/QTextDocument> // For Qt::escape()
+#include <QtGui/QTreeWidget>
+#include <QtGui/QVBoxLayout>
+#include <QtXml/QDomDocument>
+
+#include <KDE/KConfigGroup>
+#include <KDE/KGlobal>
+#include <KDE/KIcon>
+#include <KDE/KLocale>
+#include <KDE/KSharedConfig>
+
+#include "indexedarchive.h"
+#include "tools.h"
+#include "xmlwork.h"
+
+ArchiveBrowser::ArchiveBrowser(IndexedArchive *archive, QWidget *parent)
+        : KDialog(parent)
+        , m_archive(archive)
+{
+    setObjectName("ArchiveBrowser");
+    setCaption(i18n("Open Basket Archive"));
+    setButtons(Ok | Cancel);
+    setButtonText(Ok, i18n("&Import"));
+    setModal(true);
+
+    QWidget *page = new QWidget(this);
+    QVBoxLayout *layout = new QVBoxLayout(page);
+    layout->setContentsMargins(0, 0, 0, 0);
+    layout->addWidget(new QLabel(i18n("Check the baskets to import. Select a basket to see its notes."), page));
+
+    QSplitter *splitter = new QSplitter(Qt::Horizontal, page);
+    m_tree = new QTreeWidget(splitter);
+    m_tree->header()->hide();
+    m_preview = new QTextBrowser(splitter);
+    m_preview->setOpenExternalLinks(true);
+    splitter->setStretchFactor(1, 2);
+    layout->addWidget(splitter);
+    setMainWidget(page);
+
+    QDomDocument document;
+    if (document.setContent(m_archive->readFile("metadata", "baskets/baskets.xml")))
+        addBaskets(document.documentElement(), 0);
+    m_tree->expandAll();
+    connect(m_tree, SIGNAL(currentItemChanged(QTreeWidgetItem*, QTreeWidgetItem*)), this, SLOT(showBasket(QTreeWidgetItem*)));
+    if (m_tree->topLevelItemCount() > 0)
+        m_tree->setCurrentItem(m_tree->topLevelItem(0));
+
+    setInitialSize(QSize(700, 450));
+    restoreDialogSize(KGlobal::config()->group("Archive Browser"));
+}
+
+ArchiveBrowser::~ArchiveBrowser()
+{
+    KConfigGroup group = KGlobal::config()->group("Archive Browser");
+    saveDialogSize(group);
+}
+
+void ArchiveBrowser::addBaskets(const QDomElement &parent, QTreeWidgetItem *parentItem)
+{
+    for (QDomElement element = parent.firstChildElement("basket"); !element.isNull(); element = element.nextSiblingElement("basket")) {
+        QDomElement properties = XMLWork::getElement(element, "properties");
+        QTreeWidgetItem *item = (parentItem ? new QTreeWidgetItem(parentItem) : new QTreeWidgetItem(m_tree));
+        item->setText(0, XMLWork::getElementText(properties, "name"));
+        QString icon = XMLWork::getElementText(properties, "icon");
+        item->setIcon(0, KIcon(icon.isEmpty() ? "basket" : icon));
+        item->setData(0, Qt::UserRole, element.attribute("folderName"));
+        item->setFlags(item->flags() | Qt::ItemIsUserCheckable);
+        item->setCheckState(0, Qt::Checked);
+        addBaskets(element, item);
+    }
+}
+
+QStringList ArchiveBrowser::selectedBaskets() const
+{
+    QStringList folders;
+    for (int i = 0; i < m_tree->topLevelItemCount(); ++i)
+        addCheckedBaskets(m_tree->topLevelItem(i), folders);
+    return folders;
+}
+
+void ArchiveBrowser::addCheckedBaskets(QTreeWidgetItem *item, QStringList &folders) const
+{
+    if (item->checkState(0) == Qt::Checked)
+        folders.append(item->data(0, Qt::UserRole).toString());
+    for (int i = 0; i < item->childCount(); ++i)
+        addCheckedBaskets(item->child(i), folders);
+}
+
+void ArchiveBrowser::showBasket(QTreeWidgetItem *item)
+{
+    if (item == 0) {
+        m_preview->clear();
+        return;
+    }
+
+    QString folderName = item->data(0, Qt::UserRole).toString();
+    QString html = "<h3>" + Qt::escape(item->text(0)) + "</h3>";
+    QByteArray content = m_archive->readFile(folderName, "baskets/" + folderName + ".basket");
+    QDomDocument document;
+    if (!content.trimmed().startsWith('<')) // Encrypted
+        html += "<p><i>" + i18n("This basket is protected: its notes can only be seen once it is imported.") + "</i></p>";
+    else if (!document.setContent(content))
+        html += "<p><i>" + i18n("This basket cannot be read.") + "</i></p>";
+    else
+        listNotes(XMLWork::getElement(document.documentElement(), "notes"), folderName, html);
+    m_preview->setHtml(html);
+}
+
+void ArchiveBrowser::listNotes(const QDomElement &notes, const QString &folderName, QString &html)
+{
+    for (QDomElement element = notes.firstChildElement(); !element.isNull(); element = element.nextSiblingElement()) {
+        if (element.tagName() == "group") {
+            html += "<blockquote>";
+            listNotes(element, folderName, html);
+            html += "</blockquote>";
+            continue;
+        }
+        if (element.tagName() != "note")
+            continue;
+
+        QString type = element.attribute("type");
+        QDomElement contentElement = XMLWork::getElement(element, "content");
+        QString content = contentElement.text();
+        if (type == "html" || type == "text") {
+            QString text = QString::fromUtf8(m_archive->readFile(folderName, "baskets/" + folderName + content));
+            html += "<p>" + (type == "html" ? Tools::htmlToParagraph(text) : Tools::textToHTMLWithoutP(text)) + "</p>";
+        } else if (type == "link" || type == "crossreference") {
+            QString title = contentElement.attribute("title", content);
+            html += "<p><a href=\"" + Qt::escape(content) + "\">" + Qt::escape(title) + "</a></p>";
+        } else {
+            html += "<p><i>" + Qt::escape(type) + ": " + Qt::escape(content) + "</i></p>";
+        }
+        html += "<hr>";
+    }
+}
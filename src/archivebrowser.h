@@ -0,0 +1,62 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by BasKet Note Pads developers                     *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+
+#ifndef ARCHIVEBROWSER_H
+#define ARCHIVEBROWSER_H
+
+#include <KDE/KDialog>
+
+#include <QtCore/QStringList>
+
+class QDomElement;
+class QTextBrowser;
+class QTreeWidget;
+class QTreeWidgetItem;
+
+class IndexedArchive;
+
+/** Read-only view of the baskets of an archive, to choose the ones to import.
+  * BASIC FUNCTIONNING:
+  *   The tree of baskets is read from the baskets.xml of the archive, and every basket is checked for import.
+  *   The notes of the current basket are read from the archive only when it is selected (see IndexedArchive),
+  *   and shown as a simple list: nothing is extracted to the disk before the user clicks Import.
+  */
+class ArchiveBrowser : public KDialog
+{
+    Q_OBJECT
+public:
+    ArchiveBrowser(IndexedArchive *archive, QWidget *parent = 0);
+    ~ArchiveBrowser();
+    QStringList selectedBaskets() const; /// << Folder names of the baskets checked for import
+
+private slots:
+    void showBasket(QTreeWidgetItem *item);
+
+private:
+    void addBaskets(const QDomElement &parent, QTreeWidgetItem *parentItem);
+    void addCheckedBaskets(QTreeWidgetItem *item, QStringList &folders) const;
+    void listNotes(const QDomElement &notes, const QString &folderName, QString &html);
+
+    IndexedArchive *m_archive;
+    QTreeWidget    *m_tree;
+    QTextBrowser   *m_preview;
+};
+
+#endif // ARCHIVEBROWSER_H
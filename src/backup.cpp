@@ -25,15 +25,20 @@
 #include "settings.h"
 #include "tools.h"
 #include "formatimporter.h" // To move a folder
+#include "parallelgzipdevice.h"
+#include "backuprepository.h"
 
+#include <QtCore/QFile>
 #include <QtCore/QDir>
 #include <QtCore/QTextStream>
+#include <QtCore/QThread>
 #include <QtGui/QLayout>
 #include <QtGui/QLabel>
 #include <QtGui/QPushButton>
 #include <QtGui/QHBoxLayout>
 #include <QtGui/QGroupBox>
 #include <QtGui/QProgressBar>
+#include <QtGui/QSpinBox>
 
 #include <KDE/KLocale>
 #include <KDE/KApplication>
@@ -43,6 +48,8 @@
 #include <KDE/KConfig>
 #include <KDE/KTar>
 #include <KDE/KFileDialog>
+#include <KDE/KInputDialog>
+#include <KDE/KDebug>
 #include <KDE/KProgressDialog>
 #include <KDE/KMessageBox>
 #include <KDE/KVBox>
@@ -125,6 +132,58 @@ BackupDialog::BackupDialog(QWidget *parent, const char *name)
 
     populateLastBackup();
 
+    QWidget *compressionWidget = new QWidget;
+    backupGroupLayout->addWidget(compressionWidget);
+    QHBoxLayout *compressionLayout = new QHBoxLayout(compressionWidget);
+    compressionLayout->setContentsMargins(0, 0, 0, 0);
+
+    m_compressionLevel = new QSpinBox(compressionWidget);
+    m_compressionLevel->setRange(1, 9);
+    m_compressionLevel->setValue(Backup::compressionLevel());
+    m_compressionThreads = new QSpinBox(compressionWidget);
+    m_compressionThreads->setRange(1, 64);
+    m_compressionThreads->setValue(Backup::compressionThreads());
+    QLabel *levelLabel   = new QLabel(i18n("Compression &level:"), compressionWidget);
+    QLabel *threadsLabel = new QLabel(i18n("&Threads:"), compressionWidget);
+    levelLabel->setBuddy(m_compressionLevel);
+    threadsLabel->setBuddy(m_compressionThreads);
+    HelpLabel *compressionHelp = new HelpLabel(i18n("How to choose?"), i18n(
+                                                   "<p>Backups and basket archives are compressed on several processor cores at once.</p>"
+                                                   "<p>A lower compression level is faster, a higher one produces smaller files. "
+                                                   "Use as many threads as your computer has processor cores (%1 here) for the fastest backups, "
+                                                   "or less of them to keep the computer responsive meanwhile.</p>", QThread::idealThreadCount()),
+                                               compressionWidget);
+    compressionLayout->addWidget(levelLabel);
+    compressionLayout->addWidget(m_compressionLevel);
+    compressionLayout->addWidget(threadsLabel);
+    compressionLayout->addWidget(m_compressionThreads);
+    compressionLayout->addWidget(compressionHelp);
+    compressionLayout->addStretch();
+    connect(m_compressionLevel,   SIGNAL(valueChanged(int)), this, SLOT(saveCompressionSettings()));
+    connect(m_compressionThreads, SIGNAL(valueChanged(int)), this, SLOT(saveCompressionSettings()));
+
+    QWidget *snapshotWidget = new QWidget;
+    backupGroupLayout->addWidget(snapshotWidget);
+    QHBoxLayout *snapshotLayout = new QHBoxLayout(snapshotWidget);
+    snapshotLayout->setContentsMargins(0, 0, 0, 0);
+
+    QPushButton *incrementalButton = new QPushButton(i18n("Back Up &Incrementally"),   snapshotWidget);
+    QPushButton *snapshotButton    = new QPushButton(i18n("Restore a &Snapshot..."),  snapshotWidget);
+    QPushButton *repositoryButton  = new QPushButton(i18n("&Change Backup Folder..."), snapshotWidget);
+    HelpLabel *snapshotHelp = new HelpLabel(i18n("What is it?"), i18n(
+                                                "<p>Incremental backups are all stored in the same folder, and only save what changed since the previous one: "
+                                                "they are fast, and take little room, so you can back up your baskets every day.</p>"
+                                                "<p>Every incremental backup is a snapshot of your baskets, that can be restored at any time.</p>"),
+                                            snapshotWidget);
+    snapshotLayout->addWidget(incrementalButton);
+    snapshotLayout->addWidget(snapshotButton);
+    snapshotLayout->addWidget(repositoryButton);
+    snapshotLayout->addWidget(snapshotHelp);
+    snapshotLayout->addStretch();
+    connect(incrementalButton, SIGNAL(clicked()), this, SLOT(incrementalBackup()));
+    connect(snapshotButton,    SIGNAL(clicked()), this, SLOT(restoreSnapshot()));
+    connect(repositoryButton,  SIGNAL(clicked()), this, SLOT(chooseRepository()));
+
     (new QWidget(page))->setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Expanding);
 }
 
@@ -137,10 +196,23 @@ void BackupDialog::populateLastBackup()
     QString lastBackupText = i18n("Last backup: never");
     if (Settings::lastBackup().isValid())
         lastBackupText = i18n("Last backup: %1", Settings::lastBackup().toString(Qt::LocalDate));
+    if (!Settings::backupRepository().isEmpty()) {
+        int snapshotCount = BackupRepository(Settings::backupRepository()).snapshots().count();
+        if (snapshotCount > 0)
+            lastBackupText += " " + i18np("(1 snapshot)", "(%1 snapshots)", snapshotCount);
+    }
 
     m_lastBackup->setText(lastBackupText);
 }
 
+void BackupDialog::saveCompressionSettings()
+{
+    KConfig *config = KGlobal::config().data();
+    KConfigGroup configGroup(config, "Backups");
+    configGroup.writeEntry("compressionLevel",   m_compressionLevel->value());
+    configGroup.writeEntry("compressionThreads", m_compressionThreads->value());
+}
+
 void BackupDialog::moveToAnotherFolder()
 {
     KUrl selectedURL = KDirSelectDialog::selectDirectory(
@@ -230,7 +302,7 @@ void BackupDialog::backup()
     progress->setValue(0);
     progress->setTextVisible(false);
 
-    BackupThread thread(destination, Global::savesFolder());
+    BackupThread thread(destination, Global::savesFolder(), Backup::compressionLevel(), Backup::compressionThreads());
     thread.start();
     while (thread.isRunning()) {
         progress->setValue(progress->value() + 1); // Or else, the animation is not played!
@@ -238,6 +310,10 @@ void BackupDialog::backup()
         usleep(300); // Not too long because if the backup process is finished, we wait for nothing
     }
 
+    if (!thread.success()) {
+        KMessageBox::error(0, i18n("The backup failed: %1", thread.errorString()), i18n("Backup Error"));
+        return;
+    }
     Settings::setLastBackup(QDate::currentDate());
     Settings::saveConfig();
     populateLastBackup();
@@ -256,6 +332,12 @@ void BackupDialog::restore()
     if (path.isEmpty()) // User has canceled
         return;
 
+    RestoreThread thread(path, Global::savesFolder());
+    restoreThenRestart(KUrl(path).fileName(), thread);
+}
+
+void BackupDialog::restoreThenRestart(const QString &backupName, RestoreThread &thread)
+{
     // Before replacing the basket data folder with the backup content, we safely backup the current baskets to the home folder.
     // So if the backup is corrupted or something goes wrong while restoring (power cut...) the user will be able to restore the old working data:
     QString safetyPath = Backup::newSafetyFolder();
@@ -267,7 +349,7 @@ void BackupDialog::restore()
     QFile file(readmePath);
     if (file.open(QIODevice::WriteOnly)) {
         QTextStream stream(&file);
-        stream << i18n("This is a safety copy of your baskets like they were before you started to restore the backup %1.", KUrl(path).fileName()) + "\n\n"
+        stream << i18n("This is a safety copy of your baskets like they were before you started to restore the backup %1.", backupName) + "\n\n"
         << i18n("If the restoration was a success and you restored what you wanted to restore, you can remove this folder.") + "\n\n"
         << i18n("If something went wrong during the restoration process, you can re-use this folder to store your baskets and nothing will be lost.") + "\n\n"
         << i18n("Choose \"Basket\" -> \"Backup & Restore...\" -> \"Use Another Existing Folder...\" and select that folder.") + "\n";
@@ -275,7 +357,7 @@ void BackupDialog::restore()
     }
 
     QString message =
-        "<p><nobr>" + i18n("Restoring <b>%1</b>. Please wait...", KUrl(path).fileName()) + "</nobr></p><p>" +
+        "<p><nobr>" + i18n("Restoring <b>%1</b>. Please wait...", backupName) + "</nobr></p><p>" +
         i18n("If something goes wrong during the restoration process, read the file <b>%1</b>.", readmePath);
 
     KProgressDialog *dialog = new KProgressDialog(0, i18n("Restore Baskets"), message);
@@ -289,7 +371,6 @@ void BackupDialog::restore()
     progress->setTextVisible(false);
 
     // Uncompress:
-    RestoreThread thread(path, Global::savesFolder());
     thread.start();
     while (thread.isRunning()) {
         progress->setValue(progress->value() + 1); // Or else, the animation is not played!
@@ -309,7 +390,10 @@ void BackupDialog::restore()
         dir.remove(readmePath);
         copier.moveFolder(safetyPath, Global::savesFolder());
         // Tell the user:
-        KMessageBox::error(0, i18n("This archive is either not a backup of baskets or is corrupted. It cannot be imported. Your old baskets have been preserved instead."), i18n("Restore Error"));
+        if (thread.errorString().isEmpty())
+            KMessageBox::error(0, i18n("This archive is either not a backup of baskets or is corrupted. It cannot be imported. Your old baskets have been preserved instead."), i18n("Restore Error"));
+        else
+            KMessageBox::error(0, i18n("This snapshot cannot be restored: %1 Your old baskets have been preserved instead.", thread.errorString()), i18n("Restore Error"));
         return;
     }
 
@@ -320,6 +404,87 @@ void BackupDialog::restore()
     Backup::setFolderAndRestart(Global::savesFolder()/*No change*/, i18n("Your backup has been successfuly restored to <b>%1</b>. %2 is going to be restarted to take this change into account."));
 }
 
+void BackupDialog::chooseRepository()
+{
+    QString startDir = (Settings::backupRepository().isEmpty() ? QDir::homePath() : Settings::backupRepository());
+    KUrl selectedURL = KDirSelectDialog::selectDirectory(
+                           startDir, /*localOnly=*/true, /*parent=*/0,
+                           /*caption=*/i18n("Choose a Folder Where to Store Incremental Backups"));
+    if (selectedURL.isEmpty())
+        return;
+
+    // Restoring moves the save folder away: the backups must not be in it:
+    QString folder = QDir(selectedURL.path()).canonicalPath() + "/";
+    if (folder.startsWith(QDir(Global::savesFolder()).canonicalPath() + "/")) {
+        KMessageBox::error(0, i18n("The incremental backups cannot be stored in the folder of your baskets. Please choose another folder."), i18n("Incremental Backups"));
+        return;
+    }
+    Settings::setBackupRepository(folder);
+    Settings::saveConfig();
+    populateLastBackup();
+}
+
+void BackupDialog::incrementalBackup()
+{
+    if (Settings::backupRepository().isEmpty() || !QDir(Settings::backupRepository()).exists()) {
+        chooseRepository();
+        if (Settings::backupRepository().isEmpty())
+            return;
+    }
+
+    KProgressDialog dialog(0, i18n("Backup Baskets"), i18n("Backing up baskets. Please wait..."));
+    dialog.setModal(true);
+    dialog.setAllowCancel(false);
+    dialog.setAutoClose(true);
+    dialog.show();
+    QProgressBar *progress = dialog.progressBar();
+    progress->setRange(0, 0/*Busy/Undefined*/);
+    progress->setValue(0);
+    progress->setTextVisible(false);
+
+    IncrementalBackupThread thread(Settings::backupRepository(), Global::savesFolder());
+    thread.start();
+    while (thread.isRunning()) {
+        progress->setValue(progress->value() + 1); // Or else, the animation is not played!
+        kapp->processEvents();
+        usleep(300); // Not too long because if the backup process is finished, we wait for nothing
+    }
+
+    if (!thread.success()) {
+        KMessageBox::error(0, i18n("The backup failed: %1", thread.errorString()), i18n("Backup Error"));
+        return;
+    }
+    Settings::setLastBackup(QDate::currentDate());
+    Settings::saveConfig();
+    populateLastBackup();
+}
+
+void BackupDialog::restoreSnapshot()
+{
+    BackupRepository repository(Settings::backupRepository());
+    QStringList snapshots = (Settings::backupRepository().isEmpty() ? QStringList() : repository.snapshots());
+    if (snapshots.isEmpty()) {
+        KMessageBox::information(0, i18n("There is no incremental backup to restore yet."), i18n("Restore a Snapshot"));
+        return;
+    }
+
+    // Propose the most recent snapshots first:
+    QStringList names;
+    QStringList dates;
+    for (int i = snapshots.count() - 1; i >= 0; --i) {
+        names.append(snapshots.at(i));
+        dates.append(KGlobal::locale()->formatDateTime(BackupRepository::snapshotDate(snapshots.at(i)), KLocale::LongDate, /*includeSeconds=*/true));
+    }
+    bool ok;
+    QString date = KInputDialog::getItem(i18n("Restore a Snapshot"), i18n("Restore your baskets like they were on:"),
+                                         dates, /*current=*/0, /*editable=*/false, &ok, this);
+    if (!ok)
+        return;
+
+    RestoreThread thread(Settings::backupRepository(), names.at(dates.indexOf(date)), Global::savesFolder());
+    restoreThenRestart(date, thread);
+}
+
 /** class Backup: */
 
 QString Backup::binaryPath = "";
@@ -384,17 +549,39 @@ QString Backup::newSafetyFolder()
     return "";
 }
 
+int Backup::compressionLevel()
+{
+    KConfig *config = KGlobal::config().data();
+    KConfigGroup configGroup(config, "Backups");
+    return qBound(1, configGroup.readEntry("compressionLevel", (int)ParallelGzipDevice::DEFAULT_LEVEL), 9);
+}
+
+int Backup::compressionThreads()
+{
+    KConfig *config = KGlobal::config().data();
+    KConfigGroup configGroup(config, "Backups");
+    return qMax(1, configGroup.readEntry("compressionThreads", QThread::idealThreadCount()));
+}
+
 /** class BackupThread: */
 
-BackupThread::BackupThread(const QString &tarFile, const QString &folderToBackup)
+BackupThread::BackupThread(const QString &tarFile, const QString &folderToBackup, int compressionLevel, int compressionThreads)
         : m_tarFile(tarFile), m_folderToBackup(folderToBackup)
+        , m_compressionLevel(compressionLevel), m_compressionThreads(compressionThreads)
+        , m_success(false)
 {
 }
 
 void BackupThread::run()
 {
-    KTar tar(m_tarFile, "application/x-gzip");
-    tar.open(QIODevice::WriteOnly);
+    // Compress on several cores, straight to the destination (KTar would first write an uncompressed temporary file):
+    QFile file(m_tarFile);
+    ParallelGzipDevice compressor(&file, m_compressionLevel, m_compressionThreads);
+    KTar tar(&compressor);
+    if (!tar.open(QIODevice::WriteOnly)) {
+        m_errorString = file.errorString();
+        return;
+    }
     tar.addLocalDirectory(m_folderToBackup, backupMagicFolder);
     // KArchive does not add hidden files. Basket description files (".basket") are hidden, we add them manually:
     QDir dir(m_folderToBackup + "baskets/");
@@ -404,9 +591,37 @@ void BackupThread::run()
             m_folderToBackup + "baskets/" + *it + "/.basket",
             backupMagicFolder + "/baskets/" + *it + "/.basket"
         );
+        if (QFile::exists(m_folderToBackup + "baskets/" + *it + "/.basketkey"))
+            tar.addLocalFile(
+                m_folderToBackup + "baskets/" + *it + "/.basketkey",
+                backupMagicFolder + "/baskets/" + *it + "/.basketkey"
+            );
     }
     // We finished:
     tar.close();
+
+    // Do not leave a truncated backup behind, it would only fail once restored:
+    m_success = !compressor.hasFailed() && file.error() == QFile::NoError;
+    if (!m_success) {
+        m_errorString = (compressor.hasFailed() ? compressor.errorString() : file.errorString());
+        QFile::remove(m_tarFile);
+    }
+}
+
+/** class IncrementalBackupThread: */
+
+IncrementalBackupThread::IncrementalBackupThread(const QString &repository, const QString &folderToBackup)
+        : m_repository(repository), m_folderToBackup(folderToBackup), m_success(false)
+{
+}
+
+void IncrementalBackupThread::run()
+{
+    BackupRepository repository(m_repository);
+    m_success = repository.backup(m_folderToBackup);
+    m_errorString = repository.errorString();
+    kDebug() << "Incremental backup:" << repository.readFiles() << "files read out of" << repository.scannedFiles()
+             << "," << repository.storedBytes() << "bytes stored";
 }
 
 /** class RestoreThread: */
@@ -416,9 +631,20 @@ RestoreThread::RestoreThread(const QString &tarFile, const QString &destFolder)
 {
 }
 
+RestoreThread::RestoreThread(const QString &repository, const QString &snapshot, const QString &destFolder)
+        : m_repository(repository), m_snapshot(snapshot), m_destFolder(destFolder)
+{
+}
+
 void RestoreThread::run()
 {
     m_success = false;
+    if (!m_snapshot.isEmpty()) {
+        BackupRepository repository(m_repository);
+        m_success = repository.restore(m_snapshot, m_destFolder);
+        m_errorString = repository.errorString();
+        return;
+    }
     KTar tar(m_tarFile, "application/x-gzip");
     tar.open(QIODevice::ReadOnly);
     if (tar.isOpen()) {
@@ -27,6 +27,9 @@
 
 class QApplication;
 class QLabel;
+class QSpinBox;
+
+class RestoreThread;
 
 #include "basket_export.h"
 
@@ -44,9 +47,17 @@ private slots:
     void useAnotherExistingFolder();
     void backup();
     void restore();
+    void incrementalBackup();
+    void restoreSnapshot();
+    void chooseRepository();
     void populateLastBackup();
+    void saveCompressionSettings();
 private:
-    QLabel *m_lastBackup;
+    void restoreThenRestart(const QString &backupName, RestoreThread &thread);
+
+    QLabel   *m_lastBackup;
+    QSpinBox *m_compressionLevel;
+    QSpinBox *m_compressionThreads;
 };
 
 /**
@@ -58,6 +69,8 @@ public:
     static void figureOutBinaryPath(const char *argv0, QApplication &app);
     static void setFolderAndRestart(const QString &folder, const QString &message);
     static QString newSafetyFolder();
+    static int compressionLevel();   /// << For archives and backups, from 1 (fastest) to 9 (smallest)
+    static int compressionThreads(); /// << Number of threads compressing archives and backups
 
 private:
     static QString binaryPath;
@@ -66,27 +79,65 @@ private:
 class BackupThread : public QThread
 {
 public:
-    BackupThread(const QString &tarFile, const QString &folderToBackup);
+    BackupThread(const QString &tarFile, const QString &folderToBackup, int compressionLevel, int compressionThreads);
+    inline bool success() {
+        return m_success;
+    }
+    inline QString errorString() {
+        return m_errorString;
+    }
 protected:
     virtual void run();
 private:
     QString m_tarFile;
     QString m_folderToBackup;
+    int     m_compressionLevel;
+    int     m_compressionThreads;
+    bool    m_success;
+    QString m_errorString;
+};
+
+/** Take a snapshot of the data folder in a BackupRepository.
+  */
+class IncrementalBackupThread : public QThread
+{
+public:
+    IncrementalBackupThread(const QString &repository, const QString &folderToBackup);
+    inline bool success() {
+        return m_success;
+    }
+    inline QString errorString() {
+        return m_errorString;
+    }
+protected:
+    virtual void run();
+private:
+    QString m_repository;
+    QString m_folderToBackup;
+    bool    m_success;
+    QString m_errorString;
 };
 
 class RestoreThread : public QThread
 {
 public:
     RestoreThread(const QString &tarFile, const QString &destFolder);
+    RestoreThread(const QString &repository, const QString &snapshot, const QString &destFolder); /// << Restore a snapshot of a BackupRepository
     inline bool success() {
         return m_success;
     }
+    inline QString errorString() {
+        return m_errorString;
+    }
 protected:
     virtual void run();
 private:
     QString m_tarFile;
+    QString m_repository;
+    QString m_snapshot;
     QString m_destFolder;
     bool m_success;
+    QString m_errorString;
 };
 
 #endif // BACKUP_H
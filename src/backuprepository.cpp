@@ -0,0 +1,278 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by BasKet Note Pads developers                     *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+
+#include "backuprepository.h"
+
+#include <QtCore/QCryptographicHash>
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtXml/QDomDocument>
+
+#include <KDE/KLocale>
+#include <KDE/KSaveFile>
+
+static const char SNAPSHOT_DATE_FORMAT[] = "yyyy-MM-dd_hh-mm-ss";
+
+BackupRepository::BackupRepository(const QString &path)
+        : m_path(path.endsWith('/') ? path : path + '/')
+        , m_scannedFiles(0)
+        , m_readFiles(0)
+        , m_storedBytes(0)
+{
+}
+
+QStringList BackupRepository::snapshots() const
+{
+    QStringList snapshots;
+    QStringList manifests = QDir(m_path + "snapshots/").entryList(QStringList("*.xml"), QDir::Files, QDir::Name);
+    for (QStringList::iterator it = manifests.begin(); it != manifests.end(); ++it)
+        snapshots.append((*it).left((*it).length() - 4));
+    return snapshots;
+}
+
+QDateTime BackupRepository::snapshotDate(const QString &snapshot)
+{
+    return QDateTime::fromString(snapshot.left(QString(SNAPSHOT_DATE_FORMAT).length()), SNAPSHOT_DATE_FORMAT);
+}
+
+bool BackupRepository::backup(const QString &folder, QString *snapshot)
+{
+    m_errorString  = "";
+    m_scannedFiles = 0;
+    m_readFiles    = 0;
+    m_storedBytes  = 0;
+
+    QDir dir;
+    if (!dir.mkpath(m_path + "chunks/") || !dir.mkpath(m_path + "snapshots/"))
+        return fail(i18n("Cannot create the backup repository %1.", m_path));
+
+    QString sourceFolder = (folder.endsWith('/') ? folder : folder + '/');
+    m_excludedPath = QDir(m_path).canonicalPath() + '/';
+
+    // Files are only read if they changed since the previous snapshot:
+    Manifest previous;
+    QStringList existingSnapshots = snapshots();
+    if (!existingSnapshots.isEmpty() && !loadManifest(existingSnapshots.last(), &previous))
+        previous = Manifest(); // A corrupted manifest only means reading everything again
+
+    Manifest manifest;
+    manifest.startTime = QDateTime::currentDateTime().toTime_t();
+    QStringList files;
+    listFolder(sourceFolder, "", &manifest, &files);
+    for (QStringList::iterator it = files.begin(); it != files.end(); ++it) {
+        QFileInfo info(sourceFolder + *it);
+        FileEntry entry;
+        entry.size             = info.size();
+        entry.modificationTime = info.lastModified().toTime_t();
+        QMap<QString, FileEntry>::const_iterator old = previous.files.constFind(*it);
+        bool unchanged = (old != previous.files.constEnd() && old.value().size == entry.size && old.value().modificationTime == entry.modificationTime
+                          && entry.modificationTime < previous.startTime); // Else, it could have been modified again during the same second
+        if (unchanged) {
+            entry.chunks = old.value().chunks;
+        } else {
+            if (!storeFile(sourceFolder + *it, &entry))
+                return false;
+            ++m_readFiles;
+        }
+        manifest.files.insert(*it, entry);
+        ++m_scannedFiles;
+    }
+
+    // Two snapshots taken during the same second should not overwrite each other:
+    QString name = QDateTime::currentDateTime().toString(SNAPSHOT_DATE_FORMAT);
+    for (int i = 2; QFile::exists(manifestPath(name)); ++i)
+        name = QDateTime::currentDateTime().toString(SNAPSHOT_DATE_FORMAT) + '_' + QString::number(i);
+    if (!saveManifest(name, manifest))
+        return false;
+    if (snapshot)
+        *snapshot = name;
+    return true;
+}
+
+bool BackupRepository::restore(const QString &snapshot, const QString &destination)
+{
+    m_errorString = "";
+    Manifest manifest;
+    if (!loadManifest(snapshot, &manifest))
+        return false;
+
+    QString destinationFolder = (destination.endsWith('/') ? destination : destination + '/');
+    QDir dir;
+    if (!dir.mkpath(destinationFolder))
+        return fail(i18n("Cannot create the folder %1.", destinationFolder));
+    for (QStringList::iterator it = manifest.folders.begin(); it != manifest.folders.end(); ++it)
+        if (!dir.mkpath(destinationFolder + *it))
+            return fail(i18n("Cannot create the folder %1.", destinationFolder + *it));
+
+    for (QMap<QString, FileEntry>::const_iterator it = manifest.files.constBegin(); it != manifest.files.constEnd(); ++it) {
+        QFile file(destinationFolder + it.key());
+        if (!file.open(QIODevice::WriteOnly))
+            return fail(i18n("Cannot write the file %1.", file.fileName()));
+        for (QStringList::const_iterator chunk = it.value().chunks.begin(); chunk != it.value().chunks.end(); ++chunk) {
+            QByteArray data;
+            if (!loadChunk(*chunk, &data))
+                return false;
+            if (file.write(data) != data.size())
+                return fail(i18n("Cannot write the file %1.", file.fileName()));
+        }
+        file.close();
+        if (file.size() != it.value().size)
+            return fail(i18n("The file %1 of the snapshot is corrupted.", it.key()));
+    }
+    return true;
+}
+
+/** Recursively list the files and sub-folders of @p folder (hidden ones included), relatively to the backed up folder.
+  */
+void BackupRepository::listFolder(const QString &folder, const QString &relativePath, Manifest *manifest, QStringList *files)
+{
+    QDir dir(folder + relativePath);
+    if (dir.canonicalPath() + '/' == m_excludedPath)
+        return;
+
+    QStringList fileNames = dir.entryList(QDir::Files | QDir::Hidden | QDir::NoSymLinks, QDir::Name);
+    for (QStringList::iterator it = fileNames.begin(); it != fileNames.end(); ++it)
+        files->append(relativePath + *it);
+
+    QStringList folderNames = dir.entryList(QDir::Dirs | QDir::Hidden | QDir::NoSymLinks | QDir::NoDotAndDotDot, QDir::Name);
+    for (QStringList::iterator it = folderNames.begin(); it != folderNames.end(); ++it) {
+        manifest->folders.append(relativePath + *it);
+        listFolder(folder, relativePath + *it + '/', manifest, files);
+    }
+}
+
+bool BackupRepository::storeFile(const QString &fullPath, FileEntry *entry)
+{
+    QFile file(fullPath);
+    if (!file.open(QIODevice::ReadOnly))
+        return fail(i18n("Cannot read the file %1.", fullPath));
+
+    entry->chunks.clear();
+    entry->size = 0;
+    QByteArray data;
+    while (!(data = file.read(CHUNK_SIZE)).isEmpty()) {
+        QString hash;
+        if (!storeChunk(data, &hash))
+            return false;
+        entry->chunks.append(hash);
+        entry->size += data.size();
+    }
+    return true;
+}
+
+bool BackupRepository::storeChunk(const QByteArray &data, QString *hash)
+{
+    *hash = QCryptographicHash::hash(data, QCryptographicHash::Sha1).toHex();
+    QString path = chunkPath(*hash);
+    if (QFile::exists(path))
+        return true;
+
+    QDir().mkpath(path.left(path.lastIndexOf('/')));
+    QByteArray compressed = qCompress(data);
+    KSaveFile file(path); // No half-written chunk can be left, to be trusted by the next backups
+    if (!file.open(QIODevice::WriteOnly) || file.write(compressed) != compressed.size() || !file.finalize()) {
+        file.abort();
+        return fail(i18n("Cannot write to the backup repository %1.", m_path));
+    }
+    m_storedBytes += compressed.size();
+    return true;
+}
+
+bool BackupRepository::loadChunk(const QString &hash, QByteArray *data)
+{
+    QFile file(chunkPath(hash));
+    if (!file.open(QIODevice::ReadOnly))
+        return fail(i18n("The backup repository %1 is missing data.", m_path));
+    *data = qUncompress(file.readAll());
+    if (QCryptographicHash::hash(*data, QCryptographicHash::Sha1).toHex() != hash.toLatin1())
+        return fail(i18n("The backup repository %1 is corrupted.", m_path));
+    return true;
+}
+
+bool BackupRepository::loadManifest(const QString &snapshot, Manifest *manifest)
+{
+    QFile file(manifestPath(snapshot));
+    QDomDocument document;
+    if (!file.open(QIODevice::ReadOnly) || !document.setContent(&file))
+        return fail(i18n("The snapshot %1 cannot be read.", snapshot));
+
+    QDomElement root = document.documentElement();
+    manifest->startTime = root.attribute("started").toUInt(); // 0 for the first version: every file is then read again
+    for (QDomElement element = root.firstChildElement(); !element.isNull(); element = element.nextSiblingElement()) {
+        if (element.tagName() == "folder") {
+            manifest->folders.append(element.attribute("path"));
+        } else if (element.tagName() == "file") {
+            FileEntry entry;
+            entry.size             = element.attribute("size").toLongLong();
+            entry.modificationTime = element.attribute("mtime").toUInt();
+            entry.chunks           = element.text().split(' ', QString::SkipEmptyParts);
+            manifest->files.insert(element.attribute("path"), entry);
+        }
+    }
+    return true;
+}
+
+bool BackupRepository::saveManifest(const QString &snapshot, const Manifest &manifest)
+{
+    QDomDocument document("basketSnapshot");
+    QDomElement root = document.createElement("basketSnapshot");
+    root.setAttribute("version", 2);
+    root.setAttribute("started", QString::number(manifest.startTime));
+    document.appendChild(root);
+    for (QStringList::const_iterator it = manifest.folders.begin(); it != manifest.folders.end(); ++it) {
+        QDomElement folder = document.createElement("folder");
+        folder.setAttribute("path", *it);
+        root.appendChild(folder);
+    }
+    for (QMap<QString, FileEntry>::const_iterator it = manifest.files.constBegin(); it != manifest.files.constEnd(); ++it) {
+        QDomElement file = document.createElement("file");
+        file.setAttribute("path",  it.key());
+        file.setAttribute("size",  QString::number(it.value().size));
+        file.setAttribute("mtime", QString::number(it.value().modificationTime));
+        file.appendChild(document.createTextNode(it.value().chunks.join(" ")));
+        root.appendChild(file);
+    }
+
+    QByteArray xml = "<?xml version=\"1.0\" encoding=\"UTF-8\" ?>\n" + document.toString().toUtf8();
+    KSaveFile file(manifestPath(snapshot));
+    if (!file.open(QIODevice::WriteOnly) || file.write(xml) != xml.size() || !file.finalize()) {
+        file.abort();
+        return fail(i18n("Cannot write to the backup repository %1.", m_path));
+    }
+    return true;
+}
+
+bool BackupRepository::fail(const QString &errorString)
+{
+    m_errorString = errorString;
+    return false;
+}
+
+QString BackupRepository::chunkPath(const QString &hash) const
+{
+    // Spread the chunks in 256 folders, to keep the folders small:
+    return m_path + "chunks/" + hash.left(2) + '/' + hash;
+}
+
+QString BackupRepository::manifestPath(const QString &snapshot) const
+{
+    return m_path + "snapshots/" + snapshot + ".xml";
+}
@@ -0,0 +1,94 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by BasKet Note Pads developers                     *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+
+#ifndef BACKUPREPOSITORY_H
+#define BACKUPREPOSITORY_H
+
+#include <QtCore/QDateTime>
+#include <QtCore/QMap>
+#include <QtCore/QString>
+#include <QtCore/QStringList>
+
+#include "basket_export.h"
+
+/** Folder storing incremental backups of the baskets data folder, as content-addressed chunks and per-snapshot manifests.
+  * BASIC FUNCTIONNING:
+  *   Files are cut in chunks of CHUNK_SIZE bytes, named after their SHA-1 hash and stored compressed in "chunks/".
+  *   A chunk already in the repository (eg. from an unchanged file, or a copied one) is never stored twice.
+  *   Every backup() writes a manifest in "snapshots/", listing the folders and, for every file, its size,
+  *   modification time and chunks: it is written last, so an interrupted backup leaves no snapshot behind.
+  *   Files whose size and modification time did not change since the previous snapshot are not even read:
+  *   their chunks are taken from its manifest, so backing up a mostly unchanged folder is only a scan.
+  *   Modification times only have a one second resolution, so files modified at or after the second the previous
+  *   snapshot started are always read again: they could have been saved again, with the same size, while it was taken.
+  *   restore() rebuilds any snapshot, checking the hash of every chunk.
+  *   Contrary to BackupThread, hidden files (like the ".basket" files) are included like any other.
+  *   Snapshots are never deleted: removing old ones would need to collect the chunks they do not share.
+  */
+class BASKET_EXPORT BackupRepository
+{
+public:
+    explicit BackupRepository(const QString &path);
+
+    bool backup(const QString &folder, QString *snapshot = 0);         /// << Take a snapshot of @p folder, named in @p snapshot
+    bool restore(const QString &snapshot, const QString &destination); /// << Rebuild @p snapshot in the @p destination folder
+    QStringList snapshots() const;                                     /// << The names of the snapshots, the oldest first
+    static QDateTime snapshotDate(const QString &snapshot);
+
+    QString path() const         { return m_path;        }
+    QString errorString() const  { return m_errorString; }
+    int     scannedFiles() const { return m_scannedFiles; } /// << Files in the last snapshot taken
+    int     readFiles() const    { return m_readFiles;    } /// << Files that were new or changed since the previous snapshot
+    qint64  storedBytes() const  { return m_storedBytes;  } /// << Compressed size of the new chunks
+
+    static const int CHUNK_SIZE = 1024 * 1024;
+
+private:
+    struct FileEntry {
+        qint64      size;
+        uint        modificationTime;
+        QStringList chunks;
+    };
+    struct Manifest {
+        Manifest() : startTime(0) {}
+        uint                      startTime; /// << When the snapshot started to scan the folder
+        QStringList               folders;
+        QMap<QString, FileEntry>  files; /// << Keyed by path, relative to the backed up folder
+    };
+
+    void listFolder(const QString &folder, const QString &relativePath, Manifest *manifest, QStringList *files);
+    bool storeFile(const QString &fullPath, FileEntry *entry);
+    bool storeChunk(const QByteArray &data, QString *hash);
+    bool loadChunk(const QString &hash, QByteArray *data);
+    bool loadManifest(const QString &snapshot, Manifest *manifest);
+    bool saveManifest(const QString &snapshot, const Manifest &manifest);
+    bool fail(const QString &errorString);
+    QString chunkPath(const QString &hash) const;
+    QString manifestPath(const QString &snapshot) const;
+
+    QString m_path;
+    QString m_errorString;
+    QString m_excludedPath; /// << The repository itself, if it is in the backed up folder
+    int     m_scannedFiles;
+    int     m_readFiles;
+    qint64  m_storedBytes;
+};
+
+#endif // BACKUPREPOSITORY_H
@@ -31,6 +31,10 @@ void setupCmdLineOptions(KCmdLineOptions *opts)
     opts->add("data-folder \\<folder>",
               ki18n("Custom folder to load and save baskets and other "
                     "application data."));
+    opts->add("export-json \\<file>",
+              ki18n("Export every basket and note to the file as JSON Lines "
+                    "(one JSON object per line, - for the standard output), "
+                    "and quit."));
     opts->add("h");
     opts->add("start-hidden",
               ki18n("Automatically hide the main window in the system tray on "
@@ -0,0 +1,162 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by BasKet Note Pads developers                     *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+
+#include "basketcipher.h"
+
+#include <config.h>
+
+#ifdef HAVE_QCA2
+#include <QtCrypto>
+#endif
+
+const char BasketCipher::MAGIC[] = "BKC1";
+
+static const int MAGIC_SIZE       = 4;
+static const int CIPHER_KEY_SIZE  = 32;
+static const int IV_SIZE          = 16;
+static const int MAC_SIZE         = 32;
+
+#ifdef HAVE_QCA2
+static void initializeQca()
+{
+    // QCA must be initialized before any algorithm is used. The first BasketCipher is created by the GUI thread, with the first basket:
+    static QCA::Initializer *initializer = 0;
+    if (!initializer)
+        initializer = new QCA::Initializer();
+}
+
+static QByteArray computeMac(const QByteArray &macKey, const char *data, int length)
+{
+    QCA::MessageAuthenticationCode hmac("hmac(sha256)", QCA::SymmetricKey(macKey));
+    hmac.update(QCA::MemoryRegion(QByteArray::fromRawData(data, length)));
+    return hmac.final().toByteArray();
+}
+#endif // HAVE_QCA2
+
+BasketCipher::BasketCipher()
+{
+#ifdef HAVE_QCA2
+    initializeQca();
+#endif
+}
+
+BasketCipher::~BasketCipher()
+{
+    clear();
+}
+
+bool BasketCipher::isSupported()
+{
+#ifdef HAVE_QCA2
+    initializeQca();
+    return QCA::isSupported("aes256-cbc-pkcs7") && QCA::isSupported("hmac(sha256)");
+#else
+    return false;
+#endif
+}
+
+bool BasketCipher::isCipherText(const QByteArray &data)
+{
+    return data.startsWith(MAGIC);
+}
+
+QByteArray BasketCipher::generateKey()
+{
+#ifdef HAVE_QCA2
+    initializeQca();
+    return QCA::Random::randomArray(KEY_SIZE).toByteArray();
+#else
+    return QByteArray();
+#endif
+}
+
+void BasketCipher::setKey(const QByteArray &key)
+{
+    clear();
+    if (key.size() == KEY_SIZE)
+        m_key = key;
+}
+
+void BasketCipher::clear()
+{
+    if (!m_key.isEmpty())
+        m_key.fill(0); // Do not leave the key in memory
+    m_key.clear();
+}
+
+QByteArray BasketCipher::encrypt(const QByteArray &plainText) const
+{
+#ifdef HAVE_QCA2
+    if (!hasKey())
+        return QByteArray();
+
+    QCA::InitializationVector iv(IV_SIZE); // Random
+    QCA::Cipher cipher("aes256", QCA::Cipher::CBC, QCA::Cipher::PKCS7, QCA::Encode,
+                       QCA::SymmetricKey(m_key.left(CIPHER_KEY_SIZE)), iv);
+    QCA::SecureArray encrypted = cipher.update(QCA::MemoryRegion(plainText));
+    encrypted += cipher.final();
+    if (!cipher.ok())
+        return QByteArray();
+
+    QByteArray result;
+    result.reserve(MAGIC_SIZE + IV_SIZE + encrypted.size() + MAC_SIZE);
+    result.append(MAGIC, MAGIC_SIZE);
+    result.append(iv.toByteArray());
+    result.append(encrypted.toByteArray());
+    result.append(computeMac(m_key.mid(CIPHER_KEY_SIZE), result.constData(), result.size()));
+    return result;
+#else
+    Q_UNUSED(plainText);
+    return QByteArray();
+#endif
+}
+
+bool BasketCipher::decrypt(const QByteArray &cipherText, QByteArray *plainText) const
+{
+#ifdef HAVE_QCA2
+    if (!hasKey() || cipherText.size() < MAGIC_SIZE + IV_SIZE + MAC_SIZE || !isCipherText(cipherText))
+        return false;
+
+    // Check the MAC before decrypting anything, comparing in constant time:
+    int macPosition = cipherText.size() - MAC_SIZE;
+    QByteArray mac = computeMac(m_key.mid(CIPHER_KEY_SIZE), cipherText.constData(), macPosition);
+    char difference = 0;
+    for (int i = 0; i < MAC_SIZE; ++i)
+        difference |= mac.at(i) ^ cipherText.at(macPosition + i);
+    if (difference != 0)
+        return false;
+
+    QCA::Cipher cipher("aes256", QCA::Cipher::CBC, QCA::Cipher::PKCS7, QCA::Decode,
+                       QCA::SymmetricKey(m_key.left(CIPHER_KEY_SIZE)),
+                       QCA::InitializationVector(cipherText.mid(MAGIC_SIZE, IV_SIZE)));
+    QByteArray encrypted = QByteArray::fromRawData(cipherText.constData() + MAGIC_SIZE + IV_SIZE,
+                                                   macPosition - MAGIC_SIZE - IV_SIZE);
+    QCA::SecureArray decrypted = cipher.update(QCA::MemoryRegion(encrypted));
+    decrypted += cipher.final();
+    if (!cipher.ok())
+        return false;
+    *plainText = decrypted.toByteArray();
+    return true;
+#else
+    Q_UNUSED(cipherText);
+    Q_UNUSED(plainText);
+    return false;
+#endif
+}
@@ -0,0 +1,63 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by BasKet Note Pads developers                     *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+
+#ifndef BASKETCIPHER_H
+#define BASKETCIPHER_H
+
+#include <QtCore/QByteArray>
+
+#include "basket_export.h"
+
+/** Fast authenticated encryption of the files of a protected basket, with a random per-basket data key.
+  * BASIC FUNCTIONNING:
+  *   GPG operations are slow (context setup, ASCII armor and, for password protection, key derivation).
+  *   So GPG is only used once per basket: to wrap its data key in the ".basketkey" file (see BasketScene::createDataKey()).
+  *   Every note file (and the ".basket" file) is then encrypted with AES-256 in CBC mode under the first half of that key,
+  *   and authenticated with an HMAC-SHA256 under its second half (encrypt-then-MAC).
+  *   An encrypted file is: MAGIC, a random initialization vector, the cipher text, and the MAC of all of that.
+  *   The encryption methods are const and do not share any state, so they can be called from several threads at once.
+  *   Without QCA, isSupported() is false and nothing can be encrypted nor decrypted.
+  */
+class BASKET_EXPORT BasketCipher
+{
+public:
+    BasketCipher();
+    ~BasketCipher();
+
+    static bool isSupported();                              /// << @return true if the needed algorithms are available
+    static bool isCipherText(const QByteArray &data);       /// << @return true if @p data (or only its first bytes) has been encrypted by a BasketCipher
+    static QByteArray generateKey();                        /// << @return a new random data key, of KEY_SIZE bytes
+
+    void setKey(const QByteArray &key);                     /// << Use @p key for the following encryptions. It is ignored if it is not KEY_SIZE bytes long.
+    QByteArray key() const { return m_key; }
+    bool hasKey() const { return !m_key.isEmpty(); }
+    void clear();                                           /// << Forget the key (eg. when the basket is locked)
+
+    QByteArray encrypt(const QByteArray &plainText) const;                  /// << @return @p plainText encrypted, or an empty array in case of error
+    bool decrypt(const QByteArray &cipherText, QByteArray *plainText) const; /// << @return false if @p cipherText was not encrypted with the key or has been altered
+
+    static const int KEY_SIZE = 64; /// << 32 bytes for the cipher, and 32 bytes for the MAC
+    static const char MAGIC[];      /// << "BKC1", at the start of every encrypted file
+
+private:
+    QByteArray m_key;
+};
+
+#endif // BASKETCIPHER_H
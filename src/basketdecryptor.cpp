@@ -0,0 +1,122 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by BasKet Note Pads developers                     *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+
+#include "basketdecryptor.h"
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QFile>
+#include <QtCore/QRunnable>
+#include <QtCore/QThreadPool>
+
+/** Read and decrypt one file in a worker thread, and send the plain text back to the decryptor, in the GUI thread.
+  */
+class DecryptTask : public QRunnable
+{
+public:
+    DecryptTask(BasketDecryptor *decryptor, const BasketCipher &cipher, const QString &fullPath)
+        : m_decryptor(decryptor), m_cipher(cipher), m_fullPath(fullPath)
+    {
+    }
+    void run()
+    {
+        if (m_decryptor->isCanceled())
+            return;
+
+        QByteArray plainText;
+        bool success = false;
+        QFile file(m_fullPath);
+        if (file.open(QIODevice::ReadOnly)) {
+            QByteArray cipherText = file.readAll();
+            file.close();
+            success = BasketCipher::isCipherText(cipherText) && m_cipher.decrypt(cipherText, &plainText);
+        }
+
+        QMetaObject::invokeMethod(m_decryptor, "taskFinished", Qt::QueuedConnection,
+                                  Q_ARG(QString, m_fullPath), Q_ARG(QByteArray, plainText), Q_ARG(bool, success));
+    }
+private:
+    BasketDecryptor *m_decryptor;
+    BasketCipher     m_cipher;
+    QString          m_fullPath;
+};
+
+BasketDecryptor::BasketDecryptor(const BasketCipher &cipher, QObject *parent)
+        : QObject(parent)
+        , m_cipher(cipher)
+        , m_threadPool(new QThreadPool(this))
+        , m_done(0)
+        , m_total(0)
+        , m_canceled(0)
+{
+}
+
+BasketDecryptor::~BasketDecryptor()
+{
+    // The queued tasks return immediately, and the results already sent are discarded with this object:
+    m_canceled = 1;
+    m_threadPool->waitForDone();
+    for (QHash<QString, QByteArray>::iterator it = m_decrypted.begin(); it != m_decrypted.end(); ++it)
+        it.value().fill(0); // Do not leave the plain texts in memory
+}
+
+void BasketDecryptor::decrypt(const QStringList &fullPaths)
+{
+    for (QStringList::const_iterator it = fullPaths.begin(); it != fullPaths.end(); ++it) {
+        if (m_pending.contains(*it) || m_decrypted.contains(*it))
+            continue;
+        m_pending.insert(*it);
+        ++m_total;
+        m_threadPool->start(new DecryptTask(this, m_cipher, *it));
+    }
+}
+
+bool BasketDecryptor::isDecrypting(const QString &fullPath) const
+{
+    return m_pending.contains(fullPath);
+}
+
+void BasketDecryptor::waitForDone()
+{
+    m_threadPool->waitForDone();
+    // The results are queued to the GUI thread: deliver them now
+    QCoreApplication::sendPostedEvents(this, QEvent::MetaCall);
+}
+
+bool BasketDecryptor::take(const QString &fullPath, QByteArray *plainText)
+{
+    QHash<QString, QByteArray>::iterator it = m_decrypted.find(fullPath);
+    if (it == m_decrypted.end())
+        return false;
+    *plainText = it.value();
+    m_decrypted.erase(it);
+    return true;
+}
+
+void BasketDecryptor::taskFinished(const QString &fullPath, const QByteArray &plainText, bool success)
+{
+    if (!m_pending.remove(fullPath))
+        return;
+
+    ++m_done;
+    if (success)
+        m_decrypted.insert(fullPath, plainText);
+    emit fileReady(fullPath);
+    emit progress(m_done, m_total);
+}
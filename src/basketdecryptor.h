@@ -0,0 +1,75 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by BasKet Note Pads developers                     *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+
+#ifndef BASKETDECRYPTOR_H
+#define BASKETDECRYPTOR_H
+
+#include <QtCore/QObject>
+#include <QtCore/QAtomicInt>
+#include <QtCore/QByteArray>
+#include <QtCore/QHash>
+#include <QtCore/QSet>
+#include <QtCore/QStringList>
+
+#include "basketcipher.h"
+
+class QThreadPool;
+
+/** Decrypt the files of a basket protected with a data key on a thread pool, when it is unlocked.
+  * BASIC FUNCTIONNING:
+  *   Once the data key is unwrapped, BasketScene::load() gives the decryptor every file of the basket folder.
+  *   They are read and decrypted in parallel, by worker threads holding their own copy of the BasketCipher.
+  *   The plain texts are kept in memory only (never in temporary files) until BasketScene::loadFromFile() takes them.
+  *   Notes whose file is still being decrypted are first loaded empty: fileReady() then tells the basket to load them again.
+  *   Files that are not encrypted with the data key (eg. by GPG, with an older version) are left to BasketScene::loadFromFile().
+  *   Deleting the decryptor (eg. when the basket is locked) cancels the remaining decryptions and forgets the plain texts.
+  */
+class BasketDecryptor : public QObject
+{
+    Q_OBJECT
+public:
+    BasketDecryptor(const BasketCipher &cipher, QObject *parent = 0);
+    ~BasketDecryptor();
+
+    void decrypt(const QStringList &fullPaths);                 /// << Start decrypting those files
+    bool isDecrypting(const QString &fullPath) const;           /// << @return true if @p fullPath is not decrypted yet
+    bool isFinished() const { return m_pending.isEmpty(); }
+    void waitForDone();                                         /// << Block until every file is decrypted, and fileReady() was emitted for each of them
+    bool take(const QString &fullPath, QByteArray *plainText);  /// << Hand the plain text of @p fullPath over, if it is decrypted. @return false if it is not.
+    bool isCanceled() const { return m_canceled; }
+
+signals:
+    void fileReady(const QString &fullPath);   /// << @p fullPath is decrypted, or could not be and should be read as usual
+    void progress(int done, int total);
+
+private slots:
+    void taskFinished(const QString &fullPath, const QByteArray &plainText, bool success);
+
+private:
+    BasketCipher               m_cipher;
+    QThreadPool               *m_threadPool;
+    QSet<QString>              m_pending;
+    QHash<QString, QByteArray> m_decrypted;
+    int                        m_done;
+    int                        m_total;
+    QAtomicInt                 m_canceled;
+};
+
+#endif // BASKETDECRYPTOR_H
@@ -27,6 +27,7 @@
 #include <QtCore/QList>
 #include <QtCore/QStringList>
 #include <QtCore/QDateTime>  // seed for rand()
+#include <QtCore/QTime>
 #include <QtCore/QTimeLine>
 #include <QtGui/QApplication>
 #include <QtGui/QDrag>
@@ -44,6 +45,7 @@
 #include <QtGui/QFrame>
 #include <QtGui/QLabel>
 #include <QtGui/QPushButton>
+#include <QtGui/QScrollBar>
 #include <QtGui/QTextDocument>
 #include <QtGui/QAbstractTextDocumentLayout>
 #include <QtGui/QGridLayout>
@@ -76,10 +78,14 @@
 #include <KIO/CopyJob>
 
 #include <stdlib.h>     // rand() function
+#include <stdio.h>      // rename() function
 
+#include "basketcipher.h"
+#include "basketdecryptor.h"
 #include "basketview.h"
 #include "decoratedbasket.h"
 #include "diskerrordialog.h"
+#include "largenoteviewer.h"
 #include "note.h"
 #include "notedrag.h"
 #include "notefactory.h"
@@ -95,6 +101,7 @@
 #include "debugwindow.h"
 #include "exporterdialog.h"
 #include "focusedwidgets.h"
+#include "layoutcache.h"
 
 #include "config.h"
 
@@ -107,6 +114,7 @@
 #endif
 
 const int BasketScene::ANIMATION_DELAY = 2000;
+const int BasketScene::LAZY_LOAD_BUDGET = 15; // ms: about one frame
 
 void debugZone(int zone)
 {
@@ -947,8 +955,12 @@ bool BasketScene::save()
 void BasketScene::aboutToBeActivated()
 {
     if (m_finishLoadOnFirstShow) {
-        FOR_EACH_NOTE(note)
-        note->finishLazyLoad();
+        // The notes are completed little by little once the basket is shown, the visible ones first (see openBasket()).
+        // Until then, those with a known geometry are placed with it:
+        for (Note *note = firstNoteInStack(); note; note = note->nextInStack()) {
+            note->content()->useCachedLayout();
+            m_lazyLoadQueue.append(note);
+        }
 
         //relayoutNotes(/*animate=*/false);
         setFocusedNote(0); // So that during the focusInEvent that will come shortly, the FIRST note is focused.
@@ -960,11 +972,77 @@ void BasketScene::aboutToBeActivated()
     }
 }
 
+void BasketScene::finishLazyLoadChunk()
+{
+    if (m_lazyLoadQueue.isEmpty()) {
+        m_lazyLoadTimer.stop();
+        return;
+    }
+
+    // Complete as many notes as possible without delaying the next frame, and relayout them all at once:
+    QTime time;
+    time.start();
+    m_finishingLazyLoad = true;
+    do
+        m_lazyLoadQueue.takeFirst()->finishLazyLoad();
+    while (!m_lazyLoadQueue.isEmpty() && time.elapsed() < LAZY_LOAD_BUDGET);
+    m_finishingLazyLoad = false;
+    relayoutNotes(/*animate=*/false);
+
+    if (m_lazyLoadQueue.isEmpty())
+        m_lazyLoadTimer.stop();
+    else {
+        promoteVisibleLazyLoads(); // The new heights can have moved other notes into view
+        m_lazyLoadTimer.start(0);
+    }
+}
+
+void BasketScene::promoteVisibleLazyLoads()
+{
+    if (m_lazyLoadQueue.isEmpty())
+        return;
+
+    QRectF visibleRect = m_view->mapToScene(m_view->viewport()->rect()).boundingRect();
+    QList<Note*> visibleNotes;
+    QList<Note*>::iterator it = m_lazyLoadQueue.begin();
+    while (it != m_lazyLoadQueue.end()) {
+        Note *note = *it;
+        if (note->isShown() && visibleRect.intersects(QRectF(note->x(), note->y(), note->width(), note->height()))) {
+            visibleNotes.append(note);
+            it = m_lazyLoadQueue.erase(it);
+        } else
+            ++it;
+    }
+    m_lazyLoadQueue = visibleNotes + m_lazyLoadQueue;
+}
+
+void BasketScene::forgetLazyLoad(Note *note)
+{
+    m_lazyLoadQueue.removeOne(note);
+}
+
+LayoutCache* BasketScene::layoutCache()
+{
+    return (isEncrypted() ? 0 : m_layoutCache);
+}
+
+void BasketScene::saveLayoutCache()
+{
+    if (!m_layoutCache)
+        return;
+    if (isEncrypted())
+        m_layoutCache->discard(); // Do not leave hints about the content of encrypted notes
+    else
+        m_layoutCache->save();
+}
+
 void BasketScene::reload()
 {
     closeEditor();
     unbufferizeAll(); // Keep the memory footprint low
 
+    m_lazyLoadQueue.clear();
+    m_lazyLoadTimer.stop();
     m_firstNote = 0;
 
     m_loaded = false;
@@ -983,6 +1061,7 @@ void BasketScene::load()
     DEBUG_WIN << "Basket[" + folderName() + "]: Loading...";
     QDomDocument *doc = 0;
     QString content;
+    m_armoredFilesFound = false;
 
     // Load properties
     if (loadFromFile(fullPath() + ".basket", &content)) {
@@ -1021,6 +1100,14 @@ void BasketScene::load()
 
     // Load notes
     m_finishLoadOnFirstShow = (Global::bnpView->currentBasket() != this);
+    if (!m_layoutCache) {
+        m_layoutCache = new LayoutCache(fullPath() + ".layout");
+        m_layoutCache->load();
+    }
+#ifdef HAVE_LIBGPGME
+    if (isEncrypted() && m_dataKeyEncryption && m_cipher->hasKey())
+        startDecryption(); // The notes are loaded empty, and then again once their file is decrypted
+#endif
     loadNotes(notes, 0L);
     if (m_shouldConvertPlainTextNotes)
         convertTexts();
@@ -1050,6 +1137,9 @@ void BasketScene::load()
     else
         m_loaded = true;
     enableActions();
+
+    if (isEncrypted() && m_armoredFilesFound && Settings::compactEncryption())
+        QTimer::singleShot(0, this, SLOT(offerCompactEncryption()));
 }
 
 void BasketScene::filterAgain(bool andEnsureVisible/* = true*/)
@@ -1172,7 +1262,14 @@ BasketScene::BasketScene(QWidget *parent, const QString &folderName)
         , m_encryptionType(NoEncryption)
 #ifdef HAVE_LIBGPGME
         , m_gpg(0)
+        , m_cipher(0)
+        , m_newCipher(0)
+        , m_decryptor(0)
 #endif
+        , m_dataKeyEncryption(false)
+        , m_newDataKeyPending(false)
+        , m_armoredFilesFound(false)
+        , m_migrationTotal(0)
         , m_backgroundPixmap(0)
         , m_opaqueBackgroundPixmap(0)
         , m_selectedBackgroundPixmap(0)
@@ -1207,6 +1304,8 @@ BasketScene::BasketScene(QWidget *parent, const QString &folderName)
         , m_startOfShiftSelectionNote(0)
         , m_finishLoadOnFirstShow(false)
         , m_relayoutOnNextShow(false)
+        , m_layoutCache(0)
+        , m_finishingLazyLoad(false)
 {
     m_view = new BasketView(this);
     m_view->setFocusPolicy(Qt::StrongFocus);
@@ -1246,10 +1345,17 @@ BasketScene::BasketScene(QWidget *parent, const QString &folderName)
     connect(&m_timerCountsChanged,       SIGNAL(timeout()),   this, SLOT(countsChangedTimeOut()));
     connect(&m_inactivityAutoSaveTimer,  SIGNAL(timeout()),   this, SLOT(inactivityAutoSaveTimeout()));
     connect(&m_inactivityAutoLockTimer,  SIGNAL(timeout()),   this, SLOT(inactivityAutoLockTimeout()));
+    connect(&m_lazyLoadTimer,            SIGNAL(timeout()),   this, SLOT(finishLazyLoadChunk()));
+    connect(m_view->verticalScrollBar(),   SIGNAL(valueChanged(int)), this, SLOT(promoteVisibleLazyLoads()));
+    connect(m_view->horizontalScrollBar(), SIGNAL(valueChanged(int)), this, SLOT(promoteVisibleLazyLoads()));
 
 #ifdef HAVE_LIBGPGME
     m_gpg = new KGpgMe();
+    m_cipher = new BasketCipher();
+    m_newCipher = new BasketCipher();
 #endif
+    m_dataKeyEncryption = QFile::exists(fullPath() + ".basketkey");
+    m_newDataKeyPending = QFile::exists(fullPath() + ".basketkey.new");
     m_locked = isFileEncrypted();
 }
 
@@ -2260,7 +2366,10 @@ void BasketScene::mouseReleaseEvent(QGraphicsSceneMouseEvent *event)
     case Note::Custom0:
         //unselectAllBut(clicked);
         setFocusedNote(clicked);
-        noteOpen(clicked);
+        if (clicked->content()->isCollapsed())
+            LargeNoteViewer::showNote(clicked);
+        else
+            noteOpen(clicked);
         break;
 
     case Note::GroupExpander:
@@ -2871,6 +2980,8 @@ Note* BasketScene::lastNote()
 
 void BasketScene::deleteNotes()
 {
+    m_lazyLoadQueue.clear();
+    m_lazyLoadTimer.stop();
     Note *note = m_firstNote;
 
     while (note) {
@@ -2946,7 +3057,11 @@ BasketScene::~BasketScene()
         delete m_decryptBox;
 #ifdef HAVE_LIBGPGME
     delete m_gpg;
+    delete m_cipher;
+    delete m_newCipher;
 #endif
+    saveLayoutCache();
+    delete m_layoutCache;
     deleteNotes();
 
 	if(m_view)
@@ -3040,6 +3155,108 @@ void BasketScene::inactivityAutoLockTimeout()
     lock();
 }
 
+void BasketScene::fileDecrypted(const QString &fullPath)
+{
+    // Load the notes by batches, to relayout them once:
+    if (m_decryptedFiles.isEmpty())
+        QTimer::singleShot(0, this, SLOT(loadDecryptedNotes()));
+    m_decryptedFiles.append(fullPath);
+}
+
+void BasketScene::loadDecryptedNotes()
+{
+#ifdef HAVE_LIBGPGME
+    // Find the notes of the batch in one walk of the note tree, rather than one walk per file:
+    QHash<QString, Note*> notes;
+    listNotesByFileName(firstNote(), notes);
+    m_finishingLazyLoad = true;
+    for (QStringList::iterator it = m_decryptedFiles.begin(); it != m_decryptedFiles.end(); ++it) {
+        Note *note = notes.value(QFileInfo(*it).fileName());
+        if (note && note->content())
+            note->content()->loadFromFile(/*lazyLoad=*/m_finishLoadOnFirstShow);
+    }
+    m_decryptedFiles.clear();
+    m_finishingLazyLoad = false;
+    relayoutNotes(/*animate=*/false);
+
+    // Forget the plain texts no note took (eg. of images not displayed yet: they will be decrypted again when needed):
+    if (m_decryptor && m_decryptor->isFinished()) {
+        delete m_decryptor;
+        m_decryptor = 0;
+    }
+#endif
+}
+
+void BasketScene::offerCompactEncryption()
+{
+#ifdef HAVE_LIBGPGME
+    if (m_locked || !m_migrationQueue.isEmpty())
+        return;
+
+    int result = KMessageBox::questionYesNo(m_view,
+                 i18n("<p>The basket <b>%1</b> is protected in the older text format.</p>"
+                      "<p>Do you want to convert it to the compact format? It will be done in the background.</p>", basketName()),
+                 i18n("Convert Protected Basket"), KGuiItem(i18n("&Convert")), KGuiItem(i18n("&Later")),
+                 "compactEncryptionMigration");
+    if (result != KMessageBox::Yes)
+        return;
+
+    m_migrationQueue.append(fullPath() + ".basket");
+    if (QFile::exists(fullPath() + ".basketkey"))
+        m_migrationQueue.append(fullPath() + ".basketkey");
+    QStringList fileNames = QDir(fullPath()).entryList(QDir::Files);
+    for (QStringList::iterator it = fileNames.begin(); it != fileNames.end(); ++it)
+        m_migrationQueue.append(fullPath() + *it);
+    m_migrationTotal = m_migrationQueue.count();
+    QTimer::singleShot(0, this, SLOT(migrateNextFile()));
+#endif
+}
+
+void BasketScene::migrateNextFile()
+{
+#ifdef HAVE_LIBGPGME
+    if (m_migrationQueue.isEmpty()) // The basket has been locked in the meantime
+        return;
+
+    // Convert one file per event loop iteration, so the basket stays usable meanwhile.
+    // Only the armored files are converted: the files encrypted with a data key are already binary.
+    QString path = m_migrationQueue.takeFirst();
+    QFile file(path);
+    if (file.open(QIODevice::ReadOnly)) {
+        QByteArray cipherText = file.readAll();
+        file.close();
+        QByteArray plainText;
+        QByteArray compacted;
+        if (cipherText.startsWith("-----BEGIN PGP MESSAGE-----") && gpgDecrypt(cipherText, &plainText)) {
+            if (gpgEncrypt(plainText, plainText.size(), &compacted)) {
+                m_watcher->stopScan();
+                safelySaveToFile(path, compacted);
+                m_watcher->startScan();
+            }
+            plainText.fill(0);
+        }
+    }
+
+    int done = m_migrationTotal - m_migrationQueue.count();
+    if (m_migrationQueue.isEmpty()) {
+        m_armoredFilesFound = false;
+        Global::bnpView->postStatusbarMessage(i18n("The protected basket has been converted to the compact format."));
+    } else {
+        if (done % 10 == 0)
+            Global::bnpView->postStatusbarMessage(i18n("Converting the protected basket: %1 of %2 files...", done, m_migrationTotal));
+        QTimer::singleShot(0, this, SLOT(migrateNextFile()));
+    }
+#endif
+}
+
+void BasketScene::decryptionProgress(int done, int total)
+{
+    if (done == total)
+        Global::bnpView->postStatusbarMessage(i18n("Decrypted %1 files.", total));
+    else if (done % 20 == 0)
+        Global::bnpView->postStatusbarMessage(i18n("Decrypting files: %1 of %2...", done, total));
+}
+
 void BasketScene::drawBackground ( QPainter * painter, const QRectF & rect )
 {
   if (!m_loadingLaunched) {
@@ -3230,8 +3447,8 @@ void BasketScene::unsetNotesWidth()
 
 void BasketScene::relayoutNotes(bool animate)
 {
-    if (Global::bnpView->currentBasket() != this)
-        return; // Optimize load time, and basket will be relaid out when activated, anyway
+    if (Global::bnpView->currentBasket() != this || m_finishingLazyLoad)
+        return; // Optimize load time, and basket will be relaid out when activated (or when all lazy loads are finished), anyway
 
     if (!Settings::playAnimations())
         animate = false;
@@ -3826,7 +4043,10 @@ bool BasketScene::closeEditor()
 void BasketScene::closeBasket()
 {
     closeEditor();
+    m_lazyLoadTimer.stop(); // Resumed by openBasket()
     unbufferizeAll(); // Keep the memory footprint low
+    saveLayoutCache();
+    emit closed();
     if (isEncrypted()) {
         if (Settings::enableReLockTimeout()) {
             int seconds = Settings::reLockTimeoutMinutes() * 60;
@@ -3840,6 +4060,12 @@ void BasketScene::openBasket()
 {
     if (m_inactivityAutoLockTimer.isActive())
         m_inactivityAutoLockTimer.stop();
+
+    // The basket has just been relaid out: complete the visible notes before it is painted, and the others later:
+    if (!m_lazyLoadQueue.isEmpty()) {
+        promoteVisibleLazyLoads();
+        finishLazyLoadChunk();
+    }
 }
 
 Note* BasketScene::theSelectedNote()
@@ -3928,6 +4154,9 @@ void BasketScene::noteEdit(Note *note, bool justAdded, const QPointF &clickedPoi
         return;
     }
 
+    if (m_lazyLoadQueue.removeOne(note))
+        note->finishLazyLoad();
+
     if (note != m_focusedNote) {
         setFocusedNote(note);
         m_startOfShiftSelectionNote = note;
@@ -4545,6 +4774,15 @@ Note* BasketScene::noteForFullPath(const QString &path)
     return 0;
 }
 
+void BasketScene::listNotesByFileName(Note *first, QHash<QString, Note*> &notes)
+{
+    for (Note *note = first; note; note = note->next()) {
+        if (note->content())
+            notes.insert(note->content()->fileName(), note);
+        listNotesByFileName(note->firstChild(), notes);
+    }
+}
+
 void BasketScene::deleteFiles()
 {
     m_watcher->stopScan();
@@ -5098,21 +5336,60 @@ bool BasketScene::setProtection(int type, QString key)
 #ifdef HAVE_LIBGPGME
     if (type == PasswordEncryption || // Ask a new password
             m_encryptionType != type || m_encryptionKey != key) {
+        // A previous protection change was interrupted: first save the files it encrypted with the current key, to forget its key:
+        if (m_newDataKeyPending) {
+            if (!saveAgain())
+                return false;
+            QFile::remove(fullPath() + ".basketkey.new");
+            m_newCipher->clear();
+            m_newDataKeyPending = false;
+        }
+
         int savedType = m_encryptionType;
         QString savedKey = m_encryptionKey;
 
+        bool savedDataKeyEncryption = m_dataKeyEncryption;
+        QByteArray savedDataKey = m_cipher->key();
+
         m_encryptionType = type;
         m_encryptionKey = key;
         m_gpg->clearCache();
 
-        if (saveAgain()) {
+        // Protect the basket with a new data key, so GPG is only used once to wrap it, instead of once per file:
+        QByteArray wrappedKey;
+        m_dataKeyEncryption = (type != NoEncryption && BasketCipher::isSupported());
+        m_cipher->clear();
+        bool success = (!m_dataKeyEncryption || createDataKey(&wrappedKey));
+        // The new key is saved aside before any file is encrypted with it, so they can still be decrypted if we are interrupted.
+        // It only replaces the ".basketkey" file once every file is encrypted with it (see commitNewDataKey()):
+        if (success && m_dataKeyEncryption) {
+            success = safelySaveToFile(fullPath() + ".basketkey.new", wrappedKey);
+            if (success) {
+                m_newCipher->setKey(m_cipher->key());
+                m_newDataKeyPending = true;
+            }
+        }
+        bool saveStarted = success;
+        if (success && saveAgain() && (!m_dataKeyEncryption || commitNewDataKey())) {
+            if (!m_dataKeyEncryption)
+                QFile::remove(fullPath() + ".basketkey");
             emit propertiesChanged(this);
-        } else {
-            m_encryptionType = savedType;
-            m_encryptionKey = savedKey;
-            m_gpg->clearCache();
-            return false;
+            return true;
         }
+
+        m_encryptionType = savedType;
+        m_encryptionKey = savedKey;
+        m_dataKeyEncryption = savedDataKeyEncryption;
+        m_cipher->setKey(savedDataKey);
+        m_gpg->clearCache();
+        // Save the files already rewritten with the previous protection again.
+        // Until it succeeds, the new key is kept: files encrypted with it are still decrypted with m_newCipher (see loadFromFile()).
+        if (saveStarted && saveAgain() && m_newDataKeyPending) {
+            QFile::remove(fullPath() + ".basketkey.new");
+            m_newCipher->clear();
+            m_newDataKeyPending = false;
+        }
+        return false;
     }
     return true;
 #else
@@ -5127,6 +5404,14 @@ bool BasketScene::saveAgain()
 {
     bool result = false;
 
+#ifdef HAVE_LIBGPGME
+    // Files still being decrypted would not be saved: finish to decrypt and load them first (see saveToFile()):
+    if (m_decryptor) {
+        m_decryptor->waitForDone();
+        loadDecryptedNotes();
+    }
+#endif
+
     m_watcher->stopScan();
     // Re-encrypt basket file:
     result = save();
@@ -5161,14 +5446,24 @@ bool BasketScene::isEncrypted()
     return (m_encryptionType != NoEncryption);
 }
 
+/** Files encrypted by GPG are ASCII armored, or binary OpenPGP packets preceded by BINARY_PGP_MAGIC (see Settings::compactEncryption()).
+ * Contrary to the armor, that magic is not part of the OpenPGP message: it is removed before decrypting it.
+ */
+static const char BINARY_PGP_MAGIC[] = "BKG1";
+static const int  BINARY_PGP_MAGIC_SIZE = 4;
+
+/*static*/ bool BasketScene::isGpgCipherText(const QByteArray &data)
+{
+    return data.startsWith(BINARY_PGP_MAGIC) || data.startsWith("-----BEGIN PGP MESSAGE-----");
+}
+
 bool BasketScene::isFileEncrypted()
 {
     QFile file(fullPath() + ".basket");
 
     if (file.open(QIODevice::ReadOnly)) {
-        // Should be ASCII anyways
-        QString line = file.readLine(32);
-        if (line.startsWith("-----BEGIN PGP MESSAGE-----"))
+        QByteArray start = file.read(32);
+        if (isGpgCipherText(start) || BasketCipher::isCipherText(start))
             return true;
     }
     return false;
@@ -5176,37 +5471,38 @@ bool BasketScene::isFileEncrypted()
 
 bool BasketScene::loadFromFile(const QString &fullPath, QByteArray *array)
 {
+#ifdef HAVE_LIBGPGME
+    if (m_decryptor) {
+        if (m_decryptor->take(fullPath, array))
+            return true;
+        if (m_decryptor->isDecrypting(fullPath))
+            return false; // Loaded again once decrypted (see fileDecrypted())
+    }
+#endif
+
     QFile file(fullPath);
-    bool encrypted = false;
 
     if (file.open(QIODevice::ReadOnly)) {
         *array = file.readAll();
-        QByteArray magic = "-----BEGIN PGP MESSAGE-----";
-        int i = 0;
-
-        if (array->size() > magic.size())
-            for (i = 0; array->at(i) == magic[i]; ++i)
-                ;
-        if (i == magic.size()) {
-            encrypted = true;
-        }
         file.close();
+        // Notes of an unprotected basket are never decrypted, even if they happen to start with a magic.
+        // The ".basket" file is probed before its properties tell if the basket is protected (see isFileEncrypted()):
+        if (!isEncrypted() && !m_newDataKeyPending && fullPath != BasketScene::fullPath() + ".basket")
+            return true;
 #ifdef HAVE_LIBGPGME
-        if (encrypted) {
+        if (BasketCipher::isCipherText(*array)) {
             QByteArray tmp(*array);
-
-            tmp.detach();
-            // Only use gpg-agent for private key encryption since it doesn't
-            // cache password used in symmetric encryption.
-            m_gpg->setUseGnuPGAgent(Settings::useGnuPGAgent() && m_encryptionType == PrivateKeyEncryption);
-            if (m_encryptionType == PrivateKeyEncryption)
-                m_gpg->setText(i18n("Please enter the password for the following private key:"), false);
-            else
-                m_gpg->setText(i18n("Please enter the password for the basket <b>%1</b>:", basketName()), false); // Used when decrypting
-            return m_gpg->decrypt(tmp, array);
+            if (loadDataKey() && m_cipher->decrypt(tmp, array))
+                return true;
+            // The file may have been encrypted by an interrupted protection change (see setProtection()):
+            return m_newDataKeyPending && loadNewDataKey() && m_newCipher->decrypt(tmp, array);
+        }
+        if (isGpgCipherText(*array)) {
+            QByteArray tmp(*array);
+            return gpgDecrypt(tmp, array);
         }
 #else
-        if (encrypted) {
+        if (isGpgCipherText(*array) || BasketCipher::isCipherText(*array)) {
             return false;
         }
 #endif
@@ -5232,20 +5528,19 @@ bool BasketScene::saveToFile(const QString& fullPath, const QByteArray& array, u
     QByteArray tmp;
 
 #ifdef HAVE_LIBGPGME
-    if (isEncrypted()) {
-        QString key = QString::null;
-
-        // We only use gpg-agent for private key encryption and saving without
-        // public key doesn't need one.
-        m_gpg->setUseGnuPGAgent(false);
-        if (m_encryptionType == PrivateKeyEncryption) {
-            key = m_encryptionKey;
-            // public key doesn't need password
-            m_gpg->setText("", false);
-        } else
-            m_gpg->setText(i18n("Please assign a password to the basket <b>%1</b>:", basketName()), true); // Used when defining a new password
-
-        success = m_gpg->encrypt(array, length, &tmp, key);
+    if (m_decryptor && m_decryptor->isDecrypting(fullPath)) {
+        kDebug() << "Not overwriting a note that is still being decrypted: " << fullPath;
+        return false;
+    }
+    if (isEncrypted() && m_dataKeyEncryption) {
+        success = loadDataKey();
+        if (success) {
+            tmp = m_cipher->encrypt(QByteArray::fromRawData(array.constData(), length));
+            success = !tmp.isEmpty();
+            length = tmp.size();
+        }
+    } else if (isEncrypted()) {
+        success = gpgEncrypt(array, length, &tmp);
         length = tmp.size();
     } else
         tmp = array;
@@ -5267,6 +5562,139 @@ bool BasketScene::saveToFile(const QString& fullPath, const QByteArray& array, u
       return false;
 }
 
+#ifdef HAVE_LIBGPGME
+/** Decrypt @p cipherText with GPG, be it armored or in the compact format.
+ */
+bool BasketScene::gpgDecrypt(const QByteArray &cipherText, QByteArray *plainText)
+{
+    // Only use gpg-agent for private key encryption since it doesn't
+    // cache password used in symmetric encryption.
+    m_gpg->setUseGnuPGAgent(Settings::useGnuPGAgent() && m_encryptionType == PrivateKeyEncryption);
+    if (m_encryptionType == PrivateKeyEncryption)
+        m_gpg->setText(i18n("Please enter the password for the following private key:"), false);
+    else
+        m_gpg->setText(i18n("Please enter the password for the basket <b>%1</b>:", basketName()), false); // Used when decrypting
+
+    if (cipherText.startsWith(BINARY_PGP_MAGIC))
+        return m_gpg->decrypt(cipherText.mid(BINARY_PGP_MAGIC_SIZE), plainText);
+    m_armoredFilesFound = true; // Offer to convert them, see offerCompactEncryption()
+    return m_gpg->decrypt(cipherText, plainText);
+}
+
+/** Encrypt the @p length first bytes of @p plainText with GPG for the protection of the basket,
+ * armored or in the compact format, according to Settings::compactEncryption().
+ */
+bool BasketScene::gpgEncrypt(const QByteArray &plainText, unsigned long length, QByteArray *cipherText)
+{
+    QString key = QString::null;
+
+    // We only use gpg-agent for private key encryption and saving without
+    // public key doesn't need one.
+    m_gpg->setUseGnuPGAgent(false);
+    if (m_encryptionType == PrivateKeyEncryption) {
+        key = m_encryptionKey;
+        // public key doesn't need password
+        m_gpg->setText("", false);
+    } else
+        m_gpg->setText(i18n("Please assign a password to the basket <b>%1</b>:", basketName()), true); // Used when defining a new password
+
+    bool compact = Settings::compactEncryption();
+    m_gpg->setArmor(!compact);
+    if (!m_gpg->encrypt(plainText, length, cipherText, key))
+        return false;
+    if (compact)
+        cipherText->prepend(BINARY_PGP_MAGIC);
+    return true;
+}
+
+/** Unwrap the data key from the ".basketkey" file, if it was not already done.
+ * This is the only GPG operation needed to load a basket protected with a data key.
+ */
+bool BasketScene::loadDataKey()
+{
+    if (m_cipher->hasKey())
+        return true;
+
+    QFile file(fullPath() + ".basketkey");
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+    QByteArray wrappedKey = file.readAll();
+    file.close();
+
+    QByteArray key;
+    if (!gpgDecrypt(wrappedKey, &key))
+        return false;
+    m_cipher->setKey(key);
+    key.fill(0);
+    return m_cipher->hasKey();
+}
+
+/** Unwrap the data key from the ".basketkey.new" file left by a protection change that did not finish, if it was not already done.
+ */
+bool BasketScene::loadNewDataKey()
+{
+    if (m_newCipher->hasKey())
+        return true;
+
+    QFile file(fullPath() + ".basketkey.new");
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+    QByteArray wrappedKey = file.readAll();
+    file.close();
+
+    QByteArray key;
+    if (!gpgDecrypt(wrappedKey, &key))
+        return false;
+    m_newCipher->setKey(key);
+    key.fill(0);
+    return m_newCipher->hasKey();
+}
+
+/** Every file is now encrypted with the new data key: replace the ".basketkey" file by the ".basketkey.new" one.
+ * The rename is atomic, so a crash leaves one of the two keys in place, along with the other file.
+ */
+bool BasketScene::commitNewDataKey()
+{
+    QString newKeyPath = fullPath() + ".basketkey.new";
+    if (::rename(QFile::encodeName(newKeyPath), QFile::encodeName(fullPath() + ".basketkey")) != 0) {
+        kDebug() << "Cannot replace the data key of the basket by " << newKeyPath;
+        return false;
+    }
+    m_newCipher->clear();
+    m_newDataKeyPending = false;
+    return true;
+}
+
+/** Decrypt every file of the basket on worker threads, instead of one by one while the notes are loaded.
+ */
+void BasketScene::startDecryption()
+{
+    delete m_decryptor;
+    m_decryptor = new BasketDecryptor(*m_cipher, this);
+    connect(m_decryptor, SIGNAL(fileReady(const QString&)), this, SLOT(fileDecrypted(const QString&)));
+    connect(m_decryptor, SIGNAL(progress(int, int)),        this, SLOT(decryptionProgress(int, int)));
+
+    QStringList fullPaths;
+    QStringList fileNames = QDir(fullPath()).entryList(QDir::Files); // Without the hidden ".basket" and ".basketkey"
+    for (QStringList::iterator it = fileNames.begin(); it != fileNames.end(); ++it)
+        fullPaths.append(fullPath() + *it);
+    m_decryptor->decrypt(fullPaths);
+}
+
+/** Generate a new data key for the basket, and wrap it with GPG in @p wrappedKey, to be saved in the ".basketkey" file.
+ * The user is asked for the new password if the basket is protected by a password.
+ */
+bool BasketScene::createDataKey(QByteArray *wrappedKey)
+{
+    QByteArray key = BasketCipher::generateKey();
+    bool success = gpgEncrypt(key, key.size(), wrappedKey);
+    if (success)
+        m_cipher->setKey(key);
+    key.fill(0);
+    return success && m_cipher->hasKey();
+}
+#endif // HAVE_LIBGPGME
+
 /**
  * A safer version of saveToFile, that doesn't perform encryption.  To save a
  * file owned by a basket (i.e. a basket or a note file), use saveToFile(), but
@@ -5337,7 +5765,13 @@ void BasketScene::lock()
 {
 #ifdef HAVE_LIBGPGME
     closeEditor();
+    delete m_decryptor;
+    m_decryptor = 0;
+    m_decryptedFiles.clear();
+    m_migrationQueue.clear();
     m_gpg->clearCache();
+    m_cipher->clear();
+    m_newCipher->clear();
     m_locked = true;
     enableActions();
     deleteNotes();
@@ -21,8 +21,10 @@
 #ifndef BASKET_H
 #define BASKET_H
 
+#include <QtCore/QHash>
 #include <QtCore/QList>
 #include <QtCore/QSet>
+#include <QtCore/QStringList>
 #include <QtCore/QTimer>
 #include <QtGui/QTextCursor>
 #include <QtGui/QClipboard>
@@ -60,7 +62,10 @@ namespace KIO {
     class Job; 
 }
 
+class BasketCipher;
+class BasketDecryptor;
 class DecoratedBasket;
+class LayoutCache;
 class Note;
 class NoteEditor;
 class Tag;
@@ -235,7 +240,23 @@ private:
     QString m_encryptionKey;
 #ifdef HAVE_LIBGPGME
     KGpgMe* m_gpg;
+    BasketCipher* m_cipher; /// << Holds the data key of the basket once it is unwrapped
+    BasketCipher* m_newCipher; /// << Holds the data key being set by setProtection(), until every file is encrypted with it
+    BasketDecryptor* m_decryptor; /// << Decrypts the files in the background while the basket is being unlocked
+    void startDecryption();
+    bool loadDataKey();
+    bool loadNewDataKey();
+    bool commitNewDataKey();
+    bool createDataKey(QByteArray *wrappedKey);
+    bool gpgDecrypt(const QByteArray &cipherText, QByteArray *plainText);
+    bool gpgEncrypt(const QByteArray &plainText, unsigned long length, QByteArray *cipherText);
 #endif
+    bool m_dataKeyEncryption; /// << True if the files are encrypted by m_cipher with a data key wrapped by GPG in the ".basketkey" file, instead of by GPG one by one
+    bool m_newDataKeyPending; /// << True while the ".basketkey.new" file exists: a protection change did not finish, and some files may be encrypted with its key
+    QStringList m_decryptedFiles; /// << Files decrypted by m_decryptor, whose notes are still to be loaded again
+    bool        m_armoredFilesFound; /// << True if files were encrypted by GPG in the ASCII armored format, that can be converted to the compact one
+    QStringList m_migrationQueue;    /// << Files still to be converted to the compact format
+    int         m_migrationTotal;
     QTimer      m_inactivityAutoLockTimer;
     void enableActions();
 
@@ -243,6 +264,11 @@ private slots:
     void loadNotes(const QDomElement &notes, Note *parent);
     void saveNotes(QDomDocument &document, QDomElement &element, Note *parent);
     void unlock();
+    void fileDecrypted(const QString &fullPath);
+    void loadDecryptedNotes();
+    void decryptionProgress(int done, int total);
+    void offerCompactEncryption();
+    void migrateNextFile();
 protected slots:
     void inactivityAutoLockTimeout();
 public slots:
@@ -254,6 +280,7 @@ public slots:
 public:
     bool isEncrypted();
     bool isFileEncrypted();
+    static bool isGpgCipherText(const QByteArray &data); /// << @return true if @p data (or only its first bytes) has been encrypted by GPG, armored or in the compact format
     bool isLocked()        {
         return m_locked;
     };
@@ -436,6 +463,7 @@ signals:
     void resetStatusBarText();                     /// << Equivalent to setStatusBarText("").
     void propertiesChanged(BasketScene *basket);
     void countsChanged(BasketScene *basket);
+    void closed(); /// << Another basket has been made current.
 public slots:
     void linkLookChanged();
     void signalCountsChanged();
@@ -587,6 +615,8 @@ public slots:
     void slotCopyingDone2(KIO::Job *job, const KUrl &from, const KUrl &to);
 public:
     Note* noteForFullPath(const QString &path);
+private:
+    void listNotesByFileName(Note *first, QHash<QString, Note*> &notes);
 
 /// EXPORTATION:
 public:
@@ -671,8 +701,20 @@ public:
 private:
     bool m_finishLoadOnFirstShow;
     bool m_relayoutOnNextShow;
+    LayoutCache  *m_layoutCache;
+    QList<Note*>  m_lazyLoadQueue;     /// << Lazy-loaded notes still to be completed, the visible ones first
+    QTimer        m_lazyLoadTimer;
+    bool          m_finishingLazyLoad; /// << Relayout once for all the notes completed by finishLazyLoadChunk()
+    static const int LAZY_LOAD_BUDGET;
+    void saveLayoutCache();
 public:
     void aboutToBeActivated();
+    LayoutCache* layoutCache(); /// << @return 0 if the geometry of the notes is not cached (eg. for encrypted baskets)
+    void forgetLazyLoad(Note *note); /// << Called when @p note is deleted, to not complete its loading anymore
+private slots:
+    void finishLazyLoadChunk();
+    void promoteVisibleLazyLoads();
+public:
 
     
     QGraphicsView *graphicsView() { return m_view; }
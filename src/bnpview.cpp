@@ -53,6 +53,7 @@
 #include <KDE/KActionCollection>
 #include <KDE/KStandardShortcut>
 #include <KDE/KToggleAction>
+#include <KDE/KSaveFile>
 
 #include <kdeversion.h>
 
@@ -84,11 +85,13 @@
 #include "noteedit.h" // To launch InlineEditors::initToolBars()
 #include "archive.h"
 #include "htmlexporter.h"
+#include "jsonlinesexporter.h"
 #include "crashhandler.h"
 #include "likeback.h"
 #include "backup.h"
 #include "notefactory.h"
 #include "history.h"
+#include "iconmanager.h"
 
 #include "bnpviewadaptor.h"
 
@@ -126,6 +129,7 @@ BNPView::BNPView(QWidget *parent, const char *name, KXMLGUIClient *aGUIClient,
 
     // Needed when loading the baskets:
     Global::backgroundManager = new BackgroundManager();
+    connect(IconManager::instance(), SIGNAL(iconsChanged()), this, SLOT(iconThemeChanged()));
 
     setupGlobalShortcuts();
     m_history = new QUndoStack(this);
@@ -525,6 +529,11 @@ void BNPView::setupActions()
     a->setShortcut(0);
     m_actExportToHtml = a;
 
+    a = ac->addAction("basket_export_json", this, SLOT(exportToJsonLines()));
+    a->setText(i18n("&JSON Lines for Other Tools..."));
+    a->setIcon(KIcon("text-x-generic"));
+    a->setShortcut(0);
+
     a = ac->addAction("basket_import_knotes", this, SLOT(importKNotes()));
     a->setText(i18n("K&Notes"));
     a->setIcon(KIcon("knotes"));
@@ -1530,6 +1539,18 @@ void BNPView::linkLookChanged()
     }
 }
 
+void BNPView::iconThemeChanged()
+{
+    // The emblems are drawn in the buffered note pixmaps, and the link icons define the note sizes:
+    QTreeWidgetItemIterator it(m_tree);
+    while (*it) {
+        BasketListViewItem *item = ((BasketListViewItem*) * it);
+        item->basket()->unbufferizeAll();
+        item->basket()->linkLookChanged();
+        ++it;
+    }
+}
+
 void BNPView::filterPlacementChanged(bool onTop)
 {
     QTreeWidgetItemIterator it(m_tree);
@@ -1597,6 +1618,32 @@ void BNPView::exportToHTML()
 {
     HTMLExporter exporter(currentBasket());
 }
+
+/** Export every basket, read from the disk, for tools that cannot read the .basket files (see JsonLinesExporter).
+  */
+void BNPView::exportToJsonLines()
+{
+    KConfigGroup config = KGlobal::config()->group("Export to JSON Lines");
+    QString folder = config.readEntry("lastFolder", QDir::homePath()) + "/";
+    QString filter = "*.jsonl *.ndjson|" + i18n("JSON Lines Files") + "\n*|" + i18n("All Files");
+    QString destination = KFileDialog::getSaveFileName(folder + "baskets.jsonl", filter, this, i18n("Export to JSON Lines"),
+                                                       KFileDialog::ConfirmOverwrite);
+    if (destination.isEmpty()) // User canceled
+        return;
+    config.writeEntry("lastFolder", KUrl(destination).directory());
+    config.sync();
+
+    save(); // The basket tree is read from the disk too
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    KSaveFile file(destination);
+    JsonLinesExporter exporter(Global::savesFolder());
+    bool success = file.open(QIODevice::WriteOnly) && exporter.exportTo(&file) && file.finalize();
+    QApplication::restoreOverrideCursor();
+    if (!success) {
+        file.abort();
+        KMessageBox::error(this, exporter.errorString().isEmpty() ? file.errorString() : exporter.errorString(), i18n("Export to JSON Lines"));
+    }
+}
 void BNPView::editNote()
 {
     currentBasket()->noteEdit();
@@ -2335,7 +2382,7 @@ QString BNPView::s_fileToOpen = "";
 
 void BNPView::delayedOpenArchive()
 {
-    Archive::open(s_fileToOpen);
+    Archive::browse(s_fileToOpen);
 }
 
 QString BNPView::s_basketToOpen = "";
@@ -2351,7 +2398,7 @@ void BNPView::openArchive()
     QString filter = "*.baskets|" + i18n("Basket Archives") + "\n*|" + i18n("All Files");
     QString path = KFileDialog::getOpenFileName(KUrl(), filter, this, i18n("Open Basket Archive"));
     if (!path.isEmpty()) // User has not canceled
-        Archive::open(path);
+        Archive::browse(path);
 }
 
 void BNPView::activatedTagShortcut()
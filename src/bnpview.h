@@ -135,6 +135,7 @@ public slots:
     /** Note */
     void activatedTagShortcut();
     void exportToHTML();
+    void exportToJsonLines();
     void editNote();
     void cutNote();
     void copyNote();
@@ -234,6 +235,7 @@ private slots:
     void isLockedChanged();
     void lateInit();
     void onFirstShow();
+    void iconThemeChanged();
 
 public:
     KAction       *m_actEditNote;
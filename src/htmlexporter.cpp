@@ -28,6 +28,7 @@
 #include "config.h"
 #include "linklabel.h"
 #include "notecontent.h"
+#include "iconmanager.h"
 
 #include <KDE/KApplication>
 #include <KDE/KAboutData>
@@ -38,18 +39,76 @@
 #include <KDE/KFileDialog>
 #include <KDE/KMessageBox>
 #include <KDE/KProgressDialog>
+#include <KDE/KSaveFile>
 
 #include <KDE/KIO/Job>      //For KIO::file_copy
-#include <KDE/KIO/CopyJob>  //For KIO::copy
 
+#include <QtCore/QBuffer>
+#include <QtCore/QCryptographicHash>
+#include <QtCore/QDateTime>
 #include <QtCore/QDir>
 #include <QtCore/QFile>
+#include <QtCore/QFileInfo>
 #include <QtCore/QTextStream>
 #include <QtCore/QList>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QRunnable>
+#include <QtCore/QThreadPool>
 #include <QtGui/QPainter>
 #include <QtGui/QPixmap>
+#include <QtXml/QDomDocument>
+
+#include <unistd.h> // usleep()
+
+/** Write an exported page (and the text of its notes) and copy the data files of its basket, in a worker thread.
+  * If anything fails, the truncated files are removed and the basket is added to the failed ones of the exporter.
+  */
+class PageWriter : public QRunnable
+{
+public:
+    PageWriter(HTMLExporter *exporter, const QString &folderName, const QMap<QString, QByteArray> &files, const QMap<QString, QString> &copies)
+        : m_exporter(exporter), m_folderName(folderName), m_files(files), m_copies(copies)
+    {
+    }
+    void run()
+    {
+        bool success = true;
+        for (QMap<QString, QByteArray>::const_iterator it = m_files.constBegin(); it != m_files.constEnd(); ++it) {
+            QFile file(it.key());
+            if (!file.open(QIODevice::WriteOnly) || file.write(it.value()) != it.value().size() || !file.flush()) {
+                kDebug() << "Cannot write the exported file" << it.key();
+                file.remove();
+                success = false;
+            }
+        }
+
+        for (QMap<QString, QString>::const_iterator it = m_copies.constBegin(); it != m_copies.constEnd(); ++it) {
+            if (!QFile::copy(it.value(), it.key())) {
+                kDebug() << "Cannot copy" << it.value() << "to" << it.key();
+                QFile::remove(it.key());
+                success = false;
+            }
+        }
+
+        if (!success) {
+            QMutexLocker locker(&m_exporter->m_failedMutex);
+            m_exporter->m_failedBaskets.insert(m_folderName);
+        }
+        m_exporter->m_pendingPages.deref();
+    }
+private:
+    HTMLExporter              *m_exporter;
+    QString                    m_folderName;
+    QMap<QString, QByteArray>  m_files;
+    QMap<QString, QString>     m_copies;
+};
 
 HTMLExporter::HTMLExporter(BasketScene *basket)
+    : m_threadPool(new QThreadPool())
+    , m_pendingPages(0)
+    , m_incremental(false)
+    , m_startTime(0)
+    , m_previousStartTime(0)
 {
     QDir dir;
 
@@ -67,9 +126,21 @@ HTMLExporter::HTMLExporter(BasketScene *basket)
         // User canceled?
         if (destination.isEmpty())
             return;
-        // File already existing? Ask for overriding:
+        // File already existing? Ask for updating it if it was exported by BasKet, or for overriding it:
+        m_incremental = dir.exists(i18nc("HTML export folder (files)", "%1_files", destination) + "/manifest.xml");
         if (dir.exists(destination)) {
-            int result = KMessageBox::questionYesNoCancel(
+            int result;
+            if (m_incremental)
+                result = KMessageBox::questionYesNoCancel(
+                             0,
+                             "<qt>" + i18n("The file <b>%1</b> already exists. Do you want to update it?<br>"
+                                           "Only the baskets modified since it was exported will be exported again.",
+                                           KUrl(destination).fileName()),
+                             i18n("Update File?"),
+                             KGuiItem(i18n("&Update"), "document-save")
+                         );
+            else
+                result = KMessageBox::questionYesNoCancel(
                              0,
                              "<qt>" + i18n("The file <b>%1</b> already exists. Do you really want to override it?",
                                            KUrl(destination).fileName()),
@@ -98,11 +169,21 @@ HTMLExporter::HTMLExporter(BasketScene *basket)
     prepareExport(basket, destination);
     exportBasket(basket, /*isSubBasketScene*/false);
 
+    waitForPages();
+    saveManifest();
+    writeSearchIndex();
     progress->setValue(progress->value() + 1); // Finishing finished
+
+    if (!m_failedBaskets.isEmpty())
+        KMessageBox::error(0, i18n("The export to %1 is incomplete: some pages or files could not be written. "
+                                   "Check that the disk is not full, and export again to complete it.", destination),
+                           i18n("Export to HTML"));
 }
 
 HTMLExporter::~HTMLExporter()
 {
+    m_threadPool->waitForDone();
+    delete m_threadPool;
 }
 
 void HTMLExporter::prepareExport(BasketScene *basket, const QString &fullPath)
@@ -120,9 +201,16 @@ void HTMLExporter::prepareExport(BasketScene *basket, const QString &fullPath)
     BasketListViewItem *item = Global::bnpView->listViewItemForBasket(basket);
     withBasketTree = (item->childCount() >= 0);
 
-    // Create and empty the files folder:
+    // Create and empty the files folder, or only read what was exported the last time when updating the export:
     QString filesFolderPath = i18nc("HTML export folder (files)", "%1_files", filePath) + "/"; // eg.: "/home/seb/foo.html_files/"
-    Tools::deleteRecursively(filesFolderPath);
+    m_manifestPath = filesFolderPath + "manifest.xml";
+    m_startTime = QDateTime::currentDateTime().toTime_t();
+    m_previousStartTime = 0;
+    m_exportSignature = exportSignature();
+    if (m_incremental)
+        loadManifest();
+    else
+        Tools::deleteRecursively(filesFolderPath);
     QDir dir;
     dir.mkdir(filesFolderPath);
 
@@ -130,19 +218,17 @@ void HTMLExporter::prepareExport(BasketScene *basket, const QString &fullPath)
     iconsFolderPath   = filesFolderPath + i18nc("HTML export folder (icons)",   "icons")   + "/"; // eg.: "/home/seb/foo.html_files/icons/"
     imagesFolderPath  = filesFolderPath + i18nc("HTML export folder (images)",  "images")  + "/"; // eg.: "/home/seb/foo.html_files/images/"
     basketsFolderPath = filesFolderPath + i18nc("HTML export folder (baskets)", "baskets") + "/"; // eg.: "/home/seb/foo.html_files/baskets/"
+    searchFolderPath  = filesFolderPath + i18nc("HTML export folder (search)",  "search")  + "/"; // eg.: "/home/seb/foo.html_files/search/"
     dir.mkdir(iconsFolderPath);
     dir.mkdir(imagesFolderPath);
     dir.mkdir(basketsFolderPath);
+    dir.mkdir(searchFolderPath);
 
     progress->setValue(progress->value() + 1); // Preparation finished
 }
 
 void HTMLExporter::exportBasket(BasketScene *basket, bool isSubBasket)
 {
-    if (!basket->isLoaded()) {
-        basket->load();
-    }
-
     currentBasket = basket;
 
     // Compute the absolute & relative paths for this basket:
@@ -162,6 +248,7 @@ void HTMLExporter::exportBasket(BasketScene *basket, bool isSubBasket)
     }
     iconsFolderName   = (isSubBasket ? "../" : filesFolderName) + i18nc("HTML export folder (icons)",   "icons")   + "/"; // eg.: "foo.html_files/icons/"   or "../icons/"
     imagesFolderName  = (isSubBasket ? "../" : filesFolderName) + i18nc("HTML export folder (images)",  "images")  + "/"; // eg.: "foo.html_files/images/"  or "../images/"
+    searchFolderName  = (isSubBasket ? "../" : filesFolderName) + i18nc("HTML export folder (search)",  "search")  + "/"; // eg.: "foo.html_files/search/"  or "../search/"
 
     kDebug() << "Exporting ================================================";
     kDebug() << "  filePath:" << filePath;
@@ -177,9 +264,28 @@ void HTMLExporter::exportBasket(BasketScene *basket, bool isSubBasket)
     kDebug() << "  basketsFolderPath:" << basketsFolderPath;
     kDebug() << "  basketsFolderName:" << basketsFolderName;
 
-    // Create the data folder for this basket:
+    // The page and the data of the basket are still there and up to date if nothing changed since the last export
+    // (encrypted baskets are always exported again: their page also depends on whether they were unlocked or not):
+    uint lastModified;
+    QString signature = basketSignature(basket, isSubBasket, &lastModified);
+    m_signatures.insert(basket->folderName(), signature);
+    if (!basket->isEncrypted() && m_previousSignatures.value(basket->folderName()) == signature && lastModified < m_previousStartTime &&
+        QFile::exists(basketFilePath) && QFile::exists(searchDocumentsPath(basket))) {
+        kDebug() << "  Up to date";
+        progress->setValue(progress->value() + 1); // Basket exportation finished
+        exportChildBaskets(basket);
+        return;
+    }
+
+    if (!basket->isLoaded()) {
+        basket->load();
+    }
+
+    // Create the data folder for this basket (emptied, in case the basket was already exported):
+    Tools::deleteRecursively(dataFolderPath);
     QDir dir;
     dir.mkdir(dataFolderPath);
+    m_searchDocuments.clear();
 
     backgroundColorName = basket->backgroundColor().name().toLower().mid(1);
 
@@ -203,11 +309,11 @@ void HTMLExporter::exportBasket(BasketScene *basket, bool isSubBasket)
     painter.end();
     foldGroup.save(imagesFolderPath + "fold_group_" + backgroundColorName + ".png", "PNG");
 
-    // Open the file to write:
-    QFile file(basketFilePath);
-    if (!file.open(QIODevice::WriteOnly))
-        return;
-    stream.setDevice(&file);
+    // Generate the page in memory, it will be written by the thread pool:
+    QByteArray page;
+    QBuffer buffer(&page);
+    buffer.open(QIODevice::WriteOnly);
+    stream.setDevice(&buffer);
     stream.setCodec("UTF-8");
 
     // Compute the colors to draw dragient for notes:
@@ -276,6 +382,7 @@ void HTMLExporter::exportBasket(BasketScene *basket, bool isSubBasket)
         statesCss += (*it)->toCSS(imagesFolderPath, imagesFolderName, basket->QGraphicsScene::font());
     stream <<
     statesCss <<
+    "   .search { text-align: right; margin: 0 0 3px 0; }\n"
     "   .credits { text-align: right; margin: 3px 0 0 0; _margin-top: -17px; font-size: 80%; color: " << borderColor << "; }\n"
     "  </style>\n"
     "  <title>" << Tools::textToHTMLWithoutP(basket->basketName()) << "</title>\n"
@@ -290,7 +397,8 @@ void HTMLExporter::exportBasket(BasketScene *basket, bool isSubBasket)
     stream <<
     " </head>\n"
     " <body>\n"
-    "  <h1><img src=\"" << basketIcon32 << "\" width=\"32\" height=\"32\" alt=\"\"> " << Tools::textToHTMLWithoutP(basket->basketName()) << "</h1>\n";
+    "  <h1><img src=\"" << basketIcon32 << "\" width=\"32\" height=\"32\" alt=\"\"> " << Tools::textToHTMLWithoutP(basket->basketName()) << "</h1>\n"
+    "  <p class=\"search\"><a href=\"" << searchFolderName << "index.html\">" << i18n("Search the notes") << "</a></p>\n";
 
     if (withBasketTree)
         writeBasketTree(basket);
@@ -371,11 +479,17 @@ void HTMLExporter::exportBasket(BasketScene *basket, bool isSubBasket)
     " </body>\n"
     "</html>\n";
 
-    file.close();
+    stream.flush();
     stream.setDevice(0);
+    buffer.close();
+    writePage(basketFilePath, page);
     progress->setValue(progress->value() + 1); // Basket exportation finished
 
-    // Recursively export child baskets:
+    exportChildBaskets(basket);
+}
+
+void HTMLExporter::exportChildBaskets(BasketScene *basket)
+{
     BasketListViewItem *item = Global::bnpView->listViewItemForBasket(basket);
     if (item->childCount() >= 0) {
         for (int i = 0; i < item->childCount(); i++) {
@@ -456,7 +570,14 @@ void HTMLExporter::exportNote(Note *note, int indent)
         for (State::List::Iterator it = note->states().begin(); it != note->states().end(); ++it)
             additionalClasses += " tag_" + (*it)->id();
         //stream << spaces.fill(' ', indent);
-        stream << "<table class=\"note" << additionalClasses << "\"" << freeStyle << "><tr>";
+        // Remember the text of the note, to search it:
+        HTMLSearchIndex::Document document;
+        document.anchor = "note" + QString::number(m_searchDocuments.count() + 1);
+        document.text   = note->content()->toText("");
+        for (State::List::Iterator it = note->states().begin(); it != note->states().end(); ++it)
+            document.tags.append((*it)->fullName());
+        m_searchDocuments.append(document);
+        stream << "<table id=\"" << document.anchor << "\" class=\"note" << additionalClasses << "\"" << freeStyle << "><tr>";
         if (note->emblemsCount() > 0) {
             stream << "<td class=\"tags\"><nobr>";
             for (State::List::Iterator it = note->states().begin(); it != note->states().end(); ++it)
@@ -528,7 +649,8 @@ void HTMLExporter::writeBasketTree(BasketScene *currentBasket, BasketScene *bask
   * If an icon with the same name already exist in the destination,
   * it is assumed the icon is already copied, so no action is took.
   * It is optimized so that you can have an empty folder receiving the icons
-  * and call copyIcon() each time you encounter one during export process.
+  * and call copyIcon() each time you encounter one during export process:
+  * the icons already copied during this export are remembered, and the pixmaps come from the shared IconManager cache.
   */
 QString HTMLExporter::copyIcon(const QString &iconName, int size)
 {
@@ -538,32 +660,304 @@ QString HTMLExporter::copyIcon(const QString &iconName, int size)
     // Sometimes icon can be "favicons/www.kde.org", we replace the '/' with a '_'
     QString fileName = iconName; // QString::replace() isn't const, so I must copy the string before
     fileName = "ico" + QString::number(size) + "_" + fileName.replace("/", "_") + ".png";
-    QString fullPath = iconsFolderPath + fileName;
-    if (!QFile::exists(fullPath))
-        DesktopIcon(iconName, size).save(fullPath, "PNG");
+    if (!copiedIcons.contains(fileName)) {
+        IconManager::instance()->pixmap(iconName, size).save(iconsFolderPath + fileName, "PNG");
+        copiedIcons.insert(fileName);
+    }
     return fileName;
 }
 
-/** Done: Sometimes we can call two times copyFile() with the same srcPath and dataFolderPath
-  *       (eg. when exporting basket to HTML with two links to same filename
-  *            (but not necesary same path, as in "/home/foo.txt" and "/foo.txt") )
-  *       The first copy isn't yet started, so the dest file isn't created and this method
-  *       returns the same filename !!!!!!!!!!!!!!!!!!!!
+/** Give a file name to a file to copy in the data folder of the current basket, and remember to copy it.
+  * The local files are not copied immediately: they are copied in one batch by the thread pool,
+  * with the page of the basket (see writePage()).
+  * As the data folder is emptied before exporting a basket, the names of the files already queued
+  * are the only ones to avoid when choosing the name of the copy
+  * (eg. when a basket has two links to the same file name, as in "/home/foo.txt" and "/foo.txt").
   */
-QString HTMLExporter::copyFile(const QString &srcPath, bool createIt)
+QString HTMLExporter::copyFile(const QString &srcPath)
 {
-    QString fileName = Tools::fileNameForNewFile(KUrl(srcPath).fileName(), dataFolderPath);
+    QFileInfo srcInfo(KUrl(srcPath).fileName());
+    QString fileName = srcInfo.fileName();
+    for (int number = 2; m_pendingCopies.contains(dataFolderPath + fileName); ++number)
+        fileName = srcInfo.completeBaseName() + "-" + QString::number(number) +
+                   (srcInfo.suffix().isEmpty() ? "" : "." + srcInfo.suffix());
     QString fullPath = dataFolderPath + fileName;
 
-    if (createIt) {
-        // We create the file to be sure another very near call to copyFile() willn't choose the same name:
-        QFile file(KUrl(fullPath).path());
-        if (file.open(QIODevice::WriteOnly))
-            file.close();
-        // And then we copy the file AND overwriting the file we juste created:
-        KIO::file_copy(KUrl(srcPath), KUrl(fullPath), 0666, KIO::HideProgressInfo | KIO::Resume | KIO::Overwrite);
-    } else
-        /*KIO::CopyJob *copyJob = */KIO::copy(KUrl(srcPath), KUrl(fullPath), KIO::DefaultFlags); // Do it as before
+    KUrl srcUrl(srcPath);
+    if (srcUrl.isLocalFile())
+        m_pendingCopies.insert(fullPath, srcUrl.toLocalFile());
+    else {
+        // Reserve the name, and let KIO download the file:
+        m_pendingCopies.insert(fullPath, QString());
+        KIO::file_copy(srcUrl, KUrl(fullPath), 0666, KIO::HideProgressInfo | KIO::Overwrite);
+    }
 
     return fileName;
 }
+
+/** Give the page of the current basket, with the text of its notes and the data files queued by copyFile(), to the thread pool.
+  */
+void HTMLExporter::writePage(const QString &path, const QByteArray &page)
+{
+    QMap<QString, QByteArray> files;
+    files.insert(path, page);
+    files.insert(searchDocumentsPath(currentBasket), HTMLSearchIndex::documentsToXml(m_searchDocuments));
+    m_searchDocuments.clear();
+
+    QMap<QString, QString> copies;
+    for (QMap<QString, QString>::const_iterator it = m_pendingCopies.constBegin(); it != m_pendingCopies.constEnd(); ++it)
+        if (!it.value().isEmpty())
+            copies.insert(it.key(), it.value());
+    m_pendingCopies.clear();
+
+    m_pendingPages.ref();
+    m_threadPool->start(new PageWriter(this, currentBasket->folderName(), files, copies));
+}
+
+void HTMLExporter::waitForPages()
+{
+    while (m_pendingPages > 0) {
+        kapp->processEvents();
+        usleep(300); // Not too long because if the pages are written, we wait for nothing
+    }
+}
+
+/** @Return what the page of @p basket depends on, besides the export signature:
+  * the name, size and modification date of every file of the basket (the .basket file and the note files).
+  * @p lastModified is set to the modification date of the most recently modified file.
+  */
+QString HTMLExporter::basketSignature(BasketScene *basket, bool isSubBasket, uint *lastModified)
+{
+    QString signature = (isSubBasket ? "sub-basket\n" : "basket\n");
+    *lastModified = 0;
+    QFileInfoList files = QDir(basket->fullPath()).entryInfoList(QDir::Files | QDir::Hidden | QDir::NoDotAndDotDot, QDir::Name);
+    for (QFileInfoList::const_iterator it = files.constBegin(); it != files.constEnd(); ++it) {
+        uint modified = it->lastModified().toTime_t();
+        signature += it->fileName() + ':' + QString::number(it->size()) + ':' + QString::number(modified) + '\n';
+        *lastModified = qMax(*lastModified, modified);
+    }
+    return QCryptographicHash::hash(signature.toUtf8(), QCryptographicHash::Sha1).toHex();
+}
+
+/** @Return what every exported page depends on: the BasKet version, the exported file name, the basket tree,
+  * the tags and the looks of the links. If it changes, every page is exported again.
+  */
+QString HTMLExporter::exportSignature()
+{
+    QString signature = QString(VERSION) + '\n' + fileName + '\n';
+    treeSignature(exportedBasket, &signature);
+    signature += QString::number(QFileInfo(Global::savesFolder() + "tags.xml").lastModified().toTime_t()) + '\n';
+    signature += kapp->palette().color(QPalette::Highlight).name() + '\n';
+    signature += LinkLook::soundLook->toCSS("sound", Qt::black) + LinkLook::fileLook->toCSS("file", Qt::black) +
+                 LinkLook::localLinkLook->toCSS("local", Qt::black) + LinkLook::networkLinkLook->toCSS("network", Qt::black) +
+                 LinkLook::launcherLook->toCSS("launcher", Qt::black) + LinkLook::crossReferenceLook->toCSS("cross_reference", Qt::black);
+    return QCryptographicHash::hash(signature.toUtf8(), QCryptographicHash::Sha1).toHex();
+}
+
+/** Append to @p signature what is shown of @p basket and its sub-baskets in the basket tree of every page.
+  */
+void HTMLExporter::treeSignature(BasketScene *basket, QString *signature)
+{
+    QColor backgroundColor = basket->backgroundColorSetting();
+    QColor textColor       = basket->textColorSetting();
+    *signature += basket->folderName() + ':' + basket->basketName() + ':' + basket->icon() + ':' +
+                  (backgroundColor.isValid() ? backgroundColor.name() : "") + ':' + (textColor.isValid() ? textColor.name() : "") + '\n';
+    BasketListViewItem *item = Global::bnpView->listViewItemForBasket(basket);
+    for (int i = 0; i < item->childCount(); i++)
+        treeSignature(((BasketListViewItem *)item->child(i))->basket(), signature);
+    *signature += "..\n";
+}
+
+/** Read the signatures of the baskets exported the last time.
+  * They are forgotten if what every page depends on changed since: the baskets are only remembered to remove their old pages.
+  * The manifest is then removed: if the export is interrupted, the next one will export everything again.
+  */
+void HTMLExporter::loadManifest()
+{
+    QFile file(m_manifestPath);
+    QDomDocument document;
+    if (file.open(QIODevice::ReadOnly) && document.setContent(&file)) {
+        QDomElement root = document.documentElement();
+        m_previousStartTime = root.attribute("started").toUInt(); // 0 for the first version: everything is then exported again
+        uint tagsModified = QFileInfo(Global::savesFolder() + "tags.xml").lastModified().toTime_t();
+        bool upToDate = (root.attribute("signature") == m_exportSignature && tagsModified < m_previousStartTime);
+        for (QDomElement element = root.firstChildElement("basket"); !element.isNull(); element = element.nextSiblingElement("basket"))
+            m_previousSignatures.insert(element.attribute("folderName"), upToDate ? element.attribute("signature") : QString());
+    }
+    file.close();
+    file.remove();
+}
+
+/** Remove the pages of the baskets that are no longer exported, and write the signatures of the exported baskets.
+  * The baskets that could not be written are left out, so the next export does not take them for up to date.
+  */
+void HTMLExporter::saveManifest()
+{
+    for (QMap<QString, QString>::const_iterator it = m_previousSignatures.constBegin(); it != m_previousSignatures.constEnd(); ++it) {
+        if (m_signatures.contains(it.key()))
+            continue;
+        QString name = it.key().left(it.key().length() - 1);
+        QFile::remove(basketsFolderPath + name + ".html");
+        Tools::deleteRecursively(basketsFolderPath + name + "-" + i18nc("HTML export folder (data)", "data") + "/");
+        QFile::remove(searchFolderPath + name + ".xml");
+    }
+
+    QDomDocument document("htmlExport");
+    QDomElement root = document.createElement("htmlExport");
+    root.setAttribute("version", 2);
+    root.setAttribute("signature", m_exportSignature);
+    root.setAttribute("started", QString::number(m_startTime));
+    document.appendChild(root);
+    for (QMap<QString, QString>::const_iterator it = m_signatures.constBegin(); it != m_signatures.constEnd(); ++it) {
+        if (m_failedBaskets.contains(it.key()))
+            continue;
+        QDomElement basket = document.createElement("basket");
+        basket.setAttribute("folderName", it.key());
+        basket.setAttribute("signature",  it.value());
+        root.appendChild(basket);
+    }
+
+    QByteArray xml = "<?xml version=\"1.0\" encoding=\"UTF-8\" ?>\n" + document.toString().toUtf8();
+    KSaveFile file(m_manifestPath);
+    if (!file.open(QIODevice::WriteOnly) || file.write(xml) != xml.size() || !file.finalize()) {
+        file.abort();
+        kDebug() << "Cannot write the export manifest" << m_manifestPath;
+    }
+}
+
+/** @Return where the text of the notes of @p basket is saved, to build the search index even when the basket is up to date.
+  */
+QString HTMLExporter::searchDocumentsPath(BasketScene *basket)
+{
+    return searchFolderPath + basket->folderName().left(basket->folderName().length() - 1) + ".xml";
+}
+
+/** Build the search index of every exported basket, in tree order, and write it with the search page in the search folder.
+  */
+void HTMLExporter::writeSearchIndex()
+{
+    HTMLSearchIndex index;
+    addToSearchIndex(&index, exportedBasket, "");
+
+    QFile indexFile(searchFolderPath + "index.js");
+    if (!indexFile.open(QIODevice::WriteOnly) || indexFile.write(index.toJavaScript()) < 0)
+        kDebug() << "Cannot write the search index" << indexFile.fileName();
+    indexFile.close();
+
+    QFile pageFile(searchFolderPath + "index.html");
+    if (!pageFile.open(QIODevice::WriteOnly))
+        return;
+    QString noteFound       = Tools::jsonString(i18n("No note found."));
+    QString notesFound      = Tools::jsonString(i18n("Notes found: %1", QString("{count}")));
+    QString firstNotesFound = Tools::jsonString(i18n("First %1 of the %2 notes found:", QString("{max}"), QString("{count}")));
+    QTextStream page(&pageFile);
+    page.setCodec("UTF-8");
+    page <<
+    "<!DOCTYPE HTML PUBLIC \"-//W3C//DTD HTML 4.01//EN\" \"http://www.w3.org/TR/html4/strict.dtd\">\n"
+    "<html>\n"
+    " <head>\n"
+    "  <meta http-equiv=\"Content-Type\" content=\"text/html; charset=UTF-8\">\n"
+    "  <meta name=\"Generator\" content=\"" << KGlobal::mainComponent().aboutData()->programName() << " " << VERSION << " http://basket.kde.org/\">\n"
+    "  <style type=\"text/css\">\n"
+    "   body { margin: 10px; font: 11px sans-serif; }\n"
+    "   h1 { text-align: center; }\n"
+    "   #query { width: 100%; font-size: 150%; }\n"
+    "   #status { color: gray; }\n"
+    "   #results li { margin-bottom: 5px; }\n"
+    "   .path, .tags { color: gray; font-size: 90%; }\n"
+    "   .credits { text-align: right; font-size: 80%; color: gray; }\n"
+    "  </style>\n"
+    "  <title>" << i18n("Search in %1", Tools::textToHTMLWithoutP(exportedBasket->basketName())) << "</title>\n"
+    "  <script type=\"text/javascript\" src=\"index.js\"></script>\n"
+    " </head>\n"
+    " <body>\n"
+    "  <h1>" << i18n("Search in %1", "<a href=\"../../" + fileName + "\">" + Tools::textToHTMLWithoutP(exportedBasket->basketName()) + "</a>") << "</h1>\n"
+    "  <p><input id=\"query\" type=\"text\" autocomplete=\"off\"></p>\n"
+    "  <p id=\"status\"></p>\n"
+    "  <ul id=\"results\"></ul>\n"
+    "  <script type=\"text/javascript\">\n"
+    "   var index = basketSearchIndex;\n"
+    "   var maxResults = 200;\n"
+    "   " << HTMLSearchIndex::queryTermsFunction().trimmed().replace("\n", "\n   ") << "\n"
+    "   // Numbers of the notes containing a word starting with prefix (the words are sorted):\n"
+    "   function notesForPrefix(prefix) {\n"
+    "    var words = index.words, low = 0, high = words.length;\n"
+    "    while (low < high) {\n"
+    "     var middle = (low + high) >> 1;\n"
+    "     if (words[middle] < prefix) low = middle + 1; else high = middle;\n"
+    "    }\n"
+    "    var notes = {};\n"
+    "    for (var i = low; i < words.length && words[i].substr(0, prefix.length) == prefix; ++i) {\n"
+    "     var deltas = index.postings[i].split(\",\"), number = 0;\n"
+    "     for (var j = 0; j < deltas.length; ++j) {\n"
+    "      number += parseInt(deltas[j], 36);\n"
+    "      notes[number] = true;\n"
+    "     }\n"
+    "    }\n"
+    "    return notes;\n"
+    "   }\n"
+    "   function search() {\n"
+    "    var prefixes = queryTerms(document.getElementById(\"query\").value);\n"
+    "    var found = null;\n"
+    "    for (var i = 0; i < prefixes.length; ++i) {\n"
+    "     var notes = notesForPrefix(prefixes[i]);\n"
+    "     if (found != null) {\n"
+    "      for (var number in found)\n"
+    "       if (!notes[number]) delete found[number];\n"
+    "     } else\n"
+    "      found = notes;\n"
+    "    }\n"
+    "    var list = document.getElementById(\"results\");\n"
+    "    while (list.firstChild) list.removeChild(list.firstChild);\n"
+    "    var numbers = [];\n"
+    "    for (var number in found) numbers.push(parseInt(number));\n"
+    "    numbers.sort(function(a, b) { return a - b; });\n"
+    "    for (var i = 0; i < numbers.length && i < maxResults; ++i) {\n"
+    "     var note = index.notes[numbers[i]], basket = index.baskets[note[0]];\n"
+    "     var item = document.createElement(\"li\"), link = document.createElement(\"a\");\n"
+    "     link.href = basket[1] + \"#\" + note[1];\n"
+    "     link.appendChild(document.createTextNode(note[2] != \"\" ? note[2] : \"...\"));\n"
+    "     item.appendChild(link);\n"
+    "     var path = document.createElement(\"div\");\n"
+    "     path.className = \"path\";\n"
+    "     path.appendChild(document.createTextNode(basket[0]));\n"
+    "     item.appendChild(path);\n"
+    "     if (note[3] != \"\") {\n"
+    "      var tags = document.createElement(\"div\");\n"
+    "      tags.className = \"tags\";\n"
+    "      tags.appendChild(document.createTextNode(note[3]));\n"
+    "      item.appendChild(tags);\n"
+    "     }\n"
+    "     list.appendChild(item);\n"
+    "    }\n"
+    "    var status = (found == null ? \"\" : numbers.length == 0 ? " << noteFound << "\n"
+    "                  : numbers.length > maxResults ? " << firstNotesFound << " : " << notesFound << ");\n"
+    "    status = status.replace(\"{max}\", maxResults).replace(\"{count}\", numbers.length);\n"
+    "    document.getElementById(\"status\").innerHTML = \"\";\n"
+    "    document.getElementById(\"status\").appendChild(document.createTextNode(status));\n"
+    "   }\n"
+    "   document.getElementById(\"query\").onkeyup = search;\n"
+    "   document.getElementById(\"query\").focus();\n"
+    "   search();\n"
+    "  </script>\n"
+    "  <p class=\"credits\">" << i18np("One note indexed.", "%1 notes indexed.", index.notesCount()) << "</p>\n"
+    " </body>\n"
+    "</html>\n";
+}
+
+/** Add the text of the notes of @p basket and of its sub-baskets to @p index, as it was saved by writePage().
+  * @p parentPath is the names of the parents of @p basket.
+  */
+void HTMLExporter::addToSearchIndex(HTMLSearchIndex *index, BasketScene *basket, const QString &parentPath)
+{
+    QString path = (parentPath.isEmpty() ? basket->basketName() : parentPath + " / " + basket->basketName());
+    QString url  = (basket == exportedBasket ? "../../" + fileName :
+                    "../" + i18nc("HTML export folder (baskets)", "baskets") + "/" + basket->folderName().left(basket->folderName().length() - 1) + ".html");
+    QFile file(searchDocumentsPath(basket));
+    if (file.open(QIODevice::ReadOnly))
+        index->addBasket(path, url, HTMLSearchIndex::documentsFromXml(file.readAll()));
+
+    BasketListViewItem *item = Global::bnpView->listViewItemForBasket(basket);
+    for (int i = 0; i < item->childCount(); i++)
+        addToSearchIndex(index, ((BasketListViewItem *)item->child(i))->basket(), path);
+}
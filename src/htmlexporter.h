@@ -21,15 +21,32 @@
 #ifndef HTMLEXPORTER_H
 #define HTMLEXPORTER_H
 
+#include <QtCore/QAtomicInt>
+#include <QtCore/QMap>
+#include <QtCore/QMutex>
+#include <QtCore/QSet>
 #include <QtCore/QString>
 #include <QtCore/QTextStream>
 
+#include "htmlsearchindex.h"
+
 class QProgressBar;
+class QThreadPool;
 
 class BasketScene;
 class Note;
 
-/**
+/** Export a basket and its sub-baskets to HTML pages.
+ * BASIC FUNCTIONNING:
+ *   Baskets are loaded and rendered one after the other in the GUI thread, each one in its own in-memory page.
+ *   The page is then handed to a thread pool, that writes it and copies its data files in one batch,
+ *   while the next basket is rendered.
+ *   A manifest in the files folder remembers the signature of every exported basket (its files, sizes and dates):
+ *   when updating an existing export, the baskets that did not change since are neither loaded nor written again.
+ *   Modification dates only have a one second resolution: files modified at or after the start of the previous export
+ *   are considered as changed, as they could have been saved again with the same size while it was running.
+ *   Baskets whose page or files could not be written are left out of the manifest, to be exported again the next time.
+ *   The text of the notes is also saved next to every page, to build a search index of the whole export (see HTMLSearchIndex).
  * @author Sébastien Laoût <slaout@linux62.org>
  */
 class HTMLExporter
@@ -40,13 +57,24 @@ public:
 private:
     void prepareExport(BasketScene *basket, const QString &fullPath);
     void exportBasket(BasketScene *basket, bool isSubBasket);
+    void exportChildBaskets(BasketScene *basket);
     void exportNote(Note *note, int indent);
     void writeBasketTree(BasketScene *currentBasket);
     void writeBasketTree(BasketScene *currentBasket, BasketScene *basket, int indent);
+    void writePage(const QString &path, const QByteArray &page);
+    void waitForPages();
+    QString basketSignature(BasketScene *basket, bool isSubBasket, uint *lastModified);
+    QString exportSignature();
+    void treeSignature(BasketScene *basket, QString *signature);
+    void loadManifest();
+    void saveManifest();
+    QString searchDocumentsPath(BasketScene *basket);
+    void writeSearchIndex();
+    void addToSearchIndex(HTMLSearchIndex *index, BasketScene *basket, const QString &parentPath);
 
 public:
     QString copyIcon(const QString &iconName, int size);
-    QString copyFile(const QString &srcPath, bool createIt);
+    QString copyFile(const QString &srcPath);
 
 public:
     // Absolute path of the file name the user chozen:
@@ -65,6 +93,11 @@ public:
     QString dataFolderName;    // eg.: "foo.html_files/data/" or "basketN-data/"
     QString basketsFolderPath; // eg.: "/home/seb/foo.html_files/baskets/"
     QString basketsFolderName; // eg.: "foo.html_files/baskets/" or ""
+    QString searchFolderPath;  // eg.: "/home/seb/foo.html_files/search/"
+    QString searchFolderName;  // eg.: "foo.html_files/search/" or "../search/"
+
+    // File names of the icons already saved in iconsFolderPath by copyIcon():
+    QSet<QString> copiedIcons;
 
     // Various properties of the currently exporting basket:
     QString backgroundColorName;
@@ -75,6 +108,23 @@ public:
     BasketScene *currentBasket;
     bool withBasketTree;
     QProgressBar *progress;
+
+private:
+    friend class PageWriter;
+
+    QThreadPool                   *m_threadPool;
+    QAtomicInt                     m_pendingPages;       /// << Pages given to the thread pool and not written yet
+    QMutex                         m_failedMutex;
+    QSet<QString>                  m_failedBaskets;      /// << Folder names of the baskets whose page or files could not be written (protected by m_failedMutex)
+    QMap<QString, QString>         m_pendingCopies;      /// << Data files of the current basket to copy: destination path => source path
+    bool                           m_incremental;        /// << True if updating an existing export, false to export everything again
+    QString                        m_manifestPath;
+    uint                           m_startTime;          /// << When this export started
+    uint                           m_previousStartTime;  /// << When the previous export started: files modified since then are exported again
+    QString                        m_exportSignature;    /// << Signature of what every page depends on (the basket tree, the tags...)
+    QMap<QString, QString>         m_previousSignatures; /// << Folder names of the baskets found in the manifest => their signatures
+    QMap<QString, QString>         m_signatures;         /// << Folder names of the baskets exported now => their signatures
+    HTMLSearchIndex::DocumentList  m_searchDocuments;    /// << Text of the notes of the current basket
 };
 
 #endif // HTMLEXPORTER_H
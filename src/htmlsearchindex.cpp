@@ -0,0 +1,171 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by BasKet Note Pads developers                     *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+
+#include "htmlsearchindex.h"
+
+#include <QtCore/QSet>
+#include <QtXml/QDomDocument>
+
+#include "tools.h"
+
+void HTMLSearchIndex::addBasket(const QString &path, const QString &url, const DocumentList &documents)
+{
+    Basket basket;
+    basket.path = path;
+    basket.url  = url;
+    m_baskets.append(basket);
+
+    for (DocumentList::const_iterator it = documents.constBegin(); it != documents.constEnd(); ++it) {
+        IndexedNote note;
+        note.basket  = m_baskets.count() - 1;
+        note.anchor  = it->anchor;
+        note.excerpt = it->text.simplified().left(EXCERPT_LENGTH);
+        note.tags    = it->tags.join(", ");
+        int number = m_notes.count();
+        m_notes.append(note);
+
+        QStringList words = terms(it->text + '\n' + it->tags.join("\n"));
+        for (QStringList::const_iterator word = words.constBegin(); word != words.constEnd(); ++word)
+            m_postings[*word].append(number);
+    }
+}
+
+/** The posting lists are written as the differences between the numbers of the notes, in base 36, separated by commas:
+  * eg. the notes 3, 40 and 41 are written "3,11,1".
+  */
+QByteArray HTMLSearchIndex::toJavaScript() const
+{
+    QString js = "var basketSearchIndex = {\n\"version\":1,\n\"baskets\":[";
+    for (int i = 0; i < m_baskets.count(); ++i)
+        js += (i ? ",\n[" : "\n[") + Tools::jsonString(m_baskets[i].path) + ',' + Tools::jsonString(m_baskets[i].url) + ']';
+    js += "],\n\"notes\":[";
+    for (int i = 0; i < m_notes.count(); ++i) {
+        const IndexedNote &note = m_notes[i];
+        js += (i ? ",\n[" : "\n[") + QString::number(note.basket) + ',' + Tools::jsonString(note.anchor) + ',' +
+              Tools::jsonString(note.excerpt) + ',' + Tools::jsonString(note.tags) + ']';
+    }
+    js += "],\n\"words\":[";
+    QString postings;
+    for (QMap<QString, QList<int> >::const_iterator it = m_postings.constBegin(); it != m_postings.constEnd(); ++it) {
+        bool first = (it == m_postings.constBegin());
+        js += (first ? "\n" : ",\n") + Tools::jsonString(it.key());
+        QString list;
+        int previous = 0;
+        for (QList<int>::const_iterator number = it.value().constBegin(); number != it.value().constEnd(); ++number) {
+            list += (list.isEmpty() ? "" : ",") + QString::number(*number - previous, 36);
+            previous = *number;
+        }
+        postings += (first ? "\n\"" : ",\n\"") + list + '"';
+    }
+    js += "],\n\"postings\":[" + postings + "]\n};\n";
+    return js.toUtf8();
+}
+
+QByteArray HTMLSearchIndex::documentsToXml(const DocumentList &documents)
+{
+    QDomDocument document("searchDocuments");
+    QDomElement root = document.createElement("searchDocuments");
+    root.setAttribute("version", 1);
+    document.appendChild(root);
+    for (DocumentList::const_iterator it = documents.constBegin(); it != documents.constEnd(); ++it) {
+        QDomElement note = document.createElement("note");
+        note.setAttribute("anchor", it->anchor);
+        QDomElement text = document.createElement("text");
+        text.appendChild(document.createTextNode(it->text));
+        note.appendChild(text);
+        for (QStringList::const_iterator tag = it->tags.constBegin(); tag != it->tags.constEnd(); ++tag) {
+            QDomElement element = document.createElement("tag");
+            element.appendChild(document.createTextNode(*tag));
+            note.appendChild(element);
+        }
+        root.appendChild(note);
+    }
+    return "<?xml version=\"1.0\" encoding=\"UTF-8\" ?>\n" + document.toString().toUtf8();
+}
+
+HTMLSearchIndex::DocumentList HTMLSearchIndex::documentsFromXml(const QByteArray &xml)
+{
+    DocumentList documents;
+    QDomDocument document;
+    if (!document.setContent(xml))
+        return documents;
+
+    QDomElement root = document.documentElement();
+    for (QDomElement note = root.firstChildElement("note"); !note.isNull(); note = note.nextSiblingElement("note")) {
+        Document entry;
+        entry.anchor = note.attribute("anchor");
+        entry.text   = note.firstChildElement("text").text();
+        for (QDomElement tag = note.firstChildElement("tag"); !tag.isNull(); tag = tag.nextSiblingElement("tag"))
+            entry.tags.append(tag.text());
+        documents.append(entry);
+    }
+    return documents;
+}
+
+QStringList HTMLSearchIndex::terms(const QString &text)
+{
+    QStringList words;
+    QSet<QString> found;
+    QString lowerText = text.toLower();
+    const QChar *begin = lowerText.unicode();
+    const QChar *end   = begin + lowerText.length();
+    const QChar *start = begin;
+    for (const QChar *c = begin; c <= end; ++c) {
+        if (c != end && c->isLetterOrNumber())
+            continue;
+        if (c - start > 1) {
+            QString word(start, c - start);
+            if (!found.contains(word)) {
+                found.insert(word);
+                words.append(word);
+            }
+        }
+        start = c + 1;
+    }
+    return words;
+}
+
+/** Browsers do not all know the Unicode character classes: the words are separated by a regular expression listing
+  * every UTF-16 code unit that is not QChar::isLetterOrNumber(), exactly the characters terms() splits the text on.
+  */
+QString HTMLSearchIndex::queryTermsFunction()
+{
+    QString separators;
+    int code = 0;
+    while (code <= 0xFFFF) {
+        if (QChar(code).isLetterOrNumber()) {
+            ++code;
+            continue;
+        }
+        int first = code;
+        while (code <= 0xFFFF && !QChar(code).isLetterOrNumber())
+            ++code;
+        separators += QString("\\u%1").arg(first, 4, 16, QChar('0'));
+        if (code - 1 > first)
+            separators += QString("-\\u%1").arg(code - 1, 4, 16, QChar('0'));
+    }
+
+    return "function queryTerms(query) {\n"
+           " var words = query.toLowerCase().split(/[" + separators + "]+/), terms = [];\n"
+           " for (var i = 0; i < words.length; ++i)\n"
+           "  if (words[i].length > 1) terms.push(words[i]); // Single characters are not indexed\n"
+           " return terms;\n"
+           "}\n";
+}
@@ -0,0 +1,83 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by BasKet Note Pads developers                     *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+
+#ifndef HTMLSEARCHINDEX_H
+#define HTMLSEARCHINDEX_H
+
+#include <QtCore/QByteArray>
+#include <QtCore/QList>
+#include <QtCore/QMap>
+#include <QtCore/QString>
+#include <QtCore/QStringList>
+
+#include "basket_export.h"
+
+/** Inverted index of the notes of an HTML export, to search them from a Web browser without loading every page.
+  * BASIC FUNCTIONNING:
+  *   While exporting a basket, HTMLExporter collects the text equivalent and the tags of every note (the "documents" of the basket),
+  *   and saves them next to the page with documentsToXml(), so an up to date basket is still indexed without being loaded again.
+  *   At the end of the export, the documents of every basket are added in tree order, and the index is written as a JavaScript file
+  *   (the JSON data is assigned to a variable, because browsers do not let a local page read a JSON file).
+  *   The words are sorted, so the search page finds the words starting with what is typed with a binary search,
+  *   and their posting lists (the numbers of the notes containing them) are only decoded when they are searched.
+  *   The search page splits the queries with queryTermsFunction(), that follows the same rules as terms().
+  */
+class BASKET_EXPORT HTMLSearchIndex
+{
+public:
+    struct Document {
+        QString     anchor; /// << Id of the note in the page of its basket
+        QString     text;
+        QStringList tags;   /// << Full names of the tags of the note
+    };
+    typedef QList<Document> DocumentList;
+
+    /// Add the @p documents of a basket, named @p path (with the names of its parents) and exported to @p url.
+    void addBasket(const QString &path, const QString &url, const DocumentList &documents);
+    int notesCount() const { return m_notes.count(); }
+    QByteArray toJavaScript() const;
+
+    static QByteArray documentsToXml(const DocumentList &documents);
+    static DocumentList documentsFromXml(const QByteArray &xml);
+    /// @Return the lower case words of @p text, without duplicates, in the order they first appear. Single characters are not words.
+    static QStringList terms(const QString &text);
+    /// @Return the JavaScript function queryTerms(query), splitting a query typed in the search page like terms() splits the notes.
+    static QString queryTermsFunction();
+
+    static const int EXCERPT_LENGTH = 120; /// << Number of characters of a note shown in the search results
+
+private:
+    struct Basket {
+        QString path;
+        QString url;
+    };
+    struct IndexedNote {
+        int     basket;
+        QString anchor;
+        QString excerpt;
+        QString tags;
+    };
+
+    QList<Basket>              m_baskets;
+    QList<IndexedNote>         m_notes;
+    QMap<QString, QList<int> > m_postings; /// << Words => numbers of the notes containing them, in ascending order
+};
+
+#endif // HTMLSEARCHINDEX_H
@@ -0,0 +1,133 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by BasKet Note Pads developers                     *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include "iconmanager.h"
+
+#include <QtCore/QString>
+#include <QtCore/QStringList>
+#include <QtGui/QPainter>
+
+#include <KDE/KGlobalSettings>
+
+IconManager* IconManager::instance()
+{
+    static IconManager *instance = 0;
+    if (!instance)
+        instance = new IconManager();
+    return instance;
+}
+
+IconManager::IconManager()
+{
+    connect(KGlobalSettings::self(), SIGNAL(iconChanged(int)), this, SLOT(iconThemeChanged(int)));
+}
+
+IconManager::~IconManager()
+{
+}
+
+QString IconManager::keyFor(const QString &name, int size, KIconLoader::States state)
+{
+    return name + '|' + QString::number(size) + '|' + QString::number((int)state);
+}
+
+const IconManager::IconSlot& IconManager::slotFor(const QString &name, int size, KIconLoader::States state)
+{
+    Q_ASSERT(size > 0);
+    QString key = keyFor(name, size, state);
+    QHash<QString, IconSlot>::const_iterator it = m_slots.constFind(key);
+    if (it != m_slots.constEnd())
+        return it.value();
+
+    // First time this icon is requested: load it (the Desktop group is used so the ActiveState effect is applied for hovered link icons):
+    IconSlot slot;
+    QPixmap icon = KIconLoader::global()->loadIcon(name, KIconLoader::Desktop, size, state, QStringList(), 0L, /*canReturnNull=*/true);
+    slot.exists = !icon.isNull();
+    if (!slot.exists)
+        icon = KIconLoader::global()->loadIcon(name, KIconLoader::Desktop, size, state, QStringList(), 0L, /*canReturnNull=*/false);
+
+    // Find a free cell for it in the atlas pages of that size, and create a new page if they are all full:
+    int cellsPerSide = qMax(1, PAGE_SIZE / size);
+    int cell         = m_usedCells[size]++;
+    slot.page        = cell / (cellsPerSide * cellsPerSide);
+    AtlasPages &pages = m_pages[size];
+    if (slot.page >= pages.count()) {
+        QPixmap page(cellsPerSide * size, cellsPerSide * size);
+        page.fill(Qt::transparent);
+        pages.append(page);
+    }
+    cell %= cellsPerSide * cellsPerSide;
+    slot.rect = QRect((cell % cellsPerSide) * size, (cell / cellsPerSide) * size,
+                      qMin(icon.width(), size), qMin(icon.height(), size));
+
+    // Blit the icon in its cell:
+    QPainter painter(&pages[slot.page]);
+    painter.setCompositionMode(QPainter::CompositionMode_Source);
+    painter.drawPixmap(slot.rect.topLeft(), icon, QRect(QPoint(0, 0), slot.rect.size()));
+    painter.end();
+
+    return m_slots.insert(key, slot).value();
+}
+
+void IconManager::drawIcon(QPainter *painter, qreal x, qreal y, const QString &name, int size, KIconLoader::States state)
+{
+    const IconSlot &slot = slotFor(name, size, state);
+    painter->drawPixmap(QPointF(x, y), m_pages[size].at(slot.page), slot.rect);
+}
+
+QSize IconManager::iconSize(const QString &name, int size, KIconLoader::States state)
+{
+    return slotFor(name, size, state).rect.size();
+}
+
+QPixmap IconManager::pixmap(const QString &name, int size, KIconLoader::States state, bool canReturnNull)
+{
+    const IconSlot &slot = slotFor(name, size, state);
+    if (!slot.exists && canReturnNull)
+        return QPixmap();
+    return m_pages[size].at(slot.page).copy(slot.rect);
+}
+
+QImage IconManager::image(const QString &name, int size, KIconLoader::States state)
+{
+    QString key = keyFor(name, size, state);
+    QHash<QString, QImage>::const_iterator it = m_images.constFind(key);
+    if (it != m_images.constEnd())
+        return it.value();
+    return m_images.insert(key, pixmap(name, size, state).toImage()).value();
+}
+
+bool IconManager::exists(const QString &name, int size)
+{
+    return slotFor(name, size, KIconLoader::DefaultState).exists;
+}
+
+void IconManager::clear()
+{
+    m_slots.clear();
+    m_pages.clear();
+    m_usedCells.clear();
+    m_images.clear();
+}
+
+void IconManager::iconThemeChanged(int /*group*/)
+{
+    clear();
+    emit iconsChanged();
+}
@@ -0,0 +1,96 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by BasKet Note Pads developers                     *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef ICONMANAGER_H
+#define ICONMANAGER_H
+
+#include <QtCore/QObject>
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QRect>
+#include <QtGui/QImage>
+#include <QtGui/QPixmap>
+
+#include <KDE/KIconLoader>
+
+#include "basket_export.h"
+
+class QPainter;
+class QString;
+
+/** Process-wide cache of the small icons BasKet paints over and over: tag emblems, link icons, exported icons...
+  * BASIC FUNCTIONNING:
+  *   Icons are looked up by (name, size, state) and loaded only once through KIconLoader.
+  *   They are then packed in atlas pages (one set of pages per icon size, icons laid out on a grid of PAGE_SIZE pixels),
+  *   so drawing an emblem is only blitting a sub-rectangle of an already uploaded pixmap.
+  *   Use drawIcon() to paint, and pixmap() only when a standalone pixmap is really needed (eg. to save it to a file).
+  *   The whole cache is flushed when the KDE icon theme changes: the iconsChanged() signal is then emitted
+  *   so that the buffered drawings can be invalidated.
+  */
+class BASKET_EXPORT IconManager : public QObject
+{
+    Q_OBJECT
+public:
+    static IconManager* instance();
+
+    /// Paint the icon with its top-left corner at (@p x, @p y). Unknown icons are painted with the "unknown" icon.
+    void drawIcon(QPainter *painter, qreal x, qreal y, const QString &name, int size,
+                  KIconLoader::States state = KIconLoader::DefaultState);
+    /// @Return the real size of the icon (it can be smaller than @p size, eg. for some favicons).
+    QSize iconSize(const QString &name, int size, KIconLoader::States state = KIconLoader::DefaultState);
+    /// @Return a copy of the icon. If @p canReturnNull is false, the "unknown" icon is returned for unexisting icons.
+    QPixmap pixmap(const QString &name, int size, KIconLoader::States state = KIconLoader::DefaultState, bool canReturnNull = false);
+    /// @Return the icon as an image, to be painted outside of the GUI thread (see NoteRenderer).
+    QImage image(const QString &name, int size, KIconLoader::States state = KIconLoader::DefaultState);
+    /// @Return true if the icon @p name exists in the current icon theme.
+    bool exists(const QString &name, int size = 16);
+
+public slots:
+    void clear();
+
+signals:
+    void iconsChanged();
+
+private:
+    IconManager();
+    ~IconManager();
+
+    /// Where an icon is stored in the atlas pages:
+    struct IconSlot {
+        int   page;   /// << Index in m_pages[size]
+        QRect rect;   /// << Position of the icon in this page
+        bool  exists; /// << False if it is the "unknown" icon, standing for an unexisting icon
+    };
+    typedef QList<QPixmap> AtlasPages;
+
+    static QString keyFor(const QString &name, int size, KIconLoader::States state);
+    const IconSlot& slotFor(const QString &name, int size, KIconLoader::States state);
+
+    static const int PAGE_SIZE = 256; /// << Width and height of the atlas pages (one icon per page for icons bigger than that)
+
+    QHash<QString, IconSlot> m_slots;     /// << Keyed by "name|size|state"
+    QHash<int, AtlasPages>   m_pages;     /// << Atlas pages, keyed by icon size
+    QHash<int, int>          m_usedCells; /// << Number of cells already taken for every icon size
+    QHash<QString, QImage>   m_images;    /// << Images already requested with image(), keyed like m_slots
+
+private slots:
+    void iconThemeChanged(int group);
+};
+
+#endif // ICONMANAGER_H
@@ -0,0 +1,268 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by BasKet Note Pads developers                     *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include "imageloader.h"
+
+#include <QtCore/QBuffer>
+#include <QtCore/QCryptographicHash>
+#include <QtCore/QDateTime>
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QRunnable>
+#include <QtCore/QThreadPool>
+#include <QtGui/QImageReader>
+
+#include <KDE/KStandardDirs>
+
+#include "notecontent.h"
+
+/** Decode one image in a worker thread (from the thumbnail cache if possible), and send it back to the loader, in the GUI thread.
+  */
+class ImageLoadTask : public QRunnable
+{
+public:
+    ImageLoadTask(ImageLoader *loader, int id, const QString &path, int width, const QString &thumbnailPath)
+        : m_loader(loader), m_id(id), m_path(path), m_width(width), m_thumbnailPath(thumbnailPath)
+    {
+    }
+    void run()
+    {
+        QImage image;
+        if (QFile::exists(m_thumbnailPath))
+            image.load(m_thumbnailPath, "PNG");
+
+        if (image.isNull()) {
+            QImageReader reader(m_path);
+            QSize size = reader.size();
+            bool downscaled = size.isValid() && m_width < size.width();
+            if (downscaled)
+                reader.setScaledSize(QSize(m_width, qMax(1, size.height() * m_width / size.width())));
+            image = reader.read();
+            if (downscaled && !image.isNull())
+                image.save(m_thumbnailPath, "PNG");
+        }
+
+        QMetaObject::invokeMethod(m_loader, "imageLoaded", Qt::QueuedConnection, Q_ARG(int, m_id), Q_ARG(QImage, image));
+    }
+private:
+    ImageLoader *m_loader;
+    int          m_id;
+    QString      m_path;
+    int          m_width;
+    QString      m_thumbnailPath;
+};
+
+/** Encode one image in a worker thread, and send the bytes back to the loader, in the GUI thread.
+  */
+class ImageEncodeTask : public QRunnable
+{
+public:
+    ImageEncodeTask(ImageLoader *loader, int id, const QImage &image, const QByteArray &format)
+        : m_loader(loader), m_id(id), m_image(image), m_format(format)
+    {
+    }
+    void run()
+    {
+        QByteArray data = ImageLoader::encodeImage(m_image, m_format);
+        QMetaObject::invokeMethod(m_loader, "imageEncoded", Qt::QueuedConnection, Q_ARG(int, m_id), Q_ARG(QByteArray, data));
+    }
+private:
+    ImageLoader *m_loader;
+    int          m_id;
+    QImage       m_image;
+    QByteArray   m_format;
+};
+
+/** Remove the oldest thumbnails, in a worker thread.
+  */
+class ThumbnailPruneTask : public QRunnable
+{
+public:
+    void run()
+    {
+        ImageLoader::pruneThumbnails();
+    }
+};
+
+ImageLoader* ImageLoader::instance()
+{
+    static ImageLoader *instance = 0;
+    if (!instance)
+        instance = new ImageLoader();
+    return instance;
+}
+
+ImageLoader::ImageLoader()
+        : m_threadPool(new QThreadPool(this))
+        , m_lastJobId(0)
+        , m_usedBytes(0)
+{
+    m_threadPool->start(new ThumbnailPruneTask());
+}
+
+ImageLoader::~ImageLoader()
+{
+    m_threadPool->waitForDone();
+}
+
+QString ImageLoader::thumbnailPath(const QString &path, int width)
+{
+    QFileInfo info(path);
+    QCryptographicHash hash(QCryptographicHash::Md5);
+    hash.addData(info.absoluteFilePath().toUtf8());
+    hash.addData(info.lastModified().toString(Qt::ISODate).toLatin1());
+    hash.addData(QByteArray::number(width));
+    return thumbnailsFolder() + hash.result().toHex() + ".png";
+}
+
+QString ImageLoader::thumbnailsFolder()
+{
+    return KStandardDirs::locateLocal("cache", "basket/thumbnails/");
+}
+
+/** Keep the thumbnail cache under THUMBNAILS_SIZE bytes, by removing the oldest thumbnails.
+  * Thumbnails of deleted or modified images are never used again: they are the oldest ones, and go first.
+  */
+void ImageLoader::pruneThumbnails()
+{
+    QFileInfoList thumbnails = QDir(thumbnailsFolder()).entryInfoList(QStringList("*.png"), QDir::Files, QDir::Time); // Newest first
+    qint64 size = 0;
+    for (QFileInfoList::const_iterator it = thumbnails.constBegin(); it != thumbnails.constEnd(); ++it) {
+        size += it->size();
+        if (size > THUMBNAILS_SIZE)
+            QFile::remove(it->absoluteFilePath());
+    }
+}
+
+void ImageLoader::load(ImageContent *content, const QString &path, int width)
+{
+    width = qMax(1, (width + WIDTH_STEP - 1) / WIDTH_STEP) * WIDTH_STEP;
+
+    // Already being loaded at that size: just wait for it:
+    QHash<ImageContent*, PendingLoad>::const_iterator it = m_pending.constFind(content);
+    if (it != m_pending.constEnd()) {
+        if (it.value().width == width)
+            return;
+        m_jobs.remove(it.value().id);
+    }
+
+    PendingLoad pending;
+    pending.id    = ++m_lastJobId;
+    pending.width = width;
+    m_pending.insert(content, pending);
+    m_jobs.insert(pending.id, content);
+    m_threadPool->start(new ImageLoadTask(this, pending.id, path, width, thumbnailPath(path, width)));
+}
+
+QByteArray ImageLoader::encodeImage(const QImage &image, const QByteArray &format)
+{
+    QByteArray data;
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::WriteOnly);
+    image.save(&buffer, format);
+    return data;
+}
+
+void ImageLoader::encode(ImageContent *content, const QImage &image, const QByteArray &format)
+{
+    // A previous version of the image is being encoded: it is outdated
+    m_encodingJobs.remove(m_encodings.value(content));
+
+    int id = ++m_lastJobId;
+    m_encodings.insert(content, id);
+    m_encodingJobs.insert(id, content);
+    m_threadPool->start(new ImageEncodeTask(this, id, image, format));
+}
+
+bool ImageLoader::isEncoding(ImageContent *content) const
+{
+    return m_encodings.contains(content);
+}
+
+void ImageLoader::cancelEncoding(ImageContent *content)
+{
+    if (m_encodings.contains(content))
+        m_encodingJobs.remove(m_encodings.take(content));
+}
+
+void ImageLoader::touch(ImageContent *content)
+{
+    if (m_loaded.isEmpty() || m_loaded.last() == content)
+        return;
+    if (m_loaded.removeOne(content))
+        m_loaded.append(content);
+}
+
+void ImageLoader::forget(ImageContent *content)
+{
+    QHash<ImageContent*, PendingLoad>::iterator it = m_pending.find(content);
+    if (it != m_pending.end()) {
+        m_jobs.remove(it.value().id);
+        m_pending.erase(it);
+    }
+    cancelEncoding(content);
+    if (m_loaded.removeOne(content))
+        m_usedBytes -= m_bytes.take(content);
+}
+
+void ImageLoader::imageLoaded(int id, const QImage &image)
+{
+    // The content was deleted or requested another size in the meantime:
+    ImageContent *content = m_jobs.take(id);
+    if (!content)
+        return;
+    m_pending.remove(content);
+
+    if (m_loaded.removeOne(content))
+        m_usedBytes -= m_bytes.take(content);
+    content->setDisplayImage(image);
+    if (!image.isNull()) {
+        int bytes = image.byteCount();
+        m_loaded.append(content);
+        m_bytes.insert(content, bytes);
+        m_usedBytes += bytes;
+        unloadImagesOverBudget(content);
+    }
+}
+
+void ImageLoader::imageEncoded(int id, const QByteArray &data)
+{
+    // The content was deleted or got another image in the meantime:
+    ImageContent *content = m_encodingJobs.take(id);
+    if (!content)
+        return;
+    m_encodings.remove(content);
+    content->setEncodedData(data);
+}
+
+void ImageLoader::unloadImagesOverBudget(ImageContent *keep)
+{
+    QList<ImageContent*>::iterator it = m_loaded.begin();
+    while (m_usedBytes > MEMORY_BUDGET && it != m_loaded.end()) {
+        ImageContent *content = *it;
+        if (content == keep || content->isOnScreen())
+            ++it;
+        else {
+            it = m_loaded.erase(it);
+            m_usedBytes -= m_bytes.take(content);
+            content->unloadDisplayImage();
+        }
+    }
+}
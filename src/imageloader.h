@@ -0,0 +1,104 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by BasKet Note Pads developers                     *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef IMAGELOADER_H
+#define IMAGELOADER_H
+
+#include <QtCore/QObject>
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtGui/QImage>
+
+class QThreadPool;
+
+class ImageContent;
+
+/** Decode (and encode) the images of image notes on a thread pool, at the size they are displayed.
+  * BASIC FUNCTIONNING:
+  *   An ImageContent only knows the size of its image (read from the file header) until its note is painted.
+  *   It then calls load() with the width it is displayed at: the image is decoded in a worker thread
+  *   with QImageReader::setScaledSize(), so a 4K screenshot shown 400 pixels wide is never decoded at full size.
+  *   Downscaled images are also saved in a thumbnail cache on disk (keyed by path, modification time and width),
+  *   to not decode the originals at all the next times. That cache is limited to THUMBNAILS_SIZE bytes: the oldest thumbnails
+  *   are removed once per session, in a worker thread (see pruneThumbnails()). The result is handed back to the content in the GUI thread
+  *   (ImageContent::setDisplayImage()).
+  *   The decoded images are accounted in a memory budget: when it is exceeded, the least recently painted images
+  *   of notes that are not on screen anymore are unloaded (they will be loaded again when painted).
+  *   Encrypted baskets are not handled here: their images are decrypted and decoded by ImageContent itself.
+  *   The other way around, only new or modified images need to be encoded when saving a note:
+  *   encode() does it in a worker thread and hands the bytes to ImageContent::setEncodedData(), that writes them.
+  *   It is only used where nothing needs the file right away (ImageContent::saveToFileInBackground()): saveToFile() encodes synchronously.
+  */
+class ImageLoader : public QObject
+{
+    Q_OBJECT
+public:
+    static ImageLoader* instance();
+
+    /// Decode the image of @p content, stored in @p path, to be displayed @p width pixels wide.
+    /// The width is rounded up to a multiple of WIDTH_STEP, so a note resized a little does not need another decoding.
+    void load(ImageContent *content, const QString &path, int width);
+    /// Tell that the image of @p content has been painted: it will be unloaded after the images that were not painted since.
+    void touch(ImageContent *content);
+    /// Encode @p image in @p format for @p content.
+    void encode(ImageContent *content, const QImage &image, const QByteArray &format);
+    /// @Return true if an image is being encoded for @p content.
+    bool isEncoding(ImageContent *content) const;
+    /// Forget the image being encoded for @p content, if any: it will not be given to it.
+    void cancelEncoding(ImageContent *content);
+    /// Forget the loading, the encoding and the image of @p content (eg. because it is deleted or got its image from elsewhere).
+    void forget(ImageContent *content);
+
+    static QByteArray encodeImage(const QImage &image, const QByteArray &format);
+
+private:
+    ImageLoader();
+    ~ImageLoader();
+
+    static QString thumbnailsFolder();
+    static QString thumbnailPath(const QString &path, int width);
+    friend class ThumbnailPruneTask;
+    static void pruneThumbnails();
+    void unloadImagesOverBudget(ImageContent *keep);
+
+    static const int MEMORY_BUDGET = 96 * 1024 * 1024; /// << In bytes, for all the decoded images
+    static const int WIDTH_STEP    = 128;
+    static const int THUMBNAILS_SIZE = 64 * 1024 * 1024; /// << In bytes, for the thumbnail cache on disk
+
+    struct PendingLoad {
+        int id;
+        int width;
+    };
+
+    QThreadPool                        *m_threadPool;
+    QHash<ImageContent*, PendingLoad>   m_pending;
+    QHash<int, ImageContent*>           m_jobs;
+    QHash<ImageContent*, int>           m_encodings; /// << Id of the pending encoding of every content
+    QHash<int, ImageContent*>           m_encodingJobs;
+    int                                 m_lastJobId;
+    QList<ImageContent*>                m_loaded;    /// << Least recently painted first
+    QHash<ImageContent*, int>           m_bytes;     /// << Memory used by the image of every loaded content
+    qint64                              m_usedBytes;
+
+private slots:
+    void imageLoaded(int id, const QImage &image);
+    void imageEncoded(int id, const QByteArray &data);
+};
+
+#endif // IMAGELOADER_H
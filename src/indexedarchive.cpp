@@ -0,0 +1,480 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by BasKet Note Pads developers                     *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+
+#include "indexedarchive.h"
+
+#include <QtCore/QFile>
+#include <QtXml/QDomDocument>
+
+#include <KDE/KDebug>
+#include <KDE/KTar>
+
+#include <string.h> // memcpy() function
+#include <zlib.h>
+
+/** Read-only random access to the tar data of a part, inflated on the fly from the restart point before it.
+  * Every CHECKPOINT_SPACING bytes of a part, the state of the inflation is kept (the zran way: the position in
+  * the compressed stream, to the bit, and the last 32 KB inflated, as dictionary): going back in the part,
+  * eg. to read a file after KTar listed them, only inflates again from the closest checkpoint before.
+  */
+class PartDevice : public QIODevice
+{
+public:
+    PartDevice(const QString &path, qint64 archiveStart, qint64 archiveSize,
+               const ParallelGzipDevice::RestartPoint &restart, qint64 start, qint64 end);
+    ~PartDevice();
+    bool open(OpenMode mode);
+    void close();
+    bool isSequential() const { return false; }
+    qint64 size() const { return m_end - m_start; }
+
+protected:
+    qint64 readData(char *data, qint64 maxSize);
+    qint64 writeData(const char*, qint64) { return -1; }
+
+private:
+    struct Checkpoint {
+        qint64     uncompressedOffset;
+        qint64     compressedOffset; /// << Of the first byte not completely inflated yet
+        int        bits;             /// << Bits of the byte before it that are not inflated yet
+        QByteArray window;           /// << The data inflated before the checkpoint (up to WINDOW_SIZE bytes), as dictionary
+    };
+    bool restartFrom(const Checkpoint &checkpoint);
+    void stopInflating();
+    bool skipTo(qint64 position);
+    qint64 inflateData(char *data, qint64 maxSize);
+    void addToWindow(const char *data, int size);
+    QByteArray window() const;
+
+    QFile      m_file;
+    qint64     m_archiveStart;   /// << Offset of the gzip stream in the file
+    qint64     m_archiveSize;
+    qint64     m_start;          /// << Offsets of the part in the uncompressed tar archive
+    qint64     m_end;
+    z_stream   m_stream;
+    bool       m_inflating;      /// << True once m_stream is initialized
+    bool       m_streamEnded;
+    QByteArray m_input;
+    qint64     m_inputEnd;       /// << Compressed offset of the end of m_input
+    qint64     m_position;       /// << Uncompressed offset of the next byte to inflate
+    QByteArray m_window;         /// << The last WINDOW_SIZE bytes inflated, in a ring
+    int        m_windowPosition;
+    int        m_windowFill;
+    QList<Checkpoint> m_checkpoints; /// << In order, the first one being the restart point
+
+    static const int WINDOW_SIZE = 32 * 1024;
+    static const int INPUT_SIZE  = 64 * 1024;
+    static const qint64 CHECKPOINT_SPACING = 1024 * 1024;
+};
+
+PartDevice::PartDevice(const QString &path, qint64 archiveStart, qint64 archiveSize,
+                       const ParallelGzipDevice::RestartPoint &restart, qint64 start, qint64 end)
+        : m_file(path)
+        , m_archiveStart(archiveStart)
+        , m_archiveSize(archiveSize)
+        , m_start(start)
+        , m_end(end)
+        , m_inflating(false)
+        , m_streamEnded(false)
+        , m_inputEnd(0)
+        , m_position(0)
+        , m_window(WINDOW_SIZE, '\0')
+        , m_windowPosition(0)
+        , m_windowFill(0)
+{
+    Checkpoint checkpoint;
+    checkpoint.uncompressedOffset = restart.uncompressedOffset;
+    checkpoint.compressedOffset   = restart.compressedOffset;
+    checkpoint.bits               = 0;
+    m_checkpoints.append(checkpoint);
+}
+
+PartDevice::~PartDevice()
+{
+    close();
+}
+
+bool PartDevice::open(OpenMode mode)
+{
+    if ((mode & WriteOnly) || !m_file.open(QIODevice::ReadOnly))
+        return false;
+    // The inflation starts with the first read:
+    return QIODevice::open(mode | Unbuffered);
+}
+
+void PartDevice::close()
+{
+    stopInflating();
+    m_file.close();
+    QIODevice::close();
+}
+
+qint64 PartDevice::readData(char *data, qint64 maxSize)
+{
+    if (!skipTo(m_start + pos())) {
+        setErrorString("Cannot inflate the archive");
+        return -1;
+    }
+    maxSize = qMin(maxSize, m_end - m_position);
+    if (maxSize <= 0)
+        return 0;
+    qint64 read = inflateData(data, maxSize);
+    if (read < 0)
+        setErrorString("Cannot inflate the archive");
+    return read;
+}
+
+/** Inflate up to @p position, from the current position or from the closest checkpoint before it.
+  */
+bool PartDevice::skipTo(qint64 position)
+{
+    Checkpoint checkpoint = m_checkpoints.first();
+    for (QList<Checkpoint>::const_iterator it = m_checkpoints.begin(); it != m_checkpoints.end(); ++it)
+        if ((*it).uncompressedOffset <= position)
+            checkpoint = *it;
+    if ((!m_inflating || m_position > position || checkpoint.uncompressedOffset > m_position) && !restartFrom(checkpoint)) {
+        stopInflating();
+        return false;
+    }
+
+    if (m_position < position) {
+        QByteArray skipped(INPUT_SIZE, '\0');
+        while (m_position < position) {
+            if (inflateData(skipped.data(), qMin<qint64>(skipped.size(), position - m_position)) <= 0)
+                return false;
+        }
+    }
+    return true;
+}
+
+void PartDevice::stopInflating()
+{
+    if (m_inflating)
+        inflateEnd(&m_stream);
+    m_inflating = false;
+}
+
+bool PartDevice::restartFrom(const Checkpoint &checkpoint)
+{
+    stopInflating();
+    m_streamEnded = false;
+    m_stream.zalloc   = Z_NULL;
+    m_stream.zfree    = Z_NULL;
+    m_stream.opaque   = Z_NULL;
+    m_stream.avail_in = 0;
+    m_stream.next_in  = Z_NULL;
+    if (inflateInit2(&m_stream, /*Raw inflate:*/-MAX_WBITS) != Z_OK)
+        return false;
+    m_inflating = true;
+
+    // Start with the bits of the previous byte that were not inflated yet:
+    m_inputEnd = checkpoint.compressedOffset - (checkpoint.bits ? 1 : 0);
+    m_input.clear();
+    if (!m_file.seek(m_archiveStart + m_inputEnd))
+        return false;
+    if (checkpoint.bits) {
+        char byte;
+        if (!m_file.getChar(&byte))
+            return false;
+        ++m_inputEnd;
+        if (inflatePrime(&m_stream, checkpoint.bits, (quint8)byte >> (8 - checkpoint.bits)) != Z_OK)
+            return false;
+    }
+    if (!checkpoint.window.isEmpty() &&
+        inflateSetDictionary(&m_stream, (const Bytef*)checkpoint.window.constData(), checkpoint.window.size()) != Z_OK)
+        return false;
+
+    m_position = checkpoint.uncompressedOffset;
+    m_windowPosition = 0;
+    m_windowFill     = 0;
+    addToWindow(checkpoint.window.constData(), checkpoint.window.size());
+    return true;
+}
+
+/** Inflate the next bytes of the stream in @p data, and add a checkpoint at the first deflate block boundary
+  * more than CHECKPOINT_SPACING bytes after the last one.
+  * @Return the number of bytes inflated, 0 at the end of the stream, or -1 if it is corrupted or truncated.
+  */
+qint64 PartDevice::inflateData(char *data, qint64 maxSize)
+{
+    if (m_streamEnded)
+        return 0;
+    m_stream.next_out  = (Bytef*)data;
+    m_stream.avail_out = qMin<qint64>(maxSize, 1024 * 1024 * 1024); // KArchiveFile::data() reads a whole file at once
+    uInt size = m_stream.avail_out;
+    while (m_stream.avail_out > 0) {
+        // Once all the input is read, inflate() is still called, to reach the end of the last deflate block:
+        if (m_stream.avail_in == 0 && m_inputEnd < m_archiveSize) {
+            m_input = m_file.read(qMin<qint64>(INPUT_SIZE, m_archiveSize - m_inputEnd));
+            if (m_input.isEmpty()) {
+                stopInflating();
+                return -1;
+            }
+            m_inputEnd += m_input.size();
+            m_stream.next_in  = (Bytef*)m_input.data();
+            m_stream.avail_in = m_input.size();
+        }
+        char *output = (char*)m_stream.next_out;
+        uInt available = m_stream.avail_out;
+        int result = inflate(&m_stream, Z_BLOCK); // Stop at the end of every deflate block, where a checkpoint can be added
+        int produced = available - m_stream.avail_out;
+        addToWindow(output, produced);
+        m_position += produced;
+        if (result == Z_STREAM_END) {
+            m_streamEnded = true;
+            break;
+        }
+        if (result != Z_OK && !(result == Z_BUF_ERROR && m_stream.avail_in == 0 && m_inputEnd < m_archiveSize)) {
+            stopInflating();
+            return -1;
+        }
+        if ((m_stream.data_type & 128) && !(m_stream.data_type & 64) &&
+            m_position - m_checkpoints.last().uncompressedOffset >= CHECKPOINT_SPACING) {
+            Checkpoint checkpoint;
+            checkpoint.uncompressedOffset = m_position;
+            checkpoint.compressedOffset   = m_inputEnd - m_stream.avail_in;
+            checkpoint.bits               = m_stream.data_type & 7;
+            checkpoint.window             = window();
+            m_checkpoints.append(checkpoint);
+        }
+    }
+    return size - m_stream.avail_out;
+}
+
+void PartDevice::addToWindow(const char *data, int size)
+{
+    if (size >= WINDOW_SIZE) {
+        memcpy(m_window.data(), data + size - WINDOW_SIZE, WINDOW_SIZE);
+        m_windowPosition = 0;
+        m_windowFill     = WINDOW_SIZE;
+        return;
+    }
+    int first = qMin(size, WINDOW_SIZE - m_windowPosition);
+    memcpy(m_window.data() + m_windowPosition, data, first);
+    memcpy(m_window.data(), data + first, size - first);
+    m_windowPosition = (m_windowPosition + size) % WINDOW_SIZE;
+    m_windowFill     = (m_windowFill + size < WINDOW_SIZE ? m_windowFill + size : int(WINDOW_SIZE));
+}
+
+/** @Return the last WINDOW_SIZE bytes inflated (or less, at the start of the stream), in order.
+  */
+QByteArray PartDevice::window() const
+{
+    if (m_windowFill < WINDOW_SIZE)
+        return m_window.left(m_windowFill);
+    return m_window.mid(m_windowPosition) + m_window.left(m_windowPosition);
+}
+
+IndexedArchive::IndexedArchive(const QString &path)
+        : m_path(path)
+        , m_archiveStart(-1)
+        , m_archiveSize(0)
+{
+}
+
+IndexedArchive::~IndexedArchive()
+{
+    closeParts();
+}
+
+bool IndexedArchive::open()
+{
+    closeParts();
+    QFile file(m_path);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+    if (file.readLine().trimmed() != "BasKetNP:archive")
+        return false;
+
+    // Get the position of the embedded files, and read the index (see Archive::open() for the format):
+    QByteArray index;
+    while (!file.atEnd()) {
+        QByteArray line = file.readLine().trimmed();
+        int colon = line.indexOf(':');
+        if (colon < 0 || !line.left(colon).endsWith('*'))
+            continue;
+        QByteArray key = line.left(colon);
+        bool ok;
+        qint64 size = line.mid(colon + 1).toLongLong(&ok);
+        if (!ok)
+            return false;
+        if (key == "archive*") {
+            m_archiveStart = file.pos();
+            m_archiveSize  = size;
+        } else if (key == "index*") {
+            index = file.read(size);
+            size = 0;
+        }
+        file.seek(file.pos() + size);
+    }
+
+    m_parts.clear();
+    m_restartPoints.clear();
+    if (m_archiveStart >= 0 && !index.isEmpty() && !loadIndex(index)) {
+        kDebug() << "The index of the archive" << m_path << "is corrupted";
+        m_parts.clear();
+    }
+    return m_archiveStart >= 0;
+}
+
+QStringList IndexedArchive::parts() const
+{
+    QStringList names;
+    for (PartList::const_iterator it = m_parts.begin(); it != m_parts.end(); ++it)
+        names.append((*it).name);
+    return names;
+}
+
+QByteArray IndexedArchive::createIndex(const PartList &parts, const QList<ParallelGzipDevice::RestartPoint> &restartPoints)
+{
+    QDomDocument document("archiveIndex");
+    QDomElement root = document.createElement("archiveIndex");
+    root.setAttribute("version", 1);
+    document.appendChild(root);
+    for (QList<ParallelGzipDevice::RestartPoint>::const_iterator it = restartPoints.begin(); it != restartPoints.end(); ++it) {
+        QDomElement restart = document.createElement("restart");
+        restart.setAttribute("in",  QString::number((*it).uncompressedOffset));
+        restart.setAttribute("out", QString::number((*it).compressedOffset));
+        root.appendChild(restart);
+    }
+    for (PartList::const_iterator it = parts.begin(); it != parts.end(); ++it) {
+        QDomElement part = document.createElement("part");
+        part.setAttribute("name",   (*it).name);
+        part.setAttribute("offset", QString::number((*it).offset));
+        root.appendChild(part);
+    }
+    return "<?xml version=\"1.0\" encoding=\"UTF-8\" ?>\n" + document.toString().toUtf8();
+}
+
+bool IndexedArchive::loadIndex(const QByteArray &xml)
+{
+    QDomDocument document;
+    if (!document.setContent(xml))
+        return false;
+    QDomElement root = document.documentElement();
+    if (root.tagName() != "archiveIndex" || root.attribute("version") != "1")
+        return false;
+
+    for (QDomElement element = root.firstChildElement(); !element.isNull(); element = element.nextSiblingElement()) {
+        bool ok1, ok2;
+        if (element.tagName() == "restart") {
+            ParallelGzipDevice::RestartPoint point;
+            point.uncompressedOffset = element.attribute("in").toLongLong(&ok1);
+            point.compressedOffset   = element.attribute("out").toLongLong(&ok2);
+            if (!ok1 || !ok2 || point.compressedOffset >= m_archiveSize)
+                return false;
+            m_restartPoints.append(point);
+        } else if (element.tagName() == "part") {
+            Part part;
+            part.name   = element.attribute("name");
+            part.offset = element.attribute("offset").toLongLong(&ok1);
+            if (!ok1)
+                return false;
+            m_parts.append(part);
+        }
+    }
+    return !m_restartPoints.isEmpty();
+}
+
+/** Read the tar data of the part @p name, the first time it is needed, and keep it open for the next reads.
+  * @Return 0 if there is no such part or it cannot be read.
+  */
+KTar* IndexedArchive::openPart(const QString &name)
+{
+    for (int i = 0; i < m_openParts.count(); ++i) {
+        if (m_openParts.at(i).name == name) {
+            m_openParts.move(i, 0);
+            return m_openParts.first().tar;
+        }
+    }
+
+    // The part ends where the next one starts, or with the archive:
+    qint64 start = -1;
+    qint64 end   = -1;
+    for (int i = 0; i < m_parts.count(); ++i) {
+        if (m_parts.at(i).name == name) {
+            start = m_parts.at(i).offset;
+            if (i + 1 < m_parts.count())
+                end = m_parts.at(i + 1).offset;
+            break;
+        }
+    }
+    if (start < 0)
+        return 0;
+    if (end < 0) {
+        // The size of the archive is in the gzip trailer, modulo 2^32 (a part is smaller than that):
+        QFile file(m_path);
+        if (m_archiveSize < 8 || !file.open(QIODevice::ReadOnly) || !file.seek(m_archiveStart + m_archiveSize - 4))
+            return 0;
+        QByteArray trailer = file.read(4);
+        if (trailer.size() != 4)
+            return 0;
+        quint32 size = (quint8)trailer[0] | ((quint8)trailer[1] << 8) | ((quint8)trailer[2] << 16) | ((quint32)(quint8)trailer[3] << 24);
+        end = start + (quint32)(size - (quint32)start);
+    }
+    ParallelGzipDevice::RestartPoint restart = m_restartPoints.first();
+    for (QList<ParallelGzipDevice::RestartPoint>::const_iterator it = m_restartPoints.begin(); it != m_restartPoints.end(); ++it)
+        if ((*it).uncompressedOffset <= start)
+            restart = *it;
+
+    OpenPart part;
+    part.name   = name;
+    part.device = new PartDevice(m_path, m_archiveStart, m_archiveSize, restart, start, end);
+    part.tar    = new KTar(part.device);
+    if (!part.tar->open(QIODevice::ReadOnly)) {
+        delete part.tar;
+        delete part.device;
+        return 0;
+    }
+    if (m_openParts.count() >= MAX_OPEN_PARTS) {
+        OpenPart oldest = m_openParts.takeLast();
+        delete oldest.tar;
+        delete oldest.device;
+    }
+    m_openParts.prepend(part);
+    return part.tar;
+}
+
+void IndexedArchive::closeParts()
+{
+    for (QList<OpenPart>::const_iterator it = m_openParts.begin(); it != m_openParts.end(); ++it) {
+        delete (*it).tar;
+        delete (*it).device;
+    }
+    m_openParts.clear();
+}
+
+QByteArray IndexedArchive::readFile(const QString &part, const QString &path)
+{
+    KTar *tar = openPart(part);
+    if (tar == 0)
+        return QByteArray();
+    const KArchiveEntry *entry = tar->directory()->entry(path);
+    return (entry && entry->isFile() ? static_cast<const KArchiveFile*>(entry)->data() : QByteArray());
+}
+
+bool IndexedArchive::extractPart(const QString &part, const QString &destination)
+{
+    KTar *tar = openPart(part);
+    if (tar == 0)
+        return false;
+    tar->directory()->copyTo(destination);
+    return true;
+}
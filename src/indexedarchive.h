@@ -0,0 +1,91 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by BasKet Note Pads developers                     *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+
+#ifndef INDEXEDARCHIVE_H
+#define INDEXEDARCHIVE_H
+
+#include <QtCore/QByteArray>
+#include <QtCore/QList>
+#include <QtCore/QString>
+#include <QtCore/QStringList>
+
+#include "basket_export.h"
+#include "parallelgzipdevice.h"
+
+class QIODevice;
+
+class KTar;
+
+/** Random access to the parts of a basket archive (.baskets file), without extracting the whole archive.
+  * BASIC FUNCTIONNING:
+  *   Archive::save() compresses the tar archive with a ParallelGzipDevice, adding a restart point before every basket,
+  *   every background image and the "metadata" part (baskets.xml, tags.xml and the tag emblems).
+  *   It then writes an "index*" section after the "archive*" one, listing the offset of every part in the tar archive,
+  *   and the restart points of the gzip stream (older versions skip that section, and still import the archive).
+  *   To read a part, KTar lists its files through a device inflating it on the fly, from the closest restart point before it:
+  *   nothing but the file being read is kept in memory, and checkpoints of the inflation let it go back to any file
+  *   without inflating the part again from its start.
+  *   The last parts read stay open, so reading several files of the same basket only lists them once.
+  *   Archives without index (eg. created by older versions) can only be imported in full by Archive::open().
+  */
+class BASKET_EXPORT IndexedArchive
+{
+public:
+    struct Part {
+        QString name;   /// << Basket folder name (eg. "basket1/"), "backgrounds/" + image name, or "metadata"
+        qint64  offset; /// << In the uncompressed tar archive
+    };
+    typedef QList<Part> PartList;
+
+    explicit IndexedArchive(const QString &path);
+    ~IndexedArchive();
+
+    bool open();                  /// << Read the header and the index. @return false if the file is not a basket archive
+    bool hasIndex() const { return !m_parts.isEmpty(); }
+    QStringList parts() const;
+    QByteArray readFile(const QString &part, const QString &path);     /// << Read the file @p path of the tar archive (eg. "baskets/basket1/.basket")
+    bool extractPart(const QString &part, const QString &destination); /// << Extract every file of the @p part in the @p destination folder
+
+    /// @Return the content of the "index*" section, for an archive compressed with those @p restartPoints.
+    static QByteArray createIndex(const PartList &parts, const QList<ParallelGzipDevice::RestartPoint> &restartPoints);
+
+private:
+    Q_DISABLE_COPY(IndexedArchive)
+    struct OpenPart {
+        QString    name;
+        QIODevice *device;
+        KTar      *tar;
+    };
+
+    bool loadIndex(const QByteArray &xml);
+    KTar *openPart(const QString &part);
+    void closeParts();
+
+    QString  m_path;
+    qint64   m_archiveStart;  /// << Offset of the gzip stream in the file
+    qint64   m_archiveSize;
+    PartList m_parts;
+    QList<ParallelGzipDevice::RestartPoint> m_restartPoints;
+    QList<OpenPart> m_openParts; /// << The last parts read, the most recent first
+
+    static const int MAX_OPEN_PARTS = 4;
+};
+
+#endif // INDEXEDARCHIVE_H
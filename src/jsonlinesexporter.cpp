@@ -0,0 +1,285 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by BasKet Note Pads developers                     *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+
+#include "jsonlinesexporter.h"
+
+#include <QtCore/QFile>
+#include <QtCore/QIODevice>
+#include <QtGui/QColor>
+#include <QtXml/QDomDocument>
+
+#include <KDE/KDebug>
+#include <KDE/KLocale>
+#include <KDE/KService>
+#include <KDE/KUrl>
+
+#include "basketcipher.h"
+#include "basketscene.h"
+#include "tools.h"
+#include "xmlwork.h"
+
+JsonLinesExporter::JsonLinesExporter(const QString &dataFolder)
+        : m_dataFolder(dataFolder.endsWith('/') ? dataFolder : dataFolder + '/')
+        , m_device(0)
+        , m_basketsCount(0)
+        , m_notesCount(0)
+        , m_noteId(0)
+{
+}
+
+bool JsonLinesExporter::exportTo(QIODevice *device)
+{
+    m_device = device;
+    m_errorString.clear();
+    m_basketsCount = 0;
+    m_notesCount   = 0;
+    loadTags();
+
+    QFile file(m_dataFolder + "baskets/baskets.xml");
+    QDomDocument document;
+    if (!file.open(QIODevice::ReadOnly) || !document.setContent(&file)) {
+        m_errorString = i18n("Cannot read the list of baskets %1.", file.fileName());
+        return false;
+    }
+    file.close();
+
+    exportBaskets(document.documentElement(), QString(), QStringList());
+    return m_errorString.isEmpty();
+}
+
+/** Read the full names of the tag states, as Tag::loadTags() and State::fullName() do.
+  */
+void JsonLinesExporter::loadTags()
+{
+    m_stateNames.clear();
+    QFile file(m_dataFolder + "tags.xml");
+    QDomDocument document;
+    if (!file.open(QIODevice::ReadOnly) || !document.setContent(&file))
+        return;
+
+    QDomElement root = document.documentElement();
+    for (QDomElement tag = root.firstChildElement("tag"); !tag.isNull(); tag = tag.nextSiblingElement("tag")) {
+        QString tagName = XMLWork::getElementText(tag, "name");
+        QList<QDomElement> states;
+        for (QDomElement state = tag.firstChildElement("state"); !state.isNull(); state = state.nextSiblingElement("state"))
+            states.append(state);
+        for (QList<QDomElement>::const_iterator it = states.constBegin(); it != states.constEnd(); ++it) {
+            QString stateName = XMLWork::getElementText(*it, "name");
+            if (states.count() == 1)
+                m_stateNames.insert(it->attribute("id"), stateName.isEmpty() ? tagName : stateName);
+            else
+                m_stateNames.insert(it->attribute("id"), i18n("%1: %2", tagName, stateName));
+        }
+    }
+}
+
+void JsonLinesExporter::exportBaskets(const QDomElement &parent, const QString &parentFolderName, const QStringList &parentPath)
+{
+    for (QDomElement element = parent.firstChildElement("basket"); !element.isNull() && m_errorString.isEmpty(); element = element.nextSiblingElement("basket"))
+        if (!element.attribute("folderName").isEmpty())
+            exportBasket(element, parentFolderName, parentPath);
+}
+
+void JsonLinesExporter::exportBasket(const QDomElement &element, const QString &parentFolderName, const QStringList &parentPath)
+{
+    QString folderName = element.attribute("folderName");
+    QDomElement treeProperties = XMLWork::getElement(element, "properties");
+    QStringList path = parentPath;
+    path.append(XMLWork::getElementText(treeProperties, "name", folderName));
+
+    {
+        // Read the notes of the basket, and forget them before exporting the sub-baskets:
+        QByteArray data;
+        bool encrypted = false;
+        QDomDocument document;
+        bool loaded = readFile(m_dataFolder + "baskets/" + folderName + ".basket", &data, &encrypted) &&
+                      !encrypted && document.setContent(QString::fromUtf8(data.constData(), data.size()));
+        if (!loaded && !encrypted)
+            kDebug() << "Cannot read the basket" << folderName;
+        data.clear();
+
+        QDomElement properties  = (loaded ? XMLWork::getElement(document.documentElement(), "properties") : treeProperties);
+        QDomElement disposition = XMLWork::getElement(properties, "disposition");
+        QString layout = (XMLWork::trueOrFalse(disposition.attribute("mindMap", "false")) ? "mindMap" :
+                          XMLWork::trueOrFalse(disposition.attribute("free", "false"))    ? "free" : "columns");
+
+        writeRecord(QString("{\"record\":\"basket\",\"folderName\":%1,\"parentFolderName\":%2,\"path\":%3,\"name\":%4,\"icon\":%5,"
+                            "\"layout\":%6,\"columnCount\":%7,\"encrypted\":%8}")
+                    .arg(Tools::jsonString(folderName),
+                         parentFolderName.isEmpty() ? QString("null") : Tools::jsonString(parentFolderName),
+                         jsonStringList(path),
+                         Tools::jsonString(path.last()),
+                         Tools::jsonString(XMLWork::getElementText(properties, "icon", XMLWork::getElementText(treeProperties, "icon"))),
+                         Tools::jsonString(layout),
+                         QString::number(disposition.attribute("columnCount", "1").toInt()),
+                         XMLWork::trueOrFalse(encrypted)));
+        ++m_basketsCount;
+
+        if (loaded) {
+            QDomElement notes = XMLWork::getElement(document.documentElement(), "notes");
+            if (notes.isNull())
+                notes = XMLWork::getElement(document.documentElement(), "items"); // Compatibility with 0.6.0 Pre-Alpha versions
+            m_noteId = 0;
+            exportNotes(notes, folderName, jsonStringList(path), QString(), layout == "columns");
+        }
+    }
+
+    exportBaskets(element, folderName, path);
+}
+
+void JsonLinesExporter::exportNotes(const QDomElement &parent, const QString &folderName, const QString &basketPath,
+                                    const QString &parentId, bool isColumnsLayout)
+{
+    for (QDomElement e = parent.firstChildElement(); !e.isNull() && m_errorString.isEmpty(); e = e.nextSiblingElement()) {
+        bool isGroup = (e.tagName() == "group");
+        if (!isGroup && e.tagName() != "note" && e.tagName() != "item") // "item": Keep compatible with 0.6.0 Alpha 1
+            continue;
+        QString id = folderName + QString::number(++m_noteId);
+
+        // Geometry (only saved for free notes and resizeable notes, see BasketScene::saveNotes()):
+        QStringList geometry;
+        if (e.hasAttribute("x"))
+            geometry << "\"x\":" + QString::number(e.attribute("x").toInt()) << "\"y\":" + QString::number(e.attribute("y").toInt());
+        if (e.hasAttribute("width"))
+            geometry << "\"width\":" + QString::number(e.attribute("width").toInt());
+
+        QString record = QString("{\"record\":%1,\"id\":%2,\"parent\":%3,\"basket\":%4,\"basketPath\":%5,\"geometry\":%6,")
+                         .arg(isGroup ? "\"group\"" : "\"note\"",
+                              Tools::jsonString(id),
+                              parentId.isEmpty() ? QString("null") : Tools::jsonString(parentId),
+                              Tools::jsonString(folderName),
+                              basketPath,
+                              geometry.isEmpty() ? QString("null") : "{" + geometry.join(",") + "}");
+
+        if (isGroup) {
+            record += QString("\"type\":%1,\"folded\":%2}")
+                      .arg(parentId.isEmpty() && isColumnsLayout ? "\"column\"" : "\"group\"",
+                           XMLWork::trueOrFalse(XMLWork::trueOrFalse(e.attribute("folded", "false"))));
+            writeRecord(record);
+            exportNotes(e, folderName, basketPath, id, isColumnsLayout);
+            continue;
+        }
+
+        QStringList tags;
+        QStringList tagIds = XMLWork::getElementText(e, "tags", "").split(';', QString::SkipEmptyParts);
+        for (QStringList::const_iterator it = tagIds.constBegin(); it != tagIds.constEnd(); ++it)
+            tags << QString("{\"id\":%1,\"name\":%2}").arg(Tools::jsonString(*it), Tools::jsonString(m_stateNames.value(*it)));
+
+        QString type = e.attribute("type");
+        QDomElement content = XMLWork::getElement(e, "content");
+        record += QString("\"type\":%1,\"added\":%2,\"lastModification\":%3,\"tags\":[%4],")
+                  .arg(Tools::jsonString(type),
+                       e.hasAttribute("added") ? Tools::jsonString(e.attribute("added")) : QString("null"),
+                       e.hasAttribute("lastModification") ? Tools::jsonString(e.attribute("lastModification")) : QString("null"),
+                       tags.join(","));
+        record += noteContent(type, content, m_dataFolder + "baskets/" + folderName + content.text()) + "}";
+        writeRecord(record);
+        ++m_notesCount;
+    }
+}
+
+/** @Return the "text", "html", "url", "attachment" and "encrypted" members of a note record,
+  * computed like the toText() and toHtml() methods of the NoteContent sub-classes do.
+  */
+QString JsonLinesExporter::noteContent(const QString &type, const QDomElement &content, const QString &fullPath)
+{
+    QString text;
+    QString html;
+    QString url;
+    bool useFile   = true;
+    bool encrypted = false;
+
+    if (type == "text" || type == "html") {
+        QByteArray data;
+        if (readFile(fullPath, &data, &encrypted) && !encrypted) {
+            QString string = QString::fromLocal8Bit(data.constData(), data.size()); // Like TextContent and HtmlContent::loadFromFile()
+            text = (type == "text" ? string : Tools::htmlToText(string));
+            html = (type == "text" ? Tools::textToHTMLWithoutP(string) : Tools::htmlToParagraph(string));
+        }
+    } else if (type == "image" || type == "animation") {
+        text = fullPath;
+        html = QString("<img src=\"%1\">").arg(fullPath);
+    } else if (type == "sound" || type == "file") {
+        text = fullPath;
+        html = QString("<a href=\"%1\">%2</a>").arg(fullPath, content.text());
+    } else if (type == "launcher") {
+        text = fullPath;
+        html = QString("<a href=\"%1\">%2</a>").arg(fullPath, KService(fullPath).name());
+    } else if (type == "link" || type == "cross_reference") {
+        useFile = false;
+        KUrl link(content.text());
+        QString title = content.attribute("title");
+        bool autoTitle = (type == "link" && XMLWork::trueOrFalse(content.attribute("autoTitle"), title == content.text()));
+        url = link.prettyUrl();
+        if (autoTitle)
+            text = url;
+        else if (title.isEmpty() || url.isEmpty())
+            text = (title.isEmpty() ? url : title);
+        else
+            text = QString("%1 <%2>").arg(title, url);
+        html = QString("<a href=\"%1\">%2</a>").arg(url, title);
+    } else if (type == "color") {
+        useFile = false;
+        QString name = QColor(content.text()).name();
+        text = name;
+        html = QString("<span style=\"color: %1\">%2</span>").arg(name, name);
+    }
+
+    return QString("\"text\":%1,\"html\":%2,\"url\":%3,\"attachment\":%4,\"encrypted\":%5")
+           .arg(encrypted ? QString("null") : Tools::jsonString(text),
+                encrypted ? QString("null") : Tools::jsonString(html),
+                url.isEmpty() ? QString("null") : Tools::jsonString(url),
+                useFile ? Tools::jsonString(fullPath) : QString("null"),
+                XMLWork::trueOrFalse(encrypted));
+}
+
+void JsonLinesExporter::writeRecord(const QString &record)
+{
+    if (!m_errorString.isEmpty())
+        return;
+    QByteArray line = record.toUtf8() + '\n';
+    if (m_device->write(line) != line.size())
+        m_errorString = i18n("Cannot write the exported baskets: %1.", m_device->errorString());
+}
+
+bool JsonLinesExporter::readFile(const QString &fullPath, QByteArray *data, bool *encrypted)
+{
+    QFile file(fullPath);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+    *data = file.readAll();
+    *encrypted = isEncrypted(*data);
+    return true;
+}
+
+/** Files are encrypted by GPG, or by a BasketCipher with the data key of the basket (see BasketScene::loadFromFile()).
+  */
+bool JsonLinesExporter::isEncrypted(const QByteArray &data)
+{
+    return BasketScene::isGpgCipherText(data) || BasketCipher::isCipherText(data);
+}
+
+QString JsonLinesExporter::jsonStringList(const QStringList &list)
+{
+    QStringList strings;
+    for (QStringList::const_iterator it = list.constBegin(); it != list.constEnd(); ++it)
+        strings << Tools::jsonString(*it);
+    return "[" + strings.join(",") + "]";
+}
@@ -0,0 +1,76 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by BasKet Note Pads developers                     *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+
+#ifndef JSONLINESEXPORTER_H
+#define JSONLINESEXPORTER_H
+
+#include <QtCore/QHash>
+#include <QtCore/QString>
+#include <QtCore/QStringList>
+
+#include "basket_export.h"
+
+class QDomElement;
+class QIODevice;
+
+/** Export every basket and every note as newline-delimited JSON (one JSON object per line), for external tools.
+  * BASIC FUNCTIONNING:
+  *   Everything is read straight from the data folder (baskets.xml, tags.xml, the .basket files and the note files),
+  *   without creating any BasketScene nor Note: it can run without the main window (see the --export-json option).
+  *   The baskets are exported in tree order. Each one writes a "basket" record, then one record per group and note, in the order of the basket.
+  *   Every record is written as soon as it is read, and a basket is forgotten before the next one is read:
+  *   the memory used only depends on the size of the biggest basket.
+  *   Note records carry the basket path, the type, the text equivalent and HTML of the note (as Note::content() would give them),
+  *   the tags (state ids and names), the dates, the geometry, and the full path of the file of the note.
+  *   Decrypting a protected basket needs the key of the user: such baskets are exported with "encrypted": true and without their notes.
+  */
+class BASKET_EXPORT JsonLinesExporter
+{
+public:
+    /// Export the baskets of @p dataFolder (eg. Global::savesFolder()).
+    explicit JsonLinesExporter(const QString &dataFolder);
+
+    bool exportTo(QIODevice *device); /// << Write every record to @p device, that should be opened. @return false in case of error
+    QString errorString() const { return m_errorString; }
+    int basketsCount() const { return m_basketsCount; }
+    int notesCount() const { return m_notesCount; }
+
+private:
+    void loadTags();
+    void exportBaskets(const QDomElement &parent, const QString &parentFolderName, const QStringList &parentPath);
+    void exportBasket(const QDomElement &element, const QString &parentFolderName, const QStringList &parentPath);
+    void exportNotes(const QDomElement &parent, const QString &folderName, const QString &basketPath,
+                     const QString &parentId, bool isColumnsLayout);
+    void writeRecord(const QString &record);
+    QString noteContent(const QString &type, const QDomElement &content, const QString &fullPath);
+    bool readFile(const QString &fullPath, QByteArray *data, bool *encrypted);
+    static bool isEncrypted(const QByteArray &data);
+    static QString jsonStringList(const QStringList &list);
+
+    QString                 m_dataFolder;
+    QIODevice              *m_device;
+    QHash<QString, QString> m_stateNames;  /// << State ids => full names of the states (as State::fullName())
+    QString                 m_errorString;
+    int                     m_basketsCount;
+    int                     m_notesCount;
+    int                     m_noteId;      /// << Number of the last group or note exported in the current basket
+};
+
+#endif // JSONLINESEXPORTER_H
@@ -126,6 +126,12 @@ KGpgMe::~KGpgMe()
     clearCache();
 }
 
+void KGpgMe::setArmor(bool armor)
+{
+    if (m_ctx)
+        gpgme_set_armor(m_ctx, armor ? 1 : 0);
+}
+
 void KGpgMe::clearCache()
 {
     if (m_cache.size() > 0) {
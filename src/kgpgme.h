@@ -57,6 +57,7 @@ public:
     void setUseGnuPGAgent(bool use) {
         m_useGnuPGAgent = use; setPassphraseCb();
     };
+    void setArmor(bool armor); // ASCII armored output (the default), or binary OpenPGP packets
     QString text() const {
         return m_text;
     };
@@ -0,0 +1,66 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by BasKet Note Pads developers                     *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+
+#include "largenoteviewer.h"
+
+#include <QtGui/QPlainTextEdit>
+
+#include <KDE/KConfigGroup>
+#include <KDE/KGlobal>
+#include <KDE/KSharedConfig>
+
+#include "basketscene.h"
+#include "note.h"
+#include "notecontent.h"
+
+void LargeNoteViewer::showNote(Note *note)
+{
+    LargeNoteViewer *viewer = new LargeNoteViewer(note, note->basket()->graphicsView()->window());
+    viewer->show();
+}
+
+LargeNoteViewer::LargeNoteViewer(Note *note, QWidget *parent)
+        : KDialog(parent)
+{
+    setObjectName("LargeNoteViewer");
+    setCaption(note->basket()->basketName());
+    setButtons(Close);
+    setModal(false);
+    setAttribute(Qt::WA_DeleteOnClose);
+
+    m_textEdit = new QPlainTextEdit(this);
+    m_textEdit->setReadOnly(true);
+    m_textEdit->setFont(note->font());
+    QPalette palette;
+    palette.setColor(QPalette::Base, note->backgroundColor());
+    palette.setColor(QPalette::Text, note->textColor());
+    m_textEdit->setPalette(palette);
+    m_textEdit->setPlainText(note->content()->toText(""));
+    setMainWidget(m_textEdit);
+
+    setInitialSize(QSize(600, 450));
+    restoreDialogSize(KGlobal::config()->group("Large Note Viewer"));
+}
+
+LargeNoteViewer::~LargeNoteViewer()
+{
+    KConfigGroup group = KGlobal::config()->group("Large Note Viewer");
+    saveDialogSize(group);
+}
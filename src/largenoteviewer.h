@@ -0,0 +1,49 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by BasKet Note Pads developers                     *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+
+#ifndef LARGENOTEVIEWER_H
+#define LARGENOTEVIEWER_H
+
+#include <KDE/KDialog>
+
+class QPlainTextEdit;
+
+class Note;
+
+/** Read-only window showing the whole text of a very large text or HTML note.
+  * BASIC FUNCTIONNING:
+  *   Such notes only display a preview of their first lines in the basket (see NoteContent::isCollapsed()).
+  *   The whole text is shown here in a QPlainTextEdit: its document layout only lays out the lines being scrolled into view,
+  *   so opening a log of several megabytes does not stall the GUI like a QTextDocument laid out at once would.
+  *   HTML notes are shown as their text equivalent. They are still edited in place, by clicking their content.
+  *   The window is not modal and deletes itself when closed.
+  */
+class LargeNoteViewer : public KDialog
+{
+    Q_OBJECT
+public:
+    static void showNote(Note *note); /// << Open a new viewer for @p note
+private:
+    LargeNoteViewer(Note *note, QWidget *parent);
+    ~LargeNoteViewer();
+    QPlainTextEdit *m_textEdit;
+};
+
+#endif // LARGENOTEVIEWER_H
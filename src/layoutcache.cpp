@@ -0,0 +1,227 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by BasKet Note Pads developers                     *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include "layoutcache.h"
+
+#include <QtCore/QCryptographicHash>
+#include <QtCore/QDataStream>
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+
+#include <KDE/KDebug>
+#include <KDE/KSaveFile>
+
+#include "settings.h"
+
+LayoutCache::LayoutCache(const QString &filePath)
+        : m_filePath(filePath), m_dirty(false)
+{
+}
+
+LayoutCache::~LayoutCache()
+{
+}
+
+QByteArray LayoutCache::keyFor(const QByteArray &content, const QFont &font)
+{
+    QCryptographicHash hash(QCryptographicHash::Md5);
+    hash.addData(content);
+    hash.addData(font.toString().toUtf8());
+    hash.addData(Settings::bigNotes() ? "big" : "small");
+    return hash.result();
+}
+
+QByteArray LayoutCache::htmlKeyFor(const QByteArray &content, const QString &settings)
+{
+    QCryptographicHash hash(QCryptographicHash::Md5);
+    hash.addData(content);
+    hash.addData(settings.toUtf8());
+    return hash.result();
+}
+
+bool LayoutCache::minWidth(const QString &fileName, const QByteArray &key, qreal *minWidth) const
+{
+    QHash<QString, Entry>::const_iterator it = m_entries.constFind(fileName);
+    if (it == m_entries.constEnd() || it->key != key || it->minWidth < 0)
+        return false;
+    *minWidth = it->minWidth;
+    return true;
+}
+
+bool LayoutCache::height(const QString &fileName, const QByteArray &key, qreal width, qreal *height) const
+{
+    QHash<QString, Entry>::const_iterator it = m_entries.constFind(fileName);
+    if (it == m_entries.constEnd() || it->key != key)
+        return false;
+    int intWidth = qRound(width);
+    for (int i = 0; i < it->heights.count(); ++i)
+        if (it->heights.at(i).first == intWidth) {
+            *height = it->heights.at(i).second;
+            return true;
+        }
+    return false;
+}
+
+LayoutCache::Entry& LayoutCache::entryFor(const QString &fileName, const QByteArray &key)
+{
+    Entry &entry = m_entries[fileName];
+    if (entry.key != key) { // New note, or its content changed: forget everything about it
+        entry = Entry();
+        entry.key = key;
+        m_dirty = true;
+    }
+    return entry;
+}
+
+void LayoutCache::setMinWidth(const QString &fileName, const QByteArray &key, qreal minWidth)
+{
+    Entry &entry = entryFor(fileName, key);
+    if (entry.minWidth != minWidth) {
+        entry.minWidth = minWidth;
+        m_dirty = true;
+    }
+}
+
+void LayoutCache::setHeight(const QString &fileName, const QByteArray &key, qreal width, qreal height)
+{
+    Entry &entry = entryFor(fileName, key);
+    int intWidth = qRound(width);
+    for (int i = 0; i < entry.heights.count(); ++i)
+        if (entry.heights.at(i).first == intWidth) {
+            if (entry.heights.at(i).second == height)
+                return;
+            entry.heights.removeAt(i);
+            break;
+        }
+    entry.heights.prepend(qMakePair(intWidth, height));
+    if (entry.heights.count() > MAX_HEIGHTS_PER_NOTE)
+        entry.heights.removeLast();
+    m_dirty = true;
+}
+
+bool LayoutCache::displayHtml(const QString &fileName, const QByteArray &key, const QString &html, QString *displayHtml) const
+{
+    QHash<QString, HtmlEntry>::const_iterator it = m_htmlEntries.constFind(fileName);
+    if (it == m_htmlEntries.constEnd() || it->key != key)
+        return false;
+    *displayHtml = (it->displayHtml.isEmpty() ? html : it->displayHtml);
+    return true;
+}
+
+void LayoutCache::setDisplayHtml(const QString &fileName, const QByteArray &key, const QString &html, const QString &displayHtml)
+{
+    HtmlEntry &entry = m_htmlEntries[fileName];
+    if (entry.key == key)
+        return;
+    entry.key         = key;
+    entry.displayHtml = (displayHtml == html ? QString() : displayHtml); // Do not keep a copy of the note
+    m_dirty = true;
+}
+
+void LayoutCache::load()
+{
+    m_entries.clear();
+    m_htmlEntries.clear();
+    m_dirty = false;
+
+    QFile file(m_filePath);
+    if (!file.open(QIODevice::ReadOnly))
+        return;
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_4_4);
+
+    quint32 magic;
+    qint32  count;
+    stream >> magic >> count;
+    if (magic != MAGIC) {
+        kDebug() << "Ignoring the unknown layout cache" << m_filePath;
+        return;
+    }
+    for (int i = 0; i < count && stream.status() == QDataStream::Ok; ++i) {
+        QString fileName;
+        Entry   entry;
+        double  minWidth;
+        qint32  heightsCount;
+        stream >> fileName >> entry.key >> minWidth >> heightsCount;
+        entry.minWidth = minWidth;
+        for (int j = 0; j < heightsCount && stream.status() == QDataStream::Ok; ++j) {
+            qint32 width;
+            double height;
+            stream >> width >> height;
+            entry.heights.append(qMakePair((int)width, (qreal)height));
+        }
+        if (stream.status() == QDataStream::Ok)
+            m_entries.insert(fileName, entry);
+    }
+    qint32 htmlCount = 0;
+    stream >> htmlCount;
+    for (int i = 0; i < htmlCount && stream.status() == QDataStream::Ok; ++i) {
+        QString   fileName;
+        HtmlEntry entry;
+        stream >> fileName >> entry.key >> entry.displayHtml;
+        if (stream.status() == QDataStream::Ok)
+            m_htmlEntries.insert(fileName, entry);
+    }
+}
+
+void LayoutCache::save()
+{
+    if (!m_dirty)
+        return;
+
+    // Do not keep the geometry of deleted notes:
+    QDir folder = QFileInfo(m_filePath).dir();
+    for (QHash<QString, Entry>::iterator it = m_entries.begin(); it != m_entries.end(); )
+        if (folder.exists(it.key()))
+            ++it;
+        else
+            it = m_entries.erase(it);
+    for (QHash<QString, HtmlEntry>::iterator it = m_htmlEntries.begin(); it != m_htmlEntries.end(); )
+        if (folder.exists(it.key()))
+            ++it;
+        else
+            it = m_htmlEntries.erase(it);
+
+    // It is only a cache: on failure, the geometries will simply be computed again next time
+    KSaveFile file(m_filePath);
+    if (!file.open())
+        return;
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_4_4);
+    stream << MAGIC << (qint32)m_entries.count();
+    for (QHash<QString, Entry>::const_iterator it = m_entries.constBegin(); it != m_entries.constEnd(); ++it) {
+        stream << it.key() << it->key << (double)it->minWidth << (qint32)it->heights.count();
+        for (int i = 0; i < it->heights.count(); ++i)
+            stream << (qint32)it->heights.at(i).first << (double)it->heights.at(i).second;
+    }
+    stream << (qint32)m_htmlEntries.count();
+    for (QHash<QString, HtmlEntry>::const_iterator it = m_htmlEntries.constBegin(); it != m_htmlEntries.constEnd(); ++it)
+        stream << it.key() << it->key << it->displayHtml;
+    if (file.finalize())
+        m_dirty = false;
+}
+
+void LayoutCache::discard()
+{
+    m_entries.clear();
+    m_htmlEntries.clear();
+    m_dirty = false;
+    QFile::remove(m_filePath);
+}
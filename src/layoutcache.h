@@ -0,0 +1,91 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by BasKet Note Pads developers                     *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef LAYOUTCACHE_H
+#define LAYOUTCACHE_H
+
+#include <QtCore/QByteArray>
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QPair>
+#include <QtCore/QString>
+#include <QtGui/QFont>
+
+/** Geometry of the notes of a basket, as computed during the last sessions, to display a basket without laying out every note.
+  * BASIC FUNCTIONNING:
+  *   For every note file, the cache remembers the minimum width of its content and the height it took for a few widths.
+  *   Every entry is stamped with a key identifying what was laid out (content hash, font and big-notes setting, see keyFor()):
+  *   an entry with another key is stale and is never returned.
+  *   When a basket is shown for the first time, lazy-loaded contents take their geometry from here (see NoteContent::useCachedLayout()),
+  *   so the notes can be placed right away, and their real layout is done just after the basket appeared.
+  *   The cache also keeps the HTML with tagged links and cross references that HtmlContent displays (the slow conversion),
+  *   stamped with the hash of the file and the settings used, so unchanged rich text notes are displayed without tagging them again.
+  *   Only notes where something was tagged have their HTML kept: for the others, the cache only remembers that the file can be displayed as is.
+  *   The cache is stored in the ".layout" file of the basket folder. It is not used for encrypted baskets.
+  */
+class LayoutCache
+{
+public:
+    explicit LayoutCache(const QString &filePath);
+    ~LayoutCache();
+
+    /// @Return the key to stamp geometries computed for @p content with @p font.
+    static QByteArray keyFor(const QByteArray &content, const QFont &font = QFont());
+    /// @Return the key to stamp the HTML derived from the file @p content with @p settings (anything the conversion depends on).
+    static QByteArray htmlKeyFor(const QByteArray &content, const QString &settings);
+
+    /// Set @p minWidth to the cached minimum width of @p fileName, and @return true, if there is one for @p key.
+    bool minWidth(const QString &fileName, const QByteArray &key, qreal *minWidth) const;
+    /// Set @p height to the cached height of @p fileName for @p width, and @return true, if there is one for @p key.
+    bool height(const QString &fileName, const QByteArray &key, qreal width, qreal *height) const;
+    void setMinWidth(const QString &fileName, const QByteArray &key, qreal minWidth);
+    void setHeight(const QString &fileName, const QByteArray &key, qreal width, qreal height);
+    /// Set @p displayHtml to the tagged @p html of @p fileName, and @return true, if it is cached for @p key.
+    bool displayHtml(const QString &fileName, const QByteArray &key, const QString &html, QString *displayHtml) const;
+    void setDisplayHtml(const QString &fileName, const QByteArray &key, const QString &html, const QString &displayHtml);
+
+    void load();
+    void save();    /// << Write the cache to disk if it changed, forgetting the notes that do not exist anymore
+    void discard(); /// << Empty the cache and remove its file (eg. when the basket becomes encrypted)
+
+private:
+    struct Entry {
+        Entry() : minWidth(-1) {}
+        QByteArray key;                    /// << What was laid out (see keyFor())
+        qreal      minWidth;               /// << -1 if not known yet
+        QList< QPair<int, qreal> > heights; /// << (width, height) couples, the most recently used first
+    };
+
+    struct HtmlEntry {
+        QByteArray key;         /// << The file content and settings it was derived from (see htmlKeyFor())
+        QString    displayHtml; /// << With links and cross references tagged, or empty if nothing was tagged
+    };
+
+    Entry& entryFor(const QString &fileName, const QByteArray &key);
+
+    static const quint32 MAGIC = 0x424c4333; /// << "BLC3"
+    static const int MAX_HEIGHTS_PER_NOTE = 4;
+
+    QString                   m_filePath;
+    QHash<QString, Entry>     m_entries;     /// << Keyed by note file name
+    QHash<QString, HtmlEntry> m_htmlEntries; /// << Keyed by note file name
+    bool                      m_dirty;
+};
+
+#endif // LAYOUTCACHE_H
@@ -48,6 +48,7 @@
 #include "global.h"
 #include "kcolorcombo2.h"
 #include "htmlexporter.h"
+#include "iconmanager.h"
 
 /** LinkLook */
 
@@ -223,7 +224,7 @@ void LinkLabel::setLink(const QString &title, const QString &icon, LinkLook *loo
     if (icon.isEmpty())
         m_icon->clear();
     else {
-        QPixmap pixmap = DesktopIcon(icon, m_look->iconSize(), m_look->iconSize());
+        QPixmap pixmap = IconManager::instance()->pixmap(icon, m_look->iconSize());
         if (!pixmap.isNull())
             m_icon->setPixmap(pixmap);
     }
@@ -444,23 +445,15 @@ void LinkDisplay::paint(QPainter *painter, qreal x, qreal y, qreal width, qreal
     qreal BUTTON_MARGIN = kapp->style()->pixelMetric(QStyle::PM_ButtonMargin);
     qreal LINK_MARGIN   = BUTTON_MARGIN + 2;
 
-    QPixmap pixmap;
-    // Load the preview...:
-    if (!isHovered && m_look->previewEnabled() && !m_preview.isNull())
-        pixmap  = m_preview;
-    // ... Or the icon (if no preview or if the "Open" icon should be shown):
-    else {
-        qreal           iconSize   = m_look->iconSize();
-        QString       iconName   = (isHovered ? Global::openNoteIcon() : m_icon);
-        KIconLoader::States iconState  = (isIconButtonHovered ? KIconLoader::ActiveState : KIconLoader::DefaultState);
-        pixmap = KIconLoader::global()->loadIcon(
-                     iconName, KIconLoader::Desktop, iconSize, iconState, QStringList(),
-                     0L, /*canReturnNull=*/false
-                 );
-    }
+    // Draw the preview...:
+    bool drawPreview = (!isHovered && m_look->previewEnabled() && !m_preview.isNull());
+    // ... Or the icon (if no preview or if the "Open" icon should be shown), from the shared icon cache:
+    QString             iconName  = (isHovered ? Global::openNoteIcon() : m_icon);
+    KIconLoader::States iconState = (isIconButtonHovered ? KIconLoader::ActiveState : KIconLoader::DefaultState);
+    QSize pixmapSize = (drawPreview ? m_preview.size() : IconManager::instance()->iconSize(iconName, m_look->iconSize(), iconState));
     qreal iconPreviewWidth  = qMax(m_look->iconSize(), (m_look->previewEnabled() ? m_preview.width()  : 0));
-    qreal pixmapX = (iconPreviewWidth - pixmap.width()) / 2;
-    qreal pixmapY = (height - pixmap.height()) / 2;
+    qreal pixmapX = (iconPreviewWidth - pixmapSize.width()) / 2;
+    qreal pixmapY = (height - pixmapSize.height()) / 2;
     // Draw the button (if any) and the icon:
     if (isHovered) {
         QStyleOption opt;
@@ -468,7 +461,10 @@ void LinkDisplay::paint(QPainter *painter, qreal x, qreal y, qreal width, qreal
         opt.state = isIconButtonHovered ? (QStyle::State_MouseOver | QStyle::State_Enabled)  : QStyle::State_Enabled;
         kapp->style()->drawPrimitive(QStyle::PE_PanelButtonCommand, &opt, painter);
     }
-    painter->drawPixmap(x + BUTTON_MARGIN - 1 + pixmapX, y + pixmapY, pixmap);
+    if (drawPreview)
+        painter->drawPixmap(x + BUTTON_MARGIN - 1 + pixmapX, y + pixmapY, m_preview);
+    else
+        IconManager::instance()->drawIcon(painter, x + BUTTON_MARGIN - 1 + pixmapX, y + pixmapY, iconName, m_look->iconSize(), iconState);
 
     // Figure out the text color:
     if (isSelected) {
@@ -19,6 +19,10 @@
  ***************************************************************************/
 
 #include <KDE/KCmdLineArgs>
+#include <KDE/KComponentData>
+#include <KDE/KDebug>
+
+#include <QtCore/QFile>
 
 #include <kconfig.h> // TMP IN ALPHA 1
 #include <config.h>
@@ -29,6 +33,38 @@
 #include "settings.h"
 #include "global.h"
 #include "backup.h"
+#include "jsonlinesexporter.h"
+
+/** Handle the --export-json option: export the baskets for other tools, without creating the application
+  * (it would hand the command line over to an already running instance).
+  */
+static int exportJsonLines(KCmdLineArgs *args)
+{
+    KComponentData componentData(Global::about());
+    Global::basketConfig = KSharedConfig::openConfig("basketrc");
+
+    // Same data folder as the application (see Global::savesFolder()):
+    QString dataFolder = args->getOption("data-folder");
+    if (dataFolder.isEmpty())
+        dataFolder = Global::config()->group("Main window").readEntry("dataFolder", "");
+    if (!dataFolder.isEmpty())
+        Global::setCustomSavesFolder(dataFolder);
+
+    QString destination = args->getOption("export-json");
+    QFile file(destination);
+    bool opened = (destination == "-" ? file.open(stdout, QIODevice::WriteOnly) : file.open(QIODevice::WriteOnly));
+    if (!opened) {
+        kError() << "Cannot write to" << destination << ":" << file.errorString();
+        return 1;
+    }
+    JsonLinesExporter exporter(Global::savesFolder());
+    if (!exporter.exportTo(&file)) {
+        kError() << exporter.errorString();
+        return 1;
+    }
+    kDebug() << "Exported" << exporter.basketsCount() << "baskets and" << exporter.notesCount() << "notes";
+    return 0;
+}
 
 int main(int argc, char *argv[])
 {
@@ -42,6 +78,8 @@ int main(int argc, char *argv[])
     KCmdLineArgs::addCmdLineOptions(opts);
 
     KUniqueApplication::addCmdLineOptions();
+    if (KCmdLineArgs::parsedArgs()->isSet("export-json"))
+        return exportJsonLines(KCmdLineArgs::parsedArgs());
     Application app;
 
     // Initialize the config file
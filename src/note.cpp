@@ -21,6 +21,7 @@
 #include "note.h"
 
 #include <QtCore/QList>
+#include <QtCore/QVector>
 #include <QtGui/QGraphicsItemAnimation>
 #include <QtGui/QGraphicsView>
 #include <QtGui/QPainter>
@@ -28,6 +29,7 @@
 #include <QtGui/QStyle>
 #include <QtGui/QStyleOption>
 #include <QtGui/QImage>
+#include <QtGui/QPixmapCache>
 
 #include <qimageblitz/qimageblitz.h>        //For Blitz::fade(...)
 
@@ -39,6 +41,10 @@
 
 #include <stdlib.h> // rand() function
 #include <math.h> // sqrt() and pow() functions
+#include <string.h> // memcpy() function
+#ifdef __SSE2__
+#include <emmintrin.h> // For the gradient span filling
+#endif
 
 #include "basketscene.h"
 #include "filter.h"
@@ -47,6 +53,8 @@
 #include "tools.h"
 #include "settings.h"
 #include "notefactory.h" // For NoteFactory::filteredURL()
+#include "iconmanager.h"
+#include "noterenderer.h"
 
 /** class Note: */
 
@@ -116,7 +124,9 @@ Note::~Note()
             m_basket->removeItem(m_content->graphicsItem());
         }
         m_basket->removeItem(this);
+        m_basket->forgetLazyLoad(this);
     }    
+    NoteRenderer::instance()->cancel(this);
     delete m_content;
     delete m_animation;
     deleteChilds();
@@ -1285,64 +1295,103 @@ qreal Note::finalRightLimit() const
         return x() + m_groupWidth;
 }
 
+/** Fill @p count pixels of @p dst with @p color.
+  * It is the inner loop of the gradient rendering: four pixels are stored at once when SSE2 is available.
+  */
+static inline void fillSpan(QRgb *dst, QRgb color, int count)
+{
+    int i = 0;
+#ifdef __SSE2__
+    const __m128i colors = _mm_set1_epi32(color);
+    for (; i + 4 <= count; i += 4)
+        _mm_storeu_si128((__m128i*)(dst + i), colors);
+#endif
+    for (; i < count; ++i)
+        dst[i] = color;
+}
+
+/** @Return the color of each of the @p length lines of the gradient drawn by drawGradient().
+  * The interpolation is done in the HSV space.
+  */
+static QVector<QRgb> gradientColors(const QColor &colorTop, const QColor &colorBottom, int length, bool sunken)
+{
+    int h1, h2, s1, s2, v1, v2;
+    if (!sunken) {
+        colorTop.getHsv(&h1, &s1, &v1);
+        colorBottom.getHsv(&h2, &s2, &v2);
+    } else {
+        colorBottom.getHsv(&h1, &s1, &v1);
+        colorTop.getHsv(&h2, &s2, &v2);
+    }
+    QVector<QRgb> lineColors(length);
+    if (length > 1) {
+        for (int j = 0; j < length; j++)
+            lineColors[j] = QColor::fromHsv(h1 + ((h2 - h1) * j) / (length - 1),
+                                            s1 + ((s2 - s1) * j) / (length - 1),
+                                            v1 + ((v2 - v1) * j) / (length - 1)).rgb();
+    } else if (length == 1)
+        lineColors[0] = QColor::fromHsv((h1 + h2) / 2, (s1 + s2) / 2, (v1 + v2) / 2).rgb();
+    return lineColors;
+}
+
+/** @Return a pixmap of the gradient drawn by drawGradient(), @p length pixels long in the direction of the gradient,
+  * and GRADIENT_STRIP_THICKNESS pixels thick, so that it can be tiled over the whole gradient area.
+  * Strips are kept in QPixmapCache: the same few note backgrounds and handles are painted over and over.
+  */
+static QPixmap gradientStrip(const QColor &colorTop, const QColor &colorBottom, int length, bool sunken, bool horz)
+{
+    static const int GRADIENT_STRIP_THICKNESS = 32;
+
+    QString key = QString("basket-gradient-%1-%2-%3-%4%5")
+                  .arg(colorTop.rgb(), 0, 16).arg(colorBottom.rgb(), 0, 16).arg(length).arg(sunken).arg(horz);
+    QPixmap strip;
+    if (QPixmapCache::find(key, strip))
+        return strip;
+
+    // Compute the color of each line, and fill the strip, scanline by scanline:
+    QVector<QRgb> lineColors = gradientColors(colorTop, colorBottom, length, sunken);
+    QImage image(horz ? GRADIENT_STRIP_THICKNESS : length, horz ? length : GRADIENT_STRIP_THICKNESS, QImage::Format_RGB32);
+    for (int line = 0; line < image.height(); ++line) {
+        QRgb *scanLine = (QRgb*)image.scanLine(line);
+        if (horz)
+            fillSpan(scanLine, lineColors[line], image.width());
+        else
+            memcpy(scanLine, lineColors.constData(), length * sizeof(QRgb));
+    }
+
+    strip = QPixmap::fromImage(image);
+    QPixmapCache::insert(key, strip);
+    return strip;
+}
+
 /*
- * This code is derivated from drawMetalGradient() from the Qt documentation:
+ * This code is derivated from drawMetalGradient() from the Qt documentation.
+ * The gradient is now rendered once in a cached strip (see gradientStrip()) that is tiled over the area.
  */
 void drawGradient(QPainter *p, const QColor &colorTop, const QColor & colorBottom,
                   qreal x, qreal y, qreal w, qreal h,
                   bool sunken, bool horz, bool flat)   /*const*/
 {
-    QColor highlight(colorBottom);
-    QColor subh1(colorTop);
-    QColor subh2(colorTop);
-
-    QColor topgrad(colorTop);
-    QColor botgrad(colorBottom);
-
-
-    if (flat && !sunken)
+    if (flat && !sunken) {
         p->fillRect(x, y, w, h, colorTop);
-    else {
-        int i  = 0;
-        int x1 = x;
-        int y1 = y;
-        int x2 = x + w - 1;
-        int y2 = y + h - 1;
-        if (horz)
-            x2 = x2;
-        else
-            y2 = y2;
-
-#define DRAWLINE if (horz) \
-        p->drawLine( x1, y1+i, x2, y1+i ); \
-    else \
-        p->drawLine( x1+i, y1, x1+i, y2 ); \
-    i++;
-
-        // Gradient:
-        int ng = (horz ? h : w); // how many lines for the gradient?
+        return;
+    }
 
-        int h1, h2, s1, s2, v1, v2;
-        if (!sunken) {
-            topgrad.getHsv(&h1, &s1, &v1);
-            botgrad.getHsv(&h2, &s2, &v2);
-        } else {
-            botgrad.getHsv(&h1, &s1, &v1);
-            topgrad.getHsv(&h2, &s2, &v2);
-        }
+    // Same pixel rounding as when the gradient was drawn line by line:
+    int x1 = x;
+    int y1 = y;
+    int x2 = x + w - 1;
+    int y2 = y + h - 1;
+    int ng = (horz ? h : w); // how many lines for the gradient?
+    int lineLength = (horz ? x2 - x1 + 1 : y2 - y1 + 1);
+    if (ng <= 0 || lineLength <= 0)
+        return;
 
-        if (ng > 1) {
-            for (int j = 0; j < ng; j++) {
-                p->setPen(QColor::fromHsv(h1 + ((h2 - h1)*j) / (ng - 1),
-                                          s1 + ((s2 - s1)*j) / (ng - 1),
-                                          v1 + ((v2 - v1)*j) / (ng - 1)));
-                DRAWLINE;
-            }
-        } else if (ng == 1) {
-            p->setPen(QColor::fromHsv((h1 + h2) / 2, (s1 + s2) / 2, (v1 + v2) / 2));
-            DRAWLINE;
-        }
-    }
+    QPixmap strip = gradientStrip(colorTop, colorBottom, ng, sunken, horz);
+    if (horz)
+        p->drawTiledPixmap(x1, y1, lineLength, ng, strip);
+    else
+        p->drawTiledPixmap(x1, y1, ng, lineLength, strip);
 }
 
 void Note::drawExpander(QPainter *painter, qreal x, qreal y,
@@ -1480,6 +1529,25 @@ void Note::drawHandle(QPainter *painter, qreal x, qreal y, qreal width, qreal he
     painter->drawPoint(xGrips + 1, yGrips + 1);
 }
 
+/** @Return the handle drawn by drawHandle(), from QPixmapCache if it was already drawn with the same size and colors.
+  */
+QPixmap Note::handlePixmap(qreal width, qreal height, const QColor &background, const QColor &foreground)
+{
+    QString key = QString("basket-handle-%1-%2-%3-%4")
+                  .arg(width).arg(height).arg(background.rgb(), 0, 16).arg(foreground.rgb(), 0, 16);
+    QPixmap pixmap;
+    if (QPixmapCache::find(key, pixmap))
+        return pixmap;
+
+    pixmap = QPixmap(width, height);
+    pixmap.fill(background);
+    QPainter painter(&pixmap);
+    drawHandle(&painter, 0, 0, width, height, background, foreground);
+    painter.end();
+    QPixmapCache::insert(key, pixmap);
+    return pixmap;
+}
+
 void Note::drawResizer(QPainter *painter, qreal x, qreal y, qreal width, qreal height, const QColor &background, const QColor &foreground, bool rounded)
 {
     QPen backgroundPen(background);
@@ -1586,6 +1654,10 @@ QPalette Note::palette() const
  */
 void Note::drawRoundings(QPainter *painter, qreal x, qreal y, int type, qreal width, qreal height)
 {
+    // Without background image there is nothing to blend, and only the fourCorners type paints something by itself:
+    if (type != 5 && !basket()->hasBackgroundImage())
+        return;
+
     qreal right;
 
     switch (type) {
@@ -1787,6 +1859,8 @@ void Note::getGradientColors(const QColor &originalBackground, QColor *colorTop,
  *   INSTANTANEOUS
  * - We keep bufferized note/group draws BUT NOT the resizer: such objects are
  *   small and fast to draw, so we don't complexify code for that
+ * - The chrome (gradients, handle and resizer) is shared between notes through
+ *   QPixmapCache, so rebuilding a buffer mostly costs the note content
  */
 
 void Note::draw(QPainter *painter, const QRectF &/*clipRect*/)
@@ -1834,7 +1908,7 @@ void Note::draw(QPainter *painter, const QRectF &/*clipRect*/)
     if (isGroup()) {
         //Draw background or handle:
         if (hovered) {
-            drawHandle(&painter2, 0, 0, width(), height(), baseColor, highColor);
+            painter2.drawPixmap(0, 0, handlePixmap(width(), height(), baseColor, highColor));
             drawRoundings(&painter2, 0, 0,            /*type=*/1);
             drawRoundings(&painter2, 0, height() - 3, /*type=*/2);
         } else {
@@ -1887,6 +1961,43 @@ void Note::draw(QPainter *painter, const QRectF &/*clipRect*/)
     QColor bgColor;
     QColor darkBgColor;
     getGradientColors(background, &darkBgColor, &bgColor);
+
+    // Without hovering nor background image to blend, the buffer only depends on a few values
+    // and can be painted on a worker thread (see NoteRenderer):
+    if (!hovered && !basket()->hasBackgroundImage()) {
+        painter2.end();
+        NoteRenderJob job;
+        job.width               = width();
+        job.height              = height();
+        job.gradientTopColor    = bgColor;
+        job.gradientBottomColor = darkBgColor;
+        job.textColor           = (m_computedState.textColor().isValid() ? m_computedState.textColor() : basket()->textColor());
+        if (isSelected())
+            job.textColor = palette().color(QPalette::HighlightedText);
+        for (State::List::Iterator it = m_states.begin(); it != m_states.end(); ++it) {
+            if (!(*it)->emblem().isEmpty()) {
+                job.emblemNames.append((*it)->emblem());
+                job.emblems.append(IconManager::instance()->image((*it)->emblem(), 16));
+            }
+        }
+        job.haveInvisibleTags = m_haveInvisibleTags;
+        job.focused           = isFocused();
+
+        if (NoteRenderer::instance()->shouldRenderLater(this, job)) {
+            // Draw a placeholder until the buffer is ready:
+            m_bufferedPixmap = QPixmap();
+            for (QList<QRectF>::iterator it = m_areas.begin(); it != m_areas.end(); ++it) {
+                QRectF rect = (*it).translated(-x(), -y());
+                if (rect.x() < width()) // Else, it's a rect of the resizer
+                    painter->fillRect(rect, darkBgColor);
+            }
+            return;
+        }
+        m_bufferedPixmap = QPixmap::fromImage(renderBuffer(job));
+        drawBufferOnScreen(painter, m_bufferedPixmap);
+        return;
+    }
+
     // Draw background (color, gradient and pixmap):
     drawGradient(&painter2, bgColor, darkBgColor, 0, 0, width(), height(), /*sunken=*/!hovered, /*horz=*/true, /*flat=*/false);
     basket()->blendBackground(painter2, boundingRect().translated(x(),y()));
@@ -1903,7 +2014,7 @@ void Note::draw(QPainter *painter, const QRectF &/*clipRect*/)
         painter2.drawLine(0, height() - 1, width(), height() - 1);
         painter2.drawLine(0, 0,            width(), 0);
         // The handle:
-        drawHandle(&painter2, 0, 0, HANDLE_WIDTH, height(), baseColor, highColor);
+        painter2.drawPixmap(0, 0, handlePixmap(HANDLE_WIDTH, height(), baseColor, highColor));
         drawRoundings(&painter2, 0, 0,            /*type=*/1);
         drawRoundings(&painter2, 0, height() - 3, /*type=*/2);
         // Round handle-right-side border:
@@ -1944,12 +2055,7 @@ void Note::draw(QPainter *painter, const QRectF &/*clipRect*/)
     qreal xIcon = HANDLE_WIDTH + NOTE_MARGIN;
     for (State::List::Iterator it = m_states.begin(); it != m_states.end(); ++it) {
         if (!(*it)->emblem().isEmpty()) {
-            QPixmap stateEmblem = KIconLoader::global()->loadIcon(
-                                      (*it)->emblem(), KIconLoader::NoGroup, 16,
-                                      KIconLoader::DefaultState, QStringList(), 0L, false
-                                  );
-
-            painter2.drawPixmap(xIcon, yIcon, stateEmblem);
+            IconManager::instance()->drawIcon(&painter2, xIcon, yIcon, (*it)->emblem(), 16);
             xIcon += NOTE_MARGIN + EMBLEM_SIZE;
         }
     }
@@ -2015,14 +2121,26 @@ void Note::paint(QPainter *painter,
     {
        qreal right = rightLimit()-x();
        QRectF resizerRect(0, 0, RESIZER_WIDTH, resizerHeight());
+       bool resizerHovered = (m_hovered && m_hoveredZone == Resizer);
+       QColor baseColor(basket()->backgroundColor());
+       QColor highColor(palette().color(QPalette::Highlight));
+       // Without background image to blend, the resizer only depends on its height, colors and state: reuse it if possible:
+       QString cacheKey;
+       QPixmap pixmap;
+       if (!basket()->hasBackgroundImage()) {
+           cacheKey = QString("basket-resizer-%1-%2-%3-%4%5")
+                      .arg(resizerHeight()).arg(baseColor.rgb(), 0, 16).arg(highColor.rgb(), 0, 16).arg(resizerHovered).arg(isColumn());
+           if (QPixmapCache::find(cacheKey, pixmap)) {
+               painter->drawPixmap(right, 0, pixmap);
+               return;
+           }
+       }
        // Prepare to draw the resizer:
-       QPixmap pixmap(RESIZER_WIDTH, resizerHeight());
+       pixmap = QPixmap(RESIZER_WIDTH, resizerHeight());
        QPainter painter2(&pixmap);
        // Draw gradient or resizer:
-       if (m_hovered && m_hoveredZone == Resizer) 
+       if (resizerHovered) 
        {
-           QColor baseColor(basket()->backgroundColor());
-           QColor highColor(palette().color(QPalette::Highlight));
            drawResizer(&painter2, 0, 0, RESIZER_WIDTH, resizerHeight(), baseColor, highColor, /*rounded=*/!isColumn());
            if (!isColumn()) {
                drawRoundings(&painter2, RESIZER_WIDTH - 3, 0,                   /*type=*/3);
@@ -2037,6 +2155,8 @@ void Note::paint(QPainter *painter,
        }
        // Draw on screen:
        painter2.end();
+       if (!cacheKey.isEmpty())
+           QPixmapCache::insert(cacheKey, pixmap);
        painter->drawPixmap(right, 0, pixmap);
     }
 }
@@ -2053,6 +2173,58 @@ void Note::drawBufferOnScreen(QPainter *painter, const QPixmap &contentPixmap)
     }
 }
 
+/** Paint the buffer of a not hovered note, as Note::draw() would do it, but on an image:
+  * it only uses the values of @p job, so it can be called from a worker thread.
+  */
+QImage Note::renderBuffer(const NoteRenderJob &job)
+{
+    QImage image(job.width, job.height, QImage::Format_RGB32);
+
+    // Draw background gradient, directly in the image:
+    QVector<QRgb> lineColors = gradientColors(job.gradientTopColor, job.gradientBottomColor, job.height, /*sunken=*/true);
+    for (int line = 0; line < job.height; ++line)
+        fillSpan((QRgb*)image.scanLine(line), lineColors[line], job.width);
+
+    QPainter painter(&image);
+    painter.setPen(Tools::mixColor(job.gradientTopColor, job.gradientBottomColor));
+    painter.drawLine(0, job.height - 1, job.width, job.height - 1);
+
+    // Draw the Emblems:
+    qreal yIcon = (job.height - EMBLEM_SIZE) / 2;
+    qreal xIcon = HANDLE_WIDTH + NOTE_MARGIN;
+    for (QList<QImage>::const_iterator it = job.emblems.begin(); it != job.emblems.end(); ++it) {
+        painter.drawImage(QPointF(xIcon, yIcon), *it);
+        xIcon += NOTE_MARGIN + EMBLEM_SIZE;
+    }
+
+    // Draw the Tags Arrow (only the "there are hidden tags" dots, since the note is not hovered):
+    if (job.haveInvisibleTags) {
+        painter.setPen(job.textColor);
+        painter.drawPoint(xIcon,     yIcon + 7);
+        painter.drawPoint(xIcon + 2, yIcon + 7);
+        painter.drawPoint(xIcon + 4, yIcon + 7);
+    }
+
+    if (job.focused) {
+        //Temporary change to see the focus rectangle (see Note::draw())
+        painter.setPen(Qt::red);
+        painter.drawRect(QRect(HANDLE_WIDTH, NOTE_MARGIN - 1, job.width - HANDLE_WIDTH - 2, job.height - 2*NOTE_MARGIN + 2));
+    }
+
+    painter.end();
+    return image;
+}
+
+void Note::setRenderedBuffer(const QImage &image)
+{
+    // If the note has been resized meanwhile, it will request another rendering when repainted:
+    if (image.width() == (int)width() && image.height() == (int)height()) {
+        m_bufferedPixmap          = QPixmap::fromImage(image);
+        m_bufferedSelectionPixmap = QPixmap();
+    }
+    update();
+}
+
 void Note::setContent(NoteContent *content)
 {
     m_content = content;
@@ -36,12 +36,14 @@ class NoteContent;
 class NoteSelection;
 
 class QPainter;
+class QImage;
 class QPixmap;
 class QString;
 class QGraphicsItemAnimation;
 class QTimeLine;
 
 class NotePrivate;
+struct NoteRenderJob;
 
 /** Handle basket notes and groups!\n
   * After creation, the note is a group. You should create a NoteContent with this Note
@@ -193,9 +195,12 @@ private:
 public:
     void draw(QPainter *painter, const QRectF &clipRect);
     void drawBufferOnScreen(QPainter *painter, const QPixmap &contentPixmap);
+    static QImage renderBuffer(const NoteRenderJob &job);
+    void setRenderedBuffer(const QImage &image);
     static void getGradientColors(const QColor &originalBackground, QColor *colorTop, QColor *colorBottom);
     static void drawExpander(QPainter *painter, qreal x, qreal y, const QColor &background, bool expand, BasketScene *basket);
     void drawHandle(QPainter *painter, qreal x, qreal y, qreal width, qreal height, const QColor &background, const QColor &foreground);
+    QPixmap handlePixmap(qreal width, qreal height, const QColor &background, const QColor &foreground);
     void drawResizer(QPainter *painter, qreal x, qreal y, qreal width, qreal height, const QColor &background, const QColor &foreground, bool rounded);
     void drawRoundings(QPainter *painter, qreal x, qreal y, int type, qreal width = 0, qreal height = 0);
     void unbufferizeAll();
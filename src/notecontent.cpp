@@ -27,29 +27,31 @@
 #include <QtCore/QDir>
 #include <QtCore/QRegExp>
 #include <QtCore/QStringList>
+#include <QtCore/qmath.h>
 #include <QtGui/QAbstractTextDocumentLayout>    //For m_simpleRichText->documentLayout()
 #include <QtGui/QBitmap>                        //For QPixmap::createHeuristicMask()
 #include <QtGui/QFontMetrics>
+#include <QtGui/QGraphicsView>
+#include <QtGui/QImageReader>
 #include <QtGui/QMovie>
 #include <QtGui/QPainter>
 #include <QtGui/QPixmap>
 #include <QtGui/QWidget>
 #include <QtXml/QDomDocument>
-#include <QtNetwork/QNetworkReply>
-#include <KDE/KIO/AccessManager>
+#include <kio/global.h>                         //For KIO::convertSize()
 
 #include <KDE/KDebug>
 #include <KDE/KService>
 #include <KDE/KLocale>
 #include <KDE/KFileMetaInfo>
 #include <KDE/KFileItem>
-#include <KDE/KIO/PreviewJob>                   //For KIO::file_preview(...)
 
 #include <phonon/AudioOutput>
 #include <phonon/MediaObject>
 
 #include "note.h"
 #include "basketscene.h"
+#include "bnpview.h"
 #include "filter.h"
 #include "xmlwork.h"
 #include "tools.h"
@@ -58,6 +60,10 @@
 #include "settings.h"
 #include "debugwindow.h"
 #include "htmlexporter.h"
+#include "imageloader.h"
+#include "previewmanager.h"
+#include "titlefetcher.h"
+#include "layoutcache.h"
 #include "config.h"
 
 /**
@@ -83,10 +89,57 @@ void LinkDisplayItem::paint(QPainter *painter, const QStyleOptionGraphicsItem*,
   m_linkDisplay.paint(painter, 0, 0, rect.width(), rect.height(), m_note->palette(), true, m_note->isSelected(), m_note->hovered(), m_note->hovered() && m_note->hoveredZone() == Note::Custom0);
 }
 
+/**
+ * ImageItem definition
+ *
+ */
+
+QRectF ImageItem::boundingRect() const
+{
+  return QRectF(QPointF(0, 0), m_displaySize);
+}
+
+void ImageItem::paint(QPainter *painter, const QStyleOptionGraphicsItem*, QWidget*)
+{
+  m_content->loadDisplayImage(); // Now that it is shown, load the image (or a bigger version of it)
+  if (m_pixmap.isNull())
+    return; // Being loaded: only the note background is shown meanwhile
+
+  painter->setRenderHint(QPainter::SmoothPixmapTransform);
+  painter->drawPixmap(boundingRect(), m_pixmap, QRectF(m_pixmap.rect()));
+}
+
+void ImageItem::setPixmap(const QPixmap &pixmap)
+{
+  m_pixmap = pixmap;
+  update();
+}
+
+void ImageItem::setDisplaySize(const QSizeF &size)
+{
+  if (size != m_displaySize) {
+    prepareGeometryChange();
+    m_displaySize = size;
+  }
+}
+
+/**
+ * AnimationItem definition
+ *
+ */
+
+void AnimationItem::paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget)
+{
+  m_content->resumeMovie();
+  QGraphicsPixmapItem::paint(painter, option, widget);
+}
+
 /** class NoteContent:
  */
 
 const int NoteContent::FEEDBACK_DARKING = 105;
+const int NoteContent::LARGE_TEXT_SIZE = 64 * 1024;
+const int NoteContent::LARGE_TEXT_PREVIEW_LINES = 30;
 
 NoteContent::NoteContent(Note *parent, const QString &fileName)
         : m_note(parent)
@@ -150,6 +203,39 @@ void NoteContent::contentChanged(qreal newMinWidth)
     }
 }
 
+QString NoteContent::largeTextPreview(const QString &text, int *hiddenLines)
+{
+    // Do not let a few huge lines (eg. minified data) defeat the purpose of the preview:
+    const int maxLength = LARGE_TEXT_PREVIEW_LINES * 160;
+
+    int end = -1;
+    for (int line = 0; line < LARGE_TEXT_PREVIEW_LINES; ++line) {
+        int next = text.indexOf('\n', end + 1);
+        if (next == -1 || next > maxLength)
+            break;
+        end = next;
+    }
+    int hiddenStart = end + 1; // Skip the new-line
+    if (end == -1)
+        hiddenStart = end = qMin(text.length(), maxLength); // Cut in the middle of the first line
+
+    *hiddenLines = 0;
+    if (hiddenStart < text.length()) {
+        *hiddenLines = 1;
+        const QChar *data = text.unicode();
+        for (int i = hiddenStart; i < text.length() - 1; ++i) // A trailing new-line does not start a new line
+            if (data[i] == '\n')
+                ++(*hiddenLines);
+    }
+    return text.left(end);
+}
+
+QString NoteContent::largeTextExpander(int hiddenLines)
+{
+    return i18np("[...] 1 more line: click here to show the whole text",
+                 "[...] %1 more lines: click here to show the whole text", hiddenLines);
+}
+
 BasketScene* NoteContent::basket()
 {
     if (note())
@@ -158,6 +244,15 @@ BasketScene* NoteContent::basket()
         return 0;
 }
 
+bool NoteContent::isOnScreen()
+{
+    if (!note() || Global::bnpView->currentBasket() != basket() || !note()->isShown())
+        return false;
+    QGraphicsView *view = basket()->graphicsView();
+    QRectF visibleRect = view->mapToScene(view->viewport()->rect()).boundingRect();
+    return visibleRect.intersects(QRectF(note()->x(), note()->y(), note()->width(), note()->height()));
+}
+
 void NoteContent::setEdited()
 {
     note()->setLastModificationDate(QDateTime::currentDateTime());
@@ -410,7 +505,7 @@ QPixmap ImageContent::toPixmap()
 }
 QPixmap AnimationContent::toPixmap()
 {
-    return m_movie->currentPixmap();
+    return m_graphicsPixmap.pixmap();
 }
 
 void NoteContent::toLink(KUrl *url, QString *title, const QString &cuttedFullPath)
@@ -721,11 +816,11 @@ void TextContent::fontChanged()
 }
 void HtmlContent::fontChanged()
 {
-    setHtml(html());
+    setHtml(html(), /*lazyLoad=*/m_lazyLoaded);
 }
 void ImageContent::fontChanged()
 {
-    setPixmap(pixmap());
+    contentChanged(16 + 1); // Only relayout: the image itself did not change
 }
 void AnimationContent::fontChanged()
 {
@@ -789,13 +884,14 @@ void ColorContent::serialize(QDataStream &stream)
 
 QPixmap TextContent::feedbackPixmap(qreal width, qreal height)
 {
-    QRectF textRect = QFontMetrics(note()->font()).boundingRect(0, 0, width, height, Qt::AlignLeft | Qt::AlignTop | Qt::TextWordWrap, text());
+    QString text = m_graphicsTextItem.text(); // Only the preview, if the text is collapsed
+    QRectF textRect = QFontMetrics(note()->font()).boundingRect(0, 0, width, height, Qt::AlignLeft | Qt::AlignTop | Qt::TextWordWrap, text);
     QPixmap pixmap(qMin(width, textRect.width()), qMin(height, textRect.height()));
     pixmap.fill(note()->backgroundColor().dark(FEEDBACK_DARKING));
     QPainter painter(&pixmap);
     painter.setPen(note()->textColor());
     painter.setFont(note()->font());
-    painter.drawText(0, 0, pixmap.width(), pixmap.height(), Qt::AlignLeft | Qt::AlignTop | Qt::TextWordWrap, text());
+    painter.drawText(0, 0, pixmap.width(), pixmap.height(), Qt::AlignLeft | Qt::AlignTop | Qt::TextWordWrap, text);
     painter.end();
 
     return pixmap;
@@ -804,7 +900,11 @@ QPixmap TextContent::feedbackPixmap(qreal width, qreal height)
 QPixmap HtmlContent::feedbackPixmap(qreal width, qreal height)
 {
     QTextDocument richText;
-    richText.setHtml(html());
+    if (isCollapsed()) {
+        int hiddenLines;
+        richText.setPlainText(largeTextPreview(m_textEquivalent, &hiddenLines));
+    } else
+        richText.setHtml(html());
     richText.setDefaultFont(note()->font());
     richText.setTextWidth(width);
     QPalette palette;
@@ -824,19 +924,21 @@ QPixmap HtmlContent::feedbackPixmap(qreal width, qreal height)
 
 QPixmap ImageContent::feedbackPixmap(qreal width, qreal height)
 {
-    if (width >= m_pixmapItem.pixmap().width() && height >= m_pixmapItem.pixmap().height()) { // Full size
-        if (m_pixmapItem.pixmap().hasAlpha()) {
-            QPixmap opaque(m_pixmapItem.pixmap().width(), m_pixmapItem.pixmap().height());
+    // The displayed (maybe downscaled) version is good enough for the feedback:
+    QPixmap source = (m_pixmapItem.pixmap().isNull() ? pixmap() : m_pixmapItem.pixmap());
+    if (width >= source.width() && height >= source.height()) { // Full size
+        if (source.hasAlpha()) {
+            QPixmap opaque(source.width(), source.height());
             opaque.fill(note()->backgroundColor().dark(FEEDBACK_DARKING));
             QPainter painter(&opaque);
-            painter.drawPixmap(0, 0, m_pixmapItem.pixmap());
+            painter.drawPixmap(0, 0, source);
             painter.end();
             return opaque;
 	} else{
-	   return m_pixmapItem.pixmap();
+	   return source;
 	}
     } else { // Scalled down
-        QImage imageToScale = m_pixmapItem.pixmap().toImage();
+        QImage imageToScale = source.toImage();
         QPixmap pmScaled;
         pmScaled = QPixmap::fromImage(imageToScale.scaled(width, height,
                                       Qt::KeepAspectRatio));
@@ -855,7 +957,7 @@ QPixmap ImageContent::feedbackPixmap(qreal width, qreal height)
 
 QPixmap AnimationContent::feedbackPixmap(qreal width, qreal height)
 {
-    QPixmap pixmap = m_movie->currentPixmap();
+    QPixmap pixmap = m_graphicsPixmap.pixmap();
     if (width >= pixmap.width() && height >= pixmap.height()) // Full size
 	return pixmap;
     else { // Scalled down
@@ -1024,9 +1126,49 @@ QString TextContent::messageWhenOpening(OpenMessage where)
     }
 }
 
+int TextContent::zoneAt(const QPointF &pos)
+{
+    return (isCollapsed() && zoneRect(Note::Custom0, pos).contains(pos) ? Note::Custom0 : 0);
+}
+
+QRectF TextContent::zoneRect(int zone, const QPointF &pos)
+{
+    if (zone != Note::Custom0)
+        return NoteContent::zoneRect(zone, pos);
+
+    // The expander is the last line of the preview:
+    QRectF textRect = m_graphicsTextItem.boundingRect();
+    qreal lineHeight = QFontMetricsF(m_graphicsTextItem.font()).lineSpacing();
+    return QRectF(0, textRect.height() - lineHeight, textRect.width(), lineHeight);
+}
+
+QString TextContent::zoneTip(int zone)
+{
+    return (zone == Note::Custom0 ? i18n("Show the whole text") : QString());
+}
+
+Qt::CursorShape TextContent::cursorFromZone(int zone) const
+{
+    if (zone == Note::Custom0)
+        return Qt::PointingHandCursor;
+    return Qt::ArrowCursor;
+}
+
+bool TextContent::isCollapsed()
+{
+    return m_text.length() > LARGE_TEXT_SIZE;
+}
+
 void TextContent::setText(const QString &text, bool lazyLoad)
 {
-    m_graphicsTextItem.setText(text);
+    m_text = text;
+    // Very large texts only display their first lines, so they are never laid out whole:
+    if (isCollapsed()) {
+        int hiddenLines;
+        QString preview = largeTextPreview(text, &hiddenLines);
+        m_graphicsTextItem.setText(preview + '\n' + largeTextExpander(hiddenLines));
+    } else
+        m_graphicsTextItem.setText(text);
     if (!lazyLoad)
         finishLazyLoad();
     else
@@ -1045,7 +1187,7 @@ void TextContent::exportToHTML(HTMLExporter *exporter, int indent)
  */
 
 HtmlContent::HtmlContent(Note *parent, const QString &fileName, bool lazyLoad)
-        : NoteContent(parent, fileName), m_simpleRichText(0), m_graphicsTextItem(parent)
+        : NoteContent(parent, fileName), m_simpleRichText(0), m_graphicsTextItem(parent), m_lazyLoaded(false)
 {
   if(parent)
   {
@@ -1066,8 +1208,30 @@ HtmlContent::~HtmlContent()
 qreal HtmlContent::setWidthAndGetHeight(qreal width)
 {
     width -= 1;
+    LayoutCache *cache = basket()->layoutCache();
+    qreal height;
+    if (m_lazyLoaded && cache && cache->height(fileName(), layoutKey(), width, &height))
+        return height; // The text will really be laid out by finishLazyLoad()
     m_graphicsTextItem.setTextWidth(width);
-    return m_graphicsTextItem.boundingRect().height();
+    height = m_graphicsTextItem.boundingRect().height();
+    if (!m_lazyLoaded && cache)
+        cache->setHeight(fileName(), layoutKey(), width, height);
+    return height;
+}
+
+QString HtmlContent::derivedHtmlSettings()
+{
+    // Cross references are tagged with the CSS of their link look:
+    if (note()->allowCrossReferences())
+        return LinkLook::crossReferenceLook->toCSS("cross_reference", QColor());
+    return QString();
+}
+
+QByteArray HtmlContent::layoutKey()
+{
+    if (m_layoutKey.isEmpty())
+        m_layoutKey = LayoutCache::keyFor(m_html.toUtf8(), note()->font());
+    return m_layoutKey;
 }
 
 bool HtmlContent::loadFromFile(bool lazyLoad)
@@ -1097,19 +1261,43 @@ bool HtmlContent::finishLazyLoad()
     QString css = ".cross_reference { display: block; width: 100%; text-decoration: none; color: #336600; }"
        "a:hover.cross_reference { text-decoration: underline; color: #ff8000; }";
     m_graphicsTextItem.document()->setDefaultStyleSheet(css);
-    QString convert = Tools::tagURLs(m_html);
-    if(note()->allowCrossReferences())
-        convert = Tools::tagCrossReferences(convert);
-    m_graphicsTextItem.setHtml(convert);
+    if (isCollapsed()) {
+        // Very large texts only display their first lines, so they are never laid out whole:
+        int hiddenLines;
+        QString preview = largeTextPreview(m_textEquivalent, &hiddenLines);
+        m_displayHtml = "<html><body>" + Tools::textToHTMLWithoutP(preview) +
+                        "<p><i>" + Tools::textToHTMLWithoutP(largeTextExpander(hiddenLines)) + "</i></p></body></html>";
+    } else if (m_displayHtml.isEmpty()) {
+        m_displayHtml = Tools::tagURLs(m_html);
+        if(note()->allowCrossReferences())
+            m_displayHtml = Tools::tagCrossReferences(m_displayHtml);
+        if (basket()->layoutCache() && !m_htmlKey.isEmpty())
+            basket()->layoutCache()->setDisplayHtml(fileName(), m_htmlKey, m_html, m_displayHtml);
+    }
+    m_graphicsTextItem.setHtml(m_displayHtml);
+    m_displayHtml = QString(); // Only needed until it is displayed
     m_graphicsTextItem.setFont(note()->font());
     m_graphicsTextItem.setTextWidth(1); // We put a width of 1 pixel, so usedWidth() is egual to the minimum width
     int minWidth = m_graphicsTextItem.document()->idealWidth();
     m_graphicsTextItem.setTextWidth(width);
+    m_lazyLoaded = false;
+    if (basket()->layoutCache())
+        basket()->layoutCache()->setMinWidth(fileName(), layoutKey(), minWidth + 1);
     contentChanged(minWidth + 1);
 
     return true;
 }
 
+bool HtmlContent::useCachedLayout()
+{
+    LayoutCache *cache = basket()->layoutCache();
+    qreal minWidth;
+    if (!m_lazyLoaded || !cache || !cache->minWidth(fileName(), layoutKey(), &minWidth))
+        return false;
+    contentChanged(minWidth);
+    return true;
+}
+
 bool HtmlContent::saveToFile()
 {
     return basket()->saveToFile(fullPath(), html(), /*isLocalEncoding=*/true);
@@ -1134,14 +1322,50 @@ QString HtmlContent::messageWhenOpening(OpenMessage where)
     }
 }
 
+int HtmlContent::zoneAt(const QPointF &pos)
+{
+    return (isCollapsed() && zoneRect(Note::Custom0, pos).contains(pos) ? Note::Custom0 : 0);
+}
+
+QRectF HtmlContent::zoneRect(int zone, const QPointF &pos)
+{
+    if (zone != Note::Custom0)
+        return NoteContent::zoneRect(zone, pos);
+
+    // The expander is the last paragraph of the preview:
+    QTextDocument *document = m_graphicsTextItem.document();
+    return document->documentLayout()->blockBoundingRect(document->lastBlock());
+}
+
+QString HtmlContent::zoneTip(int zone)
+{
+    return (zone == Note::Custom0 ? i18n("Show the whole text") : QString());
+}
+
+Qt::CursorShape HtmlContent::cursorFromZone(int zone) const
+{
+    if (zone == Note::Custom0)
+        return Qt::PointingHandCursor;
+    return Qt::ArrowCursor;
+}
+
+bool HtmlContent::isCollapsed()
+{
+    // The visible text counts, not the markup: heavily styled notes with little text keep their formatting and links
+    return m_textEquivalent.length() > LARGE_TEXT_SIZE;
+}
+
 void HtmlContent::setHtml(const QString &html, bool lazyLoad)
 {
-    m_html = html;
-    QRegExp rx("([^\\x00-\\x7f])");
-    while (m_html.contains(rx)) {
-        m_html.replace( rx.cap().unicode()[0], QString("&#%1;").arg(rx.cap().unicode()[0].unicode()) );
-    }
+    m_html = Tools::escapeNonAscii(html);
     m_textEquivalent = toText(""); //OPTIM_FILTER
+    // Unchanged notes take their HTML with tagged links from the cache, instead of tagging them again:
+    LayoutCache *cache = basket()->layoutCache();
+    m_htmlKey = (cache ? LayoutCache::htmlKeyFor(html.toUtf8(), derivedHtmlSettings()) : QByteArray());
+    if (!cache || !cache->displayHtml(fileName(), m_htmlKey, m_html, &m_displayHtml))
+        m_displayHtml = QString(); // Computed by finishLazyLoad()
+    m_layoutKey = QByteArray();
+    m_lazyLoaded = true;
     if (!lazyLoad)
         finishLazyLoad();
     else
@@ -1164,7 +1388,7 @@ void HtmlContent::exportToHTML(HTMLExporter *exporter, int indent)
  */
 
 ImageContent::ImageContent(Note *parent, const QString &fileName, bool lazyLoad)
-        : NoteContent(parent, fileName), m_pixmapItem(parent), m_format()
+        : NoteContent(parent, fileName), m_pixmapItem(this, parent), m_format(), m_modified(false), m_lazyLoaded(false), m_undecodable(false)
 {
     if(parent)
     {
@@ -1178,37 +1402,85 @@ ImageContent::ImageContent(Note *parent, const QString &fileName, bool lazyLoad)
 
 ImageContent::~ImageContent()
 {
+    // Do not lose a new image that is still being encoded (unless the note was deleted, with its file):
+    if (ImageLoader::instance()->isEncoding(this) && QFile::exists(fullPath())) {
+        ImageLoader::instance()->forget(this);
+        setEncodedData(ImageLoader::encodeImage(m_pixmapItem.pixmap().toImage(), m_format));
+    }
+    ImageLoader::instance()->forget(this);
     if(note()) note()->removeFromGroup(&m_pixmapItem);
 }
 
 qreal ImageContent::setWidthAndGetHeight(qreal width)
 {
     width -= 1;
-    // Don't store width: we will get it on paint!
-    if (width >= m_pixmapItem.pixmap().width()) // Full size
-    {
-        m_pixmapItem.setScale(1.0);
-        return m_pixmapItem.boundingRect().height();
-    }
-    else { // Scalled down
-        qreal scaleFactor = width / m_pixmapItem.pixmap().width();
-	m_pixmapItem.setScale( scaleFactor );
-        return m_pixmapItem.boundingRect().height()*scaleFactor;
+    LayoutCache *cache = basket()->layoutCache();
+    qreal height;
+    if (m_lazyLoaded && cache && cache->height(fileName(), layoutKey(), width, &height))
+        return height; // The image size will really be read by finishLazyLoad()
+    QSizeF size = (m_size.isValid() ? QSizeF(m_size) : QSizeF(0, 0)); // Full size
+    if (width < m_size.width()) // Scalled down
+        size = QSizeF(width, m_size.height() * width / m_size.width());
+    m_pixmapItem.setDisplaySize(size);
+    height = size.height();
+    if (!m_lazyLoaded && cache)
+        cache->setHeight(fileName(), layoutKey(), width, height);
+    return height;
+}
+
+QByteArray ImageContent::layoutKey()
+{
+    // Hashing the image would cost as much as decoding it: identify it by its file instead
+    if (m_layoutKey.isEmpty()) {
+        QFileInfo info(fullPath());
+        m_layoutKey = LayoutCache::keyFor(QByteArray::number(info.size()) + ' ' + info.lastModified().toString(Qt::ISODate).toLatin1());
     }
+    return m_layoutKey;
 }
 
 bool ImageContent::loadFromFile(bool lazyLoad)
 {
+    m_lazyLoaded = true;
+    m_undecodable = false;
+    m_layoutKey = QByteArray();
     if (lazyLoad)
         return true;
     else
         return finishLazyLoad();
 }
 
+bool ImageContent::useCachedLayout()
+{
+    LayoutCache *cache = basket()->layoutCache();
+    qreal minWidth;
+    if (!m_lazyLoaded || !cache || !cache->minWidth(fileName(), layoutKey(), &minWidth))
+        return false;
+    contentChanged(minWidth);
+    return true;
+}
+
 bool ImageContent::finishLazyLoad()
 {
     DEBUG_WIN << "Loading ImageContent From " + basket()->folderName() + fileName();
 
+    m_lazyLoaded = false;
+    ImageLoader::instance()->forget(this);
+
+    // Only read the image header: the image is decoded at the displayed size when the note is painted.
+    // Encrypted images cannot be read by ImageLoader: they are decrypted and decoded right now.
+    if (!basket()->isEncrypted()) {
+        QImageReader reader(fullPath());
+        m_format = reader.format();
+        m_size   = reader.size();
+        if (!m_format.isNull() && m_size.isValid()) {
+            m_pixmapItem.setPixmap(QPixmap());
+            if (basket()->layoutCache())
+                basket()->layoutCache()->setMinWidth(fileName(), layoutKey(), 16 + 1);
+            contentChanged(16 + 1);
+            return true;
+        }
+    }
+
     QByteArray content;
     QPixmap pixmap;
     
@@ -1221,6 +1493,8 @@ bool ImageContent::finishLazyLoad()
         if (!m_format.isNull()) {
             pixmap.loadFromData(content);
             setPixmap(pixmap);
+            m_modified    = false;
+            m_encodedData = content;
             return true;
         }
     }
@@ -1232,25 +1506,49 @@ bool ImageContent::finishLazyLoad()
     pixmap.setMask(pixmap.createHeuristicMask());
     setPixmap(pixmap);
     if (!QFile::exists(fullPath()))
-        saveToFile(); // Reserve the fileName so no new note will have the same name!
+        setEncodedData(ImageLoader::encodeImage(pixmap.toImage(), m_format)); // Reserve the fileName so no new note will have the same name!
     return false;
 }
 
 bool ImageContent::saveToFile()
 {
-    QByteArray ba;
-    QBuffer buffer(&ba);
+    if (m_modified) {
+        // The caller needs the file on disk (eg. to encrypt it again): encode the new image now, replacing a background encoding
+        ImageLoader::instance()->cancelEncoding(this);
+        return setEncodedData(ImageLoader::encodeImage(m_pixmapItem.pixmap().toImage(), m_format));
+    }
+
+    // The image did not change: write the original bytes back, without encoding it again (slow, and lossy for JPEG images).
+    // It is eg. the case when the protection of the basket changes: the file is then just encrypted or decrypted.
+    QByteArray data = m_encodedData;
+    if (data.isEmpty() && !basket()->loadFromFile(fullPath(), &data))
+        return false;
+    m_encodedData = (basket()->isEncrypted() ? data : QByteArray());
+    return basket()->saveToFile(fullPath(), data);
+}
+
+void ImageContent::saveToFileInBackground()
+{
+    if (!m_modified) {
+        saveToFile();
+        return;
+    }
+    // Encode the new image in background, setEncodedData() will write it:
+    ImageLoader::instance()->encode(this, m_pixmapItem.pixmap().toImage(), m_format);
+}
 
-    buffer.open(QIODevice::WriteOnly);
-    m_pixmapItem.pixmap().save(&buffer, m_format);
-    return basket()->saveToFile(fullPath(), ba);
+bool ImageContent::setEncodedData(const QByteArray &data)
+{
+    m_modified    = false;
+    m_encodedData = (basket()->isEncrypted() ? data : QByteArray());
+    return basket()->saveToFile(fullPath(), data);
 }
 
 
 void ImageContent::toolTipInfos(QStringList *keys, QStringList *values)
 {
     keys->append(i18n("Size"));
-    values->append(i18n("%1 by %2 pixels", QString::number(m_pixmapItem.pixmap().width()), QString::number(m_pixmapItem.pixmap().height())));
+    values->append(i18n("%1 by %2 pixels", QString::number(m_size.width()), QString::number(m_size.height())));
 }
 
 QString ImageContent::messageWhenOpening(OpenMessage where)
@@ -1268,33 +1566,85 @@ QString ImageContent::messageWhenOpening(OpenMessage where)
 
 void ImageContent::setPixmap(const QPixmap &pixmap)
 {
+    ImageLoader::instance()->forget(this);
+    m_size        = pixmap.size();
+    m_modified    = true;
+    m_undecodable = false;
+    m_encodedData = QByteArray();
     m_pixmapItem.setPixmap(pixmap);
+    if (basket()->layoutCache())
+        basket()->layoutCache()->setMinWidth(fileName(), layoutKey(), 16 + 1);
     // Since it's scalled, the height is always greater or equal to the size of the tag emblems (16)
     contentChanged(16 + 1); // TODO: always good? I don't think...
 }
 
 void ImageContent::exportToHTML(HTMLExporter *exporter, int /*indent*/)
 {
-    qreal width  = m_pixmapItem.pixmap().width();
-    qreal height = m_pixmapItem.pixmap().height();
+    qreal width  = m_size.width();
+    qreal height = m_size.height();
     qreal contentWidth = note()->width() - note()->contentX() - 1 - Note::NOTE_MARGIN;
 
-    QString imageName = exporter->copyFile(fullPath(), /*createIt=*/true);
+    QString imageName = exporter->copyFile(fullPath());
 
-    if (contentWidth <= m_pixmapItem.pixmap().width()) { // Scalled down
-        qreal scale = contentWidth / m_pixmapItem.pixmap().width();
-        width  = m_pixmapItem.pixmap().width()  * scale;
-        height = m_pixmapItem.pixmap().height() * scale;
+    if (contentWidth <= m_size.width()) { // Scalled down
+        qreal scale = contentWidth / m_size.width();
+        width  = m_size.width()  * scale;
+        height = m_size.height() * scale;
         exporter->stream << "<a href=\"" << exporter->dataFolderName << imageName << "\" title=\"" << i18n("Click for full size view") << "\">";
     }
 
     exporter->stream << "<img src=\"" << exporter->dataFolderName << imageName
     << "\" width=\"" << width << "\" height=\"" << height << "\" alt=\"\">";
 
-    if (contentWidth <= m_pixmapItem.pixmap().width()) // Scalled down
+    if (contentWidth <= m_size.width()) // Scalled down
         exporter->stream << "</a>";
 }
 
+QPixmap ImageContent::pixmap()
+{
+    if (!m_pixmapItem.pixmap().isNull() && m_pixmapItem.pixmap().size() == m_size)
+        return m_pixmapItem.pixmap();
+
+    // Only a downscaled version is loaded (or nothing yet): decode the full image, but do not keep it
+    QByteArray content;
+    QPixmap pixmap;
+    if (basket()->loadFromFile(fullPath(), &content))
+        pixmap.loadFromData(content);
+    return pixmap;
+}
+
+void ImageContent::loadDisplayImage()
+{
+    if (m_lazyLoaded || m_undecodable || !m_size.isValid())
+        return;
+
+    int displayWidth = qCeil(m_pixmapItem.displaySize().width());
+    if (!m_pixmapItem.pixmap().isNull() && m_pixmapItem.pixmap().width() >= qMin(displayWidth, m_size.width()))
+        ImageLoader::instance()->touch(this); // Big enough
+    else
+        ImageLoader::instance()->load(this, fullPath(), displayWidth);
+}
+
+void ImageContent::setDisplayImage(const QImage &image)
+{
+    if (image.isNull()) {
+        kDebug() << "FAILED TO DECODE ImageContent: " << fullPath();
+        // Show a blank image instead of trying to decode it again and again.
+        // The size read from the file header is kept, so the note keeps its place, and the file is kept as is:
+        QPixmap pixmap(1, 1);
+        pixmap.fill();
+        m_pixmapItem.setPixmap(pixmap);
+        m_undecodable = true;
+        return;
+    }
+    m_pixmapItem.setPixmap(QPixmap::fromImage(image));
+}
+
+void ImageContent::unloadDisplayImage()
+{
+    m_pixmapItem.setPixmap(QPixmap());
+}
+
 /** class AnimationContent:
  */
 
@@ -1305,14 +1655,14 @@ AnimationContent::AnimationContent(Note *parent,
         , m_buffer(new QBuffer(this))
         , m_movie(new QMovie(this))
 	, m_currentWidth(0)
-	, m_graphicsPixmap(parent)
+	, m_graphicsPixmap(this, parent)
+	, m_savedFrame(0)
 {
     if(parent)
     {
       parent->addToGroup(&m_graphicsPixmap);
       m_graphicsPixmap.setPos(parent->contentX(),Note::NOTE_MARGIN);
-      connect(parent->basket(), SIGNAL(activated()), m_movie, SLOT(start()));
-      connect(parent->basket(), SIGNAL(closed()), m_movie, SLOT(stop()));
+      connect(parent->basket(), SIGNAL(closed()), this, SLOT(unloadMovie()));
     }
     
     basket()->addWatchedFile(fullPath());
@@ -1358,8 +1708,15 @@ bool AnimationContent::finishLazyLoad()
 {
     QByteArray content;
     if (basket()->loadFromFile(fullPath(), &content)) {
+        // Only decode the first frame: the movie will be started when the note is painted
+        m_movie->stop();
+        m_movie->setDevice(0);
+        m_savedFrame = 0;
+        m_buffer->close();
         m_buffer->setData(content);
-        startMovie();
+        QImageReader reader(m_buffer);
+        m_graphicsPixmap.setPixmap(QPixmap::fromImage(reader.read()));
+        m_buffer->close();
 	contentChanged(16);
         return true;
     }
@@ -1391,11 +1748,36 @@ bool AnimationContent::startMovie()
 {
     if (m_buffer->data().isEmpty())
         return false;
+    m_buffer->close(); // Read from the start
     m_movie->setDevice(m_buffer);
     m_movie->start();
     return true;
 }
 
+void AnimationContent::resumeMovie()
+{
+    switch (m_movie->state()) {
+    case QMovie::Running:
+        break;
+    case QMovie::Paused:
+        m_movie->setPaused(false);
+        break;
+    case QMovie::NotRunning:
+        if (startMovie() && m_savedFrame > 0)
+            m_movie->jumpToFrame(m_savedFrame);
+        break;
+    }
+}
+
+void AnimationContent::unloadMovie()
+{
+    if (m_movie->state() == QMovie::NotRunning)
+        return;
+    m_savedFrame = m_movie->currentFrameNumber();
+    m_movie->stop();
+    m_movie->setDevice(0); // The current frame stays in m_graphicsPixmap
+}
+
 void AnimationContent::movieUpdated()
 {
     m_graphicsPixmap.setPixmap(m_movie->currentPixmap());
@@ -1409,21 +1791,24 @@ void AnimationContent::movieResized()
 void AnimationContent::movieFrameChanged()
 {
     m_graphicsPixmap.setPixmap(m_movie->currentPixmap());
+    // Do not spend CPU for notes nobody sees: resumeMovie() will be called when the note is painted again
+    if (!isOnScreen())
+        m_movie->setPaused(true);
 }
 
 void AnimationContent::exportToHTML(HTMLExporter *exporter, int /*indent*/)
 {
     exporter->stream << QString("<img src=\"%1\" width=\"%2\" height=\"%3\" alt=\"\">")
-    .arg(exporter->dataFolderName + exporter->copyFile(fullPath(), /*createIt=*/true),
-         QString::number(m_movie->currentPixmap().size().width()),
-         QString::number(m_movie->currentPixmap().size().height()));
+    .arg(exporter->dataFolderName + exporter->copyFile(fullPath()),
+         QString::number(m_graphicsPixmap.pixmap().width()),
+         QString::number(m_graphicsPixmap.pixmap().height()));
 }
 
 /** class FileContent:
  */
 
 FileContent::FileContent(Note *parent, const QString &fileName)
-        : NoteContent(parent, fileName), m_linkDisplayItem(parent), m_previewJob(0)
+        : NoteContent(parent, fileName), m_linkDisplayItem(parent)
 {
     basket()->addWatchedFile(fullPath());
     setFileName(fileName); // FIXME: TO THAT HERE BECAUSE NoteContent() constructor seems to don't be able to call virtual methods???
@@ -1436,6 +1821,7 @@ FileContent::FileContent(Note *parent, const QString &fileName)
 
 FileContent::~FileContent()
 {
+    PreviewManager::instance()->forget(this);
     if(note()) note()->removeFromGroup(&m_linkDisplayItem);
 }
 
@@ -1554,40 +1940,26 @@ void FileContent::linkLookChanged()
     //startFetchingUrlPreview();
 }
 
-void FileContent::newPreview(const KFileItem&, const QPixmap &preview)
+void FileContent::setPreview(const QPixmap &preview)
 {
     LinkLook *linkLook = this->linkLook();
     m_linkDisplayItem.linkDisplay().setLink(fileName(), NoteFactory::iconForURL(KUrl(fullPath())), (linkLook->previewEnabled() ? preview : QPixmap()), linkLook, note()->font());
     contentChanged(m_linkDisplayItem.linkDisplay().minWidth());
 }
 
-void FileContent::removePreview(const KFileItem& ki)
-{
-    newPreview(ki, QPixmap());
-}
-
 void FileContent::startFetchingUrlPreview()
 {
-    /*
     KUrl url(fullPath());
     LinkLook *linkLook = this->linkLook();
 
-//  delete m_previewJob;
-    if (!url.isEmpty() && linkLook->previewSize() > 0) {
-        KUrl filteredUrl = NoteFactory::filteredURL(url);//KURIFilter::self()->filteredURI(url);
-        KUrl::List urlList;
-        urlList.append(filteredUrl);
-        m_previewJob = KIO::filePreview(urlList, linkLook->previewSize(), linkLook->previewSize(), linkLook->iconSize());
-        connect(m_previewJob, SIGNAL(gotPreview(const KFileItem&, const QPixmap&)), this, SLOT(newPreview(const KFileItem&, const QPixmap&)));
-        connect(m_previewJob, SIGNAL(failed(const KFileItem&)),                     this, SLOT(removePreview(const KFileItem&)));
-    }
-    */
+    if (!url.isEmpty() && linkLook->previewSize() > 0)
+        PreviewManager::instance()->request(this, NoteFactory::filteredURL(url), linkLook->previewSize(), linkLook->iconSize());
 }
 
 void FileContent::exportToHTML(HTMLExporter *exporter, int indent)
 {
     QString spaces;
-    QString fileName = exporter->copyFile(fullPath(), true);
+    QString fileName = exporter->copyFile(fullPath());
     exporter->stream << m_linkDisplayItem.linkDisplay().toHtml(exporter, KUrl(exporter->dataFolderName + fileName), "").replace("\n", "\n" + spaces.fill(' ', indent + 1));
 }
 
@@ -1653,7 +2025,7 @@ QString SoundContent::messageWhenOpening(OpenMessage where)
  */
 
 LinkContent::LinkContent(Note *parent, const KUrl &url, const QString &title, const QString &icon, bool autoTitle, bool autoIcon)
-        : NoteContent(parent), m_linkDisplayItem(parent), m_access_manager(0), m_httpBuff(0), m_previewJob(0)
+        : NoteContent(parent), m_linkDisplayItem(parent)
 {
     setLink(url, title, icon, autoTitle, autoIcon);
     if(parent)
@@ -1664,9 +2036,8 @@ LinkContent::LinkContent(Note *parent, const KUrl &url, const QString &title, co
 }
 LinkContent::~LinkContent()
 {
+    PreviewManager::instance()->forget(this);
     if(note()) note()->removeFromGroup(&m_linkDisplayItem);
-    delete m_access_manager;
-    delete m_httpBuff;
 }
 
 qreal LinkContent::setWidthAndGetHeight(qreal width)
@@ -1775,116 +2146,39 @@ void LinkContent::linkLookChanged()
     fontChanged();
 }
 
-void LinkContent::newPreview(const KFileItem&, const QPixmap &preview)
+void LinkContent::setPreview(const QPixmap &preview)
 {
     LinkLook *linkLook = LinkLook::lookForURL(url());
     m_linkDisplayItem.linkDisplay().setLink(title(), icon(), (linkLook->previewEnabled() ? preview : QPixmap()), linkLook, note()->font());
     contentChanged(m_linkDisplayItem.linkDisplay().minWidth());
 }
 
-void LinkContent::removePreview(const KFileItem& ki)
-{
-    newPreview(ki, QPixmap());
-}
-
-// QHttp slots for getting link title
-void LinkContent::httpReadyRead()
+void LinkContent::titleFetched(const KUrl &url, const QString &title)
 {
-    //Check for availability
-    unsigned long bytesAvailable = m_reply->bytesAvailable();
-    if (bytesAvailable <= 0)
+    if (!autoTitle() || url != this->url() || title.isEmpty())
         return;
 
-    char* buf = new char[bytesAvailable+1];
-
-    long bytes_read = m_reply->read(buf, bytesAvailable);
-    if (bytes_read > 0) {
-
-        // m_httpBuff will keep data if title is not found in initial read
-        if (m_httpBuff == 0) {
-            m_httpBuff = new QString(buf);
-        } else {
-            (*m_httpBuff) += buf;
-        }
-
-        // todo: this should probably strip odd html tags like &nbsp; etc
-        QRegExp reg("<title>[\\s]*(&nbsp;)?([^<]+)[\\s]*</title>", Qt::CaseInsensitive);
-        reg.setMinimal(true);
-        int offset = 0;
-        //kDebug() << *m_httpBuff << " bytes: " << bytes_read;
-
-        //FIXME: that check doesn't seem to make any sense
-        if ((offset = reg.indexIn(*m_httpBuff)) >= 0) {
-            m_title = reg.cap(2);
-            m_autoTitle = false;
-            setEdited();
-
-            // refresh the title
-            setLink(url(), title(), icon(), autoTitle(), autoIcon());
-
-            // stop the http connection
-            m_reply->abort();
-
-            delete m_httpBuff;
-            m_httpBuff = 0;
-        }
-        // Stop at 10k bytes
-        else if (m_httpBuff->length() > 10000)   {
-            m_reply->abort();
-            delete m_httpBuff;
-            m_httpBuff = 0;
-        }
-    }
-    delete buf;
-}
+    m_title = title;
+    m_autoTitle = false;
+    setEdited();
 
-void LinkContent::httpDone(QNetworkReply* reply) {
-    //If all done, close and delete the reply.
-    reply->deleteLater();
+    // refresh the title
+    setLink(this->url(), this->title(), icon(), autoTitle(), autoIcon());
 }
 
 void LinkContent::startFetchingLinkTitle()
 {
-    KUrl newUrl = this->url();
-
-    //If this is not an HTTP request, just ignore it.
-    if (newUrl.protocol() == "http") {
-
-        //If we have no access_manager, create one.
-        if (m_access_manager == 0) {
-            m_access_manager = new KIO::Integration::AccessManager(this);
-            connect(m_access_manager, SIGNAL(finished(QNetworkReply*)), this, SLOT(httpDone(QNetworkReply*)));
-        }
-
-        //If no explicit port, default to port 80.
-        if (newUrl.port() == 0)
-            newUrl.setPort(80);
-
-        //If no path or query part, default to /
-        if (newUrl.encodedPathAndQuery(KUrl::AddTrailingSlash).isEmpty())
-            newUrl.setPath("/");
-
-        //Issue request
-        m_reply = m_access_manager->get(QNetworkRequest(newUrl));
-        connect(m_reply, SIGNAL(readyRead()), this, SLOT(httpReadyRead()));
-    }
+    // Only this content is called back, with the title of its URL:
+    TitleFetcher::instance()->fetch(url(), this);
 }
 
-// Code dupicated from FileContent::startFetchingUrlPreview()
 void LinkContent::startFetchingUrlPreview()
 {
     KUrl url = this->url();
     LinkLook *linkLook = LinkLook::lookForURL(this->url());
 
-//  delete m_previewJob;
-    if (!url.isEmpty() && linkLook->previewSize() > 0) {
-        KUrl filteredUrl = NoteFactory::filteredURL(url);//KURIFilter::self()->filteredURI(url);
-        KUrl::List urlList;
-        urlList.append(filteredUrl);
-        m_previewJob = KIO::filePreview(urlList, linkLook->previewSize(), linkLook->previewSize(), linkLook->iconSize());
-        connect(m_previewJob, SIGNAL(gotPreview(const KFileItem&, const QPixmap&)), this, SLOT(newPreview(const KFileItem&, const QPixmap&)));
-        connect(m_previewJob, SIGNAL(failed(const KFileItem&)),                     this, SLOT(removePreview(const KFileItem&)));
-    }
+    if (!url.isEmpty() && linkLook->previewSize() > 0)
+        PreviewManager::instance()->request(this, NoteFactory::filteredURL(url), linkLook->previewSize(), linkLook->iconSize());
 }
 
 void LinkContent::exportToHTML(HTMLExporter *exporter, int indent)
@@ -2192,7 +2486,7 @@ void LauncherContent::setLauncher(const QString &name, const QString &icon, cons
 void LauncherContent::exportToHTML(HTMLExporter *exporter, int indent)
 {
     QString spaces;
-    QString fileName = exporter->copyFile(fullPath(), /*createIt=*/true);
+    QString fileName = exporter->copyFile(fullPath());
     exporter->stream << m_linkDisplayItem.linkDisplay().toHtml(exporter, KUrl(exporter->dataFolderName + fileName), "").replace("\n", "\n" + spaces.fill(' ', indent + 1));
 }
 
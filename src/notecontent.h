@@ -25,7 +25,6 @@
 #include <QtGui/QGraphicsItem>
 
 #include <KDE/KUrl>
-#include <KDE/KIO/AccessManager>
 
 #include <phonon/phononnamespace.h>
 
@@ -50,11 +49,6 @@ class QWidget;
 class KFileItem;
 class KUrl;
 
-namespace KIO
-{
-    class PreviewJob;
-}
-
 namespace Phonon
 {
     class MediaObject;
@@ -124,6 +118,9 @@ public:
     virtual bool    finishLazyLoad()                    {
         return false;
     } /// << Load what was not loaded by loadFromFile() if it was lazy-loaded
+    virtual bool    useCachedLayout()                   {
+        return false;
+    } /// << If lazy-loaded, take the geometry from the basket LayoutCache so finishLazyLoad() can be postponed. @return true if it was found.
     virtual bool    saveToFile()                        {
         return false;
     } /// << Save the content to the file. The default implementation does nothing. @see fileName().
@@ -133,6 +130,7 @@ public:
     virtual void    saveToNode(QDomDocument &doc, QDomElement &content);  /// << Save the note in the basket XML file. By default it store the filename if a file is used.
     virtual void    fontChanged()                                    = 0; /// << If your content display textual data, called when the font have changed (from tags or basket font)
     virtual void    linkLookChanged()                                  {} /// << If your content use LinkDisplay with preview enabled, reload the preview (can have changed size)
+    virtual void    setPreview(const QPixmap &/*preview*/)             {} /// << Called by PreviewManager with the preview requested by the content (a null pixmap if there is none)
     virtual QString editToolTipText() const                          = 0; /// << @return "Edit this [text|image|...]" to put in the tooltip for the note's content zone.
     virtual void    toolTipInfos(QStringList */*keys*/, QStringList */*values*/) {} /// << Get "key: value" couples to put in the tooltip for the note's content zone.
     // Custom Zones:                                                      ///    Implement this if you want to store custom data.
@@ -162,6 +160,10 @@ public:
     virtual int xEditorIndent()                        {
         return 0;
     } /// << If the editor should be indented (eg. to not cover an icon), return the number of pixels.
+    // Large Content:
+    virtual bool isCollapsed()                         {
+        return false;
+    } /// << @return true if the content is too large to be displayed whole, and only a preview of its first lines is shown. Its Custom0 zone then shows it whole in a LargeNoteViewer.
     // Open Content or File:
     virtual KUrl urlToOpen(bool /*with*/); /// << @return the URL to open the note, or an invalid KUrl if it's not openable. If @p with if false, it's a normal "Open". If it's true, it's for an "Open with..." action. The default implementation return the fullPath() if the note useFile() and nothing if not.
     enum OpenMessage {
@@ -192,17 +194,22 @@ public:
         return m_note;
     }         /// << Get the note managing this content.
     BasketScene  *basket();                                 /// << Get the basket containing the note managing this content.
+    bool     isOnScreen();                             /// << @return true if the note is in the visible part of the current basket.
     virtual QGraphicsItem *graphicsItem() = 0;
 public:
     void setEdited(); /// << Mark the note as edited NOW: change the "last modification time and time" AND save the basket to XML file.
 protected:
     void contentChanged(qreal newMinWidth); /// << When the content has changed, inherited classes should call this to specify its new minimum size and trigger a basket relayout.
+    static QString largeTextPreview(const QString &text, int *hiddenLines); /// << @return the first LARGE_TEXT_PREVIEW_LINES lines of @p text, and set @p hiddenLines to the number of the other ones.
+    static QString largeTextExpander(int hiddenLines);                      /// << @return the line displayed under such a preview, to show the whole content.
 private:
     Note    *m_note;
     QString  m_fileName;
     qreal    m_minWidth;
 public:
     static const int FEEDBACK_DARKING;
+    static const int LARGE_TEXT_SIZE;          /// << Text and HTML notes with more characters of text than that are collapsed (see isCollapsed())
+    static const int LARGE_TEXT_PREVIEW_LINES; /// << Number of lines displayed by collapsed notes
 };
 
 /** Real implementation of plain text notes:
@@ -234,6 +241,13 @@ public:
     QString linkAt(const QPointF &pos);
     void    fontChanged();
     QString editToolTipText() const;
+    // Custom Zones:
+    int     zoneAt(const QPointF &pos);
+    QRectF  zoneRect(int zone, const QPointF &/*pos*/);
+    QString zoneTip(int zone);
+    Qt::CursorShape cursorFromZone(int zone) const;
+    // Large Content:
+    bool    isCollapsed();
     // Drag and Drop Content:
     QPixmap feedbackPixmap(qreal width, qreal height);
     // Open Content or File:
@@ -242,7 +256,7 @@ public:
     // Content-Specific Methods:
     void    setText(const QString &text, bool lazyLoad = false); /// << Change the text note-content and relayout the note.
     QString text() {
-        return m_graphicsTextItem.text();
+        return m_text;
     }     /// << @return the text note-content.
     QByteArray data() {
         return text().toLocal8Bit();
@@ -250,9 +264,9 @@ public:
     QGraphicsItem *graphicsItem() { return &m_graphicsTextItem; }
     
 protected:
-//     QString          m_text;
+    QString          m_text;
     //QTextDocument *m_simpleRichText;
-    QGraphicsSimpleTextItem m_graphicsTextItem;
+    QGraphicsSimpleTextItem m_graphicsTextItem; /// << Only displays a preview of m_text if it is collapsed
 };
 
 #include <QGraphicsTextItem>
@@ -281,10 +295,18 @@ public:
     qreal     setWidthAndGetHeight(qreal width);
     bool    loadFromFile(bool lazyLoad);
     bool    finishLazyLoad();
+    bool    useCachedLayout();
     bool    saveToFile();
     QString linkAt(const QPointF &pos);
     void    fontChanged();
     QString editToolTipText() const;
+    // Custom Zones:
+    int     zoneAt(const QPointF &pos);
+    QRectF  zoneRect(int zone, const QPointF &/*pos*/);
+    QString zoneTip(int zone);
+    Qt::CursorShape cursorFromZone(int zone) const;
+    // Large Content:
+    bool    isCollapsed();
     // Drag and Drop Content:
     QPixmap feedbackPixmap(qreal width, qreal height);
     // Open Content or File:
@@ -304,6 +326,36 @@ protected:
     QString          m_textEquivalent; //OPTIM_FILTER
     QTextDocument *m_simpleRichText;
     QGraphicsTextItem m_graphicsTextItem;
+    bool             m_lazyLoaded; /// << True until finishLazyLoad() put the HTML in m_graphicsTextItem
+    QByteArray       m_layoutKey;
+    QString          m_displayHtml; /// << m_html with tagged links, from the LayoutCache or computed by finishLazyLoad(), until it is displayed
+    QByteArray       m_htmlKey;     /// << What m_displayHtml is derived from (see LayoutCache::htmlKeyFor())
+    QByteArray layoutKey();
+    QString derivedHtmlSettings();
+};
+
+class ImageContent;
+
+/**
+ * ImageItem is a QGraphicsItem painting the image of an ImageContent at its display size.
+ * Its pixmap can be a downscaled version of the image, or be null until the image is loaded (see ImageLoader).
+ */
+class ImageItem : public QGraphicsItem
+{
+public:
+  ImageItem(ImageContent *content, QGraphicsItem *parent) : QGraphicsItem(parent), m_content(content) {}
+  virtual ~ImageItem() {}
+  virtual QRectF boundingRect() const;
+  virtual void paint(QPainter*, const QStyleOptionGraphicsItem*, QWidget*);
+
+  void setPixmap(const QPixmap &pixmap);
+  const QPixmap& pixmap() const { return m_pixmap; }
+  void setDisplaySize(const QSizeF &size);
+  QSizeF displaySize() const { return m_displaySize; }
+private:
+  ImageContent *m_content;
+  QPixmap       m_pixmap;
+  QSizeF        m_displaySize;
 };
 
 /** Real implementation of image notes:
@@ -331,6 +383,7 @@ public:
     qreal     setWidthAndGetHeight(qreal width);
     bool    loadFromFile(bool lazyLoad);
     bool    finishLazyLoad();
+    bool    useCachedLayout();
     bool    saveToFile();
     void    fontChanged();
     QString editToolTipText() const;
@@ -345,17 +398,46 @@ public:
     QString customOpenCommand();
     // Content-Specific Methods:
     void    setPixmap(const QPixmap &pixmap); /// << Change the pixmap note-content and relayout the note.
-    QPixmap pixmap() {
-        return m_pixmapItem.pixmap();
-    }     /// << @return the pixmap note-content.
+    QPixmap pixmap();                         /// << @return the pixmap note-content. It is decoded at full size if only a downscaled version is loaded.
     QByteArray data();
     QGraphicsItem *graphicsItem() { return &m_pixmapItem; }
+    // Display Image Management (see ImageLoader):
+    void    loadDisplayImage();                        /// << Load the image at the displayed size, if not already done.
+    void    setDisplayImage(const QImage &image);      /// << Called by ImageLoader once the image is decoded.
+    void    saveToFileInBackground();                  /// << Like saveToFile(), but a new image is encoded on a worker thread: the file is written later.
+    bool    setEncodedData(const QByteArray &data);    /// << Called by ImageLoader once a new image is encoded: write it to the file.
+    void    unloadDisplayImage();                      /// << Called by ImageLoader to free memory. The image will be loaded again when painted.
 protected:
-    QGraphicsPixmapItem  m_pixmapItem;
+    ImageItem  m_pixmapItem;
+    QSize      m_size; /// << Size of the full image
     QByteArray m_format;
+    bool       m_modified;    /// << True if the image was changed since it was read from or written to the file
+    QByteArray m_encodedData; /// << The content of the file, decrypted, for encrypted baskets only (others read it back from disk)
+    bool       m_lazyLoaded; /// << True until finishLazyLoad() read the image size
+    bool       m_undecodable; /// << True if ImageLoader failed to decode the file: a blank image is shown instead
+    QByteArray m_layoutKey;
+    QByteArray layoutKey();
+};
+
+class AnimationContent;
+
+/**
+ * AnimationItem is a QGraphicsPixmapItem showing the current frame of an AnimationContent,
+ * and resuming the animation when it is painted (that is to say when the note is on screen).
+ */
+class AnimationItem : public QGraphicsPixmapItem
+{
+public:
+  AnimationItem(AnimationContent *content, QGraphicsItem *parent) : QGraphicsPixmapItem(parent), m_content(content) {}
+  virtual void paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget);
+private:
+  AnimationContent *m_content;
 };
 
 /** Real implementation of animated image (GIF, MNG) notes:
+ * The movie only plays while the note is on screen: it is paused as soon as a frame changes out of the screen,
+ * and resumed from that frame when the note is painted again. When the basket is closed, the movie is unloaded,
+ * and the last shown frame stays as a static pixmap. Until the note is shown, only the first frame is decoded.
  * @author Sébastien Laoût
  */
 class AnimationContent : public QObject, public NoteContent // QObject to be able to receive QMovie signals
@@ -396,17 +478,20 @@ public:
 
     // Content-Specific Methods:
     bool startMovie();
+    void resumeMovie(); /// << Start the movie if needed, from the frame where it was paused or unloaded.
 
 protected slots:
     void movieUpdated();
     void movieResized();
     void movieFrameChanged();
+    void unloadMovie(); /// << Free the decoder and its frames, but remember the current frame.
 
 protected:
     QBuffer *m_buffer;
     QMovie  *m_movie;
     qreal m_currentWidth;
-    QGraphicsPixmapItem m_graphicsPixmap;
+    AnimationItem m_graphicsPixmap;
+    int     m_savedFrame; /// << Frame to jump to when the movie is restarted after having been unloaded
 };
 
 /** Real implementation of file notes:
@@ -435,6 +520,7 @@ public:
     bool    loadFromFile(bool /*lazyLoad*/);
     void    fontChanged();
     void    linkLookChanged();
+    void    setPreview(const QPixmap &preview);
     QString editToolTipText() const;
     void    toolTipInfos(QStringList *keys, QStringList *values);
     // Drag and Drop Content:
@@ -457,12 +543,7 @@ public:
 protected:
     LinkDisplayItem m_linkDisplayItem;
     // File Preview Management:
-protected slots:
-    void newPreview(const KFileItem&, const QPixmap &preview);
-    void removePreview(const KFileItem&);
     void startFetchingUrlPreview();
-protected:
-    KIO::PreviewJob *m_previewJob;
 };
 
 /** Real implementation of sound notes:
@@ -530,6 +611,7 @@ public:
     void    saveToNode(QDomDocument &doc, QDomElement &content);
     void    fontChanged();
     void    linkLookChanged();
+    void    setPreview(const QPixmap &preview);
     QString editToolTipText() const;
     void    toolTipInfos(QStringList *keys, QStringList *values);
     // Drag and Drop Content:
@@ -570,18 +652,10 @@ protected:
     bool        m_autoTitle;
     bool        m_autoIcon;
     LinkDisplayItem m_linkDisplayItem;
-    KIO::Integration::AccessManager*      m_access_manager;
-    QNetworkReply*      m_reply;
-    QString*    m_httpBuff;
     // File Preview Management:
-protected slots:
-    void httpReadyRead();
-    void httpDone(QNetworkReply* reply);
-    void newPreview(const KFileItem&, const QPixmap &preview);
-    void removePreview(const KFileItem&);
     void startFetchingUrlPreview();
-protected:
-    KIO::PreviewJob *m_previewJob;
+protected slots:
+    void titleFetched(const KUrl &url, const QString &title);
 };
 
 /** Real implementation of cross reference notes:
@@ -42,6 +42,7 @@
 #include <KDE/KMimeType>
 #include <KDE/KMessageBox>
 #include <KDE/KLocale>
+#include <KDE/KDebug>
 #include <KDE/KFileMetaInfo>
 #include <KDE/KOpenWithDialog>
 #include <KDE/KFileDialog>
@@ -56,12 +57,14 @@
 
 #include "basketscene.h"
 #include "basketlistview.h"
+#include "bnpview.h"
 #include "note.h"
 #include "notedrag.h"
 #include "global.h"
 #include "settings.h"
 #include "variouswidgets.h" //For IconSizeDialog
 #include "tools.h"
+#include "iconmanager.h"
 
 #include "debugwindow.h"
 
@@ -133,7 +136,7 @@ Note* NoteFactory::createNoteImage(const QPixmap &image, BasketScene *parent)
     Note *note = new Note(parent);
     ImageContent *content = new ImageContent(note, createFileForNewNote(parent, "png"));
     content->setPixmap(image);
-    content->saveToFile();
+    content->saveToFileInBackground(); // Encoding a big screenshot would freeze the paste
     return note;
 }
 
@@ -457,6 +460,14 @@ Note* NoteFactory::dropNote(const QMimeData *source, BasketScene *parent, bool f
         QString subtype("html");
         // If the text/html comes from Mozilla or GNOME it can be UTF-16 encoded: we need ExtendedTextDrag to check that
         ExtendedTextDrag::decode(source, html, subtype);
+        if (Settings::compactPastedHtml()) {
+            int length = html.length();
+            html = Tools::compactHtml(html);
+            if (html.length() < length) {
+                kDebug() << "Compacted the dropped HTML from" << length << "to" << html.length() << "characters";
+                Global::bnpView->postStatusbarMessage(i18n("Simplified the pasted rich text from %1 to %2 characters.", length, html.length()));
+            }
+        }
         return createNoteHtml(html, parent);
     }
 
@@ -1000,10 +1011,7 @@ QString NoteFactory::iconForCommand(const QString &command)
 
 bool NoteFactory::isIconExist(const QString &icon)
 {
-    return ! KIconLoader::global()->loadIcon(
-               icon, KIconLoader::NoGroup, 16, KIconLoader::DefaultState,
-               QStringList(), 0L, true
-           ).isNull();
+    return IconManager::instance()->exists(icon);
 }
 
 Note* NoteFactory::createEmptyNote(NoteType::Id type, BasketScene *parent)
@@ -0,0 +1,133 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by BasKet Note Pads developers                     *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+
+#include "noterenderer.h"
+
+#include <QtCore/QRunnable>
+#include <QtCore/QThreadPool>
+#include <QtCore/QTimer>
+
+#include "note.h"
+
+bool NoteRenderJob::operator==(const NoteRenderJob &other) const
+{
+    return width               == other.width               &&
+           height              == other.height              &&
+           gradientTopColor    == other.gradientTopColor    &&
+           gradientBottomColor == other.gradientBottomColor &&
+           textColor           == other.textColor           &&
+           emblemNames         == other.emblemNames         &&
+           haveInvisibleTags   == other.haveInvisibleTags   &&
+           focused             == other.focused;
+}
+
+/** Paint one note buffer in a worker thread, and send the result back to the renderer, in the GUI thread.
+  */
+class NoteRenderTask : public QRunnable
+{
+public:
+    NoteRenderTask(NoteRenderer *renderer, int id, const NoteRenderJob &job)
+        : m_renderer(renderer), m_id(id), m_job(job)
+    {
+    }
+    void run()
+    {
+        QImage image = Note::renderBuffer(m_job);
+        QMetaObject::invokeMethod(m_renderer, "renderingDone", Qt::QueuedConnection, Q_ARG(int, m_id), Q_ARG(QImage, image));
+    }
+private:
+    NoteRenderer  *m_renderer;
+    int            m_id;
+    NoteRenderJob  m_job;
+};
+
+NoteRenderer* NoteRenderer::instance()
+{
+    static NoteRenderer *instance = 0;
+    if (!instance)
+        instance = new NoteRenderer();
+    return instance;
+}
+
+NoteRenderer::NoteRenderer()
+        : m_threadPool(new QThreadPool(this))
+        , m_lastJobId(0)
+        , m_synchronousBudget(SYNCHRONOUS_RENDERS_PER_ITERATION)
+        , m_budgetResetScheduled(false)
+{
+}
+
+NoteRenderer::~NoteRenderer()
+{
+    m_threadPool->waitForDone();
+}
+
+bool NoteRenderer::shouldRenderLater(Note *note, const NoteRenderJob &job)
+{
+    // Already being rendered with the same look: just wait for it:
+    QHash<Note*, PendingRender>::const_iterator it = m_pending.constFind(note);
+    if (it != m_pending.constEnd() && it.value().job == job)
+        return true;
+    cancel(note);
+
+    // A few notes changed (hovering, selection...): render them right now:
+    if (!m_budgetResetScheduled) {
+        m_budgetResetScheduled = true;
+        QTimer::singleShot(0, this, SLOT(resetBudget()));
+    }
+    if (m_synchronousBudget > 0) {
+        --m_synchronousBudget;
+        return false;
+    }
+
+    // A lot of notes need a buffer at once: do them in the background:
+    PendingRender pending;
+    pending.id  = ++m_lastJobId;
+    pending.job = job;
+    m_pending.insert(note, pending);
+    m_jobs.insert(pending.id, note);
+    m_threadPool->start(new NoteRenderTask(this, pending.id, job));
+    return true;
+}
+
+void NoteRenderer::cancel(Note *note)
+{
+    QHash<Note*, PendingRender>::iterator it = m_pending.find(note);
+    if (it != m_pending.end()) {
+        m_jobs.remove(it.value().id);
+        m_pending.erase(it);
+    }
+}
+
+void NoteRenderer::resetBudget()
+{
+    m_synchronousBudget    = SYNCHRONOUS_RENDERS_PER_ITERATION;
+    m_budgetResetScheduled = false;
+}
+
+void NoteRenderer::renderingDone(int id, const QImage &image)
+{
+    // The note was deleted or requested another rendering in the meantime:
+    Note *note = m_jobs.take(id);
+    if (!note)
+        return;
+    m_pending.remove(note);
+    note->setRenderedBuffer(image);
+}
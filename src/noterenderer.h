@@ -0,0 +1,99 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by BasKet Note Pads developers                     *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+
+#ifndef NOTERENDERER_H
+#define NOTERENDERER_H
+
+#include <QtCore/QObject>
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QStringList>
+#include <QtGui/QColor>
+#include <QtGui/QImage>
+
+class QThreadPool;
+
+class Note;
+
+/** Everything needed to paint the buffer of a (not hovered) note, copied out of the note
+  * so that the painting can be done in a worker thread, on a QImage.
+  * Emblems are given as images for the same reason.
+  */
+struct NoteRenderJob
+{
+    int           width;
+    int           height;
+    QColor        gradientTopColor;
+    QColor        gradientBottomColor;
+    QColor        textColor;
+    QStringList   emblemNames;
+    QList<QImage> emblems;
+    bool          haveInvisibleTags;
+    bool          focused;
+
+    bool operator==(const NoteRenderJob &other) const;
+};
+
+/** Paint note buffers on a thread pool.
+  * BASIC FUNCTIONNING:
+  *   When a basket appears or all its styles change, every visible note needs a new buffer at once.
+  *   Note::draw() asks shouldRenderLater() before painting a buffer: the first notes of an event loop iteration
+  *   are still painted synchronously (so that eg. hovering a note never flickers),
+  *   but the next ones are queued in the thread pool and the note draws a placeholder in the meantime.
+  *   When the image is ready, it is handed back to the note in the GUI thread (Note::setRenderedBuffer()),
+  *   which converts it to its buffered pixmap and asks for a repaint.
+  *   Results for deleted notes, or for notes that requested another rendering meanwhile, are dropped.
+  */
+class NoteRenderer : public QObject
+{
+    Q_OBJECT
+public:
+    static NoteRenderer* instance();
+
+    /// @Return true if @p note should draw a placeholder because its buffer is (or is now) being rendered in background.
+    /// If false is returned, the note should render @p job synchronously.
+    bool shouldRenderLater(Note *note, const NoteRenderJob &job);
+    /// Forget any rendering for @p note (eg. because it is deleted).
+    void cancel(Note *note);
+
+private:
+    NoteRenderer();
+    ~NoteRenderer();
+
+    static const int SYNCHRONOUS_RENDERS_PER_ITERATION = 8;
+
+    struct PendingRender {
+        int           id;
+        NoteRenderJob job;
+    };
+
+    QThreadPool                 *m_threadPool;
+    QHash<Note*, PendingRender>  m_pending;
+    QHash<int, Note*>            m_jobs;
+    int                          m_lastJobId;
+    int                          m_synchronousBudget;
+    bool                         m_budgetResetScheduled;
+
+private slots:
+    void resetBudget();
+    void renderingDone(int id, const QImage &image);
+};
+
+#endif // NOTERENDERER_H
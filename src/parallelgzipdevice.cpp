@@ -0,0 +1,286 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by BasKet Note Pads developers                     *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+
+#include "parallelgzipdevice.h"
+
+#include <QtCore/QRunnable>
+#include <QtCore/QThread>
+#include <QtCore/QThreadPool>
+
+#include <zlib.h>
+
+/** A block of data to compress, and the result of its compression.
+  */
+struct GzipBlock {
+    QByteArray input;      /// << Freed once compressed
+    int        size;       /// << Size of the input
+    QByteArray dictionary; /// << The last 32 KB before the block, to compress it as if it followed them
+    QByteArray output;     /// << Raw deflate data, ending on a byte boundary (or with the final deflate block if last)
+    quint32    crc;
+    qint64     offset;     /// << Uncompressed offset of the block
+    bool       restart;    /// << True if the block is compressed without dictionary, and is the start of a restart point
+    bool       last;
+    bool       compressed;
+};
+
+/** Deflate one block in a worker thread.
+  */
+class DeflateTask : public QRunnable
+{
+public:
+    DeflateTask(ParallelGzipDevice *device, GzipBlock *block, int level)
+        : m_device(device), m_block(block), m_level(level)
+    {
+    }
+    void run()
+    {
+        GzipBlock *block = m_block;
+        block->crc = crc32(crc32(0, Z_NULL, 0), (const Bytef*)block->input.constData(), block->input.size());
+
+        z_stream stream;
+        stream.zalloc = Z_NULL;
+        stream.zfree  = Z_NULL;
+        stream.opaque = Z_NULL;
+        bool success = (deflateInit2(&stream, m_level, Z_DEFLATED, /*Raw deflate:*/-MAX_WBITS, 8, Z_DEFAULT_STRATEGY) == Z_OK);
+        if (success && !block->dictionary.isEmpty())
+            success = (deflateSetDictionary(&stream, (const Bytef*)block->dictionary.constData(), block->dictionary.size()) == Z_OK);
+
+        if (success) {
+            // The sync flush (that ends the block on a byte boundary) needs a few bytes more than deflateBound():
+            block->output.resize(deflateBound(&stream, block->input.size()) + 16);
+            stream.next_in   = (Bytef*)block->input.data();
+            stream.avail_in  = block->input.size();
+            stream.next_out  = (Bytef*)block->output.data();
+            stream.avail_out = block->output.size();
+            int flush = (block->last ? Z_FINISH : Z_SYNC_FLUSH);
+            forever {
+                int result = deflate(&stream, flush);
+                if (result == Z_STREAM_END || (result == Z_OK && !block->last && stream.avail_out != 0))
+                    break;
+                if (result != Z_OK && result != Z_BUF_ERROR) {
+                    success = false;
+                    break;
+                }
+                // Not enough room (should not happen):
+                int written = block->output.size() - stream.avail_out;
+                block->output.resize(block->output.size() * 2);
+                stream.next_out  = (Bytef*)block->output.data() + written;
+                stream.avail_out = block->output.size() - written;
+            }
+            block->output.resize(block->output.size() - stream.avail_out);
+            deflateEnd(&stream);
+        }
+        if (!success)
+            block->output.clear(); // Tell the device the compression failed
+
+        block->input.clear();
+        block->dictionary.clear();
+        m_device->blockCompressed(block);
+    }
+private:
+    ParallelGzipDevice *m_device;
+    GzipBlock          *m_block;
+    int                 m_level;
+};
+
+ParallelGzipDevice::ParallelGzipDevice(QIODevice *device, int level, int threads)
+        : m_device(device)
+        , m_openedDevice(false)
+        , m_level(qBound(1, level, 9))
+        , m_threadPool(new QThreadPool(this))
+        , m_crc(crc32(0, Z_NULL, 0))
+        , m_size(0)
+        , m_totalIn(0)
+        , m_totalOut(0)
+        , m_restartNext(true)
+        , m_failed(false)
+{
+    if (threads <= 0)
+        threads = QThread::idealThreadCount();
+    m_threadPool->setMaxThreadCount(qMax(1, threads));
+    m_maxPendingBlocks = 2 * m_threadPool->maxThreadCount();
+}
+
+ParallelGzipDevice::~ParallelGzipDevice()
+{
+    if (isOpen())
+        close();
+    m_threadPool->waitForDone();
+    qDeleteAll(m_pendingBlocks);
+}
+
+bool ParallelGzipDevice::open(OpenMode mode)
+{
+    if ((mode & ReadOnly) || !(mode & WriteOnly)) {
+        setErrorString("ParallelGzipDevice can only be written");
+        return false;
+    }
+    if (!m_device->isOpen()) {
+        if (!m_device->open(WriteOnly))
+            return false;
+        m_openedDevice = true;
+    }
+
+    // Gzip header: magic, deflate method, no flag, no modification time, extra flags, Unix OS:
+    const char header[10] = { '\x1f', '\x8b', 8, 0, 0, 0, 0, 0, (m_level == 9 ? 2 : (m_level == 1 ? 4 : 0)), 3 };
+    m_failed = (m_device->write(header, 10) != 10);
+    if (m_failed)
+        setErrorString(m_device->errorString());
+    m_crc  = crc32(0, Z_NULL, 0);
+    m_size = 0;
+    m_totalIn  = 0;
+    m_totalOut = 10;
+    m_restartNext = true; // The start of the stream is a restart point
+    m_restartPoints.clear();
+    m_currentBlock.reserve(BLOCK_SIZE);
+    m_dictionary.clear();
+    return QIODevice::open(mode);
+}
+
+void ParallelGzipDevice::close()
+{
+    if (!isOpen())
+        return;
+
+    // Compress what remains (even nothing, the stream has to be finished), and write everything:
+    submitBlock(/*last=*/true);
+    while (!m_pendingBlocks.isEmpty())
+        writeOldestBlock();
+
+    // Gzip trailer, in little endian:
+    char trailer[8];
+    for (int i = 0; i < 4; ++i) {
+        trailer[i]     = (char)((m_crc  >> (8 * i)) & 0xFF);
+        trailer[i + 4] = (char)((m_size >> (8 * i)) & 0xFF);
+    }
+    if (!m_failed && m_device->write(trailer, 8) != 8) {
+        setErrorString(m_device->errorString());
+        m_failed = true;
+    }
+
+    if (m_openedDevice) {
+        m_device->close();
+        m_openedDevice = false;
+    }
+    QIODevice::close();
+}
+
+qint64 ParallelGzipDevice::readData(char */*data*/, qint64 /*maxSize*/)
+{
+    return -1;
+}
+
+qint64 ParallelGzipDevice::writeData(const char *data, qint64 size)
+{
+    if (m_failed)
+        return -1;
+
+    qint64 remaining = size;
+    while (remaining > 0) {
+        int length = qMin<qint64>(remaining, BLOCK_SIZE - m_currentBlock.size());
+        m_currentBlock.append(data, length);
+        m_totalIn += length;
+        data      += length;
+        remaining -= length;
+        if (m_currentBlock.size() == BLOCK_SIZE) {
+            submitBlock(/*last=*/false);
+            // Do not keep more blocks in memory than needed to keep every thread busy:
+            while (m_pendingBlocks.count() > m_maxPendingBlocks)
+                if (!writeOldestBlock())
+                    return -1;
+        }
+    }
+    return size;
+}
+
+void ParallelGzipDevice::addRestartPoint()
+{
+    if (!isOpen() || (m_restartNext && m_currentBlock.isEmpty()))
+        return;
+    if (!m_currentBlock.isEmpty()) {
+        submitBlock(/*last=*/false);
+        while (m_pendingBlocks.count() > m_maxPendingBlocks)
+            writeOldestBlock();
+    }
+    m_dictionary.clear();
+    m_restartNext = true;
+}
+
+void ParallelGzipDevice::submitBlock(bool last)
+{
+    GzipBlock *block = new GzipBlock;
+    block->input      = m_currentBlock;
+    block->size       = m_currentBlock.size();
+    block->dictionary = m_dictionary;
+    block->crc        = 0;
+    block->offset     = m_totalIn - m_currentBlock.size();
+    block->restart    = m_restartNext;
+    block->last       = last;
+    block->compressed = false;
+    m_dictionary = m_currentBlock.right(32 * 1024); // The deflate window
+    m_restartNext = false;
+    m_currentBlock.clear();
+    m_currentBlock.reserve(BLOCK_SIZE);
+
+    m_pendingBlocks.append(block);
+    m_threadPool->start(new DeflateTask(this, block, m_level));
+}
+
+/** Wait for the oldest block to be compressed, and write it to the device.
+  * @return false if the compression or the writing failed.
+  */
+bool ParallelGzipDevice::writeOldestBlock()
+{
+    GzipBlock *block = m_pendingBlocks.takeFirst();
+    m_mutex.lock();
+    while (!block->compressed)
+        m_blockCompressed.wait(&m_mutex);
+    m_mutex.unlock();
+
+    if (!m_failed) {
+        if (block->restart) {
+            RestartPoint point;
+            point.uncompressedOffset = block->offset;
+            point.compressedOffset   = m_totalOut;
+            m_restartPoints.append(point);
+        }
+        if (block->output.isEmpty()) { // Even an empty block produces some bytes
+            setErrorString("Compression failed");
+            m_failed = true;
+        } else if (m_device->write(block->output) != block->output.size()) {
+            setErrorString(m_device->errorString());
+            m_failed = true;
+        }
+        m_crc   = crc32_combine(m_crc, block->crc, block->size);
+        m_size += block->size;
+        m_totalOut += block->output.size();
+    }
+    delete block;
+    return !m_failed;
+}
+
+/** Called by DeflateTask, in a worker thread.
+  */
+void ParallelGzipDevice::blockCompressed(GzipBlock *block)
+{
+    QMutexLocker locker(&m_mutex);
+    block->compressed = true;
+    m_blockCompressed.wakeAll();
+}
@@ -0,0 +1,99 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by BasKet Note Pads developers                     *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+
+#ifndef PARALLELGZIPDEVICE_H
+#define PARALLELGZIPDEVICE_H
+
+#include <QtCore/QIODevice>
+#include <QtCore/QByteArray>
+#include <QtCore/QList>
+#include <QtCore/QMutex>
+#include <QtCore/QWaitCondition>
+
+#include "basket_export.h"
+
+class QThreadPool;
+
+struct GzipBlock;
+
+/** Write-only device compressing everything written to it in the gzip format, on several cores.
+  * BASIC FUNCTIONNING:
+  *   The data is cut in blocks of BLOCK_SIZE bytes, that are deflated in parallel by a thread pool (the pigz way).
+  *   Every block is compressed with the end of the previous one as dictionary, and ends with a sync flush,
+  *   so the compressed blocks can be written one after the other as a single, standard gzip stream:
+  *   it is read by KFilterDev (and thus KTar, Archive::open() and RestoreThread) or gunzip as usual.
+  *   Blocks are written in order, as soon as they are compressed; at most two blocks per thread are kept in memory.
+  *   The device is typically given to KTar, to compress archives and backups without temporary files.
+  *   addRestartPoint() starts a block without dictionary: a raw inflate can start there, to read a part of the data
+  *   without decompressing what is before (see IndexedArchive).
+  */
+class BASKET_EXPORT ParallelGzipDevice : public QIODevice
+{
+    Q_OBJECT
+public:
+    /// Compress to @p device, with the zlib compression @p level (1 to 9), on @p threads threads (0 for one per core).
+    ParallelGzipDevice(QIODevice *device, int level = DEFAULT_LEVEL, int threads = 0);
+    ~ParallelGzipDevice();
+
+    bool open(OpenMode mode); /// << Only QIODevice::WriteOnly is supported. @p device is opened if it is not already
+    void close();             /// << Write the pending blocks and the gzip trailer. @p device is only closed if it was opened by open()
+    bool hasFailed() const { return m_failed; } /// << @return true if the compression or the writing failed: the stream is truncated, and errorString() tells why
+
+    /// Where a raw inflate can start: the compressed offset is counted from the start of the gzip stream.
+    struct RestartPoint {
+        qint64 uncompressedOffset;
+        qint64 compressedOffset;
+    };
+    void addRestartPoint();
+    QList<RestartPoint> restartPoints() const { return m_restartPoints; } /// << Complete once the device is closed
+
+    static const int DEFAULT_LEVEL = 6;
+    static const int BLOCK_SIZE = 128 * 1024;
+
+protected:
+    qint64 readData(char *data, qint64 maxSize);
+    qint64 writeData(const char *data, qint64 size);
+
+private:
+    void submitBlock(bool last);
+    bool writeOldestBlock();
+    void blockCompressed(GzipBlock *block);
+    friend class DeflateTask;
+
+    QIODevice         *m_device;
+    bool               m_openedDevice;
+    int                m_level;
+    QThreadPool       *m_threadPool;
+    int                m_maxPendingBlocks;
+    QByteArray         m_currentBlock;   /// << Data written but not submitted yet
+    QByteArray         m_dictionary;     /// << The end of the last submitted block
+    QList<GzipBlock*>  m_pendingBlocks;  /// << Submitted blocks, in order, waiting to be written
+    QMutex             m_mutex;
+    QWaitCondition     m_blockCompressed;
+    quint32            m_crc;
+    quint32            m_size;           /// << Size of the uncompressed data, modulo 2^32 (like in the gzip trailer)
+    qint64             m_totalIn;        /// << Size of the data written
+    qint64             m_totalOut;       /// << Size of the gzip stream written to m_device
+    bool               m_restartNext;    /// << True if the next submitted block starts a restart point
+    QList<RestartPoint> m_restartPoints;
+    bool               m_failed;
+};
+
+#endif // PARALLELGZIPDEVICE_H
@@ -0,0 +1,172 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by BasKet Note Pads developers                     *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+
+#include "previewmanager.h"
+
+#include <QtCore/QDateTime>
+#include <QtCore/QFileInfo>
+
+#include <KDE/KFileItem>
+#include <KDE/KIO/PreviewJob>
+
+#include "notecontent.h"
+
+PreviewManager* PreviewManager::instance()
+{
+    static PreviewManager *instance = 0;
+    if (!instance)
+        instance = new PreviewManager();
+    return instance;
+}
+
+PreviewManager::PreviewManager()
+        : m_cache(CACHE_SIZE)
+{
+    m_startTimer.setSingleShot(true);
+    connect(&m_startTimer, SIGNAL(timeout()), this, SLOT(startJobs()));
+}
+
+PreviewManager::~PreviewManager()
+{
+}
+
+QString PreviewManager::keyFor(const KUrl &url, int size, int iconSize)
+{
+    QString key = url.url() + '|' + QString::number(size) + '|' + QString::number(iconSize);
+    if (url.isLocalFile()) {
+        QFileInfo info(url.toLocalFile());
+        key += '|' + QString::number(info.lastModified().toTime_t()) + '|' + QString::number(info.size());
+    }
+    return key;
+}
+
+void PreviewManager::request(NoteContent *content, const KUrl &url, int size, int iconSize)
+{
+    forget(content);
+
+    QString key = keyFor(url, size, iconSize);
+    if (QPixmap *preview = m_cache.object(key)) {
+        content->setPreview(*preview);
+        return;
+    }
+
+    if (m_waiting.contains(key)) {
+        m_waiting[key].append(content);
+        return;
+    }
+
+    Request request;
+    request.content  = content;
+    request.url      = url;
+    request.key      = key;
+    request.size     = size;
+    request.iconSize = iconSize;
+    m_pending.append(request);
+    // Wait for the other notes being loaded to request their previews too:
+    if (!m_startTimer.isActive())
+        m_startTimer.start(0);
+}
+
+void PreviewManager::forget(NoteContent *content)
+{
+    for (int i = m_pending.count() - 1; i >= 0; --i)
+        if (m_pending[i].content == content)
+            m_pending.removeAt(i);
+    for (QHash<QString, QList<NoteContent*> >::iterator it = m_waiting.begin(); it != m_waiting.end(); ++it)
+        it.value().removeAll(content);
+}
+
+void PreviewManager::startJobs()
+{
+    while (m_jobs.count() < MAX_JOBS && !m_pending.isEmpty()) {
+        QList<bool> onScreen;
+        int first = -1;
+        for (int i = 0; i < m_pending.count(); ++i) {
+            onScreen.append(m_pending[i].content->isOnScreen());
+            if (first < 0 && onScreen.last())
+                first = i;
+        }
+        if (first < 0)
+            first = 0;
+
+        // The job is for the basket (and preview size) of the first note on screen, or of the oldest request.
+        // Take the requests of the notes on screen of that basket first, then the other ones:
+        BasketScene *basket = m_pending[first].content->basket();
+        int size            = m_pending[first].size;
+        int iconSize        = m_pending[first].iconSize;
+        QList<int> taken;
+        QHash<QString, QString> keys; // URL -> key
+        KUrl::List urls;
+        for (int pass = 0; pass < 2; ++pass) {
+            for (int i = 0; i < m_pending.count() && urls.count() < MAX_ITEMS_PER_JOB; ++i) {
+                const Request &request = m_pending[i];
+                if (onScreen[i] != (pass == 0) || request.content->basket() != basket ||
+                        request.size != size || request.iconSize != iconSize)
+                    continue;
+                taken.append(i);
+                m_waiting[request.key].append(request.content);
+                if (!keys.contains(request.url.url())) {
+                    keys.insert(request.url.url(), request.key);
+                    urls.append(request.url);
+                }
+            }
+        }
+        qSort(taken);
+        for (int i = taken.count() - 1; i >= 0; --i)
+            m_pending.removeAt(taken[i]);
+
+        KIO::PreviewJob *job = KIO::filePreview(urls, size, size, iconSize);
+        connect(job, SIGNAL(gotPreview(const KFileItem&, const QPixmap&)), this, SLOT(gotPreview(const KFileItem&, const QPixmap&)));
+        connect(job, SIGNAL(failed(const KFileItem&)),                     this, SLOT(previewFailed(const KFileItem&)));
+        connect(job, SIGNAL(result(KJob*)),                                this, SLOT(jobFinished(KJob*)));
+        m_jobs.insert(job, keys);
+    }
+}
+
+void PreviewManager::deliver(const QString &key, const QPixmap &preview, bool cacheIt)
+{
+    if (cacheIt)
+        m_cache.insert(key, new QPixmap(preview), qMax(1, preview.width() * preview.height() * 4 / 1024));
+    QList<NoteContent*> contents = m_waiting.take(key);
+    foreach (NoteContent *content, contents)
+        content->setPreview(preview);
+}
+
+void PreviewManager::gotPreview(const KFileItem &item, const QPixmap &preview)
+{
+    KJob *job = static_cast<KJob*>(sender());
+    QString key = m_jobs[job].take(item.url().url());
+    if (!key.isEmpty())
+        deliver(key, preview, /*cacheIt=*/true);
+}
+
+void PreviewManager::previewFailed(const KFileItem &item)
+{
+    gotPreview(item, QPixmap());
+}
+
+void PreviewManager::jobFinished(KJob *job)
+{
+    // URLs for which the job did not tell anything (eg. it was killed) will be requested again next time:
+    QHash<QString, QString> keys = m_jobs.take(job);
+    foreach (const QString &key, keys)
+        deliver(key, QPixmap(), /*cacheIt=*/false);
+    startJobs();
+}
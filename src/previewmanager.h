@@ -0,0 +1,93 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by BasKet Note Pads developers                     *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+
+#ifndef PREVIEWMANAGER_H
+#define PREVIEWMANAGER_H
+
+#include <QtCore/QObject>
+#include <QtCore/QCache>
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QTimer>
+#include <QtGui/QPixmap>
+
+#include <KDE/KUrl>
+
+class KFileItem;
+class KJob;
+
+class NoteContent;
+
+/** Fetch the previews of file and link notes, and keep them in a cache shared by all notes.
+  * BASIC FUNCTIONNING:
+  *   Contents call request() instead of starting their own KIO::filePreview() job.
+  *   Requests are queued and, on the next event loop iteration, grouped in jobs of at most MAX_ITEMS_PER_JOB URLs
+  *   of the same basket, with at most MAX_JOBS jobs running at the same time.
+  *   The notes on screen are put in the first jobs, so opening a basket with hundreds of files shows the visible previews first.
+  *   Requests for a URL that is already being fetched just wait for it.
+  *   Previews (and failures) are kept in a LRU cache keyed by URL, modification time, file size and preview size:
+  *   asking again for a preview (eg. when the link look or the font change) does not start any job,
+  *   and a modified file gets a new preview. The result is given to the content with NoteContent::setPreview().
+  */
+class PreviewManager : public QObject
+{
+    Q_OBJECT
+public:
+    static PreviewManager* instance();
+
+    /// Get the preview of @p url, @p size pixels big, for @p content.
+    /// If it is cached, @p content is given it right away, otherwise the previous request of @p content is replaced by this one.
+    void request(NoteContent *content, const KUrl &url, int size, int iconSize);
+    /// Forget the requests of @p content (eg. because it is deleted).
+    void forget(NoteContent *content);
+
+private:
+    PreviewManager();
+    ~PreviewManager();
+
+    static QString keyFor(const KUrl &url, int size, int iconSize);
+    void deliver(const QString &key, const QPixmap &preview, bool cacheIt);
+
+    static const int MAX_JOBS          = 2;
+    static const int MAX_ITEMS_PER_JOB = 32;
+    static const int CACHE_SIZE        = 16 * 1024; /// << In kilobytes
+
+    struct Request {
+        NoteContent *content;
+        KUrl         url;
+        QString      key;
+        int          size;
+        int          iconSize;
+    };
+
+    QList<Request>                       m_pending;
+    QHash<QString, QList<NoteContent*> > m_waiting; /// << Contents waiting for a preview being fetched, by key
+    QHash<KJob*, QHash<QString, QString> > m_jobs;  /// << Keys of the URLs fetched by every running job
+    QCache<QString, QPixmap>             m_cache;
+    QTimer                               m_startTimer;
+
+private slots:
+    void startJobs();
+    void gotPreview(const KFileItem &item, const QPixmap &preview);
+    void previewFailed(const KFileItem &item);
+    void jobFinished(KJob *job);
+};
+
+#endif // PREVIEWMANAGER_H
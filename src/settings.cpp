@@ -56,6 +56,7 @@ bool    Settings::s_bigNotes             = false;
 bool    Settings::s_autoBullet           = true;
 bool    Settings::s_exportTextTags       = true;
 bool    Settings::s_useGnuPGAgent        = false;
+bool    Settings::s_compactEncryption    = false;
 bool    Settings::s_treeOnLeft           = true;
 bool    Settings::s_filterOnTop          = false;
 int     Settings::s_defImageX            = 300;
@@ -67,6 +68,7 @@ int     Settings::s_viewTextFileContent  = false;
 int     Settings::s_viewHtmlFileContent  = false;
 int     Settings::s_viewImageFileContent = false;
 int     Settings::s_viewSoundFileContent = false;
+bool    Settings::s_compactPastedHtml    = true;
 // Applications:
 bool    Settings::s_htmlUseProg          = false; // TODO: RENAME: s_*App (with KService!)
 bool    Settings::s_imageUseProg         = true;
@@ -92,6 +94,7 @@ int     Settings::s_basketTreeWidth      = -1;
 bool    Settings::s_welcomeBasketsAdded  = false;
 QString Settings::s_dataFolder           = "";
 QDate   Settings::s_lastBackup           = QDate();
+QString Settings::s_backupRepository     = "";
 QPoint  Settings::s_mainWindowPosition   = QPoint();
 QSize   Settings::s_mainWindowSize       = QSize();
 bool    Settings::s_showEmptyBasketInfo  = true;
@@ -130,6 +133,7 @@ void Settings::loadConfig()
     setAutoBullet(config.readEntry("autoBullet",           true));
     setExportTextTags(config.readEntry("exportTextTags",       true));
     setUseGnuPGAgent(config.readEntry("useGnuPGAgent",        false));
+    setCompactEncryption(config.readEntry("compactEncryption",    false));
     setBlinkedFilter(config.readEntry("blinkedFilter",        false));
     setEnableReLockTimeout(config.readEntry("enableReLockTimeout",  true));
     setReLockTimeoutMinutes(config.readEntry("reLockTimeoutMinutes", 0));
@@ -148,6 +152,7 @@ void Settings::loadConfig()
     setWelcomeBasketsAdded(config.readEntry("welcomeBasketsAdded",  false));
     setDataFolder(config.readEntry("dataFolder",           ""));
     setLastBackup(config.readEntry("lastBackup", QDate()));
+    setBackupRepository(config.readPathEntry("backupRepository", ""));
     setMainWindowPosition(config.readEntry("position", QPoint()));
     setMainWindowSize(config.readEntry("size",     QSize()));
 
@@ -170,6 +175,7 @@ void Settings::loadConfig()
     setViewHtmlFileContent(config.readEntry("viewHtmlFileContent",  false));
     setViewImageFileContent(config.readEntry("viewImageFileContent", true));
     setViewSoundFileContent(config.readEntry("viewSoundFileContent", true));
+    setCompactPastedHtml(config.readEntry("compactPastedHtml",    true));
 
     config = Global::config()->group("Insert Note Default Values");
     setDefImageX(config.readEntry("defImageX",   300));
@@ -216,6 +222,7 @@ void Settings::saveConfig()
 #ifdef HAVE_LIBGPGME
     if (KGpgMe::isGnuPGAgentAvailable())
         config.writeEntry("useGnuPGAgent",    useGnuPGAgent());
+    config.writeEntry("compactEncryption",    compactEncryption());
 #endif
     config.writeEntry("blinkedFilter",        blinkedFilter());
     config.writeEntry("enableReLockTimeout",  enableReLockTimeout());
@@ -235,6 +242,7 @@ void Settings::saveConfig()
     config.writeEntry("welcomeBasketsAdded",  welcomeBasketsAdded());
     config.writePathEntry("dataFolder",        dataFolder());
     config.writeEntry("lastBackup",           QDate(lastBackup()));
+    config.writePathEntry("backupRepository",  backupRepository());
     config.writeEntry("position",             mainWindowPosition());
     config.writeEntry("size",                 mainWindowSize());
 
@@ -257,6 +265,7 @@ void Settings::saveConfig()
     config.writeEntry("viewHtmlFileContent",  viewHtmlFileContent());
     config.writeEntry("viewImageFileContent", viewImageFileContent());
     config.writeEntry("viewSoundFileContent", viewSoundFileContent());
+    config.writeEntry("compactPastedHtml",    compactPastedHtml());
 
     config = Global::config()->group("Insert Note Default Values");
     config.writeEntry("defImageX",         defImageX());
@@ -638,6 +647,14 @@ BasketsPage::BasketsPage(QWidget * parent, const char * name)
     protectionLayout->addWidget(m_useGnuPGAgent);
 //  hLay->addWidget(m_useGnuPGAgent);
     connect(m_useGnuPGAgent, SIGNAL(stateChanged(int)), this, SLOT(changed()));
+
+    m_compactEncryption = new QCheckBox(i18n("Store protected baskets in a &compact format"), protectionBox);
+    protectionLayout->addWidget(m_compactEncryption);
+    m_compactEncryption->setWhatsThis(i18n("<p>Encrypted files are then stored as binary data instead of text: "
+                                           "they are about a third smaller, and faster to read and write.</p>"
+                                           "<p>Baskets stored in this format cannot be opened by older versions of %1.</p>",
+                                           KGlobal::mainComponent().aboutData()->programName()));
+    connect(m_compactEncryption, SIGNAL(stateChanged(int)), this, SLOT(changed()));
 #endif
 
     layout->insertStretch(-1);
@@ -670,6 +687,7 @@ void BasketsPage::load()
         m_useGnuPGAgent->setChecked(false);
         m_useGnuPGAgent->setEnabled(false);
     }
+    m_compactEncryption->setChecked(Settings::compactEncryption());
 #endif
 }
 
@@ -690,6 +708,7 @@ void BasketsPage::save()
     Settings::setReLockTimeoutMinutes(m_reLockTimeoutMinutes->value());
 #ifdef HAVE_LIBGPGME
     Settings::setUseGnuPGAgent(m_useGnuPGAgent->isChecked());
+    Settings::setCompactEncryption(m_compactEncryption->isChecked());
 #endif
 }
 
@@ -784,6 +803,15 @@ NewNotesPage::NewNotesPage(QWidget * parent, const char * name)
     connect(m_viewImageFileContent, SIGNAL(stateChanged(int)), this, SLOT(changed()));
     connect(m_viewSoundFileContent, SIGNAL(stateChanged(int)), this, SLOT(changed()));
 
+    // Pasted Rich Text:
+
+    m_compactPastedHtml = new QCheckBox(i18n("&Simplify the formatting of pasted rich text"), this);
+    m_compactPastedHtml->setWhatsThis(i18n("<p>Web browsers and office suites put many styles in the rich text they copy, "
+                                           "and most of them are not displayed by notes. Remove them, so the notes are smaller and faster to display. "
+                                           "The notes look the same.</p>"));
+    layout->addWidget(m_compactPastedHtml);
+    connect(m_compactPastedHtml, SIGNAL(stateChanged(int)), this, SLOT(changed()));
+
     layout->insertStretch(-1);
     load();
 }
@@ -799,6 +827,8 @@ void NewNotesPage::load()
     m_viewHtmlFileContent->setChecked(Settings::viewHtmlFileContent());
     m_viewImageFileContent->setChecked(Settings::viewImageFileContent());
     m_viewSoundFileContent->setChecked(Settings::viewSoundFileContent());
+
+    m_compactPastedHtml->setChecked(Settings::compactPastedHtml());
 }
 
 void NewNotesPage::save()
@@ -812,6 +842,8 @@ void NewNotesPage::save()
     Settings::setViewHtmlFileContent(m_viewHtmlFileContent->isChecked());
     Settings::setViewImageFileContent(m_viewImageFileContent->isChecked());
     Settings::setViewSoundFileContent(m_viewSoundFileContent->isChecked());
+
+    Settings::setCompactPastedHtml(m_compactPastedHtml->isChecked());
 }
 
 void NewNotesPage::defaults()
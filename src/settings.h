@@ -97,6 +97,7 @@ private:
 
     // Protection
     QCheckBox           *m_useGnuPGAgent;
+    QCheckBox           *m_compactEncryption;
     QCheckBox           *m_enableReLockTimeoutMinutes;
     KIntNumInput        *m_reLockTimeoutMinutes;
 };
@@ -126,6 +127,7 @@ private:
     QCheckBox           *m_viewHtmlFileContent;
     QCheckBox           *m_viewImageFileContent;
     QCheckBox           *m_viewSoundFileContent;
+    QCheckBox           *m_compactPastedHtml;
 };
 
 class BASKET_EXPORT NotesAppearancePage : public KCModule
@@ -186,6 +188,7 @@ protected:
     static bool    s_autoBullet;
     static bool    s_exportTextTags;
     static bool    s_useGnuPGAgent;
+    static bool    s_compactEncryption;
     static bool    s_usePassivePopup;
     static int     s_middleAction;         // O:Nothing ; 1:Paste ; 2:Text ; 3:Html ; 4:Image ; 5:Link ; 6:Launcher ; 7:Color
     static bool    s_groupOnInsertionLine;
@@ -194,6 +197,7 @@ protected:
     static bool    s_welcomeBasketsAdded;
     static QString s_dataFolder;
     static QDate   s_lastBackup;
+    static QString s_backupRepository;
     static QPoint  s_mainWindowPosition;
     static QSize   s_mainWindowSize;
     static bool    s_showEmptyBasketInfo;
@@ -206,6 +210,7 @@ protected:
     static int     s_viewHtmlFileContent;
     static int     s_viewImageFileContent;
     static int     s_viewSoundFileContent;
+    static bool    s_compactPastedHtml;
     /** System tray Icon */
     static bool    s_useSystray;
     static bool    s_showIconInSystray;
@@ -256,6 +261,9 @@ public:  /* And the following methods are just getter / setters */
     static inline bool    useGnuPGAgent()        {
         return s_useGnuPGAgent;
     }
+    static inline bool    compactEncryption()    {
+        return s_compactEncryption;
+    }
     static inline bool    blinkedFilter()        {
         return s_blinkedFilter;
     }
@@ -313,6 +321,9 @@ public:  /* And the following methods are just getter / setters */
     static inline QDate   lastBackup()           {
         return s_lastBackup;
     }
+    static inline QString backupRepository()     { // The snapshots of the incremental backups are listed by BackupRepository::snapshots()
+        return s_backupRepository;
+    }
     static inline QPoint  mainWindowPosition()   {
         return s_mainWindowPosition;
     }
@@ -373,6 +384,9 @@ public:  /* And the following methods are just getter / setters */
     static inline int     viewSoundFileContent() {
         return s_viewSoundFileContent;
     }
+    static inline bool    compactPastedHtml()    {
+        return s_compactPastedHtml;
+    }
 
     /** App settings SET */
     static void setTreeOnLeft(bool onLeft) {
@@ -420,6 +434,9 @@ public:  /* And the following methods are just getter / setters */
     static inline void setUseGnuPGAgent(bool yes)               {
         s_useGnuPGAgent        = yes;
     }
+    static inline void setCompactEncryption(bool yes)           {
+        s_compactEncryption    = yes;
+    }
     static inline void setPlayAnimations(bool play)             {
         s_playAnimations       = play;
     }
@@ -471,6 +488,9 @@ public:  /* And the following methods are just getter / setters */
     static inline void setLastBackup(const QDate &date)         {
         s_lastBackup           = date;
     }
+    static inline void setBackupRepository(const QString &path) {
+        s_backupRepository     = path;
+    }
     static inline void setMainWindowPosition(const QPoint &pos) {
         s_mainWindowPosition   = pos;
     }
@@ -531,6 +551,9 @@ public:  /* And the following methods are just getter / setters */
     static inline void setViewSoundFileContent(bool view)       {
         s_viewSoundFileContent = view;
     }
+    static inline void setCompactPastedHtml(bool compact)       {
+        s_compactPastedHtml    = compact;
+    }
 public:
     /* Save and load config */
     static void loadConfig();
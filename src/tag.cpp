@@ -455,6 +455,12 @@ void Tag::saveTags()
 }
 
 void Tag::saveTagsTo(QList<Tag*> &list, const QString &fullPath)
+{
+    if (!BasketScene::safelySaveToFile(fullPath, tagsToXml(list)))
+        DEBUG_WIN << "<font color=red>FAILED to save tags</font>!";
+}
+
+QString Tag::tagsToXml(QList<Tag*> &list)
 {
     // Create Document:
     QDomDocument document(/*doctype=*/"basketTags");
@@ -504,9 +510,7 @@ void Tag::saveTagsTo(QList<Tag*> &list, const QString &fullPath)
         }
     }
 
-    // Write to Disk:
-    if (!BasketScene::safelySaveToFile(fullPath, "<?xml version=\"1.0\" encoding=\"UTF-8\" ?>\n" + document.toString()))
-        DEBUG_WIN << "<font color=red>FAILED to save tags</font>!";
+    return "<?xml version=\"1.0\" encoding=\"UTF-8\" ?>\n" + document.toString();
 }
 
 void Tag::copyTo(Tag *other)
@@ -182,6 +182,7 @@ public:
     static QMap<QString, QString> loadTags(const QString &path = QString()/*, bool merge = false*/); /// << Load the tags contained in the XML file @p path or those in the application settings if @p path isEmpty(). If @p merge is true and a tag with the id of a tag that should be loaded already exist, the tag will get a new id. Otherwise, the tag will be dismissed.
     static void saveTags();
     static void saveTagsTo(QList<Tag*> &list, const QString &fullPath);
+    static QString tagsToXml(QList<Tag*> &list); /// << @Return the XML document saved by saveTagsTo()
     static void createDefaultTagsSet(const QString &file);
     static long getNextStateUid();
 private:
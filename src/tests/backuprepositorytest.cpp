@@ -0,0 +1,195 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by BasKet Note Pads developers                     *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+
+#include <QObject>
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtTest/QtTest>
+#include <qtest_kde.h>
+
+#include <KDE/KTempDir>
+
+#include <utime.h>
+
+#include "backuprepository.h"
+
+class BackupRepositoryTest: public QObject
+{
+Q_OBJECT
+private Q_SLOTS:
+    void init();
+    void cleanup();
+    void testBackupAndRestore();
+    void testUnchangedFilesAreNotRead();
+    void testRestoreOlderSnapshot();
+    void testSameSizeInSameSecond();
+    void testCorruptedChunk();
+private:
+    static void writeFile(const QString &path, const QByteArray &content);
+    static void setModificationTime(const QString &path, uint time);
+    static QByteArray readFile(const QString &path);
+    KTempDir *m_dir;
+    QString   m_data;
+    QString   m_repository;
+};
+
+QTEST_KDEMAIN(BackupRepositoryTest, NoGUI)
+
+void BackupRepositoryTest::init()
+{
+    m_dir = new KTempDir();
+    m_data       = m_dir->name() + "baskets/";
+    m_repository = m_dir->name() + "repository/";
+    QDir().mkpath(m_data + "baskets/basket1/");
+    QDir().mkpath(m_data + "baskets/empty/");
+    writeFile(m_data + "baskets/basket1/.basket", "<basket/>");
+    writeFile(m_data + "baskets/basket1/note1.html", "<html>Note</html>");
+    writeFile(m_data + "baskets/basket1/big.png", QByteArray(BackupRepository::CHUNK_SIZE * 2 + 5, 'p'));
+    writeFile(m_data + "tags.xml", "<basketTags/>");
+
+    // Files modified during the second a snapshot starts are always read again: make them older.
+    uint anHourAgo = QDateTime::currentDateTime().toTime_t() - 3600;
+    setModificationTime(m_data + "baskets/basket1/.basket", anHourAgo);
+    setModificationTime(m_data + "baskets/basket1/note1.html", anHourAgo);
+    setModificationTime(m_data + "baskets/basket1/big.png", anHourAgo);
+    setModificationTime(m_data + "tags.xml", anHourAgo);
+}
+
+void BackupRepositoryTest::cleanup()
+{
+    delete m_dir;
+}
+
+void BackupRepositoryTest::writeFile(const QString &path, const QByteArray &content)
+{
+    QFile file(path);
+    QVERIFY(file.open(QIODevice::WriteOnly));
+    file.write(content);
+}
+
+void BackupRepositoryTest::setModificationTime(const QString &path, uint time)
+{
+    struct utimbuf times;
+    times.actime  = time;
+    times.modtime = time;
+    QCOMPARE(utime(QFile::encodeName(path), &times), 0);
+}
+
+QByteArray BackupRepositoryTest::readFile(const QString &path)
+{
+    QFile file(path);
+    file.open(QIODevice::ReadOnly);
+    return file.readAll();
+}
+
+void BackupRepositoryTest::testBackupAndRestore()
+{
+    BackupRepository repository(m_repository);
+    QString snapshot;
+    QVERIFY(repository.backup(m_data, &snapshot));
+    QCOMPARE(repository.snapshots(), QStringList(snapshot));
+    QVERIFY(BackupRepository::snapshotDate(snapshot).isValid());
+    QCOMPARE(repository.scannedFiles(), 4);
+
+    QString restored = m_dir->name() + "restored/";
+    QVERIFY(repository.restore(snapshot, restored));
+    QCOMPARE(readFile(restored + "baskets/basket1/.basket"), QByteArray("<basket/>")); // Hidden files are backed up too
+    QCOMPARE(readFile(restored + "baskets/basket1/note1.html"), QByteArray("<html>Note</html>"));
+    QCOMPARE(readFile(restored + "baskets/basket1/big.png"), readFile(m_data + "baskets/basket1/big.png"));
+    QCOMPARE(readFile(restored + "tags.xml"), QByteArray("<basketTags/>"));
+    QVERIFY(QDir(restored + "baskets/empty/").exists());
+}
+
+void BackupRepositoryTest::testUnchangedFilesAreNotRead()
+{
+    BackupRepository repository(m_repository);
+    QVERIFY(repository.backup(m_data));
+    QCOMPARE(repository.readFiles(), 4);
+
+    uint anHourAgo = QDateTime::currentDateTime().toTime_t() - 3600;
+    writeFile(m_data + "baskets/basket1/note2.html", "<html>New note</html>");
+    setModificationTime(m_data + "baskets/basket1/note2.html", anHourAgo);
+    QVERIFY(repository.backup(m_data));
+    QCOMPARE(repository.scannedFiles(), 5);
+    QCOMPARE(repository.readFiles(), 1);
+    QCOMPARE(repository.snapshots().count(), 2);
+
+    // The same content is not stored twice:
+    writeFile(m_data + "baskets/basket1/copy.png", readFile(m_data + "baskets/basket1/big.png"));
+    setModificationTime(m_data + "baskets/basket1/copy.png", anHourAgo);
+    QVERIFY(repository.backup(m_data));
+    QCOMPARE(repository.readFiles(), 1);
+    QCOMPARE(repository.storedBytes(), qint64(0));
+}
+
+void BackupRepositoryTest::testRestoreOlderSnapshot()
+{
+    BackupRepository repository(m_repository);
+    QString first;
+    QVERIFY(repository.backup(m_data, &first));
+    writeFile(m_data + "baskets/basket1/note1.html", "<html>Modified note, with another size</html>");
+    QVERIFY(repository.backup(m_data));
+
+    QString restored = m_dir->name() + "restored/";
+    QVERIFY(repository.restore(first, restored));
+    QCOMPARE(readFile(restored + "baskets/basket1/note1.html"), QByteArray("<html>Note</html>"));
+}
+
+void BackupRepositoryTest::testSameSizeInSameSecond()
+{
+    // A note saved again, with the same size, during the second the previous snapshot scanned it, has the same modification time.
+    // A time after the start of the snapshot is used to not depend on the clock:
+    uint time = QDateTime::currentDateTime().toTime_t() + 3600;
+    setModificationTime(m_data + "baskets/basket1/note1.html", time);
+    BackupRepository repository(m_repository);
+    QVERIFY(repository.backup(m_data));
+
+    writeFile(m_data + "baskets/basket1/note1.html", "<html>Etoh</html>");
+    setModificationTime(m_data + "baskets/basket1/note1.html", time);
+    QString second;
+    QVERIFY(repository.backup(m_data, &second));
+    QCOMPARE(repository.readFiles(), 1);
+
+    QString restored = m_dir->name() + "restored/";
+    QVERIFY(repository.restore(second, restored));
+    QCOMPARE(readFile(restored + "baskets/basket1/note1.html"), QByteArray("<html>Etoh</html>"));
+}
+
+void BackupRepositoryTest::testCorruptedChunk()
+{
+    BackupRepository repository(m_repository);
+    QString snapshot;
+    QVERIFY(repository.backup(m_data, &snapshot));
+
+    // Replace every chunk by another valid one:
+    QDir chunks(m_repository + "chunks/");
+    QStringList folders = chunks.entryList(QDir::Dirs | QDir::NoDotAndDotDot);
+    for (QStringList::iterator it = folders.begin(); it != folders.end(); ++it) {
+        QStringList files = QDir(chunks.filePath(*it)).entryList(QDir::Files);
+        for (QStringList::iterator file = files.begin(); file != files.end(); ++file)
+            writeFile(chunks.filePath(*it) + "/" + *file, qCompress(QByteArray("altered")));
+    }
+
+    QVERIFY(!repository.restore(snapshot, m_dir->name() + "restored/"));
+    QVERIFY(!repository.errorString().isEmpty());
+}
+
+#include "backuprepositorytest.moc"
+/* vim: set et sts=4 sw=4 ts=8 tw=0 : */
@@ -0,0 +1,129 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by BasKet Note Pads developers                     *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+
+#include <QObject>
+#include <QtTest/QtTest>
+#include <qtest_kde.h>
+
+#include "basketcipher.h"
+
+class BasketCipherTest: public QObject
+{
+Q_OBJECT
+private Q_SLOTS:
+    void initTestCase();
+    void testRoundTrip_data();
+    void testRoundTrip();
+    void testRandomInitializationVector();
+    void testAlteredCipherText();
+    void testWrongKey();
+    void testInvalidKey();
+};
+
+QTEST_KDEMAIN(BasketCipherTest, NoGUI)
+
+void BasketCipherTest::initTestCase()
+{
+    BasketCipher cipher; // Initialize QCA
+    if (!BasketCipher::isSupported())
+        QSKIP("AES-256 or HMAC-SHA256 is not available", SkipAll);
+}
+
+void BasketCipherTest::testRoundTrip_data()
+{
+    QTest::addColumn<QByteArray>("plainText");
+
+    QTest::newRow("empty")      << QByteArray();
+    QTest::newRow("one block")  << QByteArray("0123456789abcdef");
+    QTest::newRow("text")       << QByteArray("<html><head></head><body>A protected note</body></html>");
+    QTest::newRow("binary")     << QByteArray("\0\1\2\3\xff\xfe", 6);
+    QTest::newRow("large")      << QByteArray(1024 * 1024 + 3, 'x');
+}
+
+void BasketCipherTest::testRoundTrip()
+{
+    QFETCH(QByteArray, plainText);
+
+    BasketCipher cipher;
+    cipher.setKey(BasketCipher::generateKey());
+    QVERIFY(cipher.hasKey());
+
+    QByteArray cipherText = cipher.encrypt(plainText);
+    QVERIFY(BasketCipher::isCipherText(cipherText));
+    QVERIFY(!cipherText.contains(plainText) || plainText.isEmpty());
+
+    QByteArray decrypted;
+    QVERIFY(cipher.decrypt(cipherText, &decrypted));
+    QCOMPARE(decrypted, plainText);
+}
+
+void BasketCipherTest::testRandomInitializationVector()
+{
+    BasketCipher cipher;
+    cipher.setKey(BasketCipher::generateKey());
+    QVERIFY(cipher.encrypt("same text") != cipher.encrypt("same text"));
+    QVERIFY(BasketCipher::generateKey() != BasketCipher::generateKey());
+}
+
+void BasketCipherTest::testAlteredCipherText()
+{
+    BasketCipher cipher;
+    cipher.setKey(BasketCipher::generateKey());
+    QByteArray cipherText = cipher.encrypt("Some secret note content");
+    QByteArray decrypted;
+
+    for (int i = 4; i < cipherText.size(); ++i) { // Everything after the magic is authenticated
+        QByteArray altered = cipherText;
+        altered[i] = altered[i] ^ 0x01;
+        QVERIFY(!cipher.decrypt(altered, &decrypted));
+    }
+    QVERIFY(!cipher.decrypt(cipherText.left(cipherText.size() - 1), &decrypted));
+    QVERIFY(!cipher.decrypt(cipherText.left(10), &decrypted));
+    QVERIFY(!cipher.decrypt("-----BEGIN PGP MESSAGE-----", &decrypted));
+}
+
+void BasketCipherTest::testWrongKey()
+{
+    BasketCipher cipher;
+    cipher.setKey(BasketCipher::generateKey());
+    QByteArray cipherText = cipher.encrypt("Some secret note content");
+
+    BasketCipher other;
+    other.setKey(BasketCipher::generateKey());
+    QByteArray decrypted;
+    QVERIFY(!other.decrypt(cipherText, &decrypted));
+
+    other.clear();
+    QVERIFY(!other.hasKey());
+    QVERIFY(!other.decrypt(cipherText, &decrypted));
+    QVERIFY(other.encrypt("text").isEmpty());
+}
+
+void BasketCipherTest::testInvalidKey()
+{
+    BasketCipher cipher;
+    cipher.setKey("too short");
+    QVERIFY(!cipher.hasKey());
+    cipher.setKey(BasketCipher::generateKey() + "x");
+    QVERIFY(!cipher.hasKey());
+}
+
+#include "basketciphertest.moc"
+/* vim: set et sts=4 sw=4 ts=8 tw=0 : */
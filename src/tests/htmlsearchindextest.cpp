@@ -0,0 +1,141 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by BasKet Note Pads developers                     *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+
+#include <QObject>
+#include <QtScript/QScriptEngine>
+#include <QtTest/QtTest>
+#include <qtest_kde.h>
+
+#include "htmlsearchindex.h"
+#include "tools.h"
+
+class HTMLSearchIndexTest: public QObject
+{
+Q_OBJECT
+private Q_SLOTS:
+    void testTerms();
+    void testQueryTerms_data();
+    void testQueryTerms();
+    void testDocumentsXml();
+    void testJavaScript();
+    void testJsonString();
+private:
+    static HTMLSearchIndex::Document document(const QString &anchor, const QString &text, const QStringList &tags = QStringList());
+};
+
+QTEST_KDEMAIN(HTMLSearchIndexTest, NoGUI)
+
+HTMLSearchIndex::Document HTMLSearchIndexTest::document(const QString &anchor, const QString &text, const QStringList &tags)
+{
+    HTMLSearchIndex::Document document;
+    document.anchor = anchor;
+    document.text   = text;
+    document.tags   = tags;
+    return document;
+}
+
+void HTMLSearchIndexTest::testTerms()
+{
+    QCOMPARE(HTMLSearchIndex::terms(""), QStringList());
+    QCOMPARE(HTMLSearchIndex::terms("Hello, hello WORLD!"), QStringList() << "hello" << "world");
+    QCOMPARE(HTMLSearchIndex::terms("a b2 c-d ef"), QStringList() << "b2" << "ef");
+    QCOMPARE(HTMLSearchIndex::terms(QString::fromUtf8("Élève\nécole")), QStringList() << QString::fromUtf8("élève") << QString::fromUtf8("école"));
+}
+
+void HTMLSearchIndexTest::testQueryTerms_data()
+{
+    QTest::addColumn<QString>("query");
+    QTest::newRow("ascii")       << "Hello, WORLD!";
+    QTest::newRow("short words") << "a b2 c-d ef";
+    QTest::newRow("accents")     << QString::fromUtf8("Élève\nécole");
+    QTest::newRow("apostrophe")  << QString::fromUtf8("l’école");
+    QTest::newRow("en dash")     << QString::fromUtf8("a–b longer");
+    QTest::newRow("guillemets")  << QString::fromUtf8("«mot»");
+}
+
+/** The search page must split a query like the notes were split when indexing them, or it would not find their text.
+  */
+void HTMLSearchIndexTest::testQueryTerms()
+{
+    QFETCH(QString, query);
+    QScriptEngine engine;
+    engine.evaluate(HTMLSearchIndex::queryTermsFunction());
+    QScriptValue result = engine.evaluate("queryTerms(" + Tools::jsonString(query) + ").join(\"\\n\")");
+    QVERIFY(!engine.hasUncaughtException());
+    QCOMPARE(result.toString().split('\n', QString::SkipEmptyParts), HTMLSearchIndex::terms(query));
+}
+
+void HTMLSearchIndexTest::testDocumentsXml()
+{
+    HTMLSearchIndex::DocumentList documents;
+    documents << document("note1", "First <note> & \"text\"\nsecond line", QStringList() << "To Do: Done" << "Important")
+              << document("note2", "");
+    HTMLSearchIndex::DocumentList read = HTMLSearchIndex::documentsFromXml(HTMLSearchIndex::documentsToXml(documents));
+    QCOMPARE(read.count(), 2);
+    QCOMPARE(read[0].anchor, QString("note1"));
+    QCOMPARE(read[0].text, documents[0].text);
+    QCOMPARE(read[0].tags, documents[0].tags);
+    QCOMPARE(read[1].anchor, QString("note2"));
+    QCOMPARE(read[1].text, QString());
+    QCOMPARE(read[1].tags, QStringList());
+
+    QVERIFY(HTMLSearchIndex::documentsFromXml("not xml").isEmpty());
+}
+
+void HTMLSearchIndexTest::testJavaScript()
+{
+    HTMLSearchIndex index;
+    HTMLSearchIndex::DocumentList first;
+    first << document("note1", "apple banana") << document("note2", "banana", QStringList() << "Fruit");
+    index.addBasket("Food", "../../food.html", first);
+    HTMLSearchIndex::DocumentList second;
+    for (int i = 0; i < 40; ++i)
+        second << document("note" + QString::number(i + 1), i == 39 ? "apple" : "other");
+    index.addBasket("Food / More", "../baskets/basket2.html", second);
+    QCOMPARE(index.notesCount(), 42);
+
+    QString js = QString::fromUtf8(index.toJavaScript());
+    QVERIFY(js.startsWith("var basketSearchIndex = {"));
+    QVERIFY(js.contains("[\"Food / More\",\"../baskets/basket2.html\"]"));
+    QVERIFY(js.contains("[1,\"note2\",\"banana\",\"Fruit\"]"));
+    QVERIFY(js.contains("[0,\"note1\",\"apple banana\",\"\"]"));
+    // Words are sorted, and postings are deltas in base 36 (apple: notes 0 and 41, "0,15"):
+    int words    = js.indexOf("\"words\":[");
+    int postings = js.indexOf("\"postings\":[");
+    QVERIFY(words > 0 && postings > words);
+    QString wordList = js.mid(words, postings - words);
+    QVERIFY(wordList.indexOf("\"apple\"") < wordList.indexOf("\"banana\""));
+    QVERIFY(wordList.indexOf("\"banana\"") < wordList.indexOf("\"fruit\""));
+    QVERIFY(wordList.indexOf("\"fruit\"") < wordList.indexOf("\"other\""));
+    QString postingList = js.mid(postings);
+    QVERIFY(postingList.contains("\"0,15\",\n\"0,1\",\n\"1\",\n\"2,1,"));
+}
+
+void HTMLSearchIndexTest::testJsonString()
+{
+    QCOMPARE(Tools::jsonString(""), QString("\"\""));
+    QCOMPARE(Tools::jsonString("a \"b\" \\ c"), QString("\"a \\\"b\\\" \\\\ c\""));
+    QCOMPARE(Tools::jsonString("line\nnext\ttab\r"), QString("\"line\\nnext\\ttab\\r\""));
+    QCOMPARE(Tools::jsonString(QString(QChar(0x01)) + QChar(0x2028)), QString("\"\\u0001\\u2028\""));
+    QCOMPARE(Tools::jsonString(QString::fromUtf8("école")), QString::fromUtf8("\"école\""));
+}
+
+#include "htmlsearchindextest.moc"
+/* vim: set et sts=4 sw=4 ts=8 tw=0 : */
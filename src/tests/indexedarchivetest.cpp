@@ -0,0 +1,177 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by BasKet Note Pads developers                     *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+
+#include <QObject>
+#include <QtCore/QFile>
+#include <QtTest/QtTest>
+#include <qtest_kde.h>
+
+#include <KDE/KTar>
+#include <KDE/KTempDir>
+
+#include "indexedarchive.h"
+#include "parallelgzipdevice.h"
+
+class IndexedArchiveTest: public QObject
+{
+Q_OBJECT
+private Q_SLOTS:
+    void initTestCase();
+    void testParts();
+    void testReadFile();
+    void testReadFileBackwards();
+    void testExtractPart();
+    void testArchiveWithoutIndex();
+private:
+    static void addPart(ParallelGzipDevice &compressor, IndexedArchive::PartList &parts, const QString &name);
+    static QByteArray largeData();
+    KTempDir m_dir;
+    QString  m_path;
+};
+
+QTEST_KDEMAIN(IndexedArchiveTest, NoGUI)
+
+void IndexedArchiveTest::addPart(ParallelGzipDevice &compressor, IndexedArchive::PartList &parts, const QString &name)
+{
+    compressor.addRestartPoint();
+    IndexedArchive::Part part;
+    part.name   = name;
+    part.offset = compressor.pos();
+    parts.append(part);
+}
+
+/** @Return several MB of data that do not compress too much, for the inflation to add checkpoints.
+  */
+QByteArray IndexedArchiveTest::largeData()
+{
+    QByteArray data;
+    for (int i = 0; i < 512 * 1024; ++i)
+        data += QByteArray::number((i * 7919) % 65521).rightJustified(8, ' ');
+    return data;
+}
+
+/** Write an archive like Archive::save() does, with two baskets and the metadata part.
+  */
+void IndexedArchiveTest::initTestCase()
+{
+    m_path = m_dir.name() + "test.baskets";
+    QFile file(m_path);
+    QVERIFY(file.open(QIODevice::WriteOnly));
+    file.write("BasKetNP:archive\nversion:0.6.1\npreview*:4\nPNG!");
+    file.write("archive*:");
+    qint64 sizePosition = file.pos();
+    file.write("00000000000000000000\n");
+    qint64 archiveStart = file.pos();
+
+    IndexedArchive::PartList parts;
+    ParallelGzipDevice compressor(&file, 6, 2);
+    KTar tar(&compressor);
+    QVERIFY(tar.open(QIODevice::WriteOnly));
+    tar.writeDir("baskets", "", "");
+    addPart(compressor, parts, "basket1/");
+    tar.writeFile("baskets/basket1/.basket", "", "", "<basket>1</basket>", 18);
+    QByteArray big(3 * ParallelGzipDevice::BLOCK_SIZE, 'x');
+    tar.writeFile("baskets/basket1/big.txt", "", "", big.constData(), big.size());
+    addPart(compressor, parts, "basket2/");
+    tar.writeFile("baskets/basket2/.basket", "", "", "<basket>2</basket>", 18);
+    tar.writeFile("baskets/basket2/note1.html", "", "", "<html>Note</html>", 17);
+    QByteArray large = largeData();
+    tar.writeFile("baskets/basket2/large.txt", "", "", large.constData(), large.size());
+    tar.writeFile("baskets/basket2/note2.html", "", "", "<html>Last</html>", 17);
+    addPart(compressor, parts, "metadata");
+    tar.writeFile("baskets/baskets.xml", "", "", "<basketTree/>", 13);
+    tar.close();
+
+    qint64 archiveSize = file.pos() - archiveStart;
+    QByteArray index = IndexedArchive::createIndex(parts, compressor.restartPoints());
+    file.write("index*:" + QByteArray::number(index.size()) + "\n");
+    file.write(index);
+    file.seek(sizePosition);
+    file.write(QByteArray::number(archiveSize).rightJustified(20, '0'));
+    file.close();
+}
+
+void IndexedArchiveTest::testParts()
+{
+    IndexedArchive archive(m_path);
+    QVERIFY(archive.open());
+    QVERIFY(archive.hasIndex());
+    QCOMPARE(archive.parts(), QStringList() << "basket1/" << "basket2/" << "metadata");
+}
+
+void IndexedArchiveTest::testReadFile()
+{
+    IndexedArchive archive(m_path);
+    QVERIFY(archive.open());
+    QCOMPARE(archive.readFile("metadata", "baskets/baskets.xml"), QByteArray("<basketTree/>"));
+    QCOMPARE(archive.readFile("basket2/", "baskets/basket2/note1.html"), QByteArray("<html>Note</html>"));
+    QCOMPARE(archive.readFile("basket1/", "baskets/basket1/.basket"), QByteArray("<basket>1</basket>"));
+    QCOMPARE(archive.readFile("basket1/", "baskets/basket1/big.txt").size(), 3 * ParallelGzipDevice::BLOCK_SIZE);
+    // Files of other parts are not read:
+    QVERIFY(archive.readFile("basket2/", "baskets/basket1/.basket").isEmpty());
+    QVERIFY(archive.readFile("unknown", "baskets/baskets.xml").isEmpty());
+}
+
+void IndexedArchiveTest::testReadFileBackwards()
+{
+    IndexedArchive archive(m_path);
+    QVERIFY(archive.open());
+    // Read the files after the large one first, then go back: the part is inflated again from a checkpoint.
+    QCOMPARE(archive.readFile("basket2/", "baskets/basket2/note2.html"), QByteArray("<html>Last</html>"));
+    QCOMPARE(archive.readFile("basket2/", "baskets/basket2/large.txt"), largeData());
+    QCOMPARE(archive.readFile("basket2/", "baskets/basket2/note1.html"), QByteArray("<html>Note</html>"));
+    QCOMPARE(archive.readFile("basket2/", "baskets/basket2/note2.html"), QByteArray("<html>Last</html>"));
+    // Reading another part then coming back uses the part kept open:
+    QCOMPARE(archive.readFile("metadata", "baskets/baskets.xml"), QByteArray("<basketTree/>"));
+    QCOMPARE(archive.readFile("basket2/", "baskets/basket2/.basket"), QByteArray("<basket>2</basket>"));
+}
+
+void IndexedArchiveTest::testExtractPart()
+{
+    IndexedArchive archive(m_path);
+    QVERIFY(archive.open());
+    QString destination = m_dir.name() + "extraction/";
+    QVERIFY(archive.extractPart("basket2/", destination));
+    QVERIFY(QFile::exists(destination + "baskets/basket2/.basket"));
+    QVERIFY(QFile::exists(destination + "baskets/basket2/note1.html"));
+    QFile large(destination + "baskets/basket2/large.txt");
+    QVERIFY(large.open(QIODevice::ReadOnly));
+    QCOMPARE(large.readAll(), largeData());
+    QVERIFY(!QFile::exists(destination + "baskets/basket1/.basket"));
+}
+
+void IndexedArchiveTest::testArchiveWithoutIndex()
+{
+    QString path = m_dir.name() + "old.baskets";
+    QFile file(path);
+    QVERIFY(file.open(QIODevice::WriteOnly));
+    file.write("BasKetNP:archive\nversion:0.6.1\narchive*:0\n");
+    file.close();
+
+    IndexedArchive archive(path);
+    QVERIFY(archive.open());
+    QVERIFY(!archive.hasIndex());
+
+    IndexedArchive notAnArchive(m_dir.name() + "missing.baskets");
+    QVERIFY(!notAnArchive.open());
+}
+
+#include "indexedarchivetest.moc"
+/* vim: set et sts=4 sw=4 ts=8 tw=0 : */
@@ -0,0 +1,149 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by BasKet Note Pads developers                     *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+
+#include <QObject>
+#include <QtCore/QBuffer>
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtTest/QtTest>
+#include <qtest_kde.h>
+
+#include <KDE/KTempDir>
+
+#include "jsonlinesexporter.h"
+
+class JsonLinesExporterTest: public QObject
+{
+Q_OBJECT
+private Q_SLOTS:
+    void initTestCase();
+    void testRecords();
+    void testMissingBasketTree();
+private:
+    static void writeFile(const QString &path, const QByteArray &content);
+    QStringList exportLines();
+    KTempDir m_dir;
+};
+
+QTEST_KDEMAIN(JsonLinesExporterTest, NoGUI)
+
+void JsonLinesExporterTest::writeFile(const QString &path, const QByteArray &content)
+{
+    QFile file(path);
+    QVERIFY(file.open(QIODevice::WriteOnly));
+    file.write(content);
+}
+
+QStringList JsonLinesExporterTest::exportLines()
+{
+    QBuffer buffer;
+    buffer.open(QIODevice::WriteOnly);
+    JsonLinesExporter exporter(m_dir.name());
+    bool success = exporter.exportTo(&buffer);
+    if (!success)
+        return QStringList();
+    QString output = QString::fromUtf8(buffer.data());
+    return output.split('\n', QString::SkipEmptyParts);
+}
+
+/** A data folder with a basket in columns, a free sub-basket, and a basket encrypted with a data key.
+  */
+void JsonLinesExporterTest::initTestCase()
+{
+    QString baskets = m_dir.name() + "baskets/";
+    QDir().mkpath(baskets + "basket1/");
+    QDir().mkpath(baskets + "basket2/");
+    QDir().mkpath(baskets + "locked/");
+    writeFile(baskets + "baskets.xml",
+              "<basketTree>"
+              "<basket folderName=\"basket1/\"><properties><name>Parent</name><icon>knotes</icon></properties>"
+              "<basket folderName=\"basket2/\"><properties><name>Child</name></properties></basket>"
+              "</basket>"
+              "<basket folderName=\"locked/\"><properties><name>Secret</name></properties></basket>"
+              "</basketTree>");
+    writeFile(m_dir.name() + "tags.xml",
+              "<basketTags>"
+              "<tag><name>To Do</name><state id=\"todo_unchecked\"><name>Unchecked</name></state><state id=\"todo_done\"><name>Done</name></state></tag>"
+              "<tag><name>Important</name><state id=\"important\"><name></name></state></tag>"
+              "</basketTags>");
+    writeFile(baskets + "basket1/.basket",
+              "<basket><properties><icon>knotes</icon><disposition free=\"false\" columnCount=\"1\"/></properties><notes>"
+              "<group width=\"300\">"
+              "<note type=\"html\" added=\"2010-01-02T03:04:05\" lastModification=\"2010-01-03T00:00:00\">"
+              "<content>note1.html</content><tags>todo_done;important</tags></note>"
+              "<note type=\"link\"><content title=\"KDE\" autoTitle=\"false\">http://kde.org/</content></note>"
+              "</group>"
+              "</notes></basket>");
+    writeFile(baskets + "basket1/note1.html", "<html><body><p>Hello &amp; \"world\"</p></body></html>");
+    writeFile(baskets + "basket2/.basket",
+              "<basket><properties><disposition free=\"true\"/></properties><notes>"
+              "<note type=\"color\" x=\"10\" y=\"20\"><content>#ff0000</content></note>"
+              "</notes></basket>");
+    writeFile(baskets + "locked/.basket", QByteArray("BKC1") + QByteArray(64, 'x'));
+}
+
+void JsonLinesExporterTest::testRecords()
+{
+    QStringList lines = exportLines();
+    QCOMPARE(lines.count(), 7); // 3 baskets, 1 column and 3 notes
+
+    // Tree order: basket1, its notes, basket2 and its note, then the locked basket:
+    QVERIFY(lines[0].startsWith("{\"record\":\"basket\",\"folderName\":\"basket1/\",\"parentFolderName\":null,\"path\":[\"Parent\"]"));
+    QVERIFY(lines[0].contains("\"layout\":\"columns\""));
+    QVERIFY(lines[0].contains("\"encrypted\":false"));
+
+    QVERIFY(lines[1].startsWith("{\"record\":\"group\",\"id\":\"basket1/1\",\"parent\":null"));
+    QVERIFY(lines[1].contains("\"geometry\":{\"width\":300}"));
+    QVERIFY(lines[1].contains("\"type\":\"column\""));
+
+    QVERIFY(lines[2].startsWith("{\"record\":\"note\",\"id\":\"basket1/2\",\"parent\":\"basket1/1\",\"basket\":\"basket1/\",\"basketPath\":[\"Parent\"]"));
+    QVERIFY(lines[2].contains("\"type\":\"html\""));
+    QVERIFY(lines[2].contains("\"added\":\"2010-01-02T03:04:05\""));
+    QVERIFY(lines[2].contains("\"tags\":[{\"id\":\"todo_done\",\"name\":\"To Do: Done\"},{\"id\":\"important\",\"name\":\"Important\"}]"));
+    QVERIFY(lines[2].contains("\"text\":\"Hello & \\\"world\\\""));
+    QVERIFY(lines[2].contains("\"attachment\":\"" + m_dir.name() + "baskets/basket1/note1.html\""));
+
+    QVERIFY(lines[3].contains("\"type\":\"link\""));
+    QVERIFY(lines[3].contains("\"text\":\"KDE <http://kde.org/>\""));
+    QVERIFY(lines[3].contains("\"url\":\"http://kde.org/\""));
+    QVERIFY(lines[3].contains("\"attachment\":null"));
+
+    QVERIFY(lines[4].contains("\"folderName\":\"basket2/\",\"parentFolderName\":\"basket1/\",\"path\":[\"Parent\",\"Child\"]"));
+    QVERIFY(lines[4].contains("\"layout\":\"free\""));
+    QVERIFY(lines[5].contains("\"basketPath\":[\"Parent\",\"Child\"],\"geometry\":{\"x\":10,\"y\":20}"));
+    QVERIFY(lines[5].contains("\"text\":\"#ff0000\""));
+
+    QVERIFY(lines[6].contains("\"folderName\":\"locked/\""));
+    QVERIFY(lines[6].contains("\"encrypted\":true"));
+}
+
+void JsonLinesExporterTest::testMissingBasketTree()
+{
+    KTempDir empty;
+    QBuffer buffer;
+    buffer.open(QIODevice::WriteOnly);
+    JsonLinesExporter exporter(empty.name());
+    QVERIFY(!exporter.exportTo(&buffer));
+    QVERIFY(!exporter.errorString().isEmpty());
+    QCOMPARE(buffer.size(), qint64(0));
+}
+
+#include "jsonlinesexportertest.moc"
+/* vim: set et sts=4 sw=4 ts=8 tw=0 : */
@@ -0,0 +1,196 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by BasKet Note Pads developers                     *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+
+#include <QObject>
+#include <QtCore/QBuffer>
+#include <QtTest/QtTest>
+#include <qtest_kde.h>
+
+#include <KDE/KFilterDev>
+
+#include <zlib.h>
+
+#include "parallelgzipdevice.h"
+
+/** A buffer that cannot store more than a few bytes, like a full disk.
+  */
+class FullBuffer : public QBuffer
+{
+public:
+    explicit FullBuffer(qint64 capacity) : m_capacity(capacity) {}
+protected:
+    qint64 writeData(const char *data, qint64 size)
+    {
+        if (pos() + size > m_capacity) {
+            setErrorString("No space left on device");
+            return -1;
+        }
+        return QBuffer::writeData(data, size);
+    }
+private:
+    qint64 m_capacity;
+};
+
+class ParallelGzipDeviceTest: public QObject
+{
+Q_OBJECT
+private Q_SLOTS:
+    void testRoundTrip_data();
+    void testRoundTrip();
+    void testSmallWrites();
+    void testWriteFailure();
+private:
+    static QByteArray compress(const QByteArray &data, int level, int threads, int writeSize);
+    static QByteArray uncompress(const QByteArray &compressed);
+    static bool inflate(const QByteArray &compressed, QByteArray *data);
+};
+
+QTEST_KDEMAIN(ParallelGzipDeviceTest, NoGUI)
+
+QByteArray ParallelGzipDeviceTest::compress(const QByteArray &data, int level, int threads, int writeSize)
+{
+    QByteArray compressed;
+    QBuffer buffer(&compressed);
+    ParallelGzipDevice device(&buffer, level, threads);
+    if (!device.open(QIODevice::WriteOnly))
+        return QByteArray();
+    for (int i = 0; i < data.size(); i += writeSize)
+        device.write(data.constData() + i, qMin(writeSize, data.size() - i));
+    device.close();
+    return compressed;
+}
+
+/** Read back with KFilterDev, like KTar does in Archive::open() and RestoreThread.
+  */
+QByteArray ParallelGzipDeviceTest::uncompress(const QByteArray &compressed)
+{
+    QBuffer buffer;
+    buffer.setData(compressed);
+    QIODevice *device = KFilterDev::device(&buffer, "application/x-gzip", /*autoDeleteInDevice=*/false);
+    device->open(QIODevice::ReadOnly);
+    QByteArray data = device->readAll();
+    device->close();
+    delete device;
+    return data;
+}
+
+/** Read back with zlib, that checks the gzip trailer (the CRC combined from the blocks, and the size), contrary to KFilterDev.
+  * @return false if the stream is corrupted or incomplete.
+  */
+bool ParallelGzipDeviceTest::inflate(const QByteArray &compressed, QByteArray *data)
+{
+    z_stream stream;
+    stream.zalloc = Z_NULL;
+    stream.zfree  = Z_NULL;
+    stream.opaque = Z_NULL;
+    stream.next_in  = (Bytef*)compressed.constData();
+    stream.avail_in = compressed.size();
+    if (inflateInit2(&stream, 16 + MAX_WBITS) != Z_OK) // Gzip format only
+        return false;
+
+    data->clear();
+    char buffer[64 * 1024];
+    int result;
+    do {
+        stream.next_out  = (Bytef*)buffer;
+        stream.avail_out = sizeof(buffer);
+        result = ::inflate(&stream, Z_NO_FLUSH);
+        data->append(buffer, sizeof(buffer) - stream.avail_out);
+    } while (result == Z_OK);
+    inflateEnd(&stream);
+    return result == Z_STREAM_END && stream.avail_in == 0;
+}
+
+void ParallelGzipDeviceTest::testRoundTrip_data()
+{
+    QTest::addColumn<QByteArray>("data");
+    QTest::addColumn<int>("level");
+    QTest::addColumn<int>("threads");
+
+    QByteArray text;
+    for (int i = 0; text.size() < 3 * ParallelGzipDevice::BLOCK_SIZE + 17; ++i)
+        text += "<note type=\"html\">Note number " + QByteArray::number(i) + "</note>\n";
+    QByteArray noise(2 * ParallelGzipDevice::BLOCK_SIZE, '\0');
+    qsrand(42);
+    for (int i = 0; i < noise.size(); ++i)
+        noise[i] = (char)(qrand() & 0xFF);
+
+    QTest::newRow("empty")              << QByteArray()                                      << 6 << 4;
+    QTest::newRow("small")              << QByteArray("<basket/>")                           << 6 << 4;
+    QTest::newRow("exactly one block")  << QByteArray(ParallelGzipDevice::BLOCK_SIZE, 'b') << 6 << 4;
+    QTest::newRow("text")               << text                                              << 6 << 4;
+    QTest::newRow("text, fastest")      << text                                              << 1 << 4;
+    QTest::newRow("text, smallest")     << text                                              << 9 << 4;
+    QTest::newRow("text, one thread")   << text                                              << 6 << 1;
+    QTest::newRow("incompressible")     << noise                                             << 6 << 3;
+}
+
+void ParallelGzipDeviceTest::testRoundTrip()
+{
+    QFETCH(QByteArray, data);
+    QFETCH(int, level);
+    QFETCH(int, threads);
+
+    QByteArray compressed = compress(data, level, threads, 64 * 1024 + 1);
+    QVERIFY(!compressed.isEmpty());
+    QCOMPARE(uncompress(compressed), data);
+    QByteArray inflated;
+    QVERIFY(inflate(compressed, &inflated));
+    QCOMPARE(inflated, data);
+}
+
+void ParallelGzipDeviceTest::testSmallWrites()
+{
+    QByteArray data;
+    for (int i = 0; data.size() < 2 * ParallelGzipDevice::BLOCK_SIZE; ++i)
+        data += QByteArray::number(i) + ' ';
+
+    // KTar writes headers of 512 bytes, and file contents in smaller chunks:
+    QByteArray compressed = compress(data, ParallelGzipDevice::DEFAULT_LEVEL, 2, 100);
+    QCOMPARE(uncompress(compressed), data);
+    QByteArray inflated;
+    QVERIFY(inflate(compressed, &inflated));
+    QCOMPARE(inflated, data);
+    QVERIFY(compressed.size() < data.size() / 2);
+
+    // A corrupted trailer is detected:
+    compressed[compressed.size() - 5] = compressed[compressed.size() - 5] ^ 1;
+    QVERIFY(!inflate(compressed, &inflated));
+}
+
+void ParallelGzipDeviceTest::testWriteFailure()
+{
+    QByteArray data(4 * ParallelGzipDevice::BLOCK_SIZE, '\0');
+    qsrand(7);
+    for (int i = 0; i < data.size(); ++i)
+        data[i] = (char)(qrand() & 0xFF);
+
+    FullBuffer buffer(ParallelGzipDevice::BLOCK_SIZE);
+    ParallelGzipDevice device(&buffer, ParallelGzipDevice::DEFAULT_LEVEL, 2);
+    QVERIFY(device.open(QIODevice::WriteOnly));
+    QVERIFY(!device.hasFailed());
+    device.write(data);
+    device.close();
+    QVERIFY(device.hasFailed());
+    QCOMPARE(device.errorString(), QString("No space left on device"));
+}
+
+#include "parallelgzipdevicetest.moc"
+/* vim: set et sts=4 sw=4 ts=8 tw=0 : */
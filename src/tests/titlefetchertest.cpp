@@ -0,0 +1,218 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by BasKet Note Pads developers                     *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+
+#include <QObject>
+#include <QtNetwork/QNetworkAccessManager>
+#include <QtNetwork/QTcpServer>
+#include <QtNetwork/QTcpSocket>
+#include <QtTest/QtTest>
+#include <qtest_kde.h>
+
+#include <KDE/KTempDir>
+
+#include "titlefetcher.h"
+
+/** A minimal HTTP server standing in for web sites: it answers every request with the same page.
+  * If @p keepOpen is true, the connection is never closed by the server, so the page never ends.
+  */
+class HttpStandIn : public QTcpServer
+{
+Q_OBJECT
+public:
+    HttpStandIn(const QByteArray &page, bool keepOpen)
+        : requests(0), m_page(page), m_keepOpen(keepOpen)
+    {
+        connect(this, SIGNAL(newConnection()), this, SLOT(acceptConnection()));
+        listen(QHostAddress::LocalHost);
+    }
+    KUrl url(const QString &path) const
+    {
+        return KUrl(QString("http://127.0.0.1:%1%2").arg(serverPort()).arg(path));
+    }
+    int requests;
+private slots:
+    void acceptConnection()
+    {
+        while (QTcpSocket *socket = nextPendingConnection())
+            connect(socket, SIGNAL(readyRead()), this, SLOT(answer()));
+    }
+    void answer()
+    {
+        QTcpSocket *socket = static_cast<QTcpSocket*>(sender());
+        QByteArray request = socket->property("request").toByteArray() + socket->readAll();
+        socket->setProperty("request", request);
+        if (!request.contains("\r\n\r\n"))
+            return;
+        ++requests;
+        socket->write("HTTP/1.0 200 OK\r\nContent-Type: text/html; charset=UTF-8\r\n\r\n" + m_page);
+        if (!m_keepOpen)
+            socket->disconnectFromHost();
+    }
+private:
+    QByteArray m_page;
+    bool       m_keepOpen;
+};
+
+/** Stands in for a link note, called back by the fetcher with the title of its URL only.
+  */
+class TitleReceiver : public QObject
+{
+Q_OBJECT
+public:
+    QList<KUrl> urls;
+protected slots:
+    void titleFetched(const KUrl &url, const QString &/*title*/)
+    {
+        urls.append(url);
+    }
+};
+
+class TitleFetcherTest: public QObject
+{
+Q_OBJECT
+private Q_SLOTS:
+    void initTestCase();
+    void testFetchTitle();
+    void testSameUrlIsFetchedOnce();
+    void testAbortAfterTitle();
+    void testConcurrencyLimit();
+    void testPersistentCache();
+    void testReceivers();
+private:
+    static void waitForSignals(QSignalSpy &spy, int count);
+    KTempDir m_tempDir;
+};
+
+QTEST_KDEMAIN(TitleFetcherTest, GUI)
+
+void TitleFetcherTest::waitForSignals(QSignalSpy &spy, int count)
+{
+    for (int i = 0; i < 50 && spy.count() < count; ++i)
+        QTest::qWait(100);
+}
+
+void TitleFetcherTest::initTestCase()
+{
+    qRegisterMetaType<KUrl>("KUrl");
+}
+
+void TitleFetcherTest::testFetchTitle()
+{
+    HttpStandIn server("<html><head><title>  Test page </title></head><body>Hello</body></html>", /*keepOpen=*/false);
+    TitleFetcher fetcher(m_tempDir.name() + "fetch", new QNetworkAccessManager(this));
+    QSignalSpy spy(&fetcher, SIGNAL(titleFetched(const KUrl&, const QString&)));
+
+    fetcher.fetch(server.url("/page.html"));
+    waitForSignals(spy, 1);
+    QCOMPARE(spy.count(), 1);
+    QCOMPARE(spy.at(0).at(0).value<KUrl>(), server.url("/page.html"));
+    QCOMPARE(spy.at(0).at(1).toString(), QString("Test page"));
+}
+
+void TitleFetcherTest::testSameUrlIsFetchedOnce()
+{
+    HttpStandIn server("<html><head><title>Shared</title></head></html>", /*keepOpen=*/false);
+    TitleFetcher fetcher(m_tempDir.name() + "dedupe", new QNetworkAccessManager(this));
+    QSignalSpy spy(&fetcher, SIGNAL(titleFetched(const KUrl&, const QString&)));
+
+    fetcher.fetch(server.url("/"));
+    fetcher.fetch(server.url("/"));
+    waitForSignals(spy, 1);
+    QTest::qWait(200);
+    QCOMPARE(spy.count(), 1);
+    QCOMPARE(server.requests, 1);
+}
+
+void TitleFetcherTest::testAbortAfterTitle()
+{
+    // The server never ends the page: the title must be reported as soon as it has been read
+    HttpStandIn server("<html><head><title>Endless</title></head><body>" + QByteArray(1000, 'x'), /*keepOpen=*/true);
+    TitleFetcher fetcher(m_tempDir.name() + "abort", new QNetworkAccessManager(this));
+    QSignalSpy spy(&fetcher, SIGNAL(titleFetched(const KUrl&, const QString&)));
+
+    fetcher.fetch(server.url("/endless"));
+    waitForSignals(spy, 1);
+    QCOMPARE(spy.count(), 1);
+    QCOMPARE(spy.at(0).at(1).toString(), QString("Endless"));
+    QCOMPARE(fetcher.runningRequests(), 0);
+}
+
+void TitleFetcherTest::testConcurrencyLimit()
+{
+    // Pages without title that never end: the requests stay running
+    HttpStandIn server("<html><head>", /*keepOpen=*/true);
+    TitleFetcher fetcher(m_tempDir.name() + "limit", new QNetworkAccessManager(this));
+
+    for (int i = 0; i < 3 * TitleFetcher::MAX_REQUESTS; ++i)
+        fetcher.fetch(server.url(QString("/page%1").arg(i)));
+    QTest::qWait(500);
+    QCOMPARE(fetcher.runningRequests(), (int)TitleFetcher::MAX_REQUESTS);
+    QCOMPARE(server.requests, (int)TitleFetcher::MAX_REQUESTS);
+}
+
+void TitleFetcherTest::testPersistentCache()
+{
+    HttpStandIn server("<html><head><title>Cached</title></head></html>", /*keepOpen=*/false);
+    QString cacheFile = m_tempDir.name() + "cache";
+    {
+        TitleFetcher fetcher(cacheFile, new QNetworkAccessManager(this));
+        QSignalSpy spy(&fetcher, SIGNAL(titleFetched(const KUrl&, const QString&)));
+        fetcher.fetch(server.url("/cached"));
+        waitForSignals(spy, 1);
+        QCOMPARE(spy.count(), 1);
+    } // Saves the cache
+
+    TitleFetcher fetcher(cacheFile, new QNetworkAccessManager(this));
+    QSignalSpy spy(&fetcher, SIGNAL(titleFetched(const KUrl&, const QString&)));
+    fetcher.fetch(server.url("/cached"));
+    QCOMPARE(spy.count(), 0); // Not emitted while the caller is still busy
+    waitForSignals(spy, 1);
+    QCOMPARE(spy.count(), 1);
+    QCOMPARE(spy.at(0).at(1).toString(), QString("Cached"));
+    QCOMPARE(server.requests, 1);
+}
+
+void TitleFetcherTest::testReceivers()
+{
+    HttpStandIn server("<html><head><title>Page</title></head></html>", /*keepOpen=*/false);
+    TitleFetcher fetcher(m_tempDir.name() + "receivers", new QNetworkAccessManager(this));
+    QSignalSpy spy(&fetcher, SIGNAL(titleFetched(const KUrl&, const QString&)));
+
+    TitleReceiver first;
+    TitleReceiver second;
+    TitleReceiver *deletedPointer = new TitleReceiver;
+    fetcher.fetch(server.url("/first"), &first);
+    fetcher.fetch(server.url("/second"), &second);
+    fetcher.fetch(server.url("/second"), deletedPointer);
+    delete deletedPointer; // Like a note deleted before its title arrived
+    waitForSignals(spy, 2);
+    QCOMPARE(spy.count(), 2);
+    QCOMPARE(first.urls, QList<KUrl>() << server.url("/first"));
+    QCOMPARE(second.urls, QList<KUrl>() << server.url("/second"));
+
+    // Titles from the cache are only given to their receiver too:
+    fetcher.fetch(server.url("/first"), &second);
+    waitForSignals(spy, 3);
+    QCOMPARE(first.urls.count(), 1);
+    QCOMPARE(second.urls, QList<KUrl>() << server.url("/second") << server.url("/first"));
+}
+
+#include "titlefetchertest.moc"
+/* vim: set et sts=4 sw=4 ts=8 tw=0 : */
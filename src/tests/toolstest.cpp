@@ -0,0 +1,306 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by BasKet Note Pads developers                     *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+
+#include <QObject>
+#include <QtCore/QRegExp>
+#include <QtGui/QFont>
+#include <QtGui/QTextDocument>
+#include <QtTest/QtTest>
+#include <qtest_kde.h>
+
+#include "tools.h"
+
+/** Check that the linear text conversions of Tools give exactly the same result as their previous implementations,
+  * that are kept here as references.
+  */
+class ToolsTest: public QObject
+{
+Q_OBJECT
+private Q_SLOTS:
+    void testHtmlToText_data();
+    void testHtmlToText();
+    void testTagURLs_data();
+    void testTagURLs();
+    void testEscapeNonAscii_data();
+    void testEscapeNonAscii();
+    void testCompactHtml_data();
+    void testCompactHtml();
+    void testCompactHtmlKeepsTheNoteFont();
+};
+
+QTEST_KDEMAIN(ToolsTest, GUI)
+
+static QString referenceHtmlToText(const QString &html)
+{
+    QString text = Tools::htmlToParagraph(html);
+    text.remove("\n");
+    text.replace("</h1>", "\n");
+    text.replace("</h2>", "\n");
+    text.replace("</h3>", "\n");
+    text.replace("</h4>", "\n");
+    text.replace("</h5>", "\n");
+    text.replace("</h6>", "\n");
+    text.replace("</li>", "\n");
+    text.replace("</dt>", "\n");
+    text.replace("</dd>", "\n");
+    text.replace("<dd>",  "   ");
+    text.replace("</div>", "\n");
+    text.replace("</blockquote>", "\n");
+    text.replace("</caption>", "\n");
+    text.replace("</tr>", "\n");
+    text.replace("</th>", "  ");
+    text.replace("</td>", "  ");
+    text.replace("<br>",  "\n");
+    text.replace("<br />", "\n");
+
+    int pos = 0;
+    int pos2;
+    QString tag, tag3;
+    int deep = 0;
+    QList<bool> ul;
+    QList<int>  lines;
+    while ((pos = text.indexOf("<"), pos) != -1) {
+        tag  = text.mid(pos + 1, 2);
+        tag3 = text.mid(pos + 1, 3);
+        if (tag == "ul") {
+            deep++;
+            ul.push_back(true);
+            lines.push_back(-1);
+        } else if (tag == "ol") {
+            deep++;
+            ul.push_back(false);
+            lines.push_back(0);
+        } else if (tag3 == "/ul" || tag3 == "/ol") {
+            deep--;
+            ul.pop_back();
+            lines.pop_back();
+        }
+        pos2 = text.indexOf(">");
+        if (pos2 != -1) {
+            text.remove(pos, pos2 - pos + 1);
+            if (tag == "li") {
+                QString spaces = "";
+                for (int i = 1; i < deep; i++)
+                    spaces += "  ";
+                QString bullet = "* ";
+                if (ul.back() == false) {
+                    lines.push_back(lines.back() + 1);
+                    lines.pop_back();
+                    bullet = QString::number(lines.back()) + ". ";
+                }
+                text.insert(pos, spaces + bullet);
+            }
+            if ((tag3 == "/ul" || tag3 == "/ol") && deep == 0)
+                text.insert(pos, "\n");
+        }
+        ++pos;
+    }
+
+    text.replace("&gt;",   ">");
+    text.replace("&lt;",   "<");
+    text.replace("&quot;", "\"");
+    text.replace("&nbsp;", " ");
+    text.replace("&amp;",  "&");
+
+    return text;
+}
+
+static QString referenceTagURLs(const QString &text)
+{
+    QRegExp urlEx("<!DOCTYPE[^\"]+\"([^\"]+)\"[^\"]+\"([^\"]+)/([^/]+)\\.dtd\">");
+    QString richText(text);
+    int urlPos = 0;
+    int urlLen;
+    if ((urlPos = urlEx.indexIn(richText, urlPos)) >= 0)
+        urlPos += urlEx.matchedLength();
+    else
+        urlPos = 0;
+    urlEx.setPattern("(www\\.(?!\\.)|(fish|(f|ht)tp(|s))://)[\\d\\w\\./,:_~\\?=&;#@\\-\\+\\%\\$]+[\\d\\w/]");
+    while ((urlPos = urlEx.indexIn(richText, urlPos)) >= 0) {
+        urlLen = urlEx.matchedLength();
+        if (richText.mid(urlPos - 6, 6) == "href=\"") {
+            urlPos += urlLen;
+            continue;
+        }
+        QString href = richText.mid(urlPos, urlLen);
+        if (href.contains("basket://")) {
+            urlPos += urlLen;
+            continue;
+        }
+        if ((urlPos > 0) && richText[urlPos-1].isLetterOrNumber()) {
+            urlPos++;
+            continue;
+        }
+        QString anchor = "<a href=\"" + href + "\">" + href + "</a>";
+        richText.replace(urlPos, urlLen, anchor);
+        urlPos += anchor.length();
+    }
+    return richText;
+}
+
+static QString referenceEscapeNonAscii(const QString &text)
+{
+    QString result = text;
+    QRegExp rx("([^\\x00-\\x7f])");
+    while (result.contains(rx))
+        result.replace(rx.cap().unicode()[0], QString("&#%1;").arg(rx.cap().unicode()[0].unicode()));
+    return result;
+}
+
+static const char *QT_DOCUMENT_START =
+    "<!DOCTYPE HTML PUBLIC \"-//W3C//DTD HTML 4.0//EN\" \"http://www.w3.org/TR/REC-html40/strict.dtd\">\n"
+    "<html><head><meta name=\"qrichtext\" content=\"1\" /><style type=\"text/css\">\n"
+    "p, li { white-space: pre-wrap; }\n"
+    "</style></head><body style=\" font-family:'Sans Serif'; font-size:10pt;\">\n";
+static const char *QT_DOCUMENT_END = "</body></html>";
+
+void ToolsTest::testHtmlToText_data()
+{
+    QTest::addColumn<QString>("html");
+
+    QTest::newRow("empty") << QString();
+    QTest::newRow("plain text") << QString("Hello world");
+    QTest::newRow("paragraphs") << QString("<p>First</p>\n<p>Second<br>line<br />third</p>");
+    QTest::newRow("headings") << QString("<h1>Title</h1><h2>Sub</h2><h3>a</h3><h4>b</h4><h5>c</h5><h6>d</h6>text");
+    QTest::newRow("unordered list") << QString("<ul><li>one</li><li>two</li></ul>after");
+    QTest::newRow("ordered list") << QString("<ol><li>one</li><li>two</li><li>three</li></ol>");
+    QTest::newRow("nested lists") << QString("<ul><li>a<ol><li>b</li><li>c<ul><li>d</li></ul></li></ol></li><li>e</li></ul>end");
+    QTest::newRow("definition list") << QString("<dl><dt>term</dt><dd>definition</dd></dl>");
+    QTest::newRow("table") << QString("<table><caption>Cap</caption><tr><th>A</th><th>B</th></tr><tr><td>1</td><td>2</td></tr></table>");
+    QTest::newRow("blocks") << QString("<div>div</div><blockquote>quote</blockquote><span style=\"color:#ff0000;\">red</span>");
+    QTest::newRow("entities") << QString("a &lt;b&gt; &quot;c&quot;&nbsp;d &amp; e &amp;gt; f &amp;amp;");
+    QTest::newRow("entity split by a tag") << QString("x &g<b>t; &am</b>p; y");
+    QTest::newRow("tags with attributes") << QString("<a href=\"http://kde.org/\">KDE</a> <img src=\"image.png\" /> <font color=\"blue\">blue</font>");
+    QTest::newRow("text after the last tag") << QString("<b>bold</b> 2 > 1");
+    QTest::newRow("qt document") << QString(QT_DOCUMENT_START) +
+        "<p style=\" margin-top:0px; margin-bottom:0px;\">Line 1</p>\n"
+        "<ul style=\"-qt-list-indent: 1;\"><li style=\" margin-top:12px;\">Item &amp; more</li>\n"
+        "<li style=\" margin-top:0px;\">Second</li></ul>\n"
+        "<p style=\"-qt-paragraph-type:empty;\"><br /></p>\n"
+        "<ol><li>First</li></ol></body></html>";
+    QTest::newRow("qt document without body end") << QString(QT_DOCUMENT_START) + "<p>Text</p></html>";
+
+    QString big = QString(QT_DOCUMENT_START);
+    for (int i = 0; i < 2000; ++i)
+        big += QString("<p>Paragraph %1 with <b>bold</b>, <i>italic</i> &amp; a <a href=\"http://example.com/%1\">link</a></p>\n").arg(i);
+    big += QT_DOCUMENT_END;
+    QTest::newRow("big document") << big;
+}
+
+void ToolsTest::testHtmlToText()
+{
+    QFETCH(QString, html);
+    QCOMPARE(Tools::htmlToText(html), referenceHtmlToText(html));
+}
+
+void ToolsTest::testTagURLs_data()
+{
+    QTest::addColumn<QString>("text");
+
+    QTest::newRow("empty") << QString();
+    QTest::newRow("no link") << QString("Nothing to see here.");
+    QTest::newRow("links") << QString("Go to http://kde.org/ or www.basket.kde.org, or ftp://ftp.kde.org/pub and https://a.b/c?d=e&amp;f=g#h.");
+    QTest::newRow("already a link") << QString("<a href=\"http://kde.org/\">http://kde.org/</a> then http://example.com");
+    QTest::newRow("basket link") << QString("[[basket://basket12/|Other basket]] http://kde.org");
+    QTest::newRow("preceded by a letter") << QString("xhttp://kde.org awww.kde.org 1www.kde.org (www.kde.org)");
+    QTest::newRow("doctype") << QString("<!DOCTYPE HTML PUBLIC \"-//W3C//DTD HTML 4.0//EN\" \"http://www.w3.org/TR/REC-html40/strict.dtd\">\n"
+                                        "<html><body><p>See fish://host/path</p></body></html>");
+    QTest::newRow("adjacent links") << QString("http://a.org/ http://b.org/,http://c.org/\nwww.d.org");
+}
+
+void ToolsTest::testTagURLs()
+{
+    QFETCH(QString, text);
+    QCOMPARE(Tools::tagURLs(text), referenceTagURLs(text));
+}
+
+void ToolsTest::testEscapeNonAscii_data()
+{
+    QTest::addColumn<QString>("text");
+
+    QTest::newRow("empty") << QString();
+    QTest::newRow("ascii") << QString("<p>Only ASCII &amp; tags</p>");
+    QTest::newRow("accents") << QString::fromUtf8("<p>Élève à l'école, ça ira. Ünïcödé</p>");
+    QTest::newRow("cjk") << QString::fromUtf8("<p>日本語のテキスト、中文文本。</p>");
+    QTest::newRow("surrogate pairs") << QString::fromUtf8("Emoji: \xF0\x9F\x98\x80 and \xF0\x9D\x84\x9E");
+}
+
+void ToolsTest::testEscapeNonAscii()
+{
+    QFETCH(QString, text);
+    QCOMPARE(Tools::escapeNonAscii(text), referenceEscapeNonAscii(text));
+}
+
+/** Rich text as pasted from office suites and web browsers, full of attributes and styles that QTextDocument ignores.
+  */
+static const char *PASTED_HTML_START =
+    "<html xmlns:o=\"urn:schemas-microsoft-com:office:office\"><head><meta http-equiv=\"Content-Type\" content=\"text/html; charset=utf-8\">"
+    "<style>p.MsoNormal { mso-style-parent:\"\"; margin:0cm; }</style></head><body lang=\"EN-US\" link=\"blue\" vlink=\"purple\">";
+
+void ToolsTest::testCompactHtml_data()
+{
+    QTest::addColumn<QString>("html");
+
+    QString start(PASTED_HTML_START);
+    QTest::newRow("paragraphs") << start +
+        "<p class=\"MsoNormal\" style=\"mso-margin-top-alt:auto\"><span lang=\"EN-US\" style=\"mso-bidi-font-weight:bold\">First</span></p>"
+        "<p class=\"MsoNormal\"><span lang=\"EN-US\">Second </span><span lang=\"EN-US\">paragraph</span></p></body></html>";
+    QTest::newRow("formats") << start +
+        "<div class=\"x\" id=\"y\" data-z=\"1\"><b class=\"a\">bold</b> <i class=\"b\">italic</i> "
+        "<span style=\"color:#ff0000; mso-highlight:yellow\">red</span> <a href=\"http://kde.org/\" target=\"_blank\" class=\"c\">link</a></div></body></html>";
+    QTest::newRow("lists") << start +
+        "<ul class=\"list\" style=\"mso-list:l0\"><li class=\"item\">one</li><li class=\"item\">two<ol><li class=\"item\">three</li></ol></li></ul></body></html>";
+    QTest::newRow("explicit font") << start +
+        "<p class=\"MsoNormal\"><span style=\"font-family:'Courier New'; font-size:14pt; mso-fareast-font-family:Calibri\">code</span></p></body></html>";
+}
+
+void ToolsTest::testCompactHtml()
+{
+    // The compacted HTML looks exactly the same once displayed:
+    QFETCH(QString, html);
+    QString compacted = Tools::compactHtml(html);
+    QVERIFY(compacted.length() < html.length());
+
+    QTextDocument original;
+    original.setDefaultFont(QFont("Serif", 15));
+    original.setHtml(html);
+    QTextDocument result;
+    result.setDefaultFont(QFont("Serif", 15));
+    result.setHtml(compacted);
+    QCOMPARE(result.toHtml(), original.toHtml());
+}
+
+void ToolsTest::testCompactHtmlKeepsTheNoteFont()
+{
+    // The default font of the application is not written: the note font of the basket should still apply.
+    QString compacted = Tools::compactHtml(QString(PASTED_HTML_START) + "<p class=\"MsoNormal\"><span lang=\"EN-US\">Text</span></p></body></html>");
+    QVERIFY(compacted.contains("Text"));
+    QVERIFY(compacted.contains("<body>"));
+    QVERIFY(!compacted.contains("font-family"));
+    QVERIFY(!compacted.contains("font-size"));
+    QVERIFY(!compacted.contains("-qt-block-indent"));
+
+    // But the fonts set in the pasted text are kept:
+    compacted = Tools::compactHtml(QString(PASTED_HTML_START) + "<p><span style=\"font-family:'Courier New'; mso-bidi-font-family:Arial\">code</span></p></body></html>");
+    QVERIFY(compacted.contains("Courier New"));
+}
+
+#include "toolstest.moc"
+/* vim: set et sts=4 sw=4 ts=8 tw=0 : */
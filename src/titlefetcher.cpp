@@ -0,0 +1,245 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by BasKet Note Pads developers                     *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+
+#include "titlefetcher.h"
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QDataStream>
+#include <QtCore/QFile>
+#include <QtCore/QRegExp>
+#include <QtCore/QTextCodec>
+#include <QtNetwork/QNetworkReply>
+#include <QtNetwork/QNetworkRequest>
+
+#include <KDE/KDebug>
+#include <KDE/KIO/AccessManager>
+#include <KDE/KSaveFile>
+#include <KDE/KStandardDirs>
+
+static const quint32 CACHE_MAGIC = 0x424c5431; // "BLT1"
+
+TitleFetcher* TitleFetcher::instance()
+{
+    static TitleFetcher *instance = 0;
+    if (!instance)
+        instance = new TitleFetcher(KStandardDirs::locateLocal("cache", "basket/linktitles"));
+    return instance;
+}
+
+TitleFetcher::TitleFetcher(const QString &cacheFile, QNetworkAccessManager *accessManager, QObject *parent)
+        : QObject(parent)
+        , m_cacheFile(cacheFile)
+        , m_accessManager(accessManager)
+        , m_cacheLoaded(false)
+{
+    if (!m_accessManager)
+        m_accessManager = new KIO::Integration::AccessManager(this);
+
+    m_saveTimer.setSingleShot(true);
+    m_saveTimer.setInterval(2000);
+    connect(&m_saveTimer, SIGNAL(timeout()), this, SLOT(saveCache()));
+    if (QCoreApplication::instance())
+        connect(QCoreApplication::instance(), SIGNAL(aboutToQuit()), this, SLOT(flushCache()));
+}
+
+TitleFetcher::~TitleFetcher()
+{
+    flushCache();
+}
+
+/** Write the titles fetched since the cache file was last saved, if any.
+  */
+void TitleFetcher::flushCache()
+{
+    if (m_saveTimer.isActive())
+        saveCache();
+}
+
+void TitleFetcher::fetch(const KUrl &url, QObject *receiver)
+{
+    if (url.protocol() != "http" && url.protocol() != "https")
+        return;
+
+    if (receiver) {
+        QList< QPointer<QObject> > &receivers = m_receivers[url.url()];
+        if (!receivers.contains(receiver))
+            receivers.append(receiver);
+    }
+
+    loadCache();
+    QHash<QString, CachedTitle>::const_iterator cached = m_cache.constFind(url.url());
+    if (cached != m_cache.constEnd() && cached->second.daysTo(QDateTime::currentDateTime()) < CACHE_EXPIRATION_DAYS) {
+        // Do not emit while the caller is still setting up the link:
+        if (m_ready.isEmpty())
+            QTimer::singleShot(0, this, SLOT(emitReadyTitles()));
+        m_ready.append(qMakePair(url, cached->first));
+        return;
+    }
+
+    if (m_queue.contains(url) || m_replies.values().contains(url))
+        return;
+    m_queue.append(url);
+    startRequests();
+}
+
+void TitleFetcher::emitReadyTitles()
+{
+    QList<QPair<KUrl, QString> > ready = m_ready;
+    m_ready.clear();
+    for (int i = 0; i < ready.count(); ++i)
+        deliver(ready[i].first, ready[i].second);
+}
+
+void TitleFetcher::deliver(const KUrl &url, const QString &title)
+{
+    QList< QPointer<QObject> > receivers = m_receivers.take(url.url());
+    for (int i = 0; i < receivers.count(); ++i)
+        if (receivers[i]) // Not deleted
+            QMetaObject::invokeMethod(receivers[i], "titleFetched", Q_ARG(KUrl, url), Q_ARG(QString, title));
+    emit titleFetched(url, title);
+}
+
+void TitleFetcher::startRequests()
+{
+    while (m_replies.count() < MAX_REQUESTS && !m_queue.isEmpty()) {
+        KUrl url = m_queue.takeFirst();
+        KUrl requestUrl = url;
+        //If no path or query part, default to /
+        if (requestUrl.encodedPathAndQuery(KUrl::AddTrailingSlash).isEmpty())
+            requestUrl.setPath("/");
+
+        QNetworkReply *reply = m_accessManager->get(QNetworkRequest(requestUrl));
+        m_replies.insert(reply, url);
+        m_pages.insert(reply, QByteArray());
+        connect(reply, SIGNAL(readyRead()), this, SLOT(replyReadyRead()));
+        connect(reply, SIGNAL(finished()),  this, SLOT(replyFinished()));
+    }
+}
+
+bool TitleFetcher::findTitle(const QByteArray &page, QString *title)
+{
+    int end = page.toLower().indexOf("</title>");
+    if (end < 0)
+        return false;
+
+    QTextCodec *codec = QTextCodec::codecForHtml(page, QTextCodec::codecForName("UTF-8"));
+    QString head = codec->toUnicode(page.left(end + 8));
+    // todo: this should probably strip odd html tags like &nbsp; etc
+    QRegExp reg("<title>[\\s]*(&nbsp;)?([^<]+)[\\s]*</title>", Qt::CaseInsensitive);
+    reg.setMinimal(true);
+    *title = (reg.indexIn(head) >= 0 ? reg.cap(2).trimmed() : QString());
+    return true;
+}
+
+void TitleFetcher::replyReadyRead()
+{
+    QNetworkReply *reply = static_cast<QNetworkReply*>(sender());
+    if (!m_replies.contains(reply))
+        return;
+
+    QByteArray &page = m_pages[reply];
+    page += reply->readAll();
+    QString title;
+    if (findTitle(page, &title))
+        finishRequest(reply, title, /*cacheIt=*/true);
+    else if (page.size() > MAX_BYTES)
+        finishRequest(reply, QString(), /*cacheIt=*/true);
+}
+
+void TitleFetcher::replyFinished()
+{
+    QNetworkReply *reply = static_cast<QNetworkReply*>(sender());
+    if (!m_replies.contains(reply))
+        return;
+
+    QByteArray page = m_pages.value(reply) + reply->readAll();
+    QString title;
+    findTitle(page, &title);
+    // Network errors are not cached, so the title is fetched again next time:
+    finishRequest(reply, title, /*cacheIt=*/reply->error() == QNetworkReply::NoError);
+}
+
+void TitleFetcher::finishRequest(QNetworkReply *reply, const QString &title, bool cacheIt)
+{
+    KUrl url = m_replies.take(reply);
+    m_pages.remove(reply);
+    reply->disconnect(this);
+    // Stop the download if the title was found before the end of the page:
+    if (reply->isRunning())
+        reply->abort();
+    reply->deleteLater();
+
+    if (cacheIt) {
+        m_cache.insert(url.url(), qMakePair(title, QDateTime::currentDateTime()));
+        m_saveTimer.start();
+    }
+    deliver(url, title);
+    startRequests();
+}
+
+void TitleFetcher::loadCache()
+{
+    if (m_cacheLoaded)
+        return;
+    m_cacheLoaded = true;
+
+    QFile file(m_cacheFile);
+    if (!file.open(QIODevice::ReadOnly))
+        return;
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_4_4);
+
+    quint32 magic;
+    qint32  count;
+    stream >> magic >> count;
+    if (magic != CACHE_MAGIC) {
+        kDebug() << "Ignoring the unknown link title cache" << m_cacheFile;
+        return;
+    }
+    QDateTime now = QDateTime::currentDateTime();
+    for (int i = 0; i < count && stream.status() == QDataStream::Ok; ++i) {
+        QString     url;
+        CachedTitle cached;
+        stream >> url >> cached.first >> cached.second;
+        if (stream.status() == QDataStream::Ok && cached.second.daysTo(now) < CACHE_EXPIRATION_DAYS)
+            m_cache.insert(url, cached);
+    }
+}
+
+void TitleFetcher::saveCache()
+{
+    m_saveTimer.stop();
+
+    // It is only a cache: on failure, the titles will simply be fetched again next time
+    KSaveFile file(m_cacheFile);
+    if (!file.open())
+        return;
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_4_4);
+    QDateTime now = QDateTime::currentDateTime();
+    QHash<QString, CachedTitle> kept;
+    for (QHash<QString, CachedTitle>::const_iterator it = m_cache.constBegin(); it != m_cache.constEnd(); ++it)
+        if (it->second.daysTo(now) < CACHE_EXPIRATION_DAYS)
+            kept.insert(it.key(), it.value());
+    stream << CACHE_MAGIC << (qint32)kept.count();
+    for (QHash<QString, CachedTitle>::const_iterator it = kept.constBegin(); it != kept.constEnd(); ++it)
+        stream << it.key() << it->first << it->second;
+    file.finalize();
+}
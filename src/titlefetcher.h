@@ -0,0 +1,106 @@
+/***************************************************************************
+ *   Copyright (C) 2010 by BasKet Note Pads developers                     *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+
+#ifndef TITLEFETCHER_H
+#define TITLEFETCHER_H
+
+#include <QtCore/QObject>
+#include <QtCore/QDateTime>
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QPair>
+#include <QtCore/QPointer>
+#include <QtCore/QTimer>
+
+#include <KDE/KUrl>
+
+#include "basket_export.h"
+
+class QNetworkAccessManager;
+class QNetworkReply;
+
+/** Fetch the titles of web pages, for the link notes with an automatic title.
+  * BASIC FUNCTIONNING:
+  *   fetch() queues the URL, and titleFetched() is emitted once its title is known (an empty title if there is none).
+  *   The receiver given to fetch() is also called back, alone: the many link notes of a basket are not all told every title.
+  *   At most MAX_REQUESTS pages are downloaded at the same time, whatever the number of links being pasted,
+  *   and a URL that is already queued or being downloaded is not requested again.
+  *   Pages are read until "</title>" is found, then the download is aborted (and in any case after MAX_BYTES bytes).
+  *   Titles are kept in a cache file (with the pages without title, but not with the network errors)
+  *   and are fetched again after CACHE_EXPIRATION_DAYS days. The cache file is written shortly after new titles are fetched,
+  *   and when the application quits (the instance() is never deleted).
+  *   The instance() uses KIO and the cache of the user. Tests can create their own fetcher with another cache file
+  *   and a plain QNetworkAccessManager, to run against a local server.
+  */
+class BASKET_EXPORT TitleFetcher : public QObject
+{
+    Q_OBJECT
+public:
+    static TitleFetcher* instance();
+
+    /// Use @p cacheFile, and download the pages with @p accessManager (a KIO one if 0).
+    explicit TitleFetcher(const QString &cacheFile, QNetworkAccessManager *accessManager = 0, QObject *parent = 0);
+    ~TitleFetcher();
+
+    /// Get the title of @p url: titleFetched() will be emitted (even if it is already in the cache). Only HTTP URLs are fetched.
+    /// The titleFetched(const KUrl&, const QString&) slot of @p receiver is then called too, unless it was deleted in the meantime.
+    void fetch(const KUrl &url, QObject *receiver = 0);
+    /// @Return the number of pages being downloaded.
+    int runningRequests() const {
+        return m_replies.count();
+    }
+
+    static const int MAX_REQUESTS          = 4;
+    static const int MAX_BYTES             = 10000;
+    static const int CACHE_EXPIRATION_DAYS = 30;
+
+signals:
+    void titleFetched(const KUrl &url, const QString &title);
+
+private:
+    /// A title in the cache, and when it was fetched:
+    typedef QPair<QString, QDateTime> CachedTitle;
+
+    void loadCache();
+    void startRequests();
+    void finishRequest(QNetworkReply *reply, const QString &title, bool cacheIt);
+    void deliver(const KUrl &url, const QString &title);
+    static bool findTitle(const QByteArray &page, QString *title);
+
+    QString                        m_cacheFile;
+    QNetworkAccessManager         *m_accessManager;
+    bool                           m_cacheLoaded;
+    QHash<QString, CachedTitle>    m_cache;       /// << Keyed by URL
+    QList<KUrl>                    m_queue;
+    QList<QPair<KUrl, QString> >   m_ready;       /// << Titles found in the cache, to be emitted
+    QHash<QNetworkReply*, KUrl>    m_replies;
+    QHash<QNetworkReply*, QByteArray> m_pages;    /// << What has been read of every page
+    QHash<QString, QList< QPointer<QObject> > > m_receivers; /// << Waiting for the title of a URL, keyed by URL
+    QTimer                         m_saveTimer;
+
+private slots:
+    void emitReadyTitles();
+    void replyReadyRead();
+    void replyFinished();
+    void saveCache();
+    void flushCache();
+};
+
+#endif // TITLEFETCHER_H
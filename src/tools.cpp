@@ -126,55 +126,120 @@ QString Tools::htmlToParagraph(const QString &html)
 // The following is adapted from KStringHanlder::tagURLs
 // The adaptation lies in the change to urlEx
 // Thanks to Richard Heck
+// The result is built by appending to it (instead of replacing the URLs in place), to stay linear with the number of links.
 QString Tools::tagURLs(const QString &text)
 {
     QRegExp urlEx("<!DOCTYPE[^\"]+\"([^\"]+)\"[^\"]+\"([^\"]+)/([^/]+)\\.dtd\">");
-    QString richText(text);
+    QString richText;
+    richText.reserve(text.length());
+    int copiedPos = 0; // The text before this position has already been appended to richText
     int urlPos = 0;
     int urlLen;
-    if ((urlPos = urlEx.indexIn(richText, urlPos)) >= 0)
+    if ((urlPos = urlEx.indexIn(text, urlPos)) >= 0)
         urlPos += urlEx.matchedLength();
     else
         urlPos = 0;
     urlEx.setPattern("(www\\.(?!\\.)|(fish|(f|ht)tp(|s))://)[\\d\\w\\./,:_~\\?=&;#@\\-\\+\\%\\$]+[\\d\\w/]");
-    while ((urlPos = urlEx.indexIn(richText, urlPos)) >= 0) {
+    while ((urlPos = urlEx.indexIn(text, urlPos)) >= 0) {
         urlLen = urlEx.matchedLength();
+        richText += text.midRef(copiedPos, urlPos - copiedPos);
+        copiedPos = urlPos;
 
         //if this match is already a link don't convert it.
-        if(richText.mid(urlPos - 6, 6) == "href=\"") {
+        if (richText.endsWith("href=\"")) {
             urlPos += urlLen;
             continue;
         }
 
-        QString href = richText.mid(urlPos, urlLen);
+        QString href = text.mid(urlPos, urlLen);
         //we handle basket links separately...
         if(href.contains("basket://")) {
             urlPos += urlLen;
             continue;
         }
         // Qt doesn't support (?<=pattern) so we do it here
-        if ((urlPos > 0) && richText[urlPos-1].isLetterOrNumber()) {
+        if (!richText.isEmpty() && richText[richText.length() - 1].isLetterOrNumber()) {
             urlPos++;
             continue;
         }
         // Don't use QString::arg since %01, %20, etc could be in the string
-        QString anchor = "<a href=\"" + href + "\">" + href + "</a>";
-        richText.replace(urlPos, urlLen, anchor);
-        urlPos += anchor.length();
+        richText += "<a href=\"" + href + "\">" + href + "</a>";
+        urlPos += urlLen;
+        copiedPos = urlPos;
     }
+    richText += text.midRef(copiedPos);
     return richText;
 }
 
+QString Tools::escapeNonAscii(const QString &text)
+{
+    QString result;
+    result.reserve(text.length());
+    const QChar *end = text.unicode() + text.length();
+    for (const QChar *c = text.unicode(); c != end; ++c) {
+        if (c->unicode() > 0x7f)
+            result += "&#" + QString::number(c->unicode()) + ';';
+        else
+            result += *c;
+    }
+    return result;
+}
+
+QString Tools::jsonString(const QString &text)
+{
+    QString result;
+    result.reserve(text.length() + 2);
+    result += '"';
+    const QChar *end = text.unicode() + text.length();
+    for (const QChar *c = text.unicode(); c != end; ++c) {
+        switch (c->unicode()) {
+        case '"':  result += "\\\""; break;
+        case '\\': result += "\\\\"; break;
+        case '\n': result += "\\n";  break;
+        case '\r': result += "\\r";  break;
+        case '\t': result += "\\t";  break;
+        default:
+            // Control characters, and the line separators that JavaScript does not accept in strings:
+            if (c->unicode() < 0x20 || c->unicode() == 0x2028 || c->unicode() == 0x2029)
+                result += QString("\\u%1").arg(c->unicode(), 4, 16, QChar('0'));
+            else
+                result += *c;
+        }
+    }
+    result += '"';
+    return result;
+}
+
+QString Tools::compactHtml(const QString &html)
+{
+    // The notes are displayed by QTextDocument: what it does not keep is never displayed anyway
+    QTextDocument document;
+    document.setHtml(html);
+    QString compacted = document.toHtml("utf-8");
+
+    // The body style is the default font of the application: the note font of the basket should apply instead
+    int bodyStart = compacted.indexOf("<body");
+    int bodyEnd   = compacted.indexOf('>', bodyStart);
+    if (bodyStart >= 0 && bodyEnd >= 0)
+        compacted.replace(bodyStart, bodyEnd + 1 - bodyStart, "<body>");
+    // The block properties that QTextDocument writes for every paragraph, while they are the defaults it reads:
+    compacted.remove(" margin-left:0px; margin-right:0px;");
+    compacted.remove(" -qt-block-indent:0; text-indent:0px;");
+    return (compacted.length() < html.length() ? compacted : html);
+}
+
 QString Tools::tagCrossReferences(const QString &text, bool userLink, HTMLExporter *exporter)
 {
-    QString richText(text);
+    QString richText;
+    richText.reserve(text.length());
 
+    int copiedPos = 0;
     int urlPos = 0;
     int urlLen;
 
     QRegExp urlEx("\\[\\[(.+)\\]\\]");
     urlEx.setMinimal(true);
-    while ((urlPos = urlEx.indexIn(richText, urlPos)) >= 0) {
+    while ((urlPos = urlEx.indexIn(text, urlPos)) >= 0) {
         urlLen = urlEx.matchedLength();
         QString href = urlEx.cap(1);
 
@@ -189,9 +254,12 @@ QString Tools::tagCrossReferences(const QString &text, bool userLink, HTMLExport
             anchor = crossReferenceForBasket(hrefParts);
 
 
-        richText.replace(urlPos, urlLen, anchor);
-        urlPos += anchor.length();
+        richText += text.midRef(copiedPos, urlPos - copiedPos);
+        richText += anchor;
+        urlPos += urlLen;
+        copiedPos = urlPos;
     }
+    richText += text.midRef(copiedPos);
     return richText;
 }
 
@@ -306,90 +374,123 @@ QString Tools::crossReferenceForConversion(QStringList linkParts)
 
 QString Tools::htmlToText(const QString &html)
 {
-    QString text = htmlToParagraph(html);
-    text.remove("\n");
-    text.replace("</h1>", "\n");
-    text.replace("</h2>", "\n");
-    text.replace("</h3>", "\n");
-    text.replace("</h4>", "\n");
-    text.replace("</h5>", "\n");
-    text.replace("</h6>", "\n");
-    text.replace("</li>", "\n");
-    text.replace("</dt>", "\n");
-    text.replace("</dd>", "\n");
-    text.replace("<dd>",  "   ");
-    text.replace("</div>", "\n");
-    text.replace("</blockquote>", "\n");
-    text.replace("</caption>", "\n");
-    text.replace("</tr>", "\n");
-    text.replace("</th>", "  ");
-    text.replace("</td>", "  ");
-    text.replace("<br>",  "\n");
-    text.replace("<br />", "\n");
+    // Block tags are first replaced by line breaks or spaces, then the other tags are removed (lists being rendered with bullets)
+    // and the entities are decoded. Each step is one pass writing in a preallocated string, so the conversion stays linear.
+    // It gives the same result as the previous implementation, that called QString::replace() and removed every tag in place.
+    static const struct {
+        const char *tag;
+        const char *replacement;
+    } blockTags[] = {
+        { "</h1>", "\n" }, { "</h2>", "\n" }, { "</h3>", "\n" }, { "</h4>", "\n" }, { "</h5>", "\n" }, { "</h6>", "\n" },
+        { "</li>", "\n" }, { "</dt>", "\n" }, { "</dd>", "\n" }, { "<dd>", "   " },
+        { "</div>", "\n" }, { "</blockquote>", "\n" }, { "</caption>", "\n" }, { "</tr>", "\n" },
+        { "</th>", "  " }, { "</td>", "  " }, { "<br>", "\n" }, { "<br />", "\n" }
+    };
+    static const int blockTagsCount = sizeof(blockTags) / sizeof(blockTags[0]);
     // FIXME: Format <table> tags better, if possible
     // TODO: Replace &eacute; and co. by theire equivalent!
 
-    // To manage tags:
-    int pos = 0;
-    int pos2;
-    QString tag, tag3;
+    QString source = htmlToParagraph(html);
+    source.remove('\n');
+    int length = source.length();
+
+    QString text;
+    text.reserve(length);
+    for (int i = 0; i < length; ) {
+        if (source.at(i) == '<') {
+            int tag = 0;
+            while (tag < blockTagsCount && source.midRef(i, qstrlen(blockTags[tag].tag)) != QLatin1String(blockTags[tag].tag))
+                ++tag;
+            if (tag < blockTagsCount) {
+                text += QLatin1String(blockTags[tag].replacement);
+                i += qstrlen(blockTags[tag].tag);
+                continue;
+            }
+        }
+        text += source.at(i);
+        ++i;
+    }
+
     // To manage lists:
     int deep = 0;            // The deep of the current line in imbriqued lists
     QList<bool> ul;    // true if current list is a <ul> one, false if it's an <ol> one
     QList<int>  lines; // The line number if it is an <ol> list
     // We're removing every other tags, or replace them in the case of li:
-    while ((pos = text.indexOf("<"), pos) != -1) {
+    length = text.length();
+    QString stripped;
+    stripped.reserve(length);
+    for (int pos = 0; pos < length; ) {
+        if (text.at(pos) != '<') {
+            stripped += text.at(pos);
+            ++pos;
+            continue;
+        }
+        // Where the tag closes? An unclosed tag is kept as text:
+        int pos2 = text.indexOf('>', pos + 1);
+        if (pos2 == -1) {
+            stripped += text.midRef(pos);
+            break;
+        }
         // What is the current tag?
-        tag  = text.mid(pos + 1, 2);
-        tag3 = text.mid(pos + 1, 3);
+        QStringRef tag  = text.midRef(pos + 1, 2);
+        QStringRef tag3 = text.midRef(pos + 1, 3);
         // Lists work:
-        if (tag == "ul") {
+        if (tag == QLatin1String("ul")) {
             deep++;
             ul.push_back(true);
             lines.push_back(-1);
-        } else if (tag == "ol") {
+        } else if (tag == QLatin1String("ol")) {
             deep++;
             ul.push_back(false);
             lines.push_back(0);
-        } else if (tag3 == "/ul" || tag3 == "/ol") {
+        } else if ((tag3 == QLatin1String("/ul") || tag3 == QLatin1String("/ol")) && deep > 0) {
             deep--;
             ul.pop_back();
             lines.pop_back();
         }
-        // Where the tag closes?
-        pos2 = text.indexOf(">");
-        if (pos2 != -1) {
-            // Remove the tag:
-            text.remove(pos, pos2 - pos + 1);
-            // And replace li with "* ", "x. "... without forbidding to indent that:
-            if (tag == "li") {
-                // How many spaces before the line (indentation):
-                QString spaces = "";
-                for (int i = 1; i < deep; i++)
-                    spaces += "  ";
-                // The bullet or number of the line:
-                QString bullet = "* ";
-                if (ul.back() == false) {
-                    lines.push_back(lines.back() + 1);
-                    lines.pop_back();
-                    bullet = QString::number(lines.back()) + ". ";
-                }
-                // Insertion:
-                text.insert(pos, spaces + bullet);
-            }
-            if ((tag3 == "/ul" || tag3 == "/ol") && deep == 0)
-                text.insert(pos, "\n"); // Empty line before and after a set of lists
+        // Replace li with "* ", "x. "... without forbidding to indent that:
+        if (tag == QLatin1String("li")) {
+            // How many spaces before the line (indentation):
+            for (int i = 1; i < deep; i++)
+                stripped += "  ";
+            // The bullet or number of the line:
+            if (!ul.isEmpty() && ul.back() == false)
+                stripped += QString::number(lines.back()) + ". ";
+            else
+                stripped += "* ";
         }
-        ++pos;
+        if ((tag3 == QLatin1String("/ul") || tag3 == QLatin1String("/ol")) && deep == 0)
+            stripped += '\n'; // Empty line before and after a set of lists
+        // Skip the tag:
+        pos = pos2 + 1;
     }
 
-    text.replace("&gt;",   ">");
-    text.replace("&lt;",   "<");
-    text.replace("&quot;", "\"");
-    text.replace("&nbsp;", " ");
-    text.replace("&amp;",  "&"); // CONVERT IN LAST!!
+    // Decode the entities (once: "&amp;gt;" gives "&gt;"):
+    static const struct {
+        const char *entity;
+        char        character;
+    } entities[] = { { "&gt;", '>' }, { "&lt;", '<' }, { "&quot;", '"' }, { "&nbsp;", ' ' }, { "&amp;", '&' } };
+    static const int entitiesCount = sizeof(entities) / sizeof(entities[0]);
+
+    length = stripped.length();
+    QString result;
+    result.reserve(length);
+    for (int i = 0; i < length; ) {
+        if (stripped.at(i) == '&') {
+            int entity = 0;
+            while (entity < entitiesCount && stripped.midRef(i, qstrlen(entities[entity].entity)) != QLatin1String(entities[entity].entity))
+                ++entity;
+            if (entity < entitiesCount) {
+                result += QLatin1Char(entities[entity].character);
+                i += qstrlen(entities[entity].entity);
+                continue;
+            }
+        }
+        result += stripped.at(i);
+        ++i;
+    }
 
-    return text;
+    return result;
 }
 
 QString Tools::cssFontDefinition(const QFont &font, bool onlyFontFamily)
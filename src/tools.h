@@ -23,6 +23,8 @@
 
 #include <QtCore/QVector>
 
+#include "basket_export.h"
+
 class QColor;
 class QFont;
 class QMimeData;
@@ -53,9 +55,20 @@ namespace Tools
 // Text <-> HTML Conversions and Tools:
 QString textToHTML(const QString &text);
 QString textToHTMLWithoutP(const QString &text);
-QString htmlToParagraph(const QString &html);
-QString htmlToText(const QString &html);
-QString tagURLs(const QString &test);
+BASKET_EXPORT QString htmlToParagraph(const QString &html);
+BASKET_EXPORT QString htmlToText(const QString &html);
+BASKET_EXPORT QString tagURLs(const QString &test);
+/** @Return @p text with every non-ASCII character replaced by its numeric character reference (eg. "&#233;"), in one pass.
+  */
+BASKET_EXPORT QString escapeNonAscii(const QString &text);
+/** @Return @p text as a JSON string, between double quotes and with the quotes, backslashes and control characters escaped.
+  */
+BASKET_EXPORT QString jsonString(const QString &text);
+/** @Return @p html as the rich text notes (QTextDocument) understand it: without the attributes and styles they do not display,
+  * with the adjacent spans of the same format merged and the empty elements dropped. @p html is returned if it would not be smaller.
+  * The default font and paragraph properties are not written, so the note font of the basket still applies.
+  */
+BASKET_EXPORT QString compactHtml(const QString &html);
 QString cssFontDefinition(const QFont &font, bool onlyFontFamily = false);
 
 //Cross Reference tools: